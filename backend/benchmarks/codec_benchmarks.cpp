@@ -0,0 +1,195 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <openssl/bio.h>
+#include <openssl/evp.h>
+
+#include "../common/codec.h"
+
+// Each codec routine against the byte-at-a-time code it replaced, copied here verbatim so the
+// comparison survives the originals being deleted.
+namespace {
+
+namespace legacy {
+
+void AppendEscapedJson(std::string &out, std::string_view value) {
+  for (const char ch : value) {
+    switch (ch) {
+      case '"':
+        out += "\\\"";
+        break;
+      case '\\':
+        out += "\\\\";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      case '\r':
+        out += "\\r";
+        break;
+      case '\t':
+        out += "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(ch) < 0x20) {
+          char buffer[7];
+          std::snprintf(buffer, sizeof(buffer), "\\u%04x", ch);
+          out += buffer;
+        } else {
+          out += ch;
+        }
+        break;
+    }
+  }
+}
+
+std::string HexEncode(const unsigned char *data, std::size_t len) {
+  static const char *kHex = "0123456789abcdef";
+  std::string output;
+  output.reserve(len * 2);
+  for (std::size_t i = 0; i < len; ++i) {
+    const unsigned char value = data[i];
+    output.push_back(kHex[value >> 4]);
+    output.push_back(kHex[value & 0x0F]);
+  }
+  return output;
+}
+
+std::vector<unsigned char> HexDecode(const std::string &hex) {
+  std::vector<unsigned char> output;
+  output.reserve(hex.size() / 2);
+  for (std::size_t i = 0; i < hex.size(); i += 2) {
+    auto decode = [](char ch) -> int {
+      if (ch >= '0' && ch <= '9') {
+        return ch - '0';
+      }
+      if (ch >= 'a' && ch <= 'f') {
+        return 10 + (ch - 'a');
+      }
+      if (ch >= 'A' && ch <= 'F') {
+        return 10 + (ch - 'A');
+      }
+      return -1;
+    };
+    output.push_back(static_cast<unsigned char>((decode(hex[i]) << 4) | decode(hex[i + 1])));
+  }
+  return output;
+}
+
+std::vector<unsigned char> Base64Decode(const std::string &value) {
+  BIO *b64 = BIO_new(BIO_f_base64());
+  BIO_set_flags(b64, BIO_FLAGS_BASE64_NO_NL);
+  BIO *source = BIO_new_mem_buf(value.data(), static_cast<int>(value.size()));
+  BIO *bio = BIO_push(b64, source);
+  std::vector<unsigned char> buffer(value.size());
+  const int decoded = BIO_read(bio, buffer.data(), static_cast<int>(buffer.size()));
+  BIO_free_all(bio);
+  buffer.resize(static_cast<std::size_t>(decoded < 0 ? 0 : decoded));
+  return buffer;
+}
+
+}  // namespace legacy
+
+// A log message with the occasional quote and newline, like a wrapped database error.
+std::string LogMessage() {
+  std::string value;
+  for (int i = 0; i < 16; ++i) {
+    value += "ERROR:  duplicate key value violates unique constraint \"accounts_email_key\"\n";
+  }
+  return value;
+}
+
+// A legacy JSON upload; the largest in practice are a few MiB, 256 KiB keeps runs short.
+std::string Base64Payload() {
+  std::string bytes(192 * 1024, '\0');
+  for (std::size_t i = 0; i < bytes.size(); ++i) {
+    bytes[i] = static_cast<char>(i * 131 + (i >> 7));
+  }
+  return codec::Base64Encode(bytes);
+}
+
+void BM_EscapeJsonBytewise(benchmark::State &state) {
+  const std::string value = LogMessage();
+  for (auto _ : state) {
+    std::string out;
+    legacy::AppendEscapedJson(out, value);
+    benchmark::DoNotOptimize(out);
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * value.size()));
+}
+BENCHMARK(BM_EscapeJsonBytewise);
+
+void BM_EscapeJsonCodec(benchmark::State &state) {
+  const std::string value = LogMessage();
+  for (auto _ : state) {
+    std::string out;
+    codec::AppendEscapedJson(out, value);
+    benchmark::DoNotOptimize(out);
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * value.size()));
+}
+BENCHMARK(BM_EscapeJsonCodec);
+
+// 32-byte digests, as in password hashes and SigV4 signatures, and a 4 KiB buffer.
+void BM_HexEncodeBytewise(benchmark::State &state) {
+  const std::vector<unsigned char> data(static_cast<std::size_t>(state.range(0)), 0xa7);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(legacy::HexEncode(data.data(), data.size()));
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * data.size()));
+}
+BENCHMARK(BM_HexEncodeBytewise)->Arg(32)->Arg(4096);
+
+void BM_HexEncodeCodec(benchmark::State &state) {
+  const std::vector<unsigned char> data(static_cast<std::size_t>(state.range(0)), 0xa7);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(codec::HexEncode(data.data(), data.size()));
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * data.size()));
+}
+BENCHMARK(BM_HexEncodeCodec)->Arg(32)->Arg(4096);
+
+void BM_HexDecodeBytewise(benchmark::State &state) {
+  const std::string hex(static_cast<std::size_t>(state.range(0)) * 2, 'c');
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(legacy::HexDecode(hex));
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * hex.size()));
+}
+BENCHMARK(BM_HexDecodeBytewise)->Arg(32)->Arg(4096);
+
+void BM_HexDecodeCodec(benchmark::State &state) {
+  const std::string hex(static_cast<std::size_t>(state.range(0)) * 2, 'c');
+  for (auto _ : state) {
+    std::vector<unsigned char> out;
+    benchmark::DoNotOptimize(codec::HexDecode(hex, out));
+    benchmark::DoNotOptimize(out);
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * hex.size()));
+}
+BENCHMARK(BM_HexDecodeCodec)->Arg(32)->Arg(4096);
+
+void BM_Base64DecodeBio(benchmark::State &state) {
+  const std::string encoded = Base64Payload();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(legacy::Base64Decode(encoded));
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * encoded.size()));
+}
+BENCHMARK(BM_Base64DecodeBio);
+
+void BM_Base64DecodeCodec(benchmark::State &state) {
+  const std::string encoded = Base64Payload();
+  for (auto _ : state) {
+    std::vector<unsigned char> out;
+    benchmark::DoNotOptimize(codec::Base64Decode(encoded, out));
+    benchmark::DoNotOptimize(out);
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * encoded.size()));
+}
+BENCHMARK(BM_Base64DecodeCodec);
+
+}  // namespace
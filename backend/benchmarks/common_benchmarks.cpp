@@ -0,0 +1,96 @@
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../common/json_writer.h"
+#include "../common/logger.h"
+#include "../common/security.h"
+
+namespace {
+
+void BM_BuildLogEntry(benchmark::State &state) {
+  const std::string message = "GET /jobs/4f1c2a9e-6b1d-4c55-9f0e-2d7c1b3a8e61/documents -> 200";
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        logging::detail::BuildLogEntry("2024-01-31T12:34:56.789Z", "jobs", "http", message, "req-8c1f4e2b"));
+  }
+}
+BENCHMARK(BM_BuildLogEntry);
+
+void BM_EscapeJson(benchmark::State &state) {
+  // Mostly clean text with the occasional quote and newline, like exception messages.
+  std::string value;
+  for (int i = 0; i < 16; ++i) {
+    value += "ERROR:  duplicate key value violates unique constraint \"accounts_email_key\"\n";
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(logging::detail::EscapeJson(value));
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * value.size()));
+}
+BENCHMARK(BM_EscapeJson);
+
+void BM_RecordRequest(benchmark::State &state) {
+  auto &registry = security::MetricsRegistry::Instance();
+  for (auto _ : state) {
+    registry.RecordRequest("jobs", "/jobs/4f1c2a9e-6b1d-4c55-9f0e-2d7c1b3a8e61/messages", "GET", 200,
+                           std::chrono::microseconds(850));
+  }
+}
+BENCHMARK(BM_RecordRequest)->Threads(1)->Threads(8);
+
+struct ProfileRow {
+  std::string id = "4f1c2a9e-6b1d-4c55-9f0e-2d7c1b3a8e61";
+  std::string email = "conveyancer@example.com.au";
+  std::string full_name = "Alex Example";
+  std::string suburb = "Parramatta";
+  std::vector<std::string> services = {"residential", "off-the-plan", "strata"};
+  std::string biography = "Licensed conveyancer with fifteen years of residential settlements in NSW.";
+};
+
+// The writer against the tree-then-dump path it replaced, for a 100-row /profiles page.
+void BM_ProfilesPageJsonWriter(benchmark::State &state) {
+  const std::vector<ProfileRow> rows(100);
+  for (auto _ : state) {
+    std::string body;
+    json_writer::Writer out(body);
+    out.Reserve(16 + rows.size() * 512);
+    out.BeginObject().Key("profiles").BeginArray();
+    for (const auto &row : rows) {
+      out.BeginObject()
+          .Field("id", row.id)
+          .Field("email", row.email)
+          .Field("fullName", row.full_name)
+          .Field("suburb", row.suburb)
+          .Field("verified", true)
+          .Field("services", row.services)
+          .Field("biography", row.biography)
+          .EndObject();
+    }
+    out.EndArray().EndObject();
+    benchmark::DoNotOptimize(body);
+  }
+}
+BENCHMARK(BM_ProfilesPageJsonWriter);
+
+void BM_ProfilesPageNlohmann(benchmark::State &state) {
+  const std::vector<ProfileRow> rows(100);
+  for (auto _ : state) {
+    nlohmann::json profiles = nlohmann::json::array();
+    for (const auto &row : rows) {
+      profiles.push_back({{"id", row.id},
+                          {"email", row.email},
+                          {"fullName", row.full_name},
+                          {"suburb", row.suburb},
+                          {"verified", true},
+                          {"services", row.services},
+                          {"biography", row.biography}});
+    }
+    benchmark::DoNotOptimize(nlohmann::json{{"profiles", profiles}}.dump());
+  }
+}
+BENCHMARK(BM_ProfilesPageNlohmann);
+
+}  // namespace
@@ -0,0 +1,38 @@
+#include <benchmark/benchmark.h>
+
+#include <string>
+#include <vector>
+
+#include "../gateway/src/http_utils.h"
+#include "../gateway/src/rate_limiter.h"
+
+namespace {
+
+void BM_ForwardQueryString(benchmark::State &state) {
+  const httplib::Params params = {{"state", "NSW"},
+                                  {"q", "off the plan & strata"},
+                                  {"limit", "25"},
+                                  {"services", "residential"},
+                                  {"services", "commercial"}};
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(gateway::http_utils::ForwardQueryString(params));
+  }
+}
+BENCHMARK(BM_ForwardQueryString);
+
+// Admission check per request across many client addresses, from several threads at once.
+void BM_RateLimiterCheck(benchmark::State &state) {
+  static gateway::RateLimiter limiter("ip", {1000000, 1000000});
+  std::vector<std::string> keys;
+  for (int i = 0; i < 1024; ++i) {
+    keys.push_back("10." + std::to_string(state.thread_index()) + "." + std::to_string(i / 256) + "." +
+                   std::to_string(i % 256));
+  }
+  std::size_t next = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(limiter.Check(keys[next++ & 1023]));
+  }
+}
+BENCHMARK(BM_RateLimiterCheck)->Threads(1)->Threads(8);
+
+}  // namespace
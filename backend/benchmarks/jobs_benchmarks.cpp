@@ -0,0 +1,64 @@
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "../services/jobs/object_signing.h"
+
+namespace {
+
+// Document-sized input; 256 KiB keeps runs short.
+constexpr std::size_t kPayloadBytes = 256 * 1024;
+
+void BM_Sha256Hex(benchmark::State &state) {
+  const std::vector<unsigned char> data(kPayloadBytes, 0x5a);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(jobs::Sha256Hex(data));
+  }
+  state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * data.size()));
+}
+BENCHMARK(BM_Sha256Hex);
+
+void BM_GeneratePresignedPut(benchmark::State &state) {
+  const jobs::SigV4Presigner presigner("minio:9000", "documents", "minioadmin", "minioadmin", "ap-southeast-2");
+  const auto now = std::chrono::system_clock::now();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(presigner.Target(
+        "PUT", "jobs/4f1c2a9e-6b1d-4c55-9f0e-2d7c1b3a8e61/contract of sale.pdf", std::chrono::minutes(15), now));
+  }
+}
+BENCHMARK(BM_GeneratePresignedPut);
+
+// Download links for a 50-document page: one batch call against 50 single presigns.
+void BM_PresignDownloadLinksBatch(benchmark::State &state) {
+  const jobs::SigV4Presigner presigner("minio:9000", "documents", "minioadmin", "minioadmin", "ap-southeast-2");
+  std::vector<std::string> keys;
+  for (int i = 0; i < 50; ++i) {
+    keys.push_back("jobs/4f1c2a9e-6b1d-4c55-9f0e-2d7c1b3a8e61/document " + std::to_string(i) + ".pdf");
+  }
+  const auto now = std::chrono::system_clock::now();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(presigner.Targets("GET", keys, std::chrono::minutes(15), now));
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * keys.size()));
+}
+BENCHMARK(BM_PresignDownloadLinksBatch);
+
+void BM_PresignDownloadLinksSingle(benchmark::State &state) {
+  const jobs::SigV4Presigner presigner("minio:9000", "documents", "minioadmin", "minioadmin", "ap-southeast-2");
+  std::vector<std::string> keys;
+  for (int i = 0; i < 50; ++i) {
+    keys.push_back("jobs/4f1c2a9e-6b1d-4c55-9f0e-2d7c1b3a8e61/document " + std::to_string(i) + ".pdf");
+  }
+  const auto now = std::chrono::system_clock::now();
+  for (auto _ : state) {
+    for (const auto &key : keys) {
+      benchmark::DoNotOptimize(presigner.Target("GET", key, std::chrono::minutes(15), now));
+    }
+  }
+  state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * keys.size()));
+}
+BENCHMARK(BM_PresignDownloadLinksSingle);
+
+}  // namespace
@@ -0,0 +1,280 @@
+// Replays a weighted mix of read requests against running services and reports throughput and
+// latency percentiles per endpoint. Endpoints whose service URL or required id is missing are
+// left out of the mix.
+//
+//   load_driver --duration=30 --concurrency=32
+//       --gateway=http://127.0.0.1:8080 --identity=http://127.0.0.1:8081
+//       --jobs=http://127.0.0.1:8082 --payments=http://127.0.0.1:8083
+//       --job-id=<uuid> --account-id=<uuid> --json=load.json --max-p99-ms=250
+//
+// Exits non-zero when --max-error-rate or --max-p99-ms is exceeded, so it can gate a deploy.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../third_party/httplib.h"
+#include "../third_party/json.hpp"
+
+namespace {
+
+struct Options {
+  std::map<std::string, std::string> targets;
+  std::string job_id;
+  std::string account_id;
+  std::string api_key;
+  std::string role = "admin";
+  int concurrency = 16;
+  int duration_seconds = 30;
+  int warmup_seconds = 2;
+  std::string json_path;
+  double max_error_rate = 0.01;
+  double max_p99_ms = 0;
+};
+
+struct Endpoint {
+  std::string name;
+  std::string service;
+  std::string path;
+  int weight = 1;
+};
+
+struct Sample {
+  std::vector<double> latencies_ms;
+  std::uint64_t errors = 0;
+  std::uint64_t transport_errors = 0;
+};
+
+bool ParseFlag(const std::string &arg, const std::string &name, std::string *value) {
+  const std::string prefix = "--" + name + "=";
+  if (arg.rfind(prefix, 0) != 0) {
+    return false;
+  }
+  *value = arg.substr(prefix.size());
+  return true;
+}
+
+Options ParseOptions(int argc, char **argv) {
+  Options options;
+  if (const char *key = std::getenv("SERVICE_API_KEY"); key && *key) {
+    options.api_key = key;
+  } else {
+    options.api_key = "local-dev-api-key";
+  }
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    std::string value;
+    bool matched = false;
+    for (const char *service : {"gateway", "identity", "jobs", "payments"}) {
+      if (ParseFlag(arg, service, &value)) {
+        options.targets[service] = value;
+        matched = true;
+      }
+    }
+    if (matched) {
+      continue;
+    }
+    if (ParseFlag(arg, "job-id", &value)) {
+      options.job_id = value;
+    } else if (ParseFlag(arg, "account-id", &value)) {
+      options.account_id = value;
+    } else if (ParseFlag(arg, "api-key", &value)) {
+      options.api_key = value;
+    } else if (ParseFlag(arg, "role", &value)) {
+      options.role = value;
+    } else if (ParseFlag(arg, "concurrency", &value)) {
+      options.concurrency = std::max(1, std::atoi(value.c_str()));
+    } else if (ParseFlag(arg, "duration", &value)) {
+      options.duration_seconds = std::max(1, std::atoi(value.c_str()));
+    } else if (ParseFlag(arg, "warmup", &value)) {
+      options.warmup_seconds = std::max(0, std::atoi(value.c_str()));
+    } else if (ParseFlag(arg, "json", &value)) {
+      options.json_path = value;
+    } else if (ParseFlag(arg, "max-error-rate", &value)) {
+      options.max_error_rate = std::atof(value.c_str());
+    } else if (ParseFlag(arg, "max-p99-ms", &value)) {
+      options.max_p99_ms = std::atof(value.c_str());
+    } else {
+      std::cerr << "unknown argument: " << arg << '\n';
+      std::exit(2);
+    }
+  }
+  return options;
+}
+
+// Roughly the read traffic the web app generates: search and job pages dominate, chat and
+// escrow polling make up the tail.
+std::vector<Endpoint> BuildMix(const Options &options) {
+  const std::string &job = options.job_id;
+  const std::string &account = options.account_id;
+  std::vector<Endpoint> candidates = {
+      {"gateway_profile_search", "gateway", "/api/profiles/search?state=NSW&limit=25", 25},
+      {"gateway_job_page", "gateway", job.empty() ? "" : "/api/jobs/" + job, 20},
+      {"identity_profiles", "identity", "/profiles?state=NSW&limit=25", 15},
+      {"identity_profile", "identity", account.empty() ? "" : "/profiles/" + account, 5},
+      {"jobs_list", "jobs", account.empty() ? "" : "/jobs?accountId=" + account + "&limit=25", 10},
+      {"jobs_detail", "jobs", job.empty() ? "" : "/jobs/" + job + "/detail", 10},
+      {"jobs_templates", "jobs", "/jobs/templates", 5},
+      {"jobs_messages", "jobs", job.empty() ? "" : "/jobs/" + job + "/messages?limit=50", 5},
+      {"payments_escrow", "payments", job.empty() ? "" : "/jobs/" + job + "/escrow", 5},
+  };
+  std::vector<Endpoint> mix;
+  for (auto &endpoint : candidates) {
+    if (!endpoint.path.empty() && options.targets.count(endpoint.service) > 0) {
+      mix.push_back(std::move(endpoint));
+    }
+  }
+  return mix;
+}
+
+double Percentile(const std::vector<double> &sorted, double fraction) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  const auto index = static_cast<std::size_t>(fraction * static_cast<double>(sorted.size() - 1) + 0.5);
+  return sorted[std::min(index, sorted.size() - 1)];
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const Options options = ParseOptions(argc, argv);
+  const auto mix = BuildMix(options);
+  if (mix.empty()) {
+    std::cerr << "no endpoints to drive; pass at least one of --gateway/--identity/--jobs/--payments\n";
+    return 2;
+  }
+
+  std::vector<int> weights;
+  for (const auto &endpoint : mix) {
+    weights.push_back(endpoint.weight);
+  }
+  const httplib::Headers headers = {{"X-API-Key", options.api_key}, {"X-Actor-Role", options.role}};
+
+  const auto start = std::chrono::steady_clock::now();
+  const auto measure_from = start + std::chrono::seconds(options.warmup_seconds);
+  const auto deadline = measure_from + std::chrono::seconds(options.duration_seconds);
+
+  // Each worker keeps its own keep-alive client per service and its own samples; nothing is
+  // shared until the run is over.
+  std::vector<std::vector<Sample>> per_worker(static_cast<std::size_t>(options.concurrency),
+                                              std::vector<Sample>(mix.size()));
+  std::vector<std::thread> workers;
+  for (int worker = 0; worker < options.concurrency; ++worker) {
+    workers.emplace_back([&, worker]() {
+      std::map<std::string, std::unique_ptr<httplib::Client>> clients;
+      for (const auto &[service, url] : options.targets) {
+        auto client = std::make_unique<httplib::Client>(url);
+        client->set_keep_alive(true);
+        client->set_connection_timeout(std::chrono::seconds(2));
+        client->set_read_timeout(std::chrono::seconds(10));
+        clients.emplace(service, std::move(client));
+      }
+      std::mt19937 rng(static_cast<std::mt19937::result_type>(worker + 1));
+      std::discrete_distribution<std::size_t> pick(weights.begin(), weights.end());
+      auto &samples = per_worker[static_cast<std::size_t>(worker)];
+      while (true) {
+        const auto sent = std::chrono::steady_clock::now();
+        if (sent >= deadline) {
+          break;
+        }
+        const std::size_t choice = pick(rng);
+        const auto &endpoint = mix[choice];
+        const auto result = clients.at(endpoint.service)->Get(endpoint.path, headers);
+        const auto finished = std::chrono::steady_clock::now();
+        if (sent < measure_from) {
+          continue;
+        }
+        auto &sample = samples[choice];
+        sample.latencies_ms.push_back(std::chrono::duration<double, std::milli>(finished - sent).count());
+        if (!result) {
+          ++sample.transport_errors;
+        } else if (result->status >= 400) {
+          ++sample.errors;
+        }
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  const double seconds = static_cast<double>(options.duration_seconds);
+  nlohmann::json report = {{"durationSeconds", options.duration_seconds},
+                           {"concurrency", options.concurrency},
+                           {"endpoints", nlohmann::json::array()}};
+  std::vector<double> all_latencies;
+  std::uint64_t total_failures = 0;
+
+  std::cout << std::left << std::setw(26) << "endpoint" << std::right << std::setw(10) << "requests"
+            << std::setw(10) << "rps" << std::setw(9) << "errors" << std::setw(10) << "p50 ms" << std::setw(10)
+            << "p90 ms" << std::setw(10) << "p99 ms" << std::setw(10) << "max ms" << '\n';
+  std::cout << std::fixed << std::setprecision(2);
+  for (std::size_t i = 0; i < mix.size(); ++i) {
+    Sample merged;
+    for (const auto &samples : per_worker) {
+      merged.latencies_ms.insert(merged.latencies_ms.end(), samples[i].latencies_ms.begin(),
+                                 samples[i].latencies_ms.end());
+      merged.errors += samples[i].errors;
+      merged.transport_errors += samples[i].transport_errors;
+    }
+    std::sort(merged.latencies_ms.begin(), merged.latencies_ms.end());
+    all_latencies.insert(all_latencies.end(), merged.latencies_ms.begin(), merged.latencies_ms.end());
+    const std::uint64_t failures = merged.errors + merged.transport_errors;
+    total_failures += failures;
+    const double p50 = Percentile(merged.latencies_ms, 0.50);
+    const double p90 = Percentile(merged.latencies_ms, 0.90);
+    const double p99 = Percentile(merged.latencies_ms, 0.99);
+    const double max = merged.latencies_ms.empty() ? 0 : merged.latencies_ms.back();
+    std::cout << std::left << std::setw(26) << mix[i].name << std::right << std::setw(10)
+              << merged.latencies_ms.size() << std::setw(10) << merged.latencies_ms.size() / seconds
+              << std::setw(9) << failures << std::setw(10) << p50 << std::setw(10) << p90 << std::setw(10) << p99
+              << std::setw(10) << max << '\n';
+    report["endpoints"].push_back({{"name", mix[i].name},
+                                   {"requests", merged.latencies_ms.size()},
+                                   {"httpErrors", merged.errors},
+                                   {"transportErrors", merged.transport_errors},
+                                   {"p50Ms", p50},
+                                   {"p90Ms", p90},
+                                   {"p99Ms", p99},
+                                   {"maxMs", max}});
+  }
+
+  std::sort(all_latencies.begin(), all_latencies.end());
+  const double total_requests = static_cast<double>(all_latencies.size());
+  const double error_rate = total_requests > 0 ? static_cast<double>(total_failures) / total_requests : 1.0;
+  const double p99 = Percentile(all_latencies, 0.99);
+  std::cout << "\ntotal " << all_latencies.size() << " requests, " << total_requests / seconds << " rps, "
+            << "error rate " << error_rate * 100 << "%, p50 " << Percentile(all_latencies, 0.50) << " ms, p99 "
+            << p99 << " ms\n";
+  report["requests"] = all_latencies.size();
+  report["rps"] = total_requests / seconds;
+  report["errorRate"] = error_rate;
+  report["p50Ms"] = Percentile(all_latencies, 0.50);
+  report["p99Ms"] = p99;
+
+  if (!options.json_path.empty()) {
+    std::ofstream(options.json_path) << report.dump(2) << '\n';
+  }
+
+  int status = 0;
+  if (error_rate > options.max_error_rate) {
+    std::cerr << "error rate " << error_rate << " exceeds --max-error-rate=" << options.max_error_rate << '\n';
+    status = 1;
+  }
+  if (options.max_p99_ms > 0 && p99 > options.max_p99_ms) {
+    std::cerr << "p99 " << p99 << " ms exceeds --max-p99-ms=" << options.max_p99_ms << '\n';
+    status = 1;
+  }
+  return status;
+}
@@ -0,0 +1,32 @@
+#include <benchmark/benchmark.h>
+
+#include "../common/persistence/accounts_repository_utils.h"
+
+namespace {
+
+void BM_BuildAccountRecord(benchmark::State &state) {
+  persistence::detail::AccountRowData row;
+  row.id = "4f1c2a9e-6b1d-4c55-9f0e-2d7c1b3a8e61";
+  row.email = "conveyancer@example.com.au";
+  row.role = "conveyancer";
+  row.full_name = "Alex Example";
+  row.state = "NSW";
+  row.suburb = "Parramatta";
+  row.phone = "+61 400 000 000";
+  const std::string password_hash(64, 'a');
+  const std::string password_salt(32, 'b');
+  row.password_hash = password_hash;
+  row.password_salt = password_salt;
+  row.licence_number = "CON-123456";
+  row.licence_state = "NSW";
+  row.biography = "Licensed conveyancer with fifteen years of residential settlements in NSW.";
+  row.specialties_json = R"(["residential","off-the-plan","strata"])";
+  row.services_json = R"(["contract review","settlement","title search"])";
+  row.verified = true;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(persistence::detail::BuildAccountRecord(row));
+  }
+}
+BENCHMARK(BM_BuildAccountRecord);
+
+}  // namespace
@@ -0,0 +1,578 @@
+#ifndef CONVEYANCERS_MARKETPLACE_CODEC_H
+#define CONVEYANCERS_MARKETPLACE_CODEC_H
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define CONVEYANCERS_MARKETPLACE_CODEC_NEON 1
+#endif
+
+// JSON string escaping, hex and base64 shared by the log formatter, the JSON writer, password
+// hashing, SigV4 signing, trace ids and document uploads. Each routine walks its input 16 or
+// 32 bytes at a time with whatever the build targets: SSE2 on every x86-64 build, AVX2 when
+// compiled with -mavx2 (or -march=native), NEON on aarch64. The scalar loops finish the tail and
+// are the whole implementation elsewhere; detail::*Scalar are kept callable so tests and
+// benchmarks can compare the two.
+namespace codec {
+
+enum class Base64Alphabet {
+  // RFC 4648 section 4, '+' and '/'; encoded with '=' padding.
+  kStandard,
+  // RFC 4648 section 5, '-' and '_'; encoded without padding, as in URLs and tokens.
+  kUrl,
+};
+
+namespace detail {
+
+inline constexpr char kHexDigits[] = "0123456789abcdef";
+
+inline bool NeedsEscape(unsigned char ch) { return ch < 0x20 || ch == '"' || ch == '\\'; }
+
+inline std::size_t FindEscapeScalar(const char *data, std::size_t size, std::size_t from = 0) {
+  for (std::size_t i = from; i < size; ++i) {
+    if (NeedsEscape(static_cast<unsigned char>(data[i]))) {
+      return i;
+    }
+  }
+  return size;
+}
+
+// Offset of the first byte a JSON string cannot hold verbatim, or size when there is none.
+inline std::size_t FindEscape(const char *data, std::size_t size) {
+  std::size_t i = 0;
+#if defined(__AVX2__)
+  {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i control = _mm256_set1_epi8(0x1f);
+    for (; i + 32 <= size; i += 32) {
+      const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+      // min(block, 0x1f) == block exactly for the unsigned bytes below 0x20.
+      const __m256i hits =
+          _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, quote), _mm256_cmpeq_epi8(block, backslash)),
+                          _mm256_cmpeq_epi8(_mm256_min_epu8(block, control), block));
+      const auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(hits));
+      if (mask != 0) {
+        return i + static_cast<std::size_t>(std::countr_zero(mask));
+      }
+    }
+  }
+#endif
+#if defined(__SSE2__)
+  {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    for (; i + 16 <= size; i += 16) {
+      const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+      const __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, backslash)),
+                                        _mm_cmpeq_epi8(_mm_min_epu8(block, control), block));
+      const auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(hits));
+      if (mask != 0) {
+        return i + static_cast<std::size_t>(std::countr_zero(mask));
+      }
+    }
+  }
+#elif defined(CONVEYANCERS_MARKETPLACE_CODEC_NEON)
+  {
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+    const uint8x16_t control = vdupq_n_u8(0x20);
+    for (; i + 16 <= size; i += 16) {
+      const uint8x16_t block = vld1q_u8(reinterpret_cast<const std::uint8_t *>(data + i));
+      const uint8x16_t hits =
+          vorrq_u8(vorrq_u8(vceqq_u8(block, quote), vceqq_u8(block, backslash)), vcltq_u8(block, control));
+      if (vmaxvq_u8(hits) != 0) {
+        return FindEscapeScalar(data, i + 16, i);
+      }
+    }
+  }
+#endif
+  return FindEscapeScalar(data, size, i);
+}
+
+inline void AppendEscape(std::string &out, unsigned char ch) {
+  switch (ch) {
+    case '"':
+      out.append("\\\"");
+      break;
+    case '\\':
+      out.append("\\\\");
+      break;
+    case '\b':
+      out.append("\\b");
+      break;
+    case '\f':
+      out.append("\\f");
+      break;
+    case '\n':
+      out.append("\\n");
+      break;
+    case '\r':
+      out.append("\\r");
+      break;
+    case '\t':
+      out.append("\\t");
+      break;
+    default: {
+      const char escape[] = {'\\', 'u', '0', '0', kHexDigits[ch >> 4], kHexDigits[ch & 0x0F]};
+      out.append(escape, sizeof(escape));
+    }
+  }
+}
+
+inline void AppendEscapedJsonScalar(std::string &out, std::string_view value) {
+  std::size_t run = 0;
+  for (std::size_t i = 0; i < value.size(); ++i) {
+    const auto ch = static_cast<unsigned char>(value[i]);
+    if (!NeedsEscape(ch)) {
+      continue;
+    }
+    out.append(value.data() + run, i - run);
+    AppendEscape(out, ch);
+    run = i + 1;
+  }
+  out.append(value.data() + run, value.size() - run);
+}
+
+inline void HexEncodeScalar(char *out, const unsigned char *data, std::size_t size) {
+  for (std::size_t i = 0; i < size; ++i) {
+    out[2 * i] = kHexDigits[data[i] >> 4];
+    out[2 * i + 1] = kHexDigits[data[i] & 0x0F];
+  }
+}
+
+// Writes 2 * size lowercase digits to out.
+inline void HexEncode(char *out, const unsigned char *data, std::size_t size) {
+  std::size_t i = 0;
+#if defined(__AVX2__)
+  {
+    const __m256i low_mask = _mm256_set1_epi8(0x0F);
+    const __m256i nine = _mm256_set1_epi8(9);
+    const __m256i zero = _mm256_set1_epi8('0');
+    const __m256i letter_gap = _mm256_set1_epi8('a' - '0' - 10);
+    const auto digits = [&](__m256i nibbles) {
+      return _mm256_add_epi8(_mm256_add_epi8(nibbles, zero),
+                             _mm256_and_si256(_mm256_cmpgt_epi8(nibbles, nine), letter_gap));
+    };
+    for (; i + 32 <= size; i += 32) {
+      const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+      const __m256i high = digits(_mm256_and_si256(_mm256_srli_epi16(bytes, 4), low_mask));
+      const __m256i low = digits(_mm256_and_si256(bytes, low_mask));
+      // The unpacks interleave within each 128-bit lane; put the lanes back in byte order.
+      const __m256i first = _mm256_unpacklo_epi8(high, low);
+      const __m256i second = _mm256_unpackhi_epi8(high, low);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 2 * i), _mm256_permute2x128_si256(first, second, 0x20));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 2 * i + 32),
+                          _mm256_permute2x128_si256(first, second, 0x31));
+    }
+  }
+#endif
+#if defined(__SSE2__)
+  {
+    const __m128i low_mask = _mm_set1_epi8(0x0F);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i letter_gap = _mm_set1_epi8('a' - '0' - 10);
+    const auto digits = [&](__m128i nibbles) {
+      return _mm_add_epi8(_mm_add_epi8(nibbles, zero), _mm_and_si128(_mm_cmpgt_epi8(nibbles, nine), letter_gap));
+    };
+    for (; i + 16 <= size; i += 16) {
+      const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+      const __m128i high = digits(_mm_and_si128(_mm_srli_epi16(bytes, 4), low_mask));
+      const __m128i low = digits(_mm_and_si128(bytes, low_mask));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i), _mm_unpacklo_epi8(high, low));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 2 * i + 16), _mm_unpackhi_epi8(high, low));
+    }
+  }
+#elif defined(CONVEYANCERS_MARKETPLACE_CODEC_NEON)
+  {
+    const uint8x16_t table = vld1q_u8(reinterpret_cast<const std::uint8_t *>(kHexDigits));
+    const uint8x16_t low_mask = vdupq_n_u8(0x0F);
+    for (; i + 16 <= size; i += 16) {
+      const uint8x16_t bytes = vld1q_u8(data + i);
+      uint8x16x2_t pairs;
+      pairs.val[0] = vqtbl1q_u8(table, vshrq_n_u8(bytes, 4));
+      pairs.val[1] = vqtbl1q_u8(table, vandq_u8(bytes, low_mask));
+      vst2q_u8(reinterpret_cast<std::uint8_t *>(out + 2 * i), pairs);
+    }
+  }
+#endif
+  HexEncodeScalar(out + 2 * i, data + i, size - i);
+}
+
+inline int HexValue(char ch) {
+  if (ch >= '0' && ch <= '9') {
+    return ch - '0';
+  }
+  if (ch >= 'a' && ch <= 'f') {
+    return ch - 'a' + 10;
+  }
+  if (ch >= 'A' && ch <= 'F') {
+    return ch - 'A' + 10;
+  }
+  return -1;
+}
+
+inline bool HexDecodeScalar(unsigned char *out, const char *hex, std::size_t pairs) {
+  for (std::size_t i = 0; i < pairs; ++i) {
+    const int high = HexValue(hex[2 * i]);
+    const int low = HexValue(hex[2 * i + 1]);
+    if (high < 0 || low < 0) {
+      return false;
+    }
+    out[i] = static_cast<unsigned char>((high << 4) | low);
+  }
+  return true;
+}
+
+#if defined(__SSE2__)
+// Nibble values of 16 hex digits in either case; valid is all ones where the digit was one.
+inline __m128i HexNibbles(__m128i chars, __m128i &valid) {
+  const __m128i digit = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+  const __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+  const __m128i letter = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+  const __m128i is_letter = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+  valid = _mm_or_si128(is_digit, is_letter);
+  return _mm_or_si128(_mm_and_si128(is_digit, digit),
+                      _mm_and_si128(is_letter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+}
+
+// Joins each (high, low) nibble pair into a byte, leaving one byte per 16-bit lane.
+inline __m128i JoinNibbles(__m128i nibbles) {
+  return _mm_or_si128(_mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0x00FF)), 4), _mm_srli_epi16(nibbles, 8));
+}
+#endif
+
+// Decodes pairs bytes from 2 * pairs digits; false on the first character that is not a digit.
+inline bool HexDecode(unsigned char *out, const char *hex, std::size_t pairs) {
+  std::size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 16 <= pairs; i += 16) {
+    __m128i valid_first;
+    __m128i valid_second;
+    const __m128i first = HexNibbles(_mm_loadu_si128(reinterpret_cast<const __m128i *>(hex + 2 * i)), valid_first);
+    const __m128i second =
+        HexNibbles(_mm_loadu_si128(reinterpret_cast<const __m128i *>(hex + 2 * i + 16)), valid_second);
+    if (_mm_movemask_epi8(_mm_and_si128(valid_first, valid_second)) != 0xFFFF) {
+      return false;
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_packus_epi16(JoinNibbles(first), JoinNibbles(second)));
+  }
+#elif defined(CONVEYANCERS_MARKETPLACE_CODEC_NEON)
+  const auto nibbles = [](uint8x16_t chars, uint8x16_t &valid) {
+    const uint8x16_t digit = vsubq_u8(chars, vdupq_n_u8('0'));
+    const uint8x16_t is_digit = vcltq_u8(digit, vdupq_n_u8(10));
+    const uint8x16_t letter = vsubq_u8(vorrq_u8(chars, vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+    const uint8x16_t is_letter = vcltq_u8(letter, vdupq_n_u8(6));
+    valid = vandq_u8(valid, vorrq_u8(is_digit, is_letter));
+    return vbslq_u8(is_digit, digit, vaddq_u8(letter, vdupq_n_u8(10)));
+  };
+  for (; i + 16 <= pairs; i += 16) {
+    // vld2 splits the 32 digits into the high (even) and low (odd) nibbles of 16 bytes.
+    const uint8x16x2_t chars = vld2q_u8(reinterpret_cast<const std::uint8_t *>(hex + 2 * i));
+    uint8x16_t valid = vdupq_n_u8(0xFF);
+    const uint8x16_t high = nibbles(chars.val[0], valid);
+    const uint8x16_t low = nibbles(chars.val[1], valid);
+    if (vminvq_u8(valid) != 0xFF) {
+      return false;
+    }
+    vst1q_u8(out + i, vorrq_u8(vshlq_n_u8(high, 4), low));
+  }
+#endif
+  return HexDecodeScalar(out + i, hex + 2 * i, pairs - i);
+}
+
+// 6-bit values per character, -1 for characters outside the alphabet.
+inline constexpr std::array<std::int8_t, 256> Base64Table(char c62, char c63) {
+  std::array<std::int8_t, 256> table{};
+  for (auto &value : table) {
+    value = -1;
+  }
+  for (int i = 0; i < 26; ++i) {
+    table['A' + i] = static_cast<std::int8_t>(i);
+    table['a' + i] = static_cast<std::int8_t>(26 + i);
+  }
+  for (int i = 0; i < 10; ++i) {
+    table['0' + i] = static_cast<std::int8_t>(52 + i);
+  }
+  table[static_cast<unsigned char>(c62)] = 62;
+  table[static_cast<unsigned char>(c63)] = 63;
+  return table;
+}
+
+inline constexpr auto kBase64StandardTable = Base64Table('+', '/');
+inline constexpr auto kBase64UrlTable = Base64Table('-', '_');
+inline constexpr char kBase64Standard[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+inline constexpr char kBase64Url[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+// Decodes whole quanta of four characters into three bytes each, then a final partial quantum
+// of two or three characters. length must not leave a remainder of one.
+inline bool Base64DecodeScalar(unsigned char *out, const char *text, std::size_t length,
+                               const std::array<std::int8_t, 256> &table) {
+  const auto value = [&](std::size_t i) { return table[static_cast<unsigned char>(text[i])]; };
+  std::size_t i = 0;
+  for (; i + 4 <= length; i += 4) {
+    const int a = value(i);
+    const int b = value(i + 1);
+    const int c = value(i + 2);
+    const int d = value(i + 3);
+    if ((a | b | c | d) < 0) {
+      return false;
+    }
+    const std::uint32_t word = (static_cast<std::uint32_t>(a) << 18) | (static_cast<std::uint32_t>(b) << 12) |
+                               (static_cast<std::uint32_t>(c) << 6) | static_cast<std::uint32_t>(d);
+    *out++ = static_cast<unsigned char>(word >> 16);
+    *out++ = static_cast<unsigned char>(word >> 8);
+    *out++ = static_cast<unsigned char>(word);
+  }
+  if (i == length) {
+    return true;
+  }
+  const int a = value(i);
+  const int b = value(i + 1);
+  const int c = length - i == 3 ? value(i + 2) : 0;
+  if ((a | b | c) < 0) {
+    return false;
+  }
+  *out++ = static_cast<unsigned char>((a << 2) | (b >> 4));
+  if (length - i == 3) {
+    *out = static_cast<unsigned char>((b << 4) | (c >> 2));
+  }
+  return true;
+}
+
+#if defined(__SSE2__)
+// 6-bit values of 16 characters; valid is all ones where the character is in the alphabet.
+inline __m128i Base64Values(__m128i chars, char c62, char c63, __m128i &valid) {
+  const auto in_range = [&chars](char first, char count, __m128i &offset) {
+    offset = _mm_sub_epi8(chars, _mm_set1_epi8(first));
+    return _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(static_cast<char>(count - 1))), offset);
+  };
+  __m128i upper;
+  __m128i lower;
+  __m128i digit;
+  const __m128i is_upper = in_range('A', 26, upper);
+  const __m128i is_lower = in_range('a', 26, lower);
+  const __m128i is_digit = in_range('0', 10, digit);
+  const __m128i is_62 = _mm_cmpeq_epi8(chars, _mm_set1_epi8(c62));
+  const __m128i is_63 = _mm_cmpeq_epi8(chars, _mm_set1_epi8(c63));
+  valid = _mm_or_si128(_mm_or_si128(_mm_or_si128(is_upper, is_lower), _mm_or_si128(is_digit, is_62)), is_63);
+  return _mm_or_si128(
+      _mm_or_si128(_mm_and_si128(is_upper, upper), _mm_and_si128(is_lower, _mm_add_epi8(lower, _mm_set1_epi8(26)))),
+      _mm_or_si128(_mm_and_si128(is_digit, _mm_add_epi8(digit, _mm_set1_epi8(52))),
+                   _mm_or_si128(_mm_and_si128(is_62, _mm_set1_epi8(62)), _mm_and_si128(is_63, _mm_set1_epi8(63)))));
+}
+#endif
+
+// Decodes the leading whole 16 (x86) or 64 (aarch64) character blocks of text and returns how
+// many characters it consumed; 0 with ok cleared when one of them is outside the alphabet.
+inline std::size_t Base64DecodeBlocks(unsigned char *out, const char *text, std::size_t length, char c62, char c63,
+                                      bool &ok) {
+  ok = true;
+  std::size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 16 <= length; i += 16) {
+    __m128i valid;
+    const __m128i values =
+        Base64Values(_mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i)), c62, c63, valid);
+    if (_mm_movemask_epi8(valid) != 0xFFFF) {
+      ok = false;
+      return 0;
+    }
+    // Merge character pairs into 12 bits per 16-bit lane, then lane pairs into 24 bits per
+    // 32-bit lane: a << 18 | b << 12 | c << 6 | d.
+    const __m128i pairs = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(values, _mm_set1_epi16(0x00FF)), 6),
+                                       _mm_srli_epi16(values, 8));
+    const __m128i words = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+    unsigned char *target = out + i / 4 * 3;
+#if defined(__SSSE3__)
+    if (i + 16 + 4 <= length) {
+      // The store writes 16 bytes for 12 of output; the next block overwrites the spare 4.
+      const __m128i order = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(target), _mm_shuffle_epi8(words, order));
+      continue;
+    }
+#endif
+    alignas(16) std::uint32_t lanes[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), words);
+    for (const auto word : lanes) {
+      *target++ = static_cast<unsigned char>(word >> 16);
+      *target++ = static_cast<unsigned char>(word >> 8);
+      *target++ = static_cast<unsigned char>(word);
+    }
+  }
+#elif defined(CONVEYANCERS_MARKETPLACE_CODEC_NEON)
+  const auto values = [c62, c63](uint8x16_t chars, uint8x16_t &valid) {
+    const uint8x16_t upper = vsubq_u8(chars, vdupq_n_u8('A'));
+    const uint8x16_t lower = vsubq_u8(chars, vdupq_n_u8('a'));
+    const uint8x16_t digit = vsubq_u8(chars, vdupq_n_u8('0'));
+    const uint8x16_t is_upper = vcltq_u8(upper, vdupq_n_u8(26));
+    const uint8x16_t is_lower = vcltq_u8(lower, vdupq_n_u8(26));
+    const uint8x16_t is_digit = vcltq_u8(digit, vdupq_n_u8(10));
+    const uint8x16_t is_62 = vceqq_u8(chars, vdupq_n_u8(static_cast<std::uint8_t>(c62)));
+    const uint8x16_t is_63 = vceqq_u8(chars, vdupq_n_u8(static_cast<std::uint8_t>(c63)));
+    valid = vandq_u8(valid, vorrq_u8(vorrq_u8(vorrq_u8(is_upper, is_lower), vorrq_u8(is_digit, is_62)), is_63));
+    return vorrq_u8(vorrq_u8(vandq_u8(is_upper, upper), vandq_u8(is_lower, vaddq_u8(lower, vdupq_n_u8(26)))),
+                    vorrq_u8(vandq_u8(is_digit, vaddq_u8(digit, vdupq_n_u8(52))),
+                             vorrq_u8(vandq_u8(is_62, vdupq_n_u8(62)), vandq_u8(is_63, vdupq_n_u8(63)))));
+  };
+  for (; i + 64 <= length; i += 64) {
+    // vld4 hands over the first, second, third and fourth characters of 16 quanta.
+    const uint8x16x4_t chars = vld4q_u8(reinterpret_cast<const std::uint8_t *>(text + i));
+    uint8x16_t valid = vdupq_n_u8(0xFF);
+    const uint8x16_t a = values(chars.val[0], valid);
+    const uint8x16_t b = values(chars.val[1], valid);
+    const uint8x16_t c = values(chars.val[2], valid);
+    const uint8x16_t d = values(chars.val[3], valid);
+    if (vminvq_u8(valid) != 0xFF) {
+      ok = false;
+      return 0;
+    }
+    uint8x16x3_t bytes;
+    bytes.val[0] = vorrq_u8(vshlq_n_u8(a, 2), vshrq_n_u8(b, 4));
+    bytes.val[1] = vorrq_u8(vshlq_n_u8(b, 4), vshrq_n_u8(c, 2));
+    bytes.val[2] = vorrq_u8(vshlq_n_u8(c, 6), d);
+    vst3q_u8(out + i / 4 * 3, bytes);
+  }
+#else
+  (void)out;
+  (void)text;
+  (void)length;
+  (void)c62;
+  (void)c63;
+#endif
+  return i;
+}
+
+template <typename Bytes>
+unsigned char *ByteData(Bytes &bytes) {
+  return reinterpret_cast<unsigned char *>(bytes.data());
+}
+
+}  // namespace detail
+
+// Appends value escaped for the inside of a JSON string literal (no surrounding quotes), the
+// way nlohmann::json::dump() escapes it. Bytes from 0x80 up are copied as-is.
+inline void AppendEscapedJson(std::string &out, std::string_view value) {
+  std::size_t run = 0;
+  while (run < value.size()) {
+    const std::size_t at = run + detail::FindEscape(value.data() + run, value.size() - run);
+    out.append(value.data() + run, at - run);
+    if (at == value.size()) {
+      break;
+    }
+    detail::AppendEscape(out, static_cast<unsigned char>(value[at]));
+    run = at + 1;
+  }
+}
+
+inline std::string EscapeJson(std::string_view value) {
+  std::string escaped;
+  escaped.reserve(value.size() + 8);
+  AppendEscapedJson(escaped, value);
+  return escaped;
+}
+
+// Lowercase hex of size bytes.
+inline std::string HexEncode(const void *data, std::size_t size) {
+  std::string out(size * 2, '\0');
+  detail::HexEncode(out.data(), static_cast<const unsigned char *>(data), size);
+  return out;
+}
+
+inline std::string HexEncode(std::string_view data) { return HexEncode(data.data(), data.size()); }
+
+// Decodes hex digits of either case into out (a std::string or std::vector<unsigned char>).
+// Returns false, leaving out unspecified, for odd lengths or non-hex characters.
+template <typename Bytes>
+bool HexDecode(std::string_view hex, Bytes &out) {
+  if (hex.size() % 2 != 0) {
+    return false;
+  }
+  out.resize(hex.size() / 2);
+  return detail::HexDecode(detail::ByteData(out), hex.data(), out.size());
+}
+
+// Whether text is a UUID in the canonical 8-4-4-4-12 hex form, which Postgres casts to uuid.
+inline bool IsUuid(std::string_view text) {
+  if (text.size() != 36) {
+    return false;
+  }
+  for (std::size_t i = 0; i < text.size(); ++i) {
+    if (i == 8 || i == 13 || i == 18 || i == 23 ? text[i] != '-' : detail::HexValue(text[i]) < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline std::string Base64Encode(std::string_view data, Base64Alphabet alphabet = Base64Alphabet::kStandard) {
+  const char *digits = alphabet == Base64Alphabet::kUrl ? detail::kBase64Url : detail::kBase64Standard;
+  const auto *bytes = reinterpret_cast<const unsigned char *>(data.data());
+  std::string out;
+  out.reserve((data.size() + 2) / 3 * 4);
+  std::size_t i = 0;
+  for (; i + 3 <= data.size(); i += 3) {
+    const std::uint32_t word = (static_cast<std::uint32_t>(bytes[i]) << 16) |
+                               (static_cast<std::uint32_t>(bytes[i + 1]) << 8) | bytes[i + 2];
+    const char quantum[] = {digits[word >> 18], digits[(word >> 12) & 0x3F], digits[(word >> 6) & 0x3F],
+                            digits[word & 0x3F]};
+    out.append(quantum, sizeof(quantum));
+  }
+  if (i < data.size()) {
+    const std::uint32_t word = (static_cast<std::uint32_t>(bytes[i]) << 16) |
+                               (i + 1 < data.size() ? static_cast<std::uint32_t>(bytes[i + 1]) << 8 : 0);
+    out.push_back(digits[word >> 18]);
+    out.push_back(digits[(word >> 12) & 0x3F]);
+    if (i + 1 < data.size()) {
+      out.push_back(digits[(word >> 6) & 0x3F]);
+    }
+    if (alphabet == Base64Alphabet::kStandard) {
+      out.append(4 - out.size() % 4, '=');
+    }
+  }
+  return out;
+}
+
+// Decodes base64 in the given alphabet into out (a std::string or std::vector<unsigned char>).
+// '=' padding is optional in either alphabet; whitespace is not accepted. Returns false,
+// leaving out unspecified, for characters outside the alphabet or an impossible length.
+template <typename Bytes>
+bool Base64Decode(std::string_view text, Bytes &out, Base64Alphabet alphabet = Base64Alphabet::kStandard) {
+  if (text.size() % 4 == 0 && !text.empty() && text.back() == '=') {
+    text.remove_suffix(text[text.size() - 2] == '=' ? 2 : 1);
+  }
+  if (text.size() % 4 == 1) {
+    return false;
+  }
+  const bool url = alphabet == Base64Alphabet::kUrl;
+  out.resize(text.size() / 4 * 3 + (text.size() % 4 == 0 ? 0 : text.size() % 4 - 1));
+  unsigned char *bytes = detail::ByteData(out);
+  // The final quantum is left to the scalar loop, so block stores never run past out.
+  const std::size_t whole = text.size() < 4 ? 0 : (text.size() - 1) / 4 * 4;
+  bool ok = true;
+  const std::size_t consumed =
+      detail::Base64DecodeBlocks(bytes, text.data(), whole, url ? '-' : '+', url ? '_' : '/', ok);
+  return ok && detail::Base64DecodeScalar(bytes + consumed / 4 * 3, text.data() + consumed, text.size() - consumed,
+                                          url ? detail::kBase64UrlTable : detail::kBase64StandardTable);
+}
+
+}  // namespace codec
+
+#endif  // CONVEYANCERS_MARKETPLACE_CODEC_H
@@ -0,0 +1,246 @@
+#ifndef CONVEYANCERS_MARKETPLACE_HTTP_SERVER_H
+#define CONVEYANCERS_MARKETPLACE_HTTP_SERVER_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "../third_party/httplib.h"
+#include "logger.h"
+#include "metrics.h"
+#include "response_filter.h"
+#include "security.h"
+#include "tracing.h"
+
+namespace http_server {
+
+struct ServerOptions {
+  std::size_t worker_threads = std::max<std::size_t>(8, std::thread::hardware_concurrency());
+  // Accepted connections allowed to wait for a busy worker. Beyond that they are answered 503
+  // by the rejection thread; once that is backed up as well they are closed unanswered.
+  std::size_t max_queued_connections = 64;
+  std::size_t keep_alive_max_requests = 100;
+  std::chrono::seconds keep_alive_timeout{5};
+  std::chrono::seconds read_timeout{5};
+  std::chrono::seconds write_timeout{5};
+  std::size_t max_payload_bytes = 8 * 1024 * 1024;
+  response_filter::FilterOptions responses;
+};
+
+// <PREFIX>_WORKER_THREADS, <PREFIX>_MAX_QUEUED_CONNECTIONS, <PREFIX>_KEEP_ALIVE_MAX_REQUESTS,
+// <PREFIX>_KEEP_ALIVE_TIMEOUT_S, <PREFIX>_READ_TIMEOUT_S, <PREFIX>_WRITE_TIMEOUT_S,
+// <PREFIX>_MAX_PAYLOAD_BYTES, <PREFIX>_COMPRESS_RESPONSES (0 or 1) and <PREFIX>_COMPRESS_MIN_BYTES
+// override the per-service defaults.
+inline ServerOptions MakeServerOptionsFromEnv(std::string_view prefix, ServerOptions defaults = {}) {
+  const auto read = [prefix](std::string_view name, long long fallback) {
+    const std::string key = std::string(prefix) + "_" + std::string(name);
+    return logging::detail::EnvInteger(key.c_str(), fallback);
+  };
+  const auto positive = [](long long value, long long fallback) { return value > 0 ? value : fallback; };
+  ServerOptions options = defaults;
+  options.worker_threads = static_cast<std::size_t>(
+      positive(read("WORKER_THREADS", static_cast<long long>(defaults.worker_threads)),
+               static_cast<long long>(defaults.worker_threads)));
+  options.max_queued_connections = static_cast<std::size_t>(
+      read("MAX_QUEUED_CONNECTIONS", static_cast<long long>(defaults.max_queued_connections)));
+  options.keep_alive_max_requests = static_cast<std::size_t>(
+      positive(read("KEEP_ALIVE_MAX_REQUESTS", static_cast<long long>(defaults.keep_alive_max_requests)),
+               static_cast<long long>(defaults.keep_alive_max_requests)));
+  options.keep_alive_timeout = std::chrono::seconds(read("KEEP_ALIVE_TIMEOUT_S", defaults.keep_alive_timeout.count()));
+  options.read_timeout = std::chrono::seconds(read("READ_TIMEOUT_S", defaults.read_timeout.count()));
+  options.write_timeout = std::chrono::seconds(read("WRITE_TIMEOUT_S", defaults.write_timeout.count()));
+  options.max_payload_bytes = static_cast<std::size_t>(
+      positive(read("MAX_PAYLOAD_BYTES", static_cast<long long>(defaults.max_payload_bytes)),
+               static_cast<long long>(defaults.max_payload_bytes)));
+  options.responses.compress = read("COMPRESS_RESPONSES", defaults.responses.compress ? 1 : 0) != 0;
+  options.responses.min_compress_bytes = static_cast<std::size_t>(
+      read("COMPRESS_MIN_BYTES", static_cast<long long>(defaults.responses.min_compress_bytes)));
+  return options;
+}
+
+// Outlives the pools: httplib creates a task queue per listen() and deletes it on return, while
+// the metrics collector keeps reading these.
+struct PoolStats {
+  std::size_t worker_threads = 0;
+  std::size_t max_queued_connections = 0;
+  metrics::Gauge queued;
+  metrics::Gauge active;
+  metrics::Counter rejected;
+  metrics::Counter dropped;
+};
+
+// Fixed worker pool with a bounded connection queue. httplib hands each accepted connection to
+// enqueue() and serves every keep-alive request on it from one worker, so the queue holds
+// connections, not requests. When it is full the connection goes to a single rejection thread,
+// which runs the same handler with security::SheddingLoad() set so the request is answered 503
+// straight from pre-routing without touching a handler.
+class WorkerPool : public httplib::TaskQueue {
+ public:
+  WorkerPool(std::size_t worker_threads, std::size_t max_queued_connections, std::shared_ptr<PoolStats> stats)
+      : max_queued_(max_queued_connections), stats_(std::move(stats)) {
+    for (std::size_t i = 0; i < std::max<std::size_t>(1, worker_threads); ++i) {
+      workers_.emplace_back([this]() { RunWorker(); });
+    }
+    workers_.emplace_back([this]() { RunRejections(); });
+  }
+
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  ~WorkerPool() override { shutdown(); }
+
+  bool enqueue(std::function<void()> fn) override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_) {
+        return false;
+      }
+      if (pending_.size() < idle_ + max_queued_) {
+        pending_.push_back(std::move(fn));
+        stats_->queued.Add(1);
+      } else if (rejecting_.size() < std::max<std::size_t>(1, max_queued_)) {
+        rejecting_.push_back(std::move(fn));
+        stats_->rejected.Add();
+      } else {
+        // httplib closes the socket when enqueue fails.
+        stats_->dropped.Add();
+        return false;
+      }
+    }
+    cv_.notify_all();
+    return true;
+  }
+
+  void shutdown() override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_) {
+        return;
+      }
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto &worker : workers_) {
+      worker.join();
+    }
+  }
+
+ private:
+  void RunWorker() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      ++idle_;
+      cv_.wait(lock, [this]() { return stopping_ || !pending_.empty(); });
+      --idle_;
+      if (pending_.empty()) {
+        return;
+      }
+      auto fn = std::move(pending_.front());
+      pending_.pop_front();
+      lock.unlock();
+      stats_->queued.Add(-1);
+      stats_->active.Add(1);
+      fn();
+      stats_->active.Add(-1);
+      lock.lock();
+    }
+  }
+
+  void RunRejections() {
+    security::SheddingLoad() = true;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      cv_.wait(lock, [this]() { return stopping_ || !rejecting_.empty(); });
+      if (rejecting_.empty()) {
+        return;
+      }
+      auto fn = std::move(rejecting_.front());
+      rejecting_.pop_front();
+      lock.unlock();
+      fn();
+      lock.lock();
+    }
+  }
+
+  const std::size_t max_queued_;
+  std::shared_ptr<PoolStats> stats_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> pending_;
+  std::deque<std::function<void()>> rejecting_;
+  std::size_t idle_ = 0;
+  bool stopping_ = false;
+  std::vector<std::thread> workers_;
+};
+
+inline std::string RenderPoolMetrics(const PoolStats &stats, std::string_view service) {
+  std::ostringstream labels;
+  labels << "service=\"" << service << '"';
+  std::ostringstream oss;
+  oss << "# HELP service_worker_threads HTTP worker threads" << '\n';
+  oss << "# TYPE service_worker_threads gauge" << '\n';
+  oss << "service_worker_threads{" << labels.str() << "} " << stats.worker_threads << '\n';
+  oss << "# HELP service_workers_active HTTP workers currently serving a connection" << '\n';
+  oss << "# TYPE service_workers_active gauge" << '\n';
+  oss << "service_workers_active{" << labels.str() << "} " << stats.active.Value() << '\n';
+  oss << "# HELP service_connection_queue_depth Accepted connections waiting for a worker" << '\n';
+  oss << "# TYPE service_connection_queue_depth gauge" << '\n';
+  oss << "service_connection_queue_depth{" << labels.str() << "} " << stats.queued.Value() << '\n';
+  oss << "# HELP service_connection_queue_limit Connections allowed to wait before load is shed" << '\n';
+  oss << "# TYPE service_connection_queue_limit gauge" << '\n';
+  oss << "service_connection_queue_limit{" << labels.str() << "} " << stats.max_queued_connections << '\n';
+  oss << "# HELP service_connections_shed_total Connections refused because the queue was full" << '\n';
+  oss << "# TYPE service_connections_shed_total counter" << '\n';
+  oss << "service_connections_shed_total{" << labels.str() << ",outcome=\"rejected\"} " << stats.rejected.Value()
+      << '\n';
+  oss << "service_connections_shed_total{" << labels.str() << ",outcome=\"dropped\"} " << stats.dropped.Value()
+      << '\n';
+  return oss.str();
+}
+
+// Applies the pool, keep-alive, timeout and payload settings, installs the standard logging,
+// metrics and error handlers, the ETag/compression response filter and the process tracer, and
+// registers the pool gauges, response filter counters and span export counters with the metrics
+// registry.
+inline void Bootstrap(httplib::Server &server, std::string_view service_name, const ServerOptions &options) {
+  auto stats = std::make_shared<PoolStats>();
+  stats->worker_threads = options.worker_threads;
+  stats->max_queued_connections = options.max_queued_connections;
+  server.new_task_queue = [options, stats]() {
+    return new WorkerPool(options.worker_threads, options.max_queued_connections, stats);
+  };
+  server.set_keep_alive_max_count(options.keep_alive_max_requests);
+  server.set_keep_alive_timeout(options.keep_alive_timeout.count());
+  server.set_read_timeout(options.read_timeout);
+  server.set_write_timeout(options.write_timeout);
+  server.set_payload_max_length(options.max_payload_bytes);
+  tracing::Tracer::Install(tracing::MakeTracerOptionsFromEnv(service_name));
+  security::AttachStandardHandlers(server, service_name);
+  auto response_stats = std::make_shared<response_filter::FilterStats>();
+  response_filter::Attach(server, options.responses, response_stats);
+  security::MetricsRegistry::Instance().RegisterCollector(
+      service_name, [stats, service = std::string(service_name)]() { return RenderPoolMetrics(*stats, service); });
+  security::MetricsRegistry::Instance().RegisterCollector(
+      service_name, [response_stats, service = std::string(service_name)]() {
+        return response_filter::RenderMetrics(*response_stats, service);
+      });
+  security::MetricsRegistry::Instance().RegisterCollector(service_name, [service = std::string(service_name)]() {
+    const auto *tracer = tracing::Tracer::Active();
+    return tracer ? tracer->RenderMetrics(service) : std::string();
+  });
+}
+
+}  // namespace http_server
+
+#endif  // CONVEYANCERS_MARKETPLACE_HTTP_SERVER_H
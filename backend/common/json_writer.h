@@ -0,0 +1,142 @@
+#ifndef CONVEYANCERS_MARKETPLACE_JSON_WRITER_H
+#define CONVEYANCERS_MARKETPLACE_JSON_WRITER_H
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "../third_party/json.hpp"
+#include "codec.h"
+
+namespace json_writer {
+
+// Appends JSON text straight into a caller-owned buffer, so list responses are serialised from
+// the records in one pass instead of being built as a nlohmann::json tree and then dumped.
+// Commas are tracked with a single flag: the writer does not validate nesting, callers are
+// expected to pair Begin/End calls. Strings are escaped the way nlohmann::json::dump() escapes
+// them; bytes from 0x80 up are copied as-is, so input must already be valid UTF-8.
+class Writer {
+ public:
+  explicit Writer(std::string &out) : out_(out) {}
+
+  Writer(const Writer &) = delete;
+  Writer &operator=(const Writer &) = delete;
+
+  void Reserve(std::size_t additional) { out_.reserve(out_.size() + additional); }
+
+  Writer &BeginObject() { return Open('{'); }
+  Writer &EndObject() { return Close('}'); }
+  Writer &BeginArray() { return Open('['); }
+  Writer &EndArray() { return Close(']'); }
+
+  Writer &Key(std::string_view key) {
+    Separate();
+    AppendString(key);
+    out_.push_back(':');
+    need_comma_ = false;
+    return *this;
+  }
+
+  Writer &Value(std::string_view value) {
+    Separate();
+    AppendString(value);
+    return Done();
+  }
+  Writer &Value(const std::string &value) { return Value(std::string_view(value)); }
+  Writer &Value(const char *value) { return Value(std::string_view(value)); }
+
+  Writer &Value(bool value) {
+    Separate();
+    out_.append(value ? "true" : "false");
+    return Done();
+  }
+
+  template <typename T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>, int> = 0>
+  Writer &Value(T value) {
+    Separate();
+    char buffer[24];
+    const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out_.append(buffer, static_cast<std::size_t>(result.ptr - buffer));
+    return Done();
+  }
+
+  Writer &Value(std::nullptr_t) {
+    Separate();
+    out_.append("null");
+    return Done();
+  }
+
+  // Nested documents that are already held as a tree (metadata, message attachments).
+  Writer &Value(const nlohmann::json &value) { return Raw(value.dump()); }
+
+  Writer &Value(const std::vector<std::string> &values) {
+    BeginArray();
+    for (const auto &value : values) {
+      Value(std::string_view(value));
+    }
+    return EndArray();
+  }
+
+  // Splices in text that is already valid JSON.
+  Writer &Raw(std::string_view json) {
+    Separate();
+    out_.append(json);
+    return Done();
+  }
+
+  template <typename T>
+  Writer &Field(std::string_view key, const T &value) {
+    Key(key);
+    return Value(value);
+  }
+
+ private:
+  Writer &Open(char bracket) {
+    Separate();
+    out_.push_back(bracket);
+    need_comma_ = false;
+    return *this;
+  }
+
+  Writer &Close(char bracket) {
+    out_.push_back(bracket);
+    return Done();
+  }
+
+  void Separate() {
+    if (need_comma_) {
+      out_.push_back(',');
+    }
+  }
+
+  Writer &Done() {
+    need_comma_ = true;
+    return *this;
+  }
+
+  void AppendString(std::string_view value) {
+    out_.push_back('"');
+    codec::AppendEscapedJson(out_, value);
+    out_.push_back('"');
+  }
+
+  std::string &out_;
+  bool need_comma_ = false;
+};
+
+// Runs write against a fresh buffer and returns the text.
+template <typename WriteFn>
+std::string Render(WriteFn &&write) {
+  std::string out;
+  Writer writer(out);
+  write(writer);
+  return out;
+}
+
+}  // namespace json_writer
+
+#endif  // CONVEYANCERS_MARKETPLACE_JSON_WRITER_H
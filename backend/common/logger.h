@@ -1,78 +1,61 @@
 #ifndef CONVEYANCERS_MARKETPLACE_LOGGER_H
 #define CONVEYANCERS_MARKETPLACE_LOGGER_H
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <cstdio>
 #include <ctime>
 #include <filesystem>
 #include <fstream>
-#include <iomanip>
 #include <iostream>
 #include <map>
 #include <memory>
 #include <mutex>
-#include <sstream>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <system_error>
+#include <thread>
 #include <utility>
+#include <vector>
+
+#include "codec.h"
 
 namespace logging {
 
 namespace detail {
 
-inline std::string EscapeJson(std::string_view value) {
-  std::string escaped;
-  escaped.reserve(value.size());
-  for (const char ch : value) {
-    switch (ch) {
-      case '"':
-        escaped += "\\\"";
-        break;
-      case '\\':
-        escaped += "\\\\";
-        break;
-      case '\n':
-        escaped += "\\n";
-        break;
-      case '\r':
-        escaped += "\\r";
-        break;
-      case '\t':
-        escaped += "\\t";
-        break;
-      default:
-        if (static_cast<unsigned char>(ch) < 0x20) {
-          char buffer[7];
-          std::snprintf(buffer, sizeof(buffer), "\\u%04x", ch);
-          escaped += buffer;
-        } else {
-          escaped += ch;
-        }
-        break;
-    }
-  }
-  return escaped;
-}
+using codec::AppendEscapedJson;
+using codec::EscapeJson;
 
+// Formats the current UTC time as 2024-01-31T12:34:56.789Z. The seconds prefix is cached per
+// thread, so the common case is a single snprintf of the milliseconds.
 inline std::string TimestampNow() {
   using clock = std::chrono::system_clock;
   const auto now = clock::now();
   const auto seconds = clock::to_time_t(now);
+  thread_local std::time_t cached_seconds = -1;
+  thread_local char cached_prefix[24] = {};
+  if (seconds != cached_seconds) {
+    std::tm tm;
 #ifdef _WIN32
-  std::tm tm;
-  gmtime_s(&tm, &seconds);
+    gmtime_s(&tm, &seconds);
 #else
-  std::tm tm;
-  gmtime_r(&seconds, &tm);
+    gmtime_r(&seconds, &tm);
 #endif
+    std::strftime(cached_prefix, sizeof(cached_prefix), "%Y-%m-%dT%H:%M:%S", &tm);
+    cached_seconds = seconds;
+  }
   const auto ms =
       std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
-  std::ostringstream oss;
-  oss << std::put_time(&tm, "%Y-%m-%dT%H:%M:%S") << '.' << std::setfill('0') << std::setw(3)
-      << ms.count() << 'Z';
-  return oss.str();
+  char buffer[32];
+  const int length =
+      std::snprintf(buffer, sizeof(buffer), "%s.%03dZ", cached_prefix, static_cast<int>(ms.count()));
+  return std::string(buffer, static_cast<std::size_t>(length));
 }
 
 inline std::string SanitizeServiceName(std::string_view service) {
@@ -121,15 +104,24 @@ inline std::filesystem::path ErrorLogFilePath() {
 inline std::string BuildLogEntry(std::string_view timestamp, std::string_view service,
                                  std::string_view category, std::string_view message,
                                  std::string_view context) {
-  std::ostringstream oss;
-  oss << "{\"timestamp\":\"" << EscapeJson(timestamp) << "\",\"service\":\"" << EscapeJson(service)
-      << "\",\"category\":\"" << EscapeJson(category) << "\",\"message\":\"" << EscapeJson(message)
-      << "\"";
+  std::string entry;
+  entry.reserve(64 + timestamp.size() + service.size() + category.size() + message.size() + context.size());
+  entry += "{\"timestamp\":\"";
+  AppendEscapedJson(entry, timestamp);
+  entry += "\",\"service\":\"";
+  AppendEscapedJson(entry, service);
+  entry += "\",\"category\":\"";
+  AppendEscapedJson(entry, category);
+  entry += "\",\"message\":\"";
+  AppendEscapedJson(entry, message);
+  entry += '"';
   if (!context.empty()) {
-    oss << ",\"context\":\"" << EscapeJson(context) << "\"";
+    entry += ",\"context\":\"";
+    AppendEscapedJson(entry, context);
+    entry += '"';
   }
-  oss << '}';
-  return oss.str();
+  entry += '}';
+  return entry;
 }
 
 inline void AppendLogEntry(const std::filesystem::path &path, const std::string &entry) {
@@ -156,8 +148,401 @@ inline void EmitConsole(std::string_view service, std::string_view message,
   }
 }
 
+// Bounded multi-producer queue (Vyukov). Producers claim a slot with a single CAS on the tail
+// and publish it through the slot's sequence number, so request threads never take a lock.
+template <typename T>
+class MpscRing {
+ public:
+  explicit MpscRing(std::size_t capacity) : mask_(RoundUp(capacity) - 1), slots_(mask_ + 1) {
+    for (std::size_t i = 0; i < slots_.size(); ++i) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MpscRing(const MpscRing &) = delete;
+  MpscRing &operator=(const MpscRing &) = delete;
+
+  // Returns false without blocking when the ring is full; value is only moved from on success.
+  bool TryPush(T &&value) {
+    std::size_t position = tail_.load(std::memory_order_relaxed);
+    while (true) {
+      Slot &slot = slots_[position & mask_];
+      const std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+          slot.value = std::move(value);
+          slot.sequence.store(position + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        position = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Single consumer only.
+  std::optional<T> TryPop() {
+    Slot &slot = slots_[head_ & mask_];
+    if (slot.sequence.load(std::memory_order_acquire) != head_ + 1) {
+      return std::nullopt;
+    }
+    std::optional<T> value(std::move(slot.value));
+    slot.sequence.store(head_ + mask_ + 1, std::memory_order_release);
+    ++head_;
+    return value;
+  }
+
+  std::size_t Capacity() const { return mask_ + 1; }
+
+ private:
+  struct Slot {
+    std::atomic<std::size_t> sequence{0};
+    T value{};
+  };
+
+  static std::size_t RoundUp(std::size_t capacity) {
+    std::size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+  const std::size_t mask_;
+  std::vector<Slot> slots_;
+  alignas(64) std::atomic<std::size_t> tail_{0};
+  alignas(64) std::size_t head_ = 0;
+};
+
+// Names the N-th rotated generation of a log file. Rotated files deliberately do not end in
+// ".log" so the admin portal only lists the live files.
+inline std::filesystem::path RotatedLogPath(const std::filesystem::path &path, std::size_t generation) {
+  auto rotated = path;
+  rotated += "." + std::to_string(generation);
+  return rotated;
+}
+
+inline long long EnvInteger(const char *key, long long fallback) {
+  const char *value = std::getenv(key);
+  if (value == nullptr || *value == '\0') {
+    return fallback;
+  }
+  try {
+    const long long parsed = std::stoll(value);
+    return parsed < 0 ? fallback : parsed;
+  } catch (...) {
+    return fallback;
+  }
+}
+
+inline bool EnvFlag(const char *key) {
+  const char *value = std::getenv(key);
+  if (value == nullptr) {
+    return false;
+  }
+  const std::string_view flag(value);
+  return flag == "1" || flag == "true" || flag == "TRUE" || flag == "yes" || flag == "on";
+}
+
 }  // namespace detail
 
+enum class OverflowPolicy { kDrop, kBlock };
+
+struct AsyncLogOptions {
+  std::size_t queue_capacity = 8192;
+  // The writer wakes at least this often, or as soon as batch_size entries are pending.
+  std::chrono::milliseconds flush_interval{200};
+  std::size_t batch_size = 512;
+  // Size and age limits for a live log file; zero disables that trigger.
+  std::uintmax_t max_file_bytes = 64ull * 1024 * 1024;
+  std::chrono::seconds rotate_interval{86400};
+  std::size_t max_rotated_files = 5;
+  // kBlock waits up to block_timeout for space before the entry is dropped anyway.
+  OverflowPolicy overflow = OverflowPolicy::kDrop;
+  std::chrono::milliseconds block_timeout{10};
+  bool console = true;
+};
+
+inline AsyncLogOptions MakeAsyncLogOptionsFromEnv() {
+  using detail::EnvInteger;
+  AsyncLogOptions options;
+  options.queue_capacity = static_cast<std::size_t>(EnvInteger("LOG_ASYNC_QUEUE_SIZE", options.queue_capacity));
+  options.flush_interval =
+      std::chrono::milliseconds(EnvInteger("LOG_FLUSH_INTERVAL_MS", options.flush_interval.count()));
+  options.batch_size = static_cast<std::size_t>(EnvInteger("LOG_BATCH_SIZE", options.batch_size));
+  options.max_file_bytes =
+      static_cast<std::uintmax_t>(EnvInteger("LOG_MAX_FILE_BYTES", static_cast<long long>(options.max_file_bytes)));
+  options.rotate_interval =
+      std::chrono::seconds(EnvInteger("LOG_ROTATE_INTERVAL_S", options.rotate_interval.count()));
+  options.max_rotated_files =
+      static_cast<std::size_t>(EnvInteger("LOG_MAX_ROTATED_FILES", options.max_rotated_files));
+  if (const char *policy = std::getenv("LOG_OVERFLOW_POLICY"); policy && std::string_view(policy) == "block") {
+    options.overflow = OverflowPolicy::kBlock;
+  }
+  options.block_timeout =
+      std::chrono::milliseconds(EnvInteger("LOG_BLOCK_TIMEOUT_MS", options.block_timeout.count()));
+  if (options.batch_size == 0) {
+    options.batch_size = 1;
+  }
+  return options;
+}
+
+struct AsyncLogStats {
+  std::uint64_t enqueued = 0;
+  std::uint64_t dropped = 0;
+  std::uint64_t written = 0;
+  std::uint64_t rotations = 0;
+  std::size_t capacity = 0;
+};
+
+// Background writer for ServiceLogger. Request threads format the entry and push it onto a
+// lock-free ring; a single thread drains it, keeps one FILE handle per log file and writes
+// each batch with one fwrite/fflush.
+class AsyncLogWriter {
+ public:
+  struct Record {
+    // Points at a path owned by a long-lived ServiceLogger; must outlive Stop().
+    const std::filesystem::path *file = nullptr;
+    bool error = false;
+    std::string entry;
+    std::string console;
+  };
+
+  // Process-wide writer configured from LOG_* variables and drained at exit. Intentionally leaked
+  // so that loggers used from static destructors never touch a destroyed writer.
+  static AsyncLogWriter &Instance() {
+    static AsyncLogWriter *writer = []() {
+      auto *created = new AsyncLogWriter(MakeAsyncLogOptionsFromEnv(), detail::ErrorLogFilePath());
+      std::atexit([]() { Instance().Stop(); });
+      return created;
+    }();
+    return *writer;
+  }
+
+  // LOG_ASYNC opts a service into the background writer; the default stays synchronous.
+  static bool Enabled() {
+    static const bool enabled = detail::EnvFlag("LOG_ASYNC");
+    return enabled;
+  }
+
+  AsyncLogWriter(AsyncLogOptions options, std::filesystem::path error_file)
+      : options_(options), error_file_(std::move(error_file)), ring_(options.queue_capacity) {
+    thread_ = std::thread([this]() { Run(); });
+  }
+
+  AsyncLogWriter(const AsyncLogWriter &) = delete;
+  AsyncLogWriter &operator=(const AsyncLogWriter &) = delete;
+
+  ~AsyncLogWriter() { Stop(); }
+
+  // Returns false once the writer has stopped so callers can fall back to writing directly.
+  // A full queue is not an error: the entry is counted as dropped.
+  bool Submit(Record &&record) {
+    if (stopping_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    if (!ring_.TryPush(std::move(record)) && !PushSlow(record)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+    enqueued_.fetch_add(1, std::memory_order_relaxed);
+    if (pending_.fetch_add(1, std::memory_order_relaxed) + 1 == options_.batch_size) {
+      wake_.notify_one();
+    }
+    return true;
+  }
+
+  // Writes everything already queued, then joins the writer thread. Idempotent.
+  void Stop() {
+    std::lock_guard<std::mutex> stop_lock(stop_mutex_);
+    if (stopping_.exchange(true, std::memory_order_acq_rel) && !thread_.joinable()) {
+      return;
+    }
+    {
+      // Taking the mutex orders the flag against the writer's predicate check.
+      std::lock_guard<std::mutex> lock(wake_mutex_);
+    }
+    wake_.notify_one();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  AsyncLogStats Stats() const {
+    AsyncLogStats stats;
+    stats.enqueued = enqueued_.load(std::memory_order_relaxed);
+    stats.dropped = dropped_.load(std::memory_order_relaxed);
+    stats.written = written_.load(std::memory_order_relaxed);
+    stats.rotations = rotations_.load(std::memory_order_relaxed);
+    stats.capacity = ring_.Capacity();
+    return stats;
+  }
+
+  const AsyncLogOptions &Options() const { return options_; }
+
+ private:
+  struct OpenFile {
+    std::FILE *handle = nullptr;
+    std::uintmax_t size = 0;
+    std::chrono::steady_clock::time_point opened_at;
+    std::string buffer;
+  };
+
+  bool PushSlow(Record &record) {
+    if (options_.overflow != OverflowPolicy::kBlock) {
+      return false;
+    }
+    const auto deadline = std::chrono::steady_clock::now() + options_.block_timeout;
+    while (std::chrono::steady_clock::now() < deadline) {
+      wake_.notify_one();
+      std::this_thread::yield();
+      if (ring_.TryPush(std::move(record))) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void Run() {
+    std::vector<Record> batch;
+    batch.reserve(options_.batch_size);
+    while (true) {
+      while (auto record = ring_.TryPop()) {
+        batch.push_back(std::move(*record));
+        if (batch.size() >= options_.batch_size) {
+          WriteBatch(batch);
+        }
+      }
+      WriteBatch(batch);
+      if (stopping_.load(std::memory_order_acquire)) {
+        // Producers that raced with Stop() may still have published a final entry.
+        while (auto record = ring_.TryPop()) {
+          batch.push_back(std::move(*record));
+        }
+        WriteBatch(batch);
+        break;
+      }
+      std::unique_lock<std::mutex> lock(wake_mutex_);
+      wake_.wait_for(lock, options_.flush_interval, [this]() {
+        return stopping_.load(std::memory_order_acquire) ||
+               pending_.load(std::memory_order_relaxed) >= options_.batch_size;
+      });
+    }
+    for (auto &[path, file] : files_) {
+      if (file.handle != nullptr) {
+        std::fclose(file.handle);
+      }
+    }
+    files_.clear();
+  }
+
+  void WriteBatch(std::vector<Record> &batch) {
+    if (batch.empty()) {
+      return;
+    }
+    std::string console;
+    for (auto &record : batch) {
+      if (record.file != nullptr) {
+        auto &buffer = files_[record.file].buffer;
+        buffer += record.entry;
+        buffer += '\n';
+      }
+      if (record.error) {
+        auto &buffer = files_[&error_file_].buffer;
+        buffer += record.entry;
+        buffer += '\n';
+      }
+      if (options_.console && !record.console.empty()) {
+        console += record.console;
+        console += '\n';
+      }
+    }
+    for (auto &[path, file] : files_) {
+      if (!file.buffer.empty()) {
+        Flush(*path, file);
+      }
+    }
+    if (!console.empty()) {
+      std::fwrite(console.data(), 1, console.size(), stderr);
+      std::fflush(stderr);
+    }
+    pending_.fetch_sub(batch.size(), std::memory_order_relaxed);
+    written_.fetch_add(batch.size(), std::memory_order_relaxed);
+    batch.clear();
+  }
+
+  void Flush(const std::filesystem::path &path, OpenFile &file) {
+    const auto now = std::chrono::steady_clock::now();
+    if (file.handle != nullptr && file.size > 0) {
+      const bool too_big = options_.max_file_bytes > 0 && file.size + file.buffer.size() > options_.max_file_bytes;
+      const bool too_old = options_.rotate_interval.count() > 0 && now - file.opened_at >= options_.rotate_interval;
+      if (too_big || too_old) {
+        Rotate(path, file);
+      }
+    }
+    if (file.handle == nullptr && !Open(path, file, now)) {
+      file.buffer.clear();
+      return;
+    }
+    std::fwrite(file.buffer.data(), 1, file.buffer.size(), file.handle);
+    std::fflush(file.handle);
+    file.size += file.buffer.size();
+    file.buffer.clear();
+  }
+
+  static bool Open(const std::filesystem::path &path, OpenFile &file, std::chrono::steady_clock::time_point now) {
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    file.handle = std::fopen(path.c_str(), "ab");
+    if (file.handle == nullptr) {
+      return false;
+    }
+    const auto size = std::filesystem::file_size(path, ec);
+    file.size = ec ? 0 : size;
+    file.opened_at = now;
+    return true;
+  }
+
+  void Rotate(const std::filesystem::path &live, OpenFile &file) {
+    std::fclose(file.handle);
+    file.handle = nullptr;
+    file.size = 0;
+    std::error_code ec;
+    if (options_.max_rotated_files == 0) {
+      std::filesystem::remove(live, ec);
+    } else {
+      std::filesystem::remove(detail::RotatedLogPath(live, options_.max_rotated_files), ec);
+      for (std::size_t generation = options_.max_rotated_files; generation > 1; --generation) {
+        std::filesystem::rename(detail::RotatedLogPath(live, generation - 1), detail::RotatedLogPath(live, generation),
+                                ec);
+      }
+      std::filesystem::rename(live, detail::RotatedLogPath(live, 1), ec);
+    }
+    rotations_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  const AsyncLogOptions options_;
+  const std::filesystem::path error_file_;
+  detail::MpscRing<Record> ring_;
+
+  std::mutex wake_mutex_;
+  std::condition_variable wake_;
+  std::mutex stop_mutex_;
+  std::atomic<bool> stopping_{false};
+  std::atomic<std::size_t> pending_{0};
+  std::atomic<std::uint64_t> enqueued_{0};
+  std::atomic<std::uint64_t> dropped_{0};
+  std::atomic<std::uint64_t> written_{0};
+  std::atomic<std::uint64_t> rotations_{0};
+
+  // Owned by the writer thread, keyed by the ServiceLogger-owned path.
+  std::map<const std::filesystem::path *, OpenFile> files_;
+  std::thread thread_;
+};
+
 class ServiceLogger {
  public:
   static ServiceLogger &Instance(std::string_view service_name) {
@@ -182,7 +567,10 @@ class ServiceLogger {
 
   void Log(std::string_view category, std::string_view message, std::string_view context = {}) {
     const auto timestamp = detail::TimestampNow();
-    const auto entry = detail::BuildLogEntry(timestamp, service_name_, category, message, context);
+    auto entry = detail::BuildLogEntry(timestamp, service_name_, category, message, context);
+    if (AsyncLogWriter::Enabled() && SubmitAsync(category, message, context, entry)) {
+      return;
+    }
     {
       std::lock_guard<std::mutex> lock(detail::LogMutex());
       detail::AppendLogEntry(log_file_, entry);
@@ -209,6 +597,24 @@ class ServiceLogger {
   const std::string &service_key() const { return service_key_; }
 
  private:
+  bool SubmitAsync(std::string_view category, std::string_view message, std::string_view context,
+                   std::string &entry) {
+    AsyncLogWriter::Record record;
+    record.file = &log_file_;
+    record.error = category == "error";
+    record.console.reserve(service_name_.size() + message.size() + context.size() + 6);
+    record.console.append("[").append(service_name_).append("] ").append(message);
+    if (!context.empty()) {
+      record.console.append(" (").append(context).append(")");
+    }
+    record.entry = std::move(entry);
+    if (AsyncLogWriter::Instance().Submit(std::move(record))) {
+      return true;
+    }
+    entry = std::move(record.entry);
+    return false;
+  }
+
   explicit ServiceLogger(std::string service_name)
       : service_name_(std::move(service_name)),
         service_key_(detail::SanitizeServiceName(service_name_)),
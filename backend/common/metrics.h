@@ -0,0 +1,271 @@
+#ifndef CONVEYANCERS_MARKETPLACE_METRICS_H
+#define CONVEYANCERS_MARKETPLACE_METRICS_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace metrics {
+
+// Hot-path updates go to a per-thread shard so concurrent requests never share a cache line;
+// shards are only summed when /metrics is rendered.
+inline constexpr std::size_t kShardCount = 16;
+
+inline std::size_t ThreadShard() {
+  static std::atomic<std::size_t> next{0};
+  thread_local const std::size_t shard = next.fetch_add(1, std::memory_order_relaxed) % kShardCount;
+  return shard;
+}
+
+class Counter {
+ public:
+  void Add(std::uint64_t amount = 1) {
+    cells_[ThreadShard()].value.fetch_add(amount, std::memory_order_relaxed);
+  }
+
+  std::uint64_t Value() const {
+    std::uint64_t total = 0;
+    for (const auto &cell : cells_) {
+      total += cell.value.load(std::memory_order_relaxed);
+    }
+    return total;
+  }
+
+ private:
+  struct alignas(64) Cell {
+    std::atomic<std::uint64_t> value{0};
+  };
+  std::array<Cell, kShardCount> cells_;
+};
+
+// Up/down gauge. A thread's increments and decrements land on the same shard, so the per-shard
+// values may be negative but the sum is exact.
+class Gauge {
+ public:
+  void Add(std::int64_t delta) { cells_[ThreadShard()].value.fetch_add(delta, std::memory_order_relaxed); }
+
+  std::int64_t Value() const {
+    std::int64_t total = 0;
+    for (const auto &cell : cells_) {
+      total += cell.value.load(std::memory_order_relaxed);
+    }
+    return total;
+  }
+
+ private:
+  struct alignas(64) Cell {
+    std::atomic<std::int64_t> value{0};
+  };
+  std::array<Cell, kShardCount> cells_;
+};
+
+// Fixed-bucket latency histogram using the Prometheus default bucket layout.
+class Histogram {
+ public:
+  static constexpr std::array<double, 11> kBounds = {0.005, 0.01, 0.025, 0.05, 0.1, 0.25,
+                                                     0.5,   1.0,  2.5,   5.0,  10.0};
+
+  struct Snapshot {
+    // Cumulative counts per bound, matching the `le` buckets of the exposition format.
+    std::array<std::uint64_t, kBounds.size()> cumulative{};
+    std::uint64_t count = 0;
+    double sum_seconds = 0.0;
+  };
+
+  void Observe(std::chrono::nanoseconds duration) {
+    const auto nanos = static_cast<std::uint64_t>(std::max<std::int64_t>(duration.count(), 0));
+    std::size_t bucket = 0;
+    while (bucket < kBoundNanos.size() && nanos > kBoundNanos[bucket]) {
+      ++bucket;
+    }
+    auto &cell = cells_[ThreadShard()];
+    cell.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    cell.sum_nanos.fetch_add(nanos, std::memory_order_relaxed);
+  }
+
+  Snapshot Collect() const {
+    Snapshot snapshot;
+    std::array<std::uint64_t, kBounds.size() + 1> buckets{};
+    std::uint64_t sum_nanos = 0;
+    for (const auto &cell : cells_) {
+      for (std::size_t i = 0; i < buckets.size(); ++i) {
+        buckets[i] += cell.buckets[i].load(std::memory_order_relaxed);
+      }
+      sum_nanos += cell.sum_nanos.load(std::memory_order_relaxed);
+    }
+    std::uint64_t running = 0;
+    for (std::size_t i = 0; i < kBounds.size(); ++i) {
+      running += buckets[i];
+      snapshot.cumulative[i] = running;
+    }
+    snapshot.count = running + buckets.back();
+    snapshot.sum_seconds = static_cast<double>(sum_nanos) / 1e9;
+    return snapshot;
+  }
+
+ private:
+  static constexpr std::array<std::uint64_t, kBounds.size()> kBoundNanos = {
+      5'000'000,   10'000'000,    25'000'000,    50'000'000,    100'000'000,    250'000'000,
+      500'000'000, 1'000'000'000, 2'500'000'000, 5'000'000'000, 10'000'000'000};
+
+  struct alignas(64) Cell {
+    std::array<std::atomic<std::uint64_t>, kBounds.size() + 1> buckets{};
+    std::atomic<std::uint64_t> sum_nanos{0};
+  };
+  std::array<Cell, kShardCount> cells_;
+};
+
+// Writes the _bucket/_sum/_count series for one label set; labels is the rendered label list
+// without braces, e.g. service="jobs",route="/jobs".
+inline void WriteHistogram(std::ostream &out, std::string_view name, std::string_view labels,
+                           const Histogram::Snapshot &snapshot) {
+  const std::string_view separator = labels.empty() ? "" : ",";
+  for (std::size_t i = 0; i < Histogram::kBounds.size(); ++i) {
+    out << name << "_bucket{" << labels << separator << "le=\"" << Histogram::kBounds[i] << "\"} "
+        << snapshot.cumulative[i] << '\n';
+  }
+  out << name << "_bucket{" << labels << separator << "le=\"+Inf\"} " << snapshot.count << '\n';
+  out << name << "_sum{" << labels << "} " << snapshot.sum_seconds << '\n';
+  out << name << "_count{" << labels << "} " << snapshot.count << '\n';
+}
+
+// Label sets are joined with a separator that cannot appear in HTTP methods, routes or service
+// names, so a key round-trips through SplitLabels.
+inline constexpr char kLabelSeparator = '\x1f';
+
+inline void JoinLabels(std::string &out, std::initializer_list<std::string_view> labels) {
+  out.clear();
+  bool first = true;
+  for (const auto label : labels) {
+    if (!first) {
+      out += kLabelSeparator;
+    }
+    out.append(label);
+    first = false;
+  }
+}
+
+inline std::vector<std::string_view> SplitLabels(std::string_view key) {
+  std::vector<std::string_view> labels;
+  std::size_t start = 0;
+  while (true) {
+    const auto end = key.find(kLabelSeparator, start);
+    labels.push_back(key.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start));
+    if (end == std::string_view::npos) {
+      return labels;
+    }
+    start = end + 1;
+  }
+}
+
+// Collapses identifiers out of a request path so the route label stays low-cardinality:
+// any segment containing a digit (ids, uuids, versions of a record) becomes ":id".
+inline void AppendRouteLabel(std::string &out, std::string_view path) {
+  if (path.empty()) {
+    out += '/';
+    return;
+  }
+  std::size_t start = 0;
+  while (start < path.size()) {
+    auto end = path.find('/', start);
+    if (end == std::string_view::npos) {
+      end = path.size();
+    }
+    const auto segment = path.substr(start, end - start);
+    if (std::any_of(segment.begin(), segment.end(), [](char ch) { return ch >= '0' && ch <= '9'; })) {
+      out += ":id";
+    } else {
+      out.append(segment);
+    }
+    if (end < path.size()) {
+      out += '/';
+    }
+    start = end + 1;
+  }
+}
+
+// Route label for requests answered 4xx. Unmatched paths land here, so a scanner probing
+// made-up paths adds no series.
+inline constexpr std::string_view kUnmatchedRoute = "unmatched";
+
+// Series a Family holds before new label sets are folded into an overflow series.
+inline constexpr std::size_t kMaxSeriesPerFamily = 2048;
+
+// Interns one metric per label set. Lookups hash the key to one of kShardCount maps, so
+// concurrent requests for different series rarely touch the same mutex, and the key is
+// only copied the first time a label set is seen. Series are never removed, which keeps
+// the returned references stable; instead the family stops adding them at max_series.
+template <typename Metric>
+class Family {
+ public:
+  explicit Family(std::size_t max_series = kMaxSeriesPerFamily) : max_series_(max_series) {}
+
+  // Once max_series label sets exist, an unseen key gets overflow_key's series, which is added
+  // past the cap, or an unexported sink when no overflow_key is given.
+  Metric &Get(std::string_view key, std::string_view overflow_key = {}) {
+    if (auto *metric = Lookup(key, false)) {
+      return *metric;
+    }
+    if (!overflow_key.empty()) {
+      return *Lookup(overflow_key, true);
+    }
+    return sink_;
+  }
+
+  // Sorted by key so the exposition is stable between scrapes.
+  std::vector<std::pair<std::string, const Metric *>> Collect() const {
+    std::vector<std::pair<std::string, const Metric *>> series;
+    for (const auto &shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      for (const auto &entry : shard.series) {
+        series.emplace_back(entry.first, entry.second.get());
+      }
+    }
+    std::sort(series.begin(), series.end(),
+              [](const auto &left, const auto &right) { return left.first < right.first; });
+    return series;
+  }
+
+ private:
+  struct Shard {
+    mutable std::mutex mutex;
+    std::map<std::string, std::unique_ptr<Metric>, std::less<>> series;
+  };
+
+  Metric *Lookup(std::string_view key, bool past_cap) {
+    auto &shard = shards_[std::hash<std::string_view>{}(key) % kShardCount];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (auto it = shard.series.find(key); it != shard.series.end()) {
+      return it->second.get();
+    }
+    // Checked without a global lock, so concurrent inserts may overshoot by a few series.
+    if (!past_cap && size_.load(std::memory_order_relaxed) >= max_series_) {
+      return nullptr;
+    }
+    size_.fetch_add(1, std::memory_order_relaxed);
+    auto inserted = shard.series.emplace(std::string(key), std::make_unique<Metric>());
+    return inserted.first->second.get();
+  }
+
+  const std::size_t max_series_;
+  std::atomic<std::size_t> size_{0};
+  std::array<Shard, kShardCount> shards_;
+  Metric sink_;
+};
+
+}  // namespace metrics
+
+#endif  // CONVEYANCERS_MARKETPLACE_METRICS_H
@@ -10,74 +10,135 @@
 namespace persistence {
 namespace {
 
-AccountRecord RowToAccount(const pqxx::row &row) {
+using Column = pqxx::row::size_type;
+
+// Positions of the columns shared by every account projection, resolved once per result.
+struct ProfileColumns {
+  template <typename Source>
+  explicit ProfileColumns(const Source &source)
+      : id(source.column_number("id")),
+        email(source.column_number("email")),
+        role(source.column_number("role")),
+        full_name(source.column_number("full_name")),
+        state(source.column_number("state")),
+        suburb(source.column_number("suburb")),
+        phone(source.column_number("phone")),
+        licence_number(source.column_number("licence_number")),
+        licence_state(source.column_number("licence_state")),
+        verified(source.column_number("verified")),
+        bio(source.column_number("bio")),
+        specialties(source.column_number("specialties")),
+        services(source.column_number("services")) {}
+
+  Column id, email, role, full_name, state, suburb, phone, licence_number, licence_state, verified, bio,
+      specialties, services;
+};
+
+// Reads the columns shared by every account projection; credentials are added by RowToAccount.
+// The data views into row, so it must be built into a record before the result goes away.
+detail::AccountRowData RowToProfileData(const pqxx::row &row, const ProfileColumns &columns) {
   detail::AccountRowData data;
-  data.id = row["id"].c_str();
-  data.email = row["email"].c_str();
-  data.role = row["role"].c_str();
-  data.full_name = row["full_name"].is_null() ? std::string{} : row["full_name"].c_str();
-  data.state = row["state"].is_null() ? std::string{} : row["state"].c_str();
-  data.suburb = row["suburb"].is_null() ? std::string{} : row["suburb"].c_str();
-  data.phone = row["phone"].is_null() ? std::string{} : row["phone"].c_str();
-  data.password_hash = row["password_hash"].c_str();
-  data.password_salt = row["password_salt"].c_str();
-  if (!row["two_factor_secret"].is_null()) {
-    data.two_factor_secret = row["two_factor_secret"].c_str();
-  }
-  if (row.size() > 10) {
-    if (!row["licence_number"].is_null()) {
-      data.licence_number = row["licence_number"].c_str();
-    }
-    if (!row["licence_state"].is_null()) {
-      data.licence_state = row["licence_state"].c_str();
-    }
-    if (!row["verified"].is_null()) {
-      data.verified = row["verified"].as<bool>();
-    }
-    if (!row["bio"].is_null()) {
-      data.biography = row["bio"].c_str();
-    }
-    if (!row["specialties"].is_null()) {
-      data.specialties_json = row["specialties"].c_str();
-    }
-    if (!row["services"].is_null()) {
-      data.services_json = row["services"].c_str();
-    }
+  data.id = Text(row[columns.id]);
+  data.email = Text(row[columns.email]);
+  data.role = Text(row[columns.role]);
+  data.full_name = Text(row[columns.full_name]);
+  data.state = Text(row[columns.state]);
+  data.suburb = Text(row[columns.suburb]);
+  data.phone = Text(row[columns.phone]);
+  data.licence_number = OptionalText(row[columns.licence_number]);
+  data.licence_state = OptionalText(row[columns.licence_state]);
+  if (!row[columns.verified].is_null()) {
+    data.verified = row[columns.verified].as<bool>();
   }
+  data.biography = OptionalText(row[columns.bio]);
+  data.specialties_json = OptionalText(row[columns.specialties]);
+  data.services_json = OptionalText(row[columns.services]);
+  return data;
+}
+
+PublicProfileRecord RowToProfile(const pqxx::row &row, const ProfileColumns &columns) {
+  return detail::BuildPublicProfile(RowToProfileData(row, columns));
+}
+
+PublicProfileRecord RowToProfile(const pqxx::row &row) { return RowToProfile(row, ProfileColumns(row)); }
+
+AccountRecord RowToAccount(const pqxx::row &row) {
+  auto data = RowToProfileData(row, ProfileColumns(row));
+  data.password_hash = Text(row["password_hash"]);
+  data.password_salt = Text(row["password_salt"]);
+  data.two_factor_secret = OptionalText(row["two_factor_secret"]);
   return detail::BuildAccountRecord(data);
 }
 
+constexpr PreparedStatement kInsertUser{
+    "accounts_insert_user",
+    "insert into users(role,email,phone,full_name,state,suburb) values ($1,$2,$3,$4,$5,$6) returning id, role, email, "
+    "full_name, state, suburb, phone"};
+constexpr PreparedStatement kInsertCredentials{
+    "accounts_insert_credentials",
+    "insert into auth_credentials(user_id,password_hash,password_salt,two_factor_secret) values ($1,$2,$3,$4)"};
+constexpr PreparedStatement kInsertProfile{
+    "accounts_insert_profile",
+    "insert into conveyancer_profiles(user_id, licence_number, licence_state, specialties, services, insurance_policy, "
+    "insurance_expiry, bio, verified) values ($1,$2,$3,$4::jsonb,$5::jsonb,$6,$7::date,$8,$9)"};
+constexpr PreparedStatement kFindByEmail{
+    "accounts_find_by_email",
+    "select u.id,u.email,u.role,u.full_name,u.state,u.suburb,u.phone,a.password_hash,a.password_salt,a.two_factor_secret,"
+    "p.specialties,p.services,p.bio,p.licence_number,p.licence_state,p.verified "
+    "from users u join auth_credentials a on a.user_id=u.id "
+    "left join conveyancer_profiles p on p.user_id=u.id where lower(u.email)=lower($1)"};
+constexpr PreparedStatement kEmailExists{"accounts_email_exists",
+                                         "select 1 from users where lower(email)=lower($1) limit 1"};
+constexpr PreparedStatement kFindById{
+    "accounts_find_by_id",
+    "select u.id,u.email,u.role,u.full_name,u.state,u.suburb,u.phone,"
+    "p.specialties,p.services,p.bio,p.licence_number,p.licence_state,p.verified "
+    "from users u left join conveyancer_profiles p on p.user_id=u.id where u.id=$1"};
+constexpr PreparedStatement kSearchConveyancers{
+    "accounts_search_conveyancers",
+    "select u.id,u.email,u.role,u.full_name,u.state,u.suburb,u.phone,"
+    "p.specialties,p.services,p.bio,p.licence_number,p.licence_state,p.verified "
+    "from users u join conveyancer_profiles p on p.user_id=u.id "
+    "where ($1='' or lower(u.state)=lower($1)) and ($2='' or lower(u.full_name) like lower($3) or "
+    "lower(coalesce(p.bio,'')) like lower($3)) order by u.full_name asc limit $4"};
+constexpr PreparedStatement kListConveyancers{
+    "accounts_list_conveyancers",
+    "select u.id,u.email,u.role,u.full_name,u.state,u.suburb,u.phone,"
+    "p.specialties,p.services,p.bio,p.licence_number,p.licence_state,p.verified "
+    "from users u join conveyancer_profiles p on p.user_id=u.id where u.role='conveyancer'"};
+constexpr PreparedStatement kRecordLogin{"accounts_record_login",
+                                         "update auth_credentials set last_login_at = now() where user_id=$1"};
+
+constexpr PreparedStatement kStatements[] = {kInsertUser,  kInsertCredentials,  kInsertProfile,    kFindByEmail,
+                                             kEmailExists, kFindById,           kSearchConveyancers, kListConveyancers,
+                                             kRecordLogin};
+
 }  // namespace
 
 AccountsRepository::AccountsRepository(std::shared_ptr<PostgresConfig> config)
-    : config_(std::move(config)) {}
+    : config_(std::move(config)) {
+  config_->RegisterStatements(kStatements);
+}
 
 AccountRecord AccountsRepository::CreateAccount(const AccountRegistrationInput &input) {
-  pqxx::connection conn = config_->Connect();
-  pqxx::work txn(conn);
+  auto conn = config_->Acquire();
+  pqxx::work txn(*conn);
 
-  const auto user_row = txn.exec_params1(
-      "insert into users(role,email,phone,full_name,state,suburb) values ($1,$2,$3,$4,$5,$6) returning id, role, email, "
-      "full_name, state, suburb, phone",
-      input.role, input.email, input.phone, input.full_name, input.state, input.suburb);
+  const auto user_row = Exec1(txn, kInsertUser, input.role, input.email, input.phone,
+                              input.full_name, input.state, input.suburb);
   const std::string user_id = user_row["id"].c_str();
 
-  txn.exec_params(
-      "insert into auth_credentials(user_id,password_hash,password_salt,two_factor_secret) values ($1,$2,$3,$4)",
-      user_id, input.password_hash, input.password_salt,
-      input.two_factor_secret.empty() ? nullptr : input.two_factor_secret.c_str());
+  Exec(txn, kInsertCredentials, user_id, input.password_hash, input.password_salt,
+       input.two_factor_secret.empty() ? nullptr : input.two_factor_secret.c_str());
 
   if (input.role == "conveyancer") {
-    txn.exec_params(
-        "insert into conveyancer_profiles(user_id, licence_number, licence_state, specialties, services, insurance_policy, "
-        "insurance_expiry, bio, verified) values ($1,$2,$3,$4::jsonb,$5::jsonb,$6,$7::date,$8,$9)",
-        user_id,
-        input.licence_number.empty() ? nullptr : input.licence_number.c_str(),
-        input.licence_state.empty() ? nullptr : input.licence_state.c_str(),
-        detail::SerializeStringArray(input.specialties), detail::SerializeStringArray(input.services),
-        input.insurance_policy.empty() ? nullptr : input.insurance_policy.c_str(),
-        input.insurance_expiry.empty() ? nullptr : input.insurance_expiry.c_str(),
-        input.biography.empty() ? nullptr : input.biography.c_str(), input.verified);
+    Exec(txn, kInsertProfile, user_id,
+         input.licence_number.empty() ? nullptr : input.licence_number.c_str(),
+         input.licence_state.empty() ? nullptr : input.licence_state.c_str(),
+         detail::SerializeStringArray(input.specialties), detail::SerializeStringArray(input.services),
+         input.insurance_policy.empty() ? nullptr : input.insurance_policy.c_str(),
+         input.insurance_expiry.empty() ? nullptr : input.insurance_expiry.c_str(),
+         input.biography.empty() ? nullptr : input.biography.c_str(), input.verified);
   }
 
   txn.commit();
@@ -103,60 +164,70 @@ AccountRecord AccountsRepository::CreateAccount(const AccountRegistrationInput &
 }
 
 std::optional<AccountRecord> AccountsRepository::FindByEmail(const std::string &email) const {
-  pqxx::connection conn = config_->Connect();
-  pqxx::work txn(conn);
-  const auto result = txn.exec_params(
-      "select u.id,u.email,u.role,u.full_name,u.state,u.suburb,u.phone,a.password_hash,a.password_salt,a.two_factor_secret,"
-      "p.specialties,p.services,p.bio,p.licence_number,p.licence_state,p.verified "
-      "from users u join auth_credentials a on a.user_id=u.id "
-      "left join conveyancer_profiles p on p.user_id=u.id where lower(u.email)=lower($1)",
-      email);
+  auto conn = config_->AcquireRead(ReadRoute::kPrimary);
+  pqxx::work txn(*conn);
+  const auto result = Exec(txn, kFindByEmail, email);
   if (result.empty()) {
     return std::nullopt;
   }
   return RowToAccount(result[0]);
 }
 
-std::optional<AccountRecord> AccountsRepository::FindById(const std::string &id) const {
-  pqxx::connection conn = config_->Connect();
-  pqxx::work txn(conn);
-  const auto result = txn.exec_params(
-      "select u.id,u.email,u.role,u.full_name,u.state,u.suburb,u.phone,a.password_hash,a.password_salt,a.two_factor_secret,"
-      "p.specialties,p.services,p.bio,p.licence_number,p.licence_state,p.verified "
-      "from users u join auth_credentials a on a.user_id=u.id left join conveyancer_profiles p on p.user_id=u.id "
-      "where u.id=$1",
-      id);
+bool AccountsRepository::EmailExists(const std::string &email) const {
+  auto conn = config_->AcquireRead(ReadRoute::kPrimary);
+  pqxx::work txn(*conn);
+  return !Exec(txn, kEmailExists, email).empty();
+}
+
+std::optional<PublicProfileRecord> AccountsRepository::FindById(const std::string &id) const {
+  auto conn = config_->AcquireRead(ReadRoute::kPrimary);
+  pqxx::work txn(*conn);
+  const auto result = Exec(txn, kFindById, id);
   if (result.empty()) {
     return std::nullopt;
   }
-  return RowToAccount(result[0]);
+  return RowToProfile(result[0]);
 }
 
-std::vector<AccountRecord> AccountsRepository::SearchConveyancers(const std::string &state,
-                                                                  const std::string &query,
-                                                                  int limit) const {
-  pqxx::connection conn = config_->Connect();
-  pqxx::work txn(conn);
+std::vector<PublicProfileRecord> AccountsRepository::SearchConveyancers(const std::string &state,
+                                                                        const std::string &query,
+                                                                        int limit) const {
+  auto conn = config_->AcquireRead(ReadRoute::kReplica);
+  pqxx::read_transaction txn(*conn);
   const std::string like_query = "%" + query + "%";
-  const auto result = txn.exec_params(
-      "select u.id,u.email,u.role,u.full_name,u.state,u.suburb,u.phone,a.password_hash,a.password_salt,a.two_factor_secret,"
-      "p.specialties,p.services,p.bio,p.licence_number,p.licence_state,p.verified "
-      "from users u join conveyancer_profiles p on p.user_id=u.id join auth_credentials a on a.user_id=u.id "
-      "where ($1='' or lower(u.state)=lower($1)) and ($2='' or lower(u.full_name) like lower($3) or "
-      "lower(coalesce(p.bio,'')) like lower($3)) order by u.full_name asc limit $4",
-      state, query, like_query, limit);
-  std::vector<AccountRecord> accounts;
+  const auto result = Exec(txn, kSearchConveyancers, state, query, like_query, limit);
+  std::vector<PublicProfileRecord> accounts;
   accounts.reserve(result.size());
+  if (result.empty()) {
+    return accounts;
+  }
+  const ProfileColumns columns(result);
+  for (const auto &row : result) {
+    accounts.push_back(RowToProfile(row, columns));
+  }
+  return accounts;
+}
+
+std::vector<PublicProfileRecord> AccountsRepository::ListConveyancers() const {
+  auto conn = config_->AcquireRead(ReadRoute::kReplica);
+  pqxx::read_transaction txn(*conn);
+  const auto result = Exec(txn, kListConveyancers);
+  std::vector<PublicProfileRecord> accounts;
+  accounts.reserve(result.size());
+  if (result.empty()) {
+    return accounts;
+  }
+  const ProfileColumns columns(result);
   for (const auto &row : result) {
-    accounts.push_back(RowToAccount(row));
+    accounts.push_back(RowToProfile(row, columns));
   }
   return accounts;
 }
 
 void AccountsRepository::RecordLogin(const std::string &account_id) const {
-  pqxx::connection conn = config_->Connect();
-  pqxx::work txn(conn);
-  txn.exec_params("update auth_credentials set last_login_at = now() where user_id=$1", account_id);
+  auto conn = config_->Acquire();
+  pqxx::work txn(*conn);
+  Exec(txn, kRecordLogin, account_id);
   txn.commit();
 }
 
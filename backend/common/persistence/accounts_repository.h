@@ -10,7 +10,9 @@ namespace persistence {
 
 class PostgresConfig;
 
-struct AccountRecord {
+// Fields that may be shown to other users. Search and profile lookups return only this
+// projection and never read auth_credentials.
+struct PublicProfileRecord {
   std::string id;
   std::string email;
   std::string role;
@@ -18,9 +20,6 @@ struct AccountRecord {
   std::string state;
   std::string suburb;
   std::string phone;
-  std::string password_hash;
-  std::string password_salt;
-  std::string two_factor_secret;
   std::vector<std::string> services;
   std::vector<std::string> specialties;
   std::string biography;
@@ -29,6 +28,13 @@ struct AccountRecord {
   bool verified = false;
 };
 
+// Profile plus credentials, for login and registration only.
+struct AccountRecord : PublicProfileRecord {
+  std::string password_hash;
+  std::string password_salt;
+  std::string two_factor_secret;
+};
+
 struct AccountRegistrationInput {
   std::string email;
   std::string password_hash;
@@ -55,9 +61,12 @@ class AccountsRepository {
 
   AccountRecord CreateAccount(const AccountRegistrationInput &input);
   std::optional<AccountRecord> FindByEmail(const std::string &email) const;
-  std::optional<AccountRecord> FindById(const std::string &id) const;
-  std::vector<AccountRecord> SearchConveyancers(const std::string &state, const std::string &query,
-                                                int limit) const;
+  bool EmailExists(const std::string &email) const;
+  std::optional<PublicProfileRecord> FindById(const std::string &id) const;
+  std::vector<PublicProfileRecord> SearchConveyancers(const std::string &state, const std::string &query,
+                                                      int limit) const;
+  // Every conveyancer profile, for seeding the identity service's in-memory search index.
+  std::vector<PublicProfileRecord> ListConveyancers() const;
   void RecordLogin(const std::string &account_id) const;
 
  private:
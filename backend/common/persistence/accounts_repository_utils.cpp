@@ -1,11 +1,13 @@
 #include "accounts_repository_utils.h"
 
+#include <algorithm>
+
 #include <nlohmann/json.hpp>
 
 namespace persistence::detail {
 
-AccountRecord BuildAccountRecord(const AccountRowData &data) {
-  AccountRecord record;
+PublicProfileRecord BuildPublicProfile(const AccountRowData &data) {
+  PublicProfileRecord record;
   record.id = data.id;
   record.email = data.email;
   record.role = data.role;
@@ -13,27 +15,92 @@ AccountRecord BuildAccountRecord(const AccountRowData &data) {
   record.state = data.state;
   record.suburb = data.suburb;
   record.phone = data.phone;
-  record.password_hash = data.password_hash;
-  record.password_salt = data.password_salt;
-  record.two_factor_secret = data.two_factor_secret.value_or("");
-  record.biography = data.biography.value_or("");
-  record.licence_number = data.licence_number.value_or("");
-  record.licence_state = data.licence_state.value_or("");
+  record.biography = data.biography.value_or(std::string_view{});
+  record.licence_number = data.licence_number.value_or(std::string_view{});
+  record.licence_state = data.licence_state.value_or(std::string_view{});
   record.verified = data.verified.value_or(false);
   record.specialties = ParseStringArray(data.specialties_json);
   record.services = ParseStringArray(data.services_json);
   return record;
 }
 
+AccountRecord BuildAccountRecord(const AccountRowData &data) {
+  AccountRecord record;
+  static_cast<PublicProfileRecord &>(record) = BuildPublicProfile(data);
+  record.password_hash = data.password_hash;
+  record.password_salt = data.password_salt;
+  record.two_factor_secret = data.two_factor_secret.value_or(std::string_view{});
+  return record;
+}
+
 std::string SerializeStringArray(const std::vector<std::string> &values) {
   nlohmann::json json_array = values;
   return json_array.dump();
 }
 
-std::vector<std::string> ParseStringArray(const std::optional<std::string> &json_payload) {
+namespace {
+
+// Postgres renders these jsonb columns as e.g. ["residential", "off-the-plan"]. Strings without
+// escapes are copied straight out of the text; anything else returns false so the caller can
+// fall back to a full parse.
+bool ScanPlainStringArray(std::string_view text, std::vector<std::string> &values) {
+  std::size_t i = 0;
+  const auto skip_space = [&text, &i]() {
+    while (i < text.size() && (text[i] == ' ' || text[i] == '\t' || text[i] == '\n' || text[i] == '\r')) {
+      ++i;
+    }
+  };
+  const auto closed = [&text, &i, &skip_space]() {
+    ++i;
+    skip_space();
+    return i == text.size();
+  };
+  skip_space();
+  if (i == text.size() || text[i] != '[') {
+    return false;
+  }
+  ++i;
+  skip_space();
+  if (i < text.size() && text[i] == ']') {
+    return closed();
+  }
+  values.reserve(static_cast<std::size_t>(std::count(text.begin(), text.end(), ',')) + 1);
+  while (i < text.size() && text[i] == '"') {
+    const std::size_t begin = i + 1;
+    for (i = begin; i < text.size() && text[i] != '"'; ++i) {
+      if (text[i] == '\\' || static_cast<unsigned char>(text[i]) < 0x20) {
+        return false;
+      }
+    }
+    if (i == text.size()) {
+      return false;
+    }
+    values.emplace_back(text.substr(begin, i - begin));
+    ++i;
+    skip_space();
+    if (i < text.size() && text[i] == ']') {
+      return closed();
+    }
+    if (i == text.size() || text[i] != ',') {
+      return false;
+    }
+    ++i;
+    skip_space();
+  }
+  return false;
+}
+
+}  // namespace
+
+std::vector<std::string> ParseStringArray(const std::optional<std::string_view> &json_payload) {
   if (!json_payload.has_value() || json_payload->empty()) {
     return {};
   }
+  std::vector<std::string> values;
+  if (ScanPlainStringArray(*json_payload, values)) {
+    return values;
+  }
+  values.clear();
   nlohmann::json parsed;
   try {
     parsed = nlohmann::json::parse(*json_payload);
@@ -43,7 +110,6 @@ std::vector<std::string> ParseStringArray(const std::optional<std::string> &json
   if (!parsed.is_array()) {
     return {};
   }
-  std::vector<std::string> values;
   values.reserve(parsed.size());
   for (const auto &item : parsed) {
     if (item.is_string()) {
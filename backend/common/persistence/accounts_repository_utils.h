@@ -3,35 +3,39 @@
 
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "accounts_repository.h"
 
 namespace persistence::detail {
 
+// Views into the pqxx::result being decoded; the Build functions copy what they keep.
 struct AccountRowData {
-  std::string id;
-  std::string email;
-  std::string role;
-  std::string full_name;
-  std::string state;
-  std::string suburb;
-  std::string phone;
-  std::string password_hash;
-  std::string password_salt;
-  std::optional<std::string> two_factor_secret;
-  std::optional<std::string> licence_number;
-  std::optional<std::string> licence_state;
-  std::optional<std::string> biography;
-  std::optional<std::string> specialties_json;
-  std::optional<std::string> services_json;
+  std::string_view id;
+  std::string_view email;
+  std::string_view role;
+  std::string_view full_name;
+  std::string_view state;
+  std::string_view suburb;
+  std::string_view phone;
+  std::string_view password_hash;
+  std::string_view password_salt;
+  std::optional<std::string_view> two_factor_secret;
+  std::optional<std::string_view> licence_number;
+  std::optional<std::string_view> licence_state;
+  std::optional<std::string_view> biography;
+  std::optional<std::string_view> specialties_json;
+  std::optional<std::string_view> services_json;
   std::optional<bool> verified;
 };
 
+PublicProfileRecord BuildPublicProfile(const AccountRowData &data);
 AccountRecord BuildAccountRecord(const AccountRowData &data);
 
 std::string SerializeStringArray(const std::vector<std::string> &values);
-std::vector<std::string> ParseStringArray(const std::optional<std::string> &json_payload);
+// Reads a JSON array of strings, skipping other elements; malformed input yields an empty list.
+std::vector<std::string> ParseStringArray(const std::optional<std::string_view> &json_payload);
 
 }  // namespace persistence::detail
 
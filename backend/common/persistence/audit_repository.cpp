@@ -2,18 +2,57 @@
 
 
 namespace persistence {
+namespace {
+
+constexpr PreparedStatement kRecordEvent{
+    "audit_record_event",
+    "insert into audit_logs(actor, action, subject, details, ip) values ($1,$2,$3,$4::jsonb,$5)"};
+
+// $1 is a JSON array in the detail::AuditEventToJson shape; ordinality keeps ids in batch order.
+// created_at is the time the event was recorded, not the time its batch reached the database.
+constexpr PreparedStatement kRecordEvents{
+    "audit_record_events",
+    "insert into audit_logs(actor, action, subject, details, ip, created_at) "
+    "select (e->>'actor')::uuid, e->>'action', e->>'subject', e->'details', e->>'ip', "
+    "coalesce((e->>'occurred_at')::timestamptz, now()) "
+    "from jsonb_array_elements($1::jsonb) with ordinality as batch(e, n) order by n"};
+
+constexpr PreparedStatement kStatements[] = {kRecordEvent, kRecordEvents};
+
+}  // namespace
 
 AuditRepository::AuditRepository(std::shared_ptr<PostgresConfig> config)
-    : config_(std::move(config)) {}
+    : config_(std::move(config)) {
+  config_->RegisterStatements(kStatements);
+}
 
 void AuditRepository::RecordEvent(const std::string &actor_id, const std::string &action,
                                   const std::string &subject, const nlohmann::json &details,
                                   const std::string &ip_address) const {
-  pqxx::connection conn = config_->Connect();
-  pqxx::work txn(conn);
-  txn.exec_params("insert into audit_logs(actor, action, subject, details, ip) values ($1,$2,$3,$4::jsonb,$5)",
-                  actor_id.empty() ? nullptr : actor_id.c_str(), action, subject,
-                  details.dump(), ip_address.empty() ? nullptr : ip_address.c_str());
+  auto conn = config_->Acquire();
+  pqxx::work txn(*conn);
+  Exec(txn, kRecordEvent, actor_id.empty() ? nullptr : actor_id.c_str(), action, subject,
+       details.dump(), ip_address.empty() ? nullptr : ip_address.c_str());
+  txn.commit();
+}
+
+void AuditRepository::RecordEvents(const std::vector<AuditEvent> &events) const {
+  if (events.empty()) {
+    return;
+  }
+  nlohmann::json batch = nlohmann::json::array();
+  for (const auto &event : events) {
+    batch.push_back(detail::AuditEventToJson(event));
+  }
+  auto conn = config_->Acquire();
+  pqxx::work txn(*conn);
+  try {
+    Exec(txn, kRecordEvents, batch.dump());
+  } catch (const pqxx::data_exception &ex) {
+    throw RejectedAuditEvent(ex.what());
+  } catch (const pqxx::integrity_constraint_violation &ex) {
+    throw RejectedAuditEvent(ex.what());
+  }
   txn.commit();
 }
 
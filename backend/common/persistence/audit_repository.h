@@ -5,7 +5,9 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
+#include "audit_writer.h"
 #include "postgres.h"
 
 namespace persistence {
@@ -16,6 +18,9 @@ class AuditRepository {
 
   void RecordEvent(const std::string &actor_id, const std::string &action, const std::string &subject,
                    const nlohmann::json &details, const std::string &ip_address = {}) const;
+  // Inserts the whole batch with one statement in one transaction. Throws RejectedAuditEvent
+  // when the database refuses the data itself (a malformed actor uuid, say).
+  void RecordEvents(const std::vector<AuditEvent> &events) const;
 
  private:
   std::shared_ptr<PostgresConfig> config_;
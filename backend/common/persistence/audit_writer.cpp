@@ -0,0 +1,332 @@
+#include "audit_writer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <utility>
+
+#include "../codec.h"
+#include "../logger.h"
+
+namespace persistence {
+namespace detail {
+
+nlohmann::json AuditEventToJson(const AuditEvent &event) {
+  nlohmann::json value{{"action", event.action}, {"subject", event.subject}, {"details", event.details}};
+  value["actor"] = event.actor_id.empty() ? nlohmann::json() : nlohmann::json(event.actor_id);
+  value["ip"] = event.ip_address.empty() ? nlohmann::json() : nlohmann::json(event.ip_address);
+  value["occurred_at"] = event.occurred_at.empty() ? nlohmann::json() : nlohmann::json(event.occurred_at);
+  return value;
+}
+
+AuditEvent AuditEventFromJson(const nlohmann::json &value) {
+  AuditEvent event;
+  if (value.contains("actor") && value["actor"].is_string()) {
+    event.actor_id = value["actor"].get<std::string>();
+  }
+  event.action = value.value("action", "");
+  event.subject = value.value("subject", "");
+  event.details = value.contains("details") ? value["details"] : nlohmann::json::object();
+  if (value.contains("ip") && value["ip"].is_string()) {
+    event.ip_address = value["ip"].get<std::string>();
+  }
+  if (value.contains("occurred_at") && value["occurred_at"].is_string()) {
+    event.occurred_at = value["occurred_at"].get<std::string>();
+  }
+  return event;
+}
+
+}  // namespace detail
+
+namespace {
+
+std::filesystem::path ReplayPath(const std::filesystem::path &spill_path) {
+  auto path = spill_path;
+  path += ".replay";
+  return path;
+}
+
+}  // namespace
+
+AuditWriterOptions MakeAuditWriterOptionsFromEnv(std::string_view service) {
+  using logging::detail::EnvInteger;
+  AuditWriterOptions options;
+  options.service = std::string(service);
+  options.batch_size = static_cast<std::size_t>(EnvInteger("AUDIT_BATCH_SIZE", options.batch_size));
+  options.max_latency = std::chrono::milliseconds(EnvInteger("AUDIT_FLUSH_INTERVAL_MS", options.max_latency.count()));
+  options.queue_limit = static_cast<std::size_t>(EnvInteger("AUDIT_QUEUE_LIMIT", options.queue_limit));
+  if (const char *path = std::getenv("AUDIT_SPILL_PATH"); path && *path) {
+    options.spill_path = path;
+  } else {
+    options.spill_path = logging::detail::LogDirectoryPath() / (std::string(service) + "-audit.spill");
+  }
+  if (options.batch_size == 0) {
+    options.batch_size = 1;
+  }
+  return options;
+}
+
+AsyncAuditWriter::AsyncAuditWriter(Sink sink, AuditWriterOptions options)
+    : sink_(std::move(sink)), options_(std::move(options)) {
+  if (!options_.spill_path.empty()) {
+    std::error_code ec;
+    spill_pending_ =
+        std::filesystem::exists(options_.spill_path, ec) || std::filesystem::exists(ReplayPath(options_.spill_path), ec);
+  }
+  queue_.reserve(options_.batch_size);
+  worker_ = std::thread([this]() { Run(); });
+}
+
+AsyncAuditWriter::~AsyncAuditWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  ready_.notify_all();
+  worker_.join();
+}
+
+void AsyncAuditWriter::RecordEvent(const std::string &actor_id, const std::string &action,
+                                   const std::string &subject, const nlohmann::json &details,
+                                   const std::string &ip_address) {
+  Record(AuditEvent{actor_id, action, subject, details, ip_address, {}});
+}
+
+void AsyncAuditWriter::Record(AuditEvent event) {
+  if (event.occurred_at.empty()) {
+    event.occurred_at = logging::detail::TimestampNow();
+  }
+  // The actor column is a uuid; keep anything else in the details rather than fail the insert.
+  if (!event.actor_id.empty() && !codec::IsUuid(event.actor_id) &&
+      (event.details.is_null() || event.details.is_object())) {
+    event.details["unverifiedActor"] = std::move(event.actor_id);
+    event.actor_id.clear();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queue_.size() < options_.queue_limit) {
+      queue_.push_back(std::move(event));
+      if (queue_.size() == 1 || queue_.size() >= options_.batch_size) {
+        ready_.notify_one();
+      }
+      return;
+    }
+  }
+  const std::vector<AuditEvent> overflow{std::move(event)};
+  Spill(overflow.begin(), overflow.end());
+}
+
+std::size_t AsyncAuditWriter::QueueDepth() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return queue_.size();
+}
+
+std::string AsyncAuditWriter::RenderMetrics(std::string_view service) const {
+  std::ostringstream labels;
+  labels << "service=\"" << service << '"';
+  std::ostringstream oss;
+  oss << "# HELP audit_events_total Audit events by outcome" << '\n';
+  oss << "# TYPE audit_events_total counter" << '\n';
+  oss << "audit_events_total{" << labels.str() << ",outcome=\"written\"} " << written_.Value() << '\n';
+  oss << "audit_events_total{" << labels.str() << ",outcome=\"spilled\"} " << spilled_.Value() << '\n';
+  oss << "audit_events_total{" << labels.str() << ",outcome=\"replayed\"} " << replayed_.Value() << '\n';
+  oss << "audit_events_total{" << labels.str() << ",outcome=\"dropped\"} " << dropped_.Value() << '\n';
+  oss << "audit_events_total{" << labels.str() << ",outcome=\"rejected\"} " << rejected_.Value() << '\n';
+  oss << "# HELP audit_queue_depth Audit events waiting to be written" << '\n';
+  oss << "# TYPE audit_queue_depth gauge" << '\n';
+  oss << "audit_queue_depth{" << labels.str() << "} " << QueueDepth() << '\n';
+  oss << "# HELP audit_flush_seconds Time spent writing one audit batch" << '\n';
+  oss << "# TYPE audit_flush_seconds histogram" << '\n';
+  metrics::WriteHistogram(oss, "audit_flush_seconds", labels.str(), flush_duration_.Collect());
+  return oss.str();
+}
+
+void AsyncAuditWriter::Run() {
+  std::vector<AuditEvent> batch;
+  batch.reserve(options_.batch_size);
+  while (true) {
+    bool done = false;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      const auto has_work = [this]() { return stopping_ || !queue_.empty(); };
+      if (!has_work()) {
+        bool pending = false;
+        {
+          std::lock_guard<std::mutex> spill_lock(spill_mutex_);
+          pending = spill_pending_;
+        }
+        // With a spill outstanding, wake periodically to replay it even if nothing new arrives.
+        if (pending) {
+          ready_.wait_for(lock, options_.retry_interval, has_work);
+        } else {
+          ready_.wait(lock, has_work);
+        }
+      }
+      if (!stopping_ && !queue_.empty() && queue_.size() < options_.batch_size) {
+        ready_.wait_for(lock, options_.max_latency,
+                        [this]() { return stopping_ || queue_.size() >= options_.batch_size; });
+      }
+      const std::size_t count = std::min(queue_.size(), options_.batch_size);
+      batch.assign(std::make_move_iterator(queue_.begin()), std::make_move_iterator(queue_.begin() + count));
+      queue_.erase(queue_.begin(), queue_.begin() + count);
+      done = stopping_ && queue_.empty();
+    }
+    Flush(batch);
+    batch.clear();
+    if (done) {
+      return;
+    }
+  }
+}
+
+bool AsyncAuditWriter::Flush(const std::vector<AuditEvent> &batch) {
+  bool pending = false;
+  {
+    std::lock_guard<std::mutex> lock(spill_mutex_);
+    pending = spill_pending_ && std::chrono::steady_clock::now() >= next_retry_;
+  }
+  if (pending) {
+    ReplaySpill();
+  }
+  if (batch.empty()) {
+    return true;
+  }
+  {
+    // Until the backlog is replayed, new events queue up behind it on disk.
+    std::lock_guard<std::mutex> lock(spill_mutex_);
+    pending = spill_pending_ && std::chrono::steady_clock::now() < next_retry_;
+  }
+  if (pending) {
+    Spill(batch.begin(), batch.end());
+    return false;
+  }
+  const auto started = std::chrono::steady_clock::now();
+  const std::size_t handled = Write(batch, written_, "audit_flush_failed");
+  if (handled < batch.size()) {
+    Spill(batch.begin() + static_cast<std::ptrdiff_t>(handled), batch.end());
+    return false;
+  }
+  flush_duration_.Observe(std::chrono::steady_clock::now() - started);
+  return true;
+}
+
+std::size_t AsyncAuditWriter::Write(const std::vector<AuditEvent> &events, metrics::Counter &accepted,
+                                    const char *failure_event) {
+  auto &logger = logging::ServiceLogger::Instance(options_.service);
+  const auto reject = [&](const AuditEvent &event, const RejectedAuditEvent &ex) {
+    logger.Error("audit_event_rejected", event.action + " " + event.subject + ": " + ex.what());
+    rejected_.Add(1);
+  };
+  try {
+    sink_(events);
+    accepted.Add(events.size());
+    return events.size();
+  } catch (const RejectedAuditEvent &ex) {
+    if (events.size() == 1) {
+      reject(events.front(), ex);
+      return 1;
+    }
+    logger.Warn(failure_event, ex.what());
+  } catch (const std::exception &ex) {
+    logger.Warn(failure_event, ex.what());
+    if (events.size() == 1) {
+      return 0;
+    }
+  }
+  // A single bad event fails the whole batch insert, so find it by writing the events one by one.
+  std::size_t handled = 0;
+  std::vector<AuditEvent> single(1);
+  for (const auto &event : events) {
+    single.front() = event;
+    try {
+      sink_(single);
+      accepted.Add(1);
+    } catch (const RejectedAuditEvent &ex) {
+      reject(event, ex);
+    } catch (const std::exception &ex) {
+      logger.Warn(failure_event, ex.what());
+      break;
+    }
+    ++handled;
+  }
+  return handled;
+}
+
+bool AsyncAuditWriter::ReplaySpill() {
+  if (options_.spill_path.empty()) {
+    return true;
+  }
+  const auto replay_path = ReplayPath(options_.spill_path);
+  {
+    std::lock_guard<std::mutex> lock(spill_mutex_);
+    std::error_code ec;
+    // A replay file left by a crash is finished first; the spill file waits for the next pass.
+    if (!std::filesystem::exists(replay_path, ec)) {
+      std::filesystem::rename(options_.spill_path, replay_path, ec);
+      if (ec) {
+        spill_pending_ = false;
+        return true;
+      }
+    }
+    spill_pending_ = std::filesystem::exists(options_.spill_path, ec);
+  }
+
+  std::vector<AuditEvent> events;
+  {
+    std::ifstream in(replay_path);
+    std::string line;
+    while (std::getline(in, line)) {
+      if (line.empty()) {
+        continue;
+      }
+      try {
+        events.push_back(detail::AuditEventFromJson(nlohmann::json::parse(line)));
+      } catch (const std::exception &ex) {
+        logging::ServiceLogger::Instance(options_.service).Warn("audit_spill_corrupt", ex.what());
+      }
+    }
+  }
+
+  std::size_t offset = 0;
+  while (offset < events.size()) {
+    const std::size_t end = std::min(events.size(), offset + options_.batch_size);
+    const std::vector<AuditEvent> chunk(events.begin() + offset, events.begin() + end);
+    const std::size_t handled = Write(chunk, replayed_, "audit_replay_failed");
+    offset += handled;
+    if (handled < chunk.size()) {
+      Spill(events.begin() + offset, events.end());
+      break;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::remove(replay_path, ec);
+  return offset == events.size();
+}
+
+void AsyncAuditWriter::Spill(std::vector<AuditEvent>::const_iterator begin,
+                             std::vector<AuditEvent>::const_iterator end) {
+  const auto count = static_cast<std::size_t>(std::distance(begin, end));
+  if (count == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(spill_mutex_);
+  next_retry_ = std::chrono::steady_clock::now() + options_.retry_interval;
+  if (options_.spill_path.empty()) {
+    dropped_.Add(count);
+    return;
+  }
+  std::ofstream out(options_.spill_path, std::ios::app);
+  for (auto it = begin; it != end; ++it) {
+    out << detail::AuditEventToJson(*it).dump() << '\n';
+  }
+  out.flush();
+  if (!out) {
+    logging::ServiceLogger::Instance(options_.service).Error("audit_spill_failed", options_.spill_path.string());
+    dropped_.Add(count);
+    return;
+  }
+  spill_pending_ = true;
+  spilled_.Add(count);
+}
+
+}  // namespace persistence
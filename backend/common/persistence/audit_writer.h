@@ -0,0 +1,126 @@
+#ifndef CONVEYANCERS_MARKETPLACE_PERSISTENCE_AUDIT_WRITER_H
+#define CONVEYANCERS_MARKETPLACE_PERSISTENCE_AUDIT_WRITER_H
+
+#include <nlohmann/json.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "../metrics.h"
+
+namespace persistence {
+
+struct AuditEvent {
+  std::string actor_id;
+  std::string action;
+  std::string subject;
+  nlohmann::json details;
+  std::string ip_address;
+  // UTC time the handler recorded the event; written as the row's created_at so batching and
+  // spill replays do not shift it. Filled in by AsyncAuditWriter::Record() when empty.
+  std::string occurred_at;
+};
+
+// Thrown by a sink for an event the database will never accept (bad data rather than an
+// outage). The writer drops such events instead of spilling and retrying them.
+class RejectedAuditEvent : public std::runtime_error {
+ public:
+  using std::runtime_error::runtime_error;
+};
+
+namespace detail {
+
+// Wire shape shared by the batch insert and the spill file; empty actor, ip and occurred_at
+// become null.
+nlohmann::json AuditEventToJson(const AuditEvent &event);
+AuditEvent AuditEventFromJson(const nlohmann::json &value);
+
+}  // namespace detail
+
+struct AuditWriterOptions {
+  // Service whose log receives flush and spill failures.
+  std::string service = "audit";
+  std::size_t batch_size = 256;
+  std::chrono::milliseconds max_latency{250};
+  std::size_t queue_limit = 10000;
+  // Batches that cannot be written are appended here as JSON lines and replayed once the
+  // database accepts writes again.
+  std::filesystem::path spill_path;
+  std::chrono::milliseconds retry_interval{std::chrono::seconds(2)};
+};
+
+// AUDIT_BATCH_SIZE, AUDIT_FLUSH_INTERVAL_MS, AUDIT_QUEUE_LIMIT and AUDIT_SPILL_PATH override the
+// defaults; the spill file defaults to <LOG_DIRECTORY>/<service>-audit.spill.
+AuditWriterOptions MakeAuditWriterOptionsFromEnv(std::string_view service);
+
+// Takes audit writes off the request path. RecordEvent() queues the event; a background
+// thread hands the sink batches of up to batch_size events, waiting at most max_latency
+// after the first queued event. When the sink throws, or the queue is full, events go to
+// the spill file instead of being dropped. A failed batch is retried one event at a time so
+// a single event the sink rejects cannot hold back the rest.
+class AsyncAuditWriter {
+ public:
+  using Sink = std::function<void(const std::vector<AuditEvent> &events)>;
+
+  AsyncAuditWriter(Sink sink, AuditWriterOptions options);
+  // Flushes whatever is still queued before returning.
+  ~AsyncAuditWriter();
+
+  AsyncAuditWriter(const AsyncAuditWriter &) = delete;
+  AsyncAuditWriter &operator=(const AsyncAuditWriter &) = delete;
+
+  // Same signature as AuditRepository::RecordEvent so handlers do not change.
+  void RecordEvent(const std::string &actor_id, const std::string &action, const std::string &subject,
+                   const nlohmann::json &details, const std::string &ip_address = {});
+  void Record(AuditEvent event);
+
+  std::size_t QueueDepth() const;
+  std::string RenderMetrics(std::string_view service) const;
+
+ private:
+  void Run();
+  // Replays the spill file when due, then writes batch. Returns false if batch was spilled.
+  bool Flush(const std::vector<AuditEvent> &batch);
+  bool ReplaySpill();
+  // Hands events to the sink, falling back to one event at a time when the batch fails and
+  // dropping the events the sink rejects. Returns how many leading events were dealt with;
+  // the rest hit an outage and are left for the caller to spill.
+  std::size_t Write(const std::vector<AuditEvent> &events, metrics::Counter &accepted, const char *failure_event);
+  void Spill(std::vector<AuditEvent>::const_iterator begin, std::vector<AuditEvent>::const_iterator end);
+
+  const Sink sink_;
+  const AuditWriterOptions options_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable ready_;
+  std::vector<AuditEvent> queue_;
+  bool stopping_ = false;
+
+  // Guards the spill file, which both the worker and an overflowing RecordEvent() append to.
+  std::mutex spill_mutex_;
+  bool spill_pending_ = false;
+  std::chrono::steady_clock::time_point next_retry_{};
+
+  std::thread worker_;
+
+  metrics::Counter written_;
+  metrics::Counter spilled_;
+  metrics::Counter replayed_;
+  metrics::Counter dropped_;
+  metrics::Counter rejected_;
+  metrics::Histogram flush_duration_;
+};
+
+}  // namespace persistence
+
+#endif  // CONVEYANCERS_MARKETPLACE_PERSISTENCE_AUDIT_WRITER_H
@@ -4,71 +4,228 @@
 namespace persistence {
 namespace {
 
-EscrowRecord RowToEscrow(const pqxx::row &row) {
+using Column = pqxx::row::size_type;
+
+// Positions of the escrow columns, resolved once per result rather than per field per row.
+struct EscrowColumns {
+  template <typename Source>
+  explicit EscrowColumns(const Source &source)
+      : id(source.column_number("id")),
+        job_id(source.column_number("job_id")),
+        milestone_id(source.column_number("milestone_id")),
+        amount_authorised_cents(source.column_number("amount_authorised_cents")),
+        amount_held_cents(source.column_number("amount_held_cents")),
+        amount_released_cents(source.column_number("amount_released_cents")),
+        provider_ref(source.column_number("provider_ref")),
+        status(source.column_number("status")),
+        created_at(source.column_number("created_at")) {}
+
+  Column id, job_id, milestone_id, amount_authorised_cents, amount_held_cents, amount_released_cents, provider_ref,
+      status, created_at;
+};
+
+int CentsOrZero(const pqxx::field &field) { return field.is_null() ? 0 : field.as<int>(); }
+
+EscrowRecord RowToEscrow(const pqxx::row &row, const EscrowColumns &columns) {
   EscrowRecord record;
-  record.id = row["id"].c_str();
-  record.job_id = row["job_id"].is_null() ? std::string{} : row["job_id"].c_str();
-  record.milestone_id = row["milestone_id"].is_null() ? std::string{} : row["milestone_id"].c_str();
-  record.amount_authorised_cents = row["amount_authorised_cents"].is_null() ? 0 : row["amount_authorised_cents"].as<int>();
-  record.amount_held_cents = row["amount_held_cents"].is_null() ? 0 : row["amount_held_cents"].as<int>();
-  record.amount_released_cents =
-      row["amount_released_cents"].is_null() ? 0 : row["amount_released_cents"].as<int>();
-  record.provider_ref = row["provider_ref"].is_null() ? std::string{} : row["provider_ref"].c_str();
-  record.status = row["status"].is_null() ? std::string{} : row["status"].c_str();
-  record.created_at = row["created_at"].is_null() ? std::string{} : row["created_at"].c_str();
+  record.id = Text(row[columns.id]);
+  record.job_id = Text(row[columns.job_id]);
+  record.milestone_id = Text(row[columns.milestone_id]);
+  record.amount_authorised_cents = CentsOrZero(row[columns.amount_authorised_cents]);
+  record.amount_held_cents = CentsOrZero(row[columns.amount_held_cents]);
+  record.amount_released_cents = CentsOrZero(row[columns.amount_released_cents]);
+  record.provider_ref = Text(row[columns.provider_ref]);
+  record.status = Text(row[columns.status]);
+  record.created_at = Text(row[columns.created_at]);
   return record;
 }
 
+EscrowRecord RowToEscrow(const pqxx::row &row) { return RowToEscrow(row, EscrowColumns(row)); }
+
+constexpr PreparedStatement kCreateEscrow{
+    "escrow_create",
+    "insert into escrow_payments(job_id, milestone_id, amount_authorised_cents, amount_held_cents, provider_ref, status) "
+    "values ($1,$2,$3,$3,$4,$5) returning id, job_id, milestone_id, amount_authorised_cents, amount_held_cents, "
+    "amount_released_cents, provider_ref, status, created_at"};
+// Claims the idempotency key and moves the funds in one statement. The update takes the escrow row lock, and
+// the held-amount guard is re-checked against the locked row, so concurrent releases cannot overdraw it. A
+// second request with the same key waits on the key's unique index, then claims nothing and releases nothing.
+// Always returns one row: "claimed" plus the released escrow, or null escrow columns when nothing moved.
+constexpr PreparedStatement kReleaseFunds{
+    "escrow_release_funds",
+    "with claim as (insert into escrow_release_requests(idempotency_key, escrow_id, job_id, amount_cents) "
+    "select $3, id, job_id, $2 from escrow_payments where id=$1 on conflict (idempotency_key) do nothing "
+    "returning escrow_id), "
+    "released as (update escrow_payments e set amount_released_cents = coalesce(e.amount_released_cents,0) + $2, "
+    "amount_held_cents = coalesce(e.amount_held_cents,0) - $2, status = 'released' from claim "
+    "where e.id = claim.escrow_id and coalesce(e.amount_held_cents,0) >= $2 returning e.id, e.job_id, "
+    "e.milestone_id, e.amount_authorised_cents, e.amount_held_cents, e.amount_released_cents, e.provider_ref, "
+    "e.status, e.created_at) "
+    "select exists(select 1 from claim) as claimed, released.* from (select 1) as one left join released on true"};
+// Read after an unclaimed or unmatched release: the escrow as it stands, and whether the key was spent on this
+// exact release.
+constexpr PreparedStatement kReleaseLookup{
+    "escrow_release_lookup",
+    "select e.id, e.job_id, e.milestone_id, e.amount_authorised_cents, e.amount_held_cents, e.amount_released_cents, "
+    "e.provider_ref, e.status, e.created_at, coalesce(r.escrow_id = e.id and r.amount_cents = $3, false) as replay "
+    "from escrow_payments e left join escrow_release_requests r on r.idempotency_key = $2 where e.id=$1"};
+// Batch settlement for a job. Held rows are locked in id order, so a batch and single releases queue up on
+// the same locks in the same order instead of deadlocking. Returns "claimed" plus one row per released escrow.
+constexpr PreparedStatement kReleaseForJob{
+    "escrow_release_for_job",
+    "with claim as (insert into escrow_release_requests(idempotency_key, job_id) select $2, id from jobs "
+    "where id=$1 on conflict (idempotency_key) do nothing returning job_id), "
+    "held as (select e.id, e.amount_held_cents from escrow_payments e join claim on e.job_id = claim.job_id "
+    "where e.amount_held_cents > 0 order by e.id for update of e), "
+    "released as (update escrow_payments e set amount_released_cents = coalesce(e.amount_released_cents,0) + "
+    "held.amount_held_cents, amount_held_cents = 0, status = 'released' from held where e.id = held.id "
+    "returning e.id, e.job_id, e.milestone_id, e.amount_authorised_cents, e.amount_held_cents, "
+    "e.amount_released_cents, e.provider_ref, e.status, e.created_at, held.amount_held_cents as released_cents) "
+    "select exists(select 1 from claim) as claimed, released.* from (select 1) as one left join released on true "
+    "order by released.created_at desc"};
+// Written in the settling transaction once the released rows are known; a data-modifying CTE cannot update
+// the request row its own claim inserted.
+constexpr PreparedStatement kRecordJobRelease{
+    "escrow_record_job_release",
+    "update escrow_release_requests set amount_cents=$2, released_escrow_ids=$3::uuid[] where idempotency_key=$1"};
+constexpr PreparedStatement kReleaseForJobLookup{
+    "escrow_release_for_job_lookup",
+    "select exists(select 1 from jobs where id=$1) as job_exists, "
+    "exists(select 1 from escrow_release_requests where idempotency_key=$2 and job_id=$1 and escrow_id is null) "
+    "as replay, (select amount_cents from escrow_release_requests where idempotency_key=$2) as released_cents"};
+constexpr PreparedStatement kReleasedForJob{
+    "escrow_released_for_job",
+    "select e.id, e.job_id, e.milestone_id, e.amount_authorised_cents, e.amount_held_cents, e.amount_released_cents, "
+    "e.provider_ref, e.status, e.created_at from escrow_release_requests r "
+    "join escrow_payments e on e.id = any(r.released_escrow_ids) where r.idempotency_key=$1 "
+    "order by e.created_at desc"};
+constexpr PreparedStatement kListForJob{
+    "escrow_list_for_job",
+    "select id, job_id, milestone_id, amount_authorised_cents, amount_held_cents, amount_released_cents, provider_ref, "
+    "status, created_at from escrow_payments where job_id=$1 order by created_at desc"};
+constexpr PreparedStatement kGetById{
+    "escrow_get_by_id",
+    "select id, job_id, milestone_id, amount_authorised_cents, amount_held_cents, amount_released_cents, provider_ref, "
+    "status, created_at from escrow_payments where id=$1"};
+
+constexpr PreparedStatement kStatements[] = {kCreateEscrow,   kReleaseFunds,     kReleaseLookup,
+                                             kReleaseForJob,  kRecordJobRelease, kReleaseForJobLookup,
+                                             kReleasedForJob, kListForJob,       kGetById};
+
 }  // namespace
 
-EscrowRepository::EscrowRepository(std::shared_ptr<PostgresConfig> config) : config_(std::move(config)) {}
+EscrowRepository::EscrowRepository(std::shared_ptr<PostgresConfig> config) : config_(std::move(config)) {
+  config_->RegisterStatements(kStatements);
+}
 
 EscrowRecord EscrowRepository::CreateEscrow(const EscrowCreateInput &input) const {
-  pqxx::connection conn = config_->Connect();
-  pqxx::work txn(conn);
-  const auto row = txn.exec_params1(
-      "insert into escrow_payments(job_id, milestone_id, amount_authorised_cents, amount_held_cents, provider_ref, status) "
-      "values ($1,$2,$3,$3,$4,$5) returning id, job_id, milestone_id, amount_authorised_cents, amount_held_cents, "
-      "amount_released_cents, provider_ref, status, created_at",
-      input.job_id, input.milestone_id.empty() ? nullptr : input.milestone_id.c_str(),
-      input.amount_authorised_cents,
-      input.provider_ref.empty() ? nullptr : input.provider_ref.c_str(), "held");
+  auto conn = config_->Acquire();
+  pqxx::work txn(*conn);
+  const auto row = Exec1(txn, kCreateEscrow, input.job_id,
+                         input.milestone_id.empty() ? nullptr : input.milestone_id.c_str(),
+                         input.amount_authorised_cents,
+                         input.provider_ref.empty() ? nullptr : input.provider_ref.c_str(), "held");
   txn.commit();
   return RowToEscrow(row);
 }
 
-void EscrowRepository::ReleaseFunds(const std::string &escrow_id, int amount_cents) const {
-  pqxx::connection conn = config_->Connect();
-  pqxx::work txn(conn);
-  txn.exec_params(
-      "update escrow_payments set amount_released_cents = coalesce(amount_released_cents,0) + $2, "
-      "amount_held_cents = greatest(coalesce(amount_held_cents,0) - $2, 0), status = 'released' where id=$1",
-      escrow_id, amount_cents);
-  txn.commit();
+EscrowReleaseResult EscrowRepository::ReleaseFunds(const std::string &escrow_id, int amount_cents,
+                                                  const std::string &idempotency_key) const {
+  auto conn = config_->Acquire();
+  pqxx::work txn(*conn);
+  const auto row = Exec1(txn, kReleaseFunds, escrow_id, amount_cents, idempotency_key);
+  EscrowReleaseResult result;
+  if (!row["id"].is_null()) {
+    txn.commit();
+    result.outcome = EscrowReleaseOutcome::kReleased;
+    result.record = RowToEscrow(row);
+    return result;
+  }
+  // Nothing moved. The transaction is left uncommitted, so a key claimed for a release that did not fit
+  // the held amount is rolled back and the client can retry it once funds are held.
+  const bool claimed = row["claimed"].as<bool>();
+  const auto current = Exec(txn, kReleaseLookup, escrow_id, idempotency_key, amount_cents);
+  if (current.empty()) {
+    result.outcome = EscrowReleaseOutcome::kNotFound;
+    return result;
+  }
+  result.record = RowToEscrow(current[0]);
+  if (claimed) {
+    result.outcome = EscrowReleaseOutcome::kInsufficientFunds;
+  } else if (current[0]["replay"].as<bool>()) {
+    result.outcome = EscrowReleaseOutcome::kReplayed;
+  } else {
+    result.outcome = EscrowReleaseOutcome::kKeyReused;
+  }
+  return result;
+}
+
+EscrowBatchReleaseResult EscrowRepository::ReleaseForJob(const std::string &job_id,
+                                                         const std::string &idempotency_key) const {
+  auto conn = config_->Acquire();
+  pqxx::work txn(*conn);
+  const auto released = Exec(txn, kReleaseForJob, job_id, idempotency_key);
+  EscrowBatchReleaseResult result;
+  if (released[0]["claimed"].as<bool>()) {
+    const EscrowColumns columns(released);
+    const auto released_cents = released.column_number("released_cents");
+    std::string released_ids = "{";
+    for (const auto &row : released) {
+      if (row[columns.id].is_null()) {
+        continue;
+      }
+      result.records.push_back(RowToEscrow(row, columns));
+      result.released_cents += row[released_cents].as<int>();
+      if (released_ids.size() > 1) {
+        released_ids += ',';
+      }
+      released_ids += result.records.back().id;
+    }
+    released_ids += '}';
+    Exec(txn, kRecordJobRelease, idempotency_key, result.released_cents, released_ids);
+    txn.commit();
+    return result;
+  }
+  const auto lookup = Exec1(txn, kReleaseForJobLookup, job_id, idempotency_key);
+  if (!lookup["job_exists"].as<bool>()) {
+    result.outcome = EscrowReleaseOutcome::kNotFound;
+  } else if (!lookup["replay"].as<bool>()) {
+    result.outcome = EscrowReleaseOutcome::kKeyReused;
+  } else {
+    result.outcome = EscrowReleaseOutcome::kReplayed;
+    result.released_cents = lookup["released_cents"].is_null() ? 0 : lookup["released_cents"].as<int>();
+    const auto rows = Exec(txn, kReleasedForJob, idempotency_key);
+    result.records.reserve(rows.size());
+    if (!rows.empty()) {
+      const EscrowColumns columns(rows);
+      for (const auto &row : rows) {
+        result.records.push_back(RowToEscrow(row, columns));
+      }
+    }
+  }
+  return result;
 }
 
 std::vector<EscrowRecord> EscrowRepository::ListForJob(const std::string &job_id) const {
-  pqxx::connection conn = config_->Connect();
-  pqxx::work txn(conn);
-  const auto result = txn.exec_params(
-      "select id, job_id, milestone_id, amount_authorised_cents, amount_held_cents, amount_released_cents, provider_ref, "
-      "status, created_at from escrow_payments where job_id=$1 order by created_at desc",
-      job_id);
+  auto conn = config_->AcquireRead(ReadRoute::kReplica);
+  pqxx::read_transaction txn(*conn);
+  const auto result = Exec(txn, kListForJob, job_id);
   std::vector<EscrowRecord> records;
   records.reserve(result.size());
+  if (result.empty()) {
+    return records;
+  }
+  const EscrowColumns columns(result);
   for (const auto &row : result) {
-    records.push_back(RowToEscrow(row));
+    records.push_back(RowToEscrow(row, columns));
   }
   return records;
 }
 
 std::optional<EscrowRecord> EscrowRepository::GetById(const std::string &escrow_id) const {
-  pqxx::connection conn = config_->Connect();
-  pqxx::work txn(conn);
-  const auto result = txn.exec_params(
-      "select id, job_id, milestone_id, amount_authorised_cents, amount_held_cents, amount_released_cents, provider_ref, "
-      "status, created_at from escrow_payments where id=$1",
-      escrow_id);
+  auto conn = config_->AcquireRead(ReadRoute::kPrimary);
+  pqxx::work txn(*conn);
+  const auto result = Exec(txn, kGetById, escrow_id);
   if (result.empty()) {
     return std::nullopt;
   }
@@ -29,12 +29,42 @@ struct EscrowRecord {
   std::string created_at;
 };
 
+enum class EscrowReleaseOutcome {
+  kReleased,
+  // The idempotency key was already used for this same release; nothing moved this time.
+  kReplayed,
+  // The idempotency key was already used for a different release.
+  kKeyReused,
+  kInsufficientFunds,
+  kNotFound,
+};
+
+struct EscrowReleaseResult {
+  EscrowReleaseOutcome outcome = EscrowReleaseOutcome::kNotFound;
+  // The escrow after the release, or as it stands now on a replay or insufficient funds.
+  std::optional<EscrowRecord> record;
+};
+
+struct EscrowBatchReleaseResult {
+  EscrowReleaseOutcome outcome = EscrowReleaseOutcome::kReleased;
+  // The escrows this call released; on a replay, the escrows the first call released as they stand
+  // now, with that call's released_cents.
+  std::vector<EscrowRecord> records;
+  int released_cents = 0;
+};
+
 class EscrowRepository {
  public:
   explicit EscrowRepository(std::shared_ptr<PostgresConfig> config);
 
   EscrowRecord CreateEscrow(const EscrowCreateInput &input) const;
-  void ReleaseFunds(const std::string &escrow_id, int amount_cents) const;
+  // Moves amount_cents from held to released in one statement, claiming idempotency_key in the same
+  // transaction so a retried request is answered from the first attempt instead of releasing twice.
+  // Never releases more than is held.
+  EscrowReleaseResult ReleaseFunds(const std::string &escrow_id, int amount_cents,
+                                   const std::string &idempotency_key) const;
+  // Releases everything still held across all of a job's milestones in one transaction.
+  EscrowBatchReleaseResult ReleaseForJob(const std::string &job_id, const std::string &idempotency_key) const;
   std::vector<EscrowRecord> ListForJob(const std::string &job_id) const;
   std::optional<EscrowRecord> GetById(const std::string &escrow_id) const;
 
@@ -1,233 +1,485 @@
 #include "jobs_repository.h"
 #include "postgres.h"
 
+#include <algorithm>
 
 #include "jobs_repository_utils.h"
 
 namespace persistence {
 namespace {
 
-JobRecord RowToJob(const pqxx::row &row) {
+using Column = pqxx::row::size_type;
+
+// Each decoder takes its column positions from a *Columns struct built once per result (or
+// from the row itself for single-row statements).
+struct JobColumns {
+  template <typename Source>
+  explicit JobColumns(const Source &source)
+      : id(source.column_number("id")),
+        customer_id(source.column_number("customer_id")),
+        conveyancer_id(source.column_number("conveyancer_id")),
+        state(source.column_number("state")),
+        property_type(source.column_number("property_type")),
+        status(source.column_number("status")),
+        created_at(source.column_number("created_at")) {}
+
+  Column id, customer_id, conveyancer_id, state, property_type, status, created_at;
+};
+
+JobRecord RowToJob(const pqxx::row &row, const JobColumns &columns) {
   JobRecord job;
-  job.id = row["id"].c_str();
-  job.customer_id = row["customer_id"].is_null() ? std::string{} : row["customer_id"].c_str();
-  job.conveyancer_id = row["conveyancer_id"].is_null() ? std::string{} : row["conveyancer_id"].c_str();
-  job.state = row["state"].is_null() ? std::string{} : row["state"].c_str();
-  job.property_type = row["property_type"].is_null() ? std::string{} : row["property_type"].c_str();
-  job.status = row["status"].is_null() ? std::string{} : row["status"].c_str();
-  job.created_at = row["created_at"].is_null() ? std::string{} : row["created_at"].c_str();
+  job.id = Text(row[columns.id]);
+  job.customer_id = Text(row[columns.customer_id]);
+  job.conveyancer_id = Text(row[columns.conveyancer_id]);
+  job.state = Text(row[columns.state]);
+  job.property_type = Text(row[columns.property_type]);
+  job.status = Text(row[columns.status]);
+  job.created_at = Text(row[columns.created_at]);
   return job;
 }
 
-MilestoneRecord RowToMilestone(const pqxx::row &row) {
+JobRecord RowToJob(const pqxx::row &row) { return RowToJob(row, JobColumns(row)); }
+
+struct MilestoneColumns {
+  template <typename Source>
+  explicit MilestoneColumns(const Source &source)
+      : id(source.column_number("id")),
+        job_id(source.column_number("job_id")),
+        name(source.column_number("name")),
+        amount_cents(source.column_number("amount_cents")),
+        due_date(source.column_number("due_date")),
+        status(source.column_number("status")) {}
+
+  Column id, job_id, name, amount_cents, due_date, status;
+};
+
+MilestoneRecord RowToMilestone(const pqxx::row &row, const MilestoneColumns &columns) {
   MilestoneRecord record;
-  record.id = row["id"].c_str();
-  record.job_id = row["job_id"].c_str();
-  record.name = row["name"].c_str();
-  record.amount_cents = row["amount_cents"].as<int>();
-  record.due_date = row["due_date"].is_null() ? std::string{} : row["due_date"].c_str();
-  record.status = row["status"].is_null() ? std::string{} : row["status"].c_str();
+  record.id = Text(row[columns.id]);
+  record.job_id = Text(row[columns.job_id]);
+  record.name = Text(row[columns.name]);
+  record.amount_cents = row[columns.amount_cents].as<int>();
+  record.due_date = Text(row[columns.due_date]);
+  record.status = Text(row[columns.status]);
   return record;
 }
 
-DocumentRecord RowToDocument(const pqxx::row &row) {
+MilestoneRecord RowToMilestone(const pqxx::row &row) { return RowToMilestone(row, MilestoneColumns(row)); }
+
+struct DocumentColumns {
+  template <typename Source>
+  explicit DocumentColumns(const Source &source)
+      : id(source.column_number("id")),
+        job_id(source.column_number("job_id")),
+        doc_type(source.column_number("doc_type")),
+        url(source.column_number("url")),
+        checksum(source.column_number("checksum")),
+        uploaded_by(source.column_number("uploaded_by")),
+        version(source.column_number("version")),
+        created_at(source.column_number("created_at")),
+        scan_status(source.column_number("scan_status")) {}
+
+  Column id, job_id, doc_type, url, checksum, uploaded_by, version, created_at, scan_status;
+};
+
+DocumentRecord RowToDocument(const pqxx::row &row, const DocumentColumns &columns) {
   DocumentRecord record;
-  record.id = row["id"].c_str();
-  record.job_id = row["job_id"].c_str();
-  record.doc_type = row["doc_type"].is_null() ? std::string{} : row["doc_type"].c_str();
-  record.url = row["url"].is_null() ? std::string{} : row["url"].c_str();
-  record.checksum = row["checksum"].is_null() ? std::string{} : row["checksum"].c_str();
-  record.uploaded_by = row["uploaded_by"].is_null() ? std::string{} : row["uploaded_by"].c_str();
-  record.version = row["version"].is_null() ? 1 : row["version"].as<int>();
-  record.created_at = row["created_at"].is_null() ? std::string{} : row["created_at"].c_str();
+  record.id = Text(row[columns.id]);
+  record.job_id = Text(row[columns.job_id]);
+  record.doc_type = Text(row[columns.doc_type]);
+  record.url = Text(row[columns.url]);
+  record.checksum = Text(row[columns.checksum]);
+  record.uploaded_by = Text(row[columns.uploaded_by]);
+  record.version = row[columns.version].is_null() ? 1 : row[columns.version].as<int>();
+  record.created_at = Text(row[columns.created_at]);
+  record.scan_status = Text(row[columns.scan_status]);
   return record;
 }
 
-TemplateRecord RowToTemplate(const pqxx::row &row) {
-  detail::TemplateRowData data;
-  data.id = row["id"].c_str();
-  data.name = row["name"].c_str();
-  if (!row["jurisdiction"].is_null()) {
-    data.jurisdiction = row["jurisdiction"].c_str();
-  }
-  if (!row["description"].is_null()) {
-    data.description = row["description"].c_str();
-  }
-  if (!row["integration_url"].is_null()) {
-    data.integration_url = row["integration_url"].c_str();
+DocumentRecord RowToDocument(const pqxx::row &row) { return RowToDocument(row, DocumentColumns(row)); }
+
+struct MessageColumns {
+  template <typename Source>
+  explicit MessageColumns(const Source &source)
+      : id(source.column_number("id")),
+        from_user(source.column_number("from_user")),
+        content(source.column_number("content")),
+        attachments(source.column_number("attachments")),
+        created_at(source.column_number("created_at")) {}
+
+  Column id, from_user, content, attachments, created_at;
+};
+
+nlohmann::json RowToMessage(const pqxx::row &row, const MessageColumns &columns) {
+  const auto optional_string = [](const pqxx::field &field) {
+    return field.is_null() ? nlohmann::json{} : nlohmann::json(Text(field));
+  };
+  nlohmann::json payload;
+  payload["id"] = Text(row[columns.id]);
+  payload["from"] = optional_string(row[columns.from_user]);
+  payload["content"] = Text(row[columns.content]);
+  const auto attachments = row[columns.attachments];
+  payload["attachments"] = attachments.is_null() ? nlohmann::json::array() : nlohmann::json::parse(Text(attachments));
+  payload["createdAt"] = optional_string(row[columns.created_at]);
+  return payload;
+}
+
+PageCursor CursorAt(const pqxx::row &row) {
+  return PageCursor{std::string(Text(row["created_at"])), std::string(Text(row["id"]))};
+}
+
+// Runs a keyset statement taking (key, limit, cursor created_at, cursor id) and trims the
+// extra look-ahead row into Page::next.
+template <typename T, typename Columns>
+Page<T> FetchPage(pqxx::transaction_base &txn, const PreparedStatement &statement, const std::string &key, int limit,
+                  const std::optional<PageCursor> &cursor, T (*decode)(const pqxx::row &, const Columns &)) {
+  const auto result = Exec(txn, statement, key, limit + 1, cursor ? cursor->created_at.c_str() : nullptr,
+                           cursor ? cursor->id.c_str() : nullptr);
+  Page<T> page;
+  const auto count = std::min<std::size_t>(result.size(), static_cast<std::size_t>(limit));
+  page.items.reserve(count);
+  if (count == 0) {
+    return page;
   }
-  if (!row["integration_auth"].is_null()) {
-    data.integration_auth_json = row["integration_auth"].c_str();
+  const Columns columns(result);
+  for (std::size_t i = 0; i < count; ++i) {
+    page.items.push_back(decode(result[static_cast<int>(i)], columns));
   }
-  if (!row["latest_version"].is_null()) {
-    data.latest_version = row["latest_version"].as<int>();
+  if (static_cast<std::size_t>(result.size()) > count) {
+    page.next = CursorAt(result[static_cast<int>(count - 1)]);
   }
-  if (!row["payload"].is_null()) {
-    data.payload_json = row["payload"].c_str();
+  return page;
+}
+
+struct TemplateColumns {
+  template <typename Source>
+  explicit TemplateColumns(const Source &source)
+      : id(source.column_number("id")),
+        name(source.column_number("name")),
+        jurisdiction(source.column_number("jurisdiction")),
+        description(source.column_number("description")),
+        integration_url(source.column_number("integration_url")),
+        integration_auth(source.column_number("integration_auth")),
+        latest_version(source.column_number("latest_version")),
+        payload(source.column_number("payload")) {}
+
+  Column id, name, jurisdiction, description, integration_url, integration_auth, latest_version, payload;
+};
+
+TemplateRecord RowToTemplate(const pqxx::row &row, const TemplateColumns &columns) {
+  detail::TemplateRowData data;
+  data.id = Text(row[columns.id]);
+  data.name = Text(row[columns.name]);
+  data.jurisdiction = OptionalText(row[columns.jurisdiction]);
+  data.description = OptionalText(row[columns.description]);
+  data.integration_url = OptionalText(row[columns.integration_url]);
+  data.integration_auth_json = OptionalText(row[columns.integration_auth]);
+  if (!row[columns.latest_version].is_null()) {
+    data.latest_version = row[columns.latest_version].as<int>();
   }
+  data.payload_json = OptionalText(row[columns.payload]);
   return detail::BuildTemplateRecord(data);
 }
 
+TemplateRecord RowToTemplate(const pqxx::row &row) { return RowToTemplate(row, TemplateColumns(row)); }
+
+constexpr PreparedStatement kCreateJob{
+    "jobs_create_job",
+    "insert into jobs(customer_id, conveyancer_id, state, property_type, status) values ($1,$2,$3,$4,$5) "
+    "returning id, customer_id, conveyancer_id, state, property_type, status, created_at"};
+constexpr PreparedStatement kGetJobById{
+    "jobs_get_job_by_id",
+    "select id, customer_id, conveyancer_id, state, property_type, status, created_at from jobs where id=$1"};
+// One round trip for the job page. Children are aggregated to JSON with text-cast columns so
+// ids, dates and timestamps match what the single-table queries return.
+constexpr PreparedStatement kGetJobDetail{
+    "jobs_get_job_detail",
+    "select j.id, j.customer_id, j.conveyancer_id, j.state, j.property_type, j.status, j.created_at, "
+    "(select coalesce(json_agg(json_build_object('id', m.id::text, 'job_id', m.job_id::text, 'name', m.name, "
+    "'amount_cents', m.amount_cents, 'due_date', m.due_date::text, 'status', m.status) "
+    "order by m.due_date asc, m.id), '[]'::json) from milestones m where m.job_id=j.id) as milestones, "
+    "(select coalesce(json_agg(json_build_object('id', d.id::text, 'job_id', d.job_id::text, 'doc_type', d.doc_type, "
+    "'url', d.url, 'checksum', d.checksum, 'uploaded_by', d.uploaded_by::text, 'version', d.version, "
+    "'created_at', d.created_at::text, 'scan_status', d.scan_status) order by d.created_at desc), '[]'::json) "
+    "from documents d where d.job_id=j.id) as documents, "
+    "(select coalesce(json_agg(json_build_object('id', x.id::text, 'from', x.from_user::text, 'content', x.content, "
+    "'attachments', coalesce(x.attachments, '[]'::jsonb), 'createdAt', x.created_at::text) "
+    "order by x.created_at desc), '[]'::json) from (select * from messages where job_id=j.id "
+    "order by created_at desc limit $2) x) as messages "
+    "from jobs j where j.id=$1"};
+// Keyset pages: $3/$4 are the (created_at, id) of the previous page's last row, or null for
+// the first page. One row more than requested is fetched to tell whether another page exists.
+constexpr PreparedStatement kListJobsForAccount{
+    "jobs_list_for_account",
+    "select id, customer_id, conveyancer_id, state, property_type, status, created_at from jobs "
+    "where ($1='' or customer_id=$1 or conveyancer_id=$1) "
+    "and ($3::timestamptz is null or (created_at, id) < ($3::timestamptz, $4::uuid)) "
+    "order by created_at desc, id desc limit $2"};
+constexpr PreparedStatement kCreateMilestone{
+    "jobs_create_milestone",
+    "insert into milestones(job_id, name, amount_cents, due_date) values ($1,$2,$3,$4::date) "
+    "returning id, job_id, name, amount_cents, due_date, status"};
+constexpr PreparedStatement kListMilestones{
+    "jobs_list_milestones",
+    "select id, job_id, name, amount_cents, due_date, status from milestones where job_id=$1 order by due_date asc, id"};
+constexpr PreparedStatement kStoreDocument{
+    "jobs_store_document",
+    "insert into documents(id, job_id, doc_type, url, checksum, uploaded_by, version, scan_status) "
+    "values (coalesce($8::uuid, gen_random_uuid()),$1,$2,$3,$4,$5,$6,$7) "
+    "returning id, job_id, doc_type, url, checksum, uploaded_by, version, created_at, scan_status"};
+constexpr PreparedStatement kResolveDocumentScan{
+    "jobs_resolve_document_scan",
+    "update documents set scan_status=$2 where id=$1 and scan_status='pending' "
+    "returning id, job_id, doc_type, url, checksum, uploaded_by, version, created_at, scan_status"};
+constexpr PreparedStatement kListPendingScans{
+    "jobs_list_pending_scans",
+    "select id, job_id, doc_type, url, checksum, uploaded_by, version, created_at, scan_status from documents "
+    "where scan_status='pending' order by created_at asc limit $1"};
+constexpr PreparedStatement kListDocuments{
+    "jobs_list_documents",
+    "select id, job_id, doc_type, url, checksum, uploaded_by, version, created_at, scan_status from documents "
+    "where job_id=$1 "
+    "and ($3::timestamptz is null or (created_at, id) < ($3::timestamptz, $4::uuid)) "
+    "order by created_at desc, id desc limit $2"};
+constexpr PreparedStatement kAppendMessage{
+    "jobs_append_message",
+    "insert into messages(job_id, from_user, content, attachments) values ($1,$2,$3,$4::jsonb) "
+    "returning id, from_user, content, attachments, created_at"};
+constexpr PreparedStatement kFetchMessages{
+    "jobs_fetch_messages",
+    "select id, from_user, content, attachments, created_at from messages where job_id=$1 "
+    "and ($3::timestamptz is null or (created_at, id) < ($3::timestamptz, $4::uuid)) "
+    "order by created_at desc, id desc limit $2"};
+constexpr PreparedStatement kFetchMessagesSince{
+    "jobs_fetch_messages_since",
+    "select id, from_user, content, attachments, created_at from messages where job_id=$1 "
+    "and (created_at, id) > ($3::timestamptz, $4::uuid) order by created_at asc, id asc limit $2"};
+constexpr PreparedStatement kUpdateJobStatus{"jobs_update_status", "update jobs set status=$2 where id=$1"};
+constexpr PreparedStatement kInsertTemplate{
+    "jobs_insert_template",
+    "insert into job_templates(name, jurisdiction, description, integration_url, integration_auth, latest_version) "
+    "values ($1,$2,$3,$4,$5::jsonb,0) returning id"};
+constexpr PreparedStatement kUpdateTemplate{
+    "jobs_update_template",
+    "update job_templates set name=$2, jurisdiction=$3, description=$4, integration_url=$5, integration_auth=$6::jsonb "
+    "where id=$1"};
+constexpr PreparedStatement kCurrentTemplateVersion{
+    "jobs_current_template_version",
+    "select coalesce(max(version),0) as current_version from job_template_versions where template_id=$1"};
+constexpr PreparedStatement kInsertTemplateVersion{
+    "jobs_insert_template_version",
+    "insert into job_template_versions(template_id, version, payload, source) values ($1,$2,$3::jsonb,$4::jsonb)"};
+constexpr PreparedStatement kSetLatestVersion{"jobs_set_latest_template_version",
+                                              "update job_templates set latest_version=$2 where id=$1"};
+constexpr PreparedStatement kTemplateAtVersion{
+    "jobs_template_at_version",
+    "select t.id, t.name, t.jurisdiction, t.description, t.integration_url, t.integration_auth, t.latest_version, "
+    "v.payload from job_templates t join job_template_versions v on v.template_id=t.id and v.version=$2 where t.id=$1"};
+constexpr PreparedStatement kListTemplates{
+    "jobs_list_templates",
+    "select t.id, t.name, t.jurisdiction, t.description, t.integration_url, t.integration_auth, t.latest_version, "
+    "coalesce(v.payload,'{}') as payload from job_templates t left join lateral (select payload from "
+    "job_template_versions v where v.template_id=t.id order by version desc limit 1) v on true order by t.name"};
+// Every upsert bumps one template's latest_version, so the sum changes whenever the list does.
+constexpr PreparedStatement kTemplateListVersion{
+    "jobs_template_list_version",
+    "select count(*) || '.' || coalesce(sum(latest_version), 0) as version from job_templates"};
+
+constexpr PreparedStatement kStatements[] = {
+    kCreateJob,          kGetJobById,       kGetJobDetail,          kListJobsForAccount,
+    kCreateMilestone,    kListMilestones,   kStoreDocument,         kListDocuments,
+    kAppendMessage,      kFetchMessages,    kFetchMessagesSince,    kUpdateJobStatus,
+    kInsertTemplate,     kUpdateTemplate,   kCurrentTemplateVersion, kInsertTemplateVersion,
+    kSetLatestVersion,   kTemplateAtVersion, kListTemplates,         kTemplateListVersion,
+    kResolveDocumentScan, kListPendingScans};
+
 }  // namespace
 
-JobsRepository::JobsRepository(std::shared_ptr<PostgresConfig> config) : config_(std::move(config)) {}
+JobsRepository::JobsRepository(std::shared_ptr<PostgresConfig> config) : config_(std::move(config)) {
+  config_->RegisterStatements(kStatements);
+}
 
 JobRecord JobsRepository::CreateJob(const JobCreateInput &input) const {
-  pqxx::connection conn = config_->Connect();
-  pqxx::work txn(conn);
-  const auto row = txn.exec_params1(
-      "insert into jobs(customer_id, conveyancer_id, state, property_type, status) values ($1,$2,$3,$4,$5) "
-      "returning id, customer_id, conveyancer_id, state, property_type, status, created_at",
-      input.customer_id.empty() ? nullptr : input.customer_id.c_str(),
-      input.conveyancer_id.empty() ? nullptr : input.conveyancer_id.c_str(),
-      input.state.empty() ? nullptr : input.state.c_str(),
-      input.property_type.empty() ? nullptr : input.property_type.c_str(),
-      input.status.empty() ? "quote_pending" : input.status.c_str());
+  auto conn = config_->Acquire();
+  pqxx::work txn(*conn);
+  const auto row = Exec1(txn, kCreateJob,
+                         input.customer_id.empty() ? nullptr : input.customer_id.c_str(),
+                         input.conveyancer_id.empty() ? nullptr : input.conveyancer_id.c_str(),
+                         input.state.empty() ? nullptr : input.state.c_str(),
+                         input.property_type.empty() ? nullptr : input.property_type.c_str(),
+                         input.status.empty() ? "quote_pending" : input.status.c_str());
   txn.commit();
   return RowToJob(row);
 }
 
 std::optional<JobRecord> JobsRepository::GetJobById(const std::string &id) const {
-  pqxx::connection conn = config_->Connect();
-  pqxx::work txn(conn);
-  const auto result = txn.exec_params(
-      "select id, customer_id, conveyancer_id, state, property_type, status, created_at from jobs where id=$1", id);
+  auto conn = config_->AcquireRead(ReadRoute::kPrimary);
+  pqxx::work txn(*conn);
+  const auto result = Exec(txn, kGetJobById, id);
   if (result.empty()) {
     return std::nullopt;
   }
   return RowToJob(result[0]);
 }
 
-std::vector<JobRecord> JobsRepository::ListJobsForAccount(const std::string &account_id, int limit) const {
-  pqxx::connection conn = config_->Connect();
-  pqxx::work txn(conn);
-  const auto result = txn.exec_params(
-      "select id, customer_id, conveyancer_id, state, property_type, status, created_at from jobs "
-      "where ($1='' or customer_id=$1 or conveyancer_id=$1) order by created_at desc limit $2",
-      account_id, limit);
-  std::vector<JobRecord> jobs;
-  jobs.reserve(result.size());
-  for (const auto &row : result) {
-    jobs.push_back(RowToJob(row));
+std::optional<JobDetailRecord> JobsRepository::GetJobDetail(const std::string &id, int message_limit) const {
+  auto conn = config_->AcquireRead(ReadRoute::kPrimary);
+  pqxx::read_transaction txn(*conn);
+  const auto result = Exec(txn, kGetJobDetail, id, message_limit);
+  if (result.empty()) {
+    return std::nullopt;
   }
-  return jobs;
+  const auto &row = result[0];
+  JobDetailRecord detail;
+  detail.job = RowToJob(row);
+  detail.milestones = detail::ParseMilestones(Text(row["milestones"]));
+  detail.documents = detail::ParseDocuments(Text(row["documents"]));
+  detail.messages = detail::ParseMessages(Text(row["messages"]));
+  return detail;
+}
+
+Page<JobRecord> JobsRepository::ListJobsForAccount(const std::string &account_id, int limit,
+                                                  const std::optional<PageCursor> &cursor) const {
+  auto conn = config_->AcquireRead(ReadRoute::kReplica);
+  pqxx::read_transaction txn(*conn);
+  return FetchPage(txn, kListJobsForAccount, account_id, limit, cursor, RowToJob);
 }
 
 MilestoneRecord JobsRepository::CreateMilestone(const MilestoneInput &input) const {
-  pqxx::connection conn = config_->Connect();
-  pqxx::work txn(conn);
-  const auto row = txn.exec_params1(
-      "insert into milestones(job_id, name, amount_cents, due_date) values ($1,$2,$3,$4::date) "
-      "returning id, job_id, name, amount_cents, due_date, status",
-      input.job_id, input.name, input.amount_cents,
-      input.due_date.empty() ? nullptr : input.due_date.c_str());
+  auto conn = config_->Acquire();
+  pqxx::work txn(*conn);
+  const auto row = Exec1(txn, kCreateMilestone, input.job_id, input.name, input.amount_cents,
+                         input.due_date.empty() ? nullptr : input.due_date.c_str());
   txn.commit();
   return RowToMilestone(row);
 }
 
 std::vector<MilestoneRecord> JobsRepository::ListMilestones(const std::string &job_id) const {
-  pqxx::connection conn = config_->Connect();
-  pqxx::work txn(conn);
-  const auto result = txn.exec_params(
-      "select id, job_id, name, amount_cents, due_date, status from milestones where job_id=$1 order by due_date asc, id",
-      job_id);
+  auto conn = config_->AcquireRead(ReadRoute::kPrimary);
+  pqxx::work txn(*conn);
+  const auto result = Exec(txn, kListMilestones, job_id);
   std::vector<MilestoneRecord> milestones;
   milestones.reserve(result.size());
+  if (result.empty()) {
+    return milestones;
+  }
+  const MilestoneColumns columns(result);
   for (const auto &row : result) {
-    milestones.push_back(RowToMilestone(row));
+    milestones.push_back(RowToMilestone(row, columns));
   }
   return milestones;
 }
 
 DocumentRecord JobsRepository::StoreDocument(const DocumentRecord &input) const {
-  pqxx::connection conn = config_->Connect();
-  pqxx::work txn(conn);
-  const auto row = txn.exec_params1(
-      "insert into documents(job_id, doc_type, url, checksum, uploaded_by, version) values ($1,$2,$3,$4,$5,$6) "
-      "returning id, job_id, doc_type, url, checksum, uploaded_by, version, created_at",
-      input.job_id, input.doc_type.empty() ? nullptr : input.doc_type.c_str(),
-      input.url, input.checksum.empty() ? nullptr : input.checksum.c_str(),
-      input.uploaded_by.empty() ? nullptr : input.uploaded_by.c_str(), input.version);
+  auto conn = config_->Acquire();
+  pqxx::work txn(*conn);
+  const auto row = Exec1(txn, kStoreDocument, input.job_id,
+                         input.doc_type.empty() ? nullptr : input.doc_type.c_str(), input.url,
+                         input.checksum.empty() ? nullptr : input.checksum.c_str(),
+                         input.uploaded_by.empty() ? nullptr : input.uploaded_by.c_str(), input.version,
+                         input.scan_status, input.id.empty() ? nullptr : input.id.c_str());
   txn.commit();
   return RowToDocument(row);
 }
 
-std::vector<DocumentRecord> JobsRepository::ListDocuments(const std::string &job_id) const {
-  pqxx::connection conn = config_->Connect();
-  pqxx::work txn(conn);
-  const auto result = txn.exec_params(
-      "select id, job_id, doc_type, url, checksum, uploaded_by, version, created_at from documents where job_id=$1 order by "
-      "created_at desc",
-      job_id);
+std::optional<DocumentRecord> JobsRepository::ResolveDocumentScan(const std::string &document_id,
+                                                                  const std::string &scan_status) const {
+  auto conn = config_->Acquire();
+  pqxx::work txn(*conn);
+  const auto result = Exec(txn, kResolveDocumentScan, document_id, scan_status);
+  txn.commit();
+  if (result.empty()) {
+    return std::nullopt;
+  }
+  return RowToDocument(result[0]);
+}
+
+std::vector<DocumentRecord> JobsRepository::ListPendingScans(int limit) const {
+  auto conn = config_->AcquireRead(ReadRoute::kPrimary);
+  pqxx::read_transaction txn(*conn);
+  const auto result = Exec(txn, kListPendingScans, limit);
   std::vector<DocumentRecord> documents;
   documents.reserve(result.size());
+  if (result.empty()) {
+    return documents;
+  }
+  const DocumentColumns columns(result);
   for (const auto &row : result) {
-    documents.push_back(RowToDocument(row));
+    documents.push_back(RowToDocument(row, columns));
   }
   return documents;
 }
 
-void JobsRepository::AppendMessage(const std::string &job_id, const std::string &author_id,
-                                   const std::string &content, const nlohmann::json &attachments) const {
-  pqxx::connection conn = config_->Connect();
-  pqxx::work txn(conn);
-  txn.exec_params("insert into messages(job_id, from_user, content, attachments) values ($1,$2,$3,$4::jsonb)", job_id,
-                  author_id.empty() ? nullptr : author_id.c_str(), content, attachments.dump());
+Page<DocumentRecord> JobsRepository::ListDocuments(const std::string &job_id, int limit,
+                                                  const std::optional<PageCursor> &cursor) const {
+  auto conn = config_->AcquireRead(ReadRoute::kReplica);
+  pqxx::read_transaction txn(*conn);
+  return FetchPage(txn, kListDocuments, job_id, limit, cursor, RowToDocument);
+}
+
+nlohmann::json JobsRepository::AppendMessage(const std::string &job_id, const std::string &author_id,
+                                             const std::string &content, const nlohmann::json &attachments) const {
+  auto conn = config_->Acquire();
+  pqxx::work txn(*conn);
+  const auto row = Exec1(txn, kAppendMessage, job_id, author_id.empty() ? nullptr : author_id.c_str(), content,
+                         attachments.dump());
   txn.commit();
+  return RowToMessage(row, MessageColumns(row));
+}
+
+Page<nlohmann::json> JobsRepository::FetchMessages(const std::string &job_id, int limit,
+                                                  const std::optional<PageCursor> &cursor) const {
+  auto conn = config_->AcquireRead(ReadRoute::kPrimary);
+  pqxx::read_transaction txn(*conn);
+  return FetchPage(txn, kFetchMessages, job_id, limit, cursor, RowToMessage);
 }
 
-std::vector<nlohmann::json> JobsRepository::FetchMessages(const std::string &job_id, int limit) const {
-  pqxx::connection conn = config_->Connect();
-  pqxx::work txn(conn);
-  const auto result = txn.exec_params(
-      "select id, from_user, content, attachments, created_at from messages where job_id=$1 order by created_at desc limit $2",
-      job_id, limit);
-  std::vector<nlohmann::json> messages;
-  messages.reserve(result.size());
+Page<nlohmann::json> JobsRepository::FetchMessagesSince(const std::string &job_id, const PageCursor &since,
+                                                        int limit) const {
+  auto conn = config_->AcquireRead(ReadRoute::kPrimary);
+  pqxx::read_transaction txn(*conn);
+  const auto result = Exec(txn, kFetchMessagesSince, job_id, limit, since.created_at, since.id);
+  Page<nlohmann::json> page;
+  if (result.empty()) {
+    return page;
+  }
+  page.items.reserve(result.size());
+  const MessageColumns columns(result);
   for (const auto &row : result) {
-    nlohmann::json payload;
-    payload["id"] = row["id"].c_str();
-    payload["from"] = row["from_user"].is_null() ? nlohmann::json{} : nlohmann::json(row["from_user"].c_str());
-    payload["content"] = row["content"].c_str();
-    payload["attachments"] = nlohmann::json::parse(row["attachments"].is_null() ? "[]" : row["attachments"].c_str());
-    payload["createdAt"] = row["created_at"].is_null() ? nlohmann::json{} : nlohmann::json(row["created_at"].c_str());
-    messages.push_back(std::move(payload));
+    page.items.push_back(RowToMessage(row, columns));
   }
-  return messages;
+  page.next = CursorAt(result[static_cast<int>(result.size() - 1)]);
+  return page;
 }
 
 void JobsRepository::UpdateJobStatus(const std::string &job_id, const std::string &status) const {
-  pqxx::connection conn = config_->Connect();
-  pqxx::work txn(conn);
-  txn.exec_params("update jobs set status=$2 where id=$1", job_id, status);
+  auto conn = config_->Acquire();
+  pqxx::work txn(*conn);
+  Exec(txn, kUpdateJobStatus, job_id, status);
   txn.commit();
 }
 
 TemplateRecord JobsRepository::UpsertTemplateVersion(const TemplateUpsertInput &input) const {
-  pqxx::connection conn = config_->Connect();
-  pqxx::work txn(conn);
+  auto conn = config_->Acquire();
+  pqxx::work txn(*conn);
 
   std::string template_id = input.template_id;
   if (template_id.empty()) {
-    const auto row = txn.exec_params1(
-        "insert into job_templates(name, jurisdiction, description, integration_url, integration_auth, latest_version) "
-        "values ($1,$2,$3,$4,$5::jsonb,0) returning id",
-        input.name, input.jurisdiction.empty() ? nullptr : input.jurisdiction.c_str(),
-        input.description.empty() ? nullptr : input.description.c_str(),
-        input.integration_url.empty() ? nullptr : input.integration_url.c_str(),
-        input.integration_auth.dump());
+    const auto row = Exec1(txn, kInsertTemplate, input.name,
+                           input.jurisdiction.empty() ? nullptr : input.jurisdiction.c_str(),
+                           input.description.empty() ? nullptr : input.description.c_str(),
+                           input.integration_url.empty() ? nullptr : input.integration_url.c_str(),
+                           input.integration_auth.dump());
     template_id = row["id"].c_str();
   } else {
-    txn.exec_params(
-        "update job_templates set name=$2, jurisdiction=$3, description=$4, integration_url=$5, integration_auth=$6::jsonb "
-        "where id=$1",
-        template_id, input.name, input.jurisdiction.empty() ? nullptr : input.jurisdiction.c_str(),
-        input.description.empty() ? nullptr : input.description.c_str(),
-        input.integration_url.empty() ? nullptr : input.integration_url.c_str(), input.integration_auth.dump());
+    Exec(txn, kUpdateTemplate, template_id, input.name,
+         input.jurisdiction.empty() ? nullptr : input.jurisdiction.c_str(),
+         input.description.empty() ? nullptr : input.description.c_str(),
+         input.integration_url.empty() ? nullptr : input.integration_url.c_str(),
+         input.integration_auth.dump());
   }
 
-  const auto version_row = txn.exec_params1(
-      "select coalesce(max(version),0) as current_version from job_template_versions where template_id=$1", template_id);
+  const auto version_row = Exec1(txn, kCurrentTemplateVersion, template_id);
   const int next_version = version_row["current_version"].as<int>() + 1;
 
   nlohmann::json payload;
@@ -243,32 +495,35 @@ TemplateRecord JobsRepository::UpsertTemplateVersion(const TemplateUpsertInput &
     payload["syncMetadata"] = input.metadata;
   }
 
-  txn.exec_params(
-      "insert into job_template_versions(template_id, version, payload, source) values ($1,$2,$3::jsonb,$4::jsonb)",
-      template_id, next_version, payload.dump(), input.source.dump());
-  txn.exec_params("update job_templates set latest_version=$2 where id=$1", template_id, next_version);
+  Exec(txn, kInsertTemplateVersion, template_id, next_version, payload.dump(), input.source.dump());
+  Exec(txn, kSetLatestVersion, template_id, next_version);
 
-  const auto row = txn.exec_params1(
-      "select t.id, t.name, t.jurisdiction, t.description, t.integration_url, t.integration_auth, t.latest_version, "
-      "v.payload from job_templates t join job_template_versions v on v.template_id=t.id and v.version=$2 where t.id=$1",
-      template_id, next_version);
+  const auto row = Exec1(txn, kTemplateAtVersion, template_id, next_version);
   txn.commit();
   return RowToTemplate(row);
 }
 
 std::vector<TemplateRecord> JobsRepository::ListTemplates() const {
-  pqxx::connection conn = config_->Connect();
-  pqxx::work txn(conn);
-  const auto result = txn.exec(
-      "select t.id, t.name, t.jurisdiction, t.description, t.integration_url, t.integration_auth, t.latest_version, "
-      "coalesce(v.payload,'{}') as payload from job_templates t left join lateral (select payload from "
-      "job_template_versions v where v.template_id=t.id order by version desc limit 1) v on true order by t.name");
+  auto conn = config_->AcquireRead(ReadRoute::kPrimary);
+  pqxx::read_transaction txn(*conn);
+  const auto result = Exec(txn, kListTemplates);
   std::vector<TemplateRecord> templates;
   templates.reserve(result.size());
+  if (result.empty()) {
+    return templates;
+  }
+  const TemplateColumns columns(result);
   for (const auto &row : result) {
-    templates.push_back(RowToTemplate(row));
+    templates.push_back(RowToTemplate(row, columns));
   }
   return templates;
 }
 
+std::string JobsRepository::TemplateListVersion() const {
+  auto conn = config_->AcquireRead(ReadRoute::kPrimary);
+  pqxx::read_transaction txn(*conn);
+  const auto row = Exec1(txn, kTemplateListVersion);
+  return row["version"].c_str();
+}
+
 }  // namespace persistence
@@ -55,6 +55,31 @@ struct DocumentRecord {
   std::string uploaded_by;
   int version = 1;
   std::string created_at;
+  // "pending" while quarantined awaiting a virus scan, then "clean", "infected" or
+  // "scan_failed". Documents stored without a scanner configured are "unscanned".
+  std::string scan_status = "clean";
+};
+
+// Keyset position: the (created_at, id) of the last row a client has seen. Handed out as an
+// opaque token; see detail::EncodeCursor.
+struct PageCursor {
+  std::string created_at;
+  std::string id;
+};
+
+template <typename T>
+struct Page {
+  std::vector<T> items;
+  // Set when more rows follow; pass it back to continue from the last item.
+  std::optional<PageCursor> next;
+};
+
+// Everything the job page shows, read in one statement.
+struct JobDetailRecord {
+  JobRecord job;
+  std::vector<MilestoneRecord> milestones;
+  std::vector<DocumentRecord> documents;
+  std::vector<nlohmann::json> messages;
 };
 
 struct TemplateTaskRecord {
@@ -93,17 +118,38 @@ class JobsRepository {
 
   JobRecord CreateJob(const JobCreateInput &input) const;
   std::optional<JobRecord> GetJobById(const std::string &id) const;
-  std::vector<JobRecord> ListJobsForAccount(const std::string &account_id, int limit) const;
+  // Job, milestones, documents and the newest message_limit messages from one snapshot.
+  std::optional<JobDetailRecord> GetJobDetail(const std::string &id, int message_limit) const;
+  // Newest first. cursor continues after the last job of a previous page.
+  Page<JobRecord> ListJobsForAccount(const std::string &account_id, int limit,
+                                     const std::optional<PageCursor> &cursor = std::nullopt) const;
   MilestoneRecord CreateMilestone(const MilestoneInput &input) const;
   std::vector<MilestoneRecord> ListMilestones(const std::string &job_id) const;
   DocumentRecord StoreDocument(const DocumentRecord &input) const;
-  std::vector<DocumentRecord> ListDocuments(const std::string &job_id) const;
-  void AppendMessage(const std::string &job_id, const std::string &author_id, const std::string &content,
-                     const nlohmann::json &attachments) const;
-  std::vector<nlohmann::json> FetchMessages(const std::string &job_id, int limit) const;
+  // Moves a pending document to its scan verdict. Null when the document is gone or was
+  // already resolved.
+  std::optional<DocumentRecord> ResolveDocumentScan(const std::string &document_id,
+                                                    const std::string &scan_status) const;
+  // Oldest first, for re-queueing scans that were interrupted by a restart.
+  std::vector<DocumentRecord> ListPendingScans(int limit) const;
+  Page<DocumentRecord> ListDocuments(const std::string &job_id, int limit,
+                                     const std::optional<PageCursor> &cursor = std::nullopt) const;
+  // Returns the stored message in the FetchMessages shape, id and createdAt included.
+  nlohmann::json AppendMessage(const std::string &job_id, const std::string &author_id, const std::string &content,
+                               const nlohmann::json &attachments) const;
+  // Newest first, paging back through history.
+  Page<nlohmann::json> FetchMessages(const std::string &job_id, int limit,
+                                     const std::optional<PageCursor> &cursor = std::nullopt) const;
+  // Messages newer than since, oldest first, for clients polling for new activity. next is set
+  // whenever anything was returned so the client can poll from there.
+  Page<nlohmann::json> FetchMessagesSince(const std::string &job_id, const PageCursor &since, int limit) const;
   void UpdateJobStatus(const std::string &job_id, const std::string &status) const;
   TemplateRecord UpsertTemplateVersion(const TemplateUpsertInput &input) const;
+  // Served by the primary, like TemplateListVersion(), so a list is never cached under a stamp
+  // from a lagging replica and a revalidation after Invalidate() sees the new version.
   std::vector<TemplateRecord> ListTemplates() const;
+  // Cheap stamp that changes whenever ListTemplates() would return something different.
+  std::string TemplateListVersion() const;
 
  private:
   std::shared_ptr<PostgresConfig> config_;
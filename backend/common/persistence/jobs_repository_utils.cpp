@@ -1,5 +1,9 @@
 #include "jobs_repository_utils.h"
 
+#include <chrono>
+
+#include "../codec.h"
+
 namespace persistence::detail {
 
 TemplateTaskRecord MakeTaskRecord(const nlohmann::json &task) {
@@ -14,9 +18,9 @@ TemplateRecord BuildTemplateRecord(const TemplateRowData &data) {
   TemplateRecord record;
   record.id = data.id;
   record.name = data.name;
-  record.jurisdiction = data.jurisdiction.value_or("");
-  record.description = data.description.value_or("");
-  record.integration_url = data.integration_url.value_or("");
+  record.jurisdiction = data.jurisdiction.value_or(std::string_view{});
+  record.description = data.description.value_or(std::string_view{});
+  record.integration_url = data.integration_url.value_or(std::string_view{});
   record.integration_auth = nlohmann::json::object();
   if (data.integration_auth_json.has_value() && !data.integration_auth_json->empty()) {
     try {
@@ -52,4 +56,156 @@ TemplateRecord BuildTemplateRecord(const TemplateRowData &data) {
   return record;
 }
 
+namespace {
+
+std::string StringOrEmpty(const nlohmann::json &value, const char *key) {
+  const auto it = value.find(key);
+  return it != value.end() && it->is_string() ? it->get<std::string>() : std::string{};
+}
+
+int IntOr(const nlohmann::json &value, const char *key, int fallback) {
+  const auto it = value.find(key);
+  return it != value.end() && it->is_number_integer() ? it->get<int>() : fallback;
+}
+
+// Reads count digits at *pos into *value.
+bool ReadDigits(std::string_view text, std::size_t *pos, std::size_t count, int *value) {
+  if (text.size() - *pos < count) {
+    return false;
+  }
+  *value = 0;
+  for (std::size_t end = *pos + count; *pos < end; ++*pos) {
+    if (text[*pos] < '0' || text[*pos] > '9') {
+      return false;
+    }
+    *value = *value * 10 + (text[*pos] - '0');
+  }
+  return true;
+}
+
+bool Expect(std::string_view text, std::size_t *pos, char ch) {
+  if (*pos >= text.size() || text[*pos] != ch) {
+    return false;
+  }
+  ++*pos;
+  return true;
+}
+
+// Whether text is a timestamptz as Postgres prints it under the ISO DateStyle,
+// "2024-05-01 10:15:30.123456+00" with optional fraction and optional ":MM" in the offset, and
+// names a real date and time, so the cast in a keyset query cannot fail.
+bool IsTimestamp(std::string_view text) {
+  std::size_t pos = 0;
+  int year, month, day, hour, minute, second, offset;
+  if (!ReadDigits(text, &pos, 4, &year) || !Expect(text, &pos, '-') || !ReadDigits(text, &pos, 2, &month) ||
+      !Expect(text, &pos, '-') || !ReadDigits(text, &pos, 2, &day) || !Expect(text, &pos, ' ') ||
+      !ReadDigits(text, &pos, 2, &hour) || !Expect(text, &pos, ':') || !ReadDigits(text, &pos, 2, &minute) ||
+      !Expect(text, &pos, ':') || !ReadDigits(text, &pos, 2, &second)) {
+    return false;
+  }
+  const std::chrono::year_month_day date{std::chrono::year(year), std::chrono::month(static_cast<unsigned>(month)),
+                                         std::chrono::day(static_cast<unsigned>(day))};
+  if (!date.ok() || hour > 23 || minute > 59 || second > 59) {
+    return false;
+  }
+  if (Expect(text, &pos, '.')) {
+    const auto digits = pos;
+    while (pos < text.size() && pos - digits < 6 && text[pos] >= '0' && text[pos] <= '9') {
+      ++pos;
+    }
+    if (pos == digits) {
+      return false;
+    }
+  }
+  if (!Expect(text, &pos, '+') && !Expect(text, &pos, '-')) {
+    return false;
+  }
+  if (!ReadDigits(text, &pos, 2, &offset) || offset > 15) {
+    return false;
+  }
+  if (Expect(text, &pos, ':') && (!ReadDigits(text, &pos, 2, &offset) || offset > 59)) {
+    return false;
+  }
+  return pos == text.size();
+}
+
+}  // namespace
+
+std::string EncodeCursor(const PageCursor &cursor) {
+  return codec::Base64Encode(cursor.created_at + '|' + cursor.id, codec::Base64Alphabet::kUrl);
+}
+
+std::optional<PageCursor> DecodeCursor(std::string_view token) {
+  std::string raw;
+  if (!codec::Base64Decode(token, raw, codec::Base64Alphabet::kUrl)) {
+    return std::nullopt;
+  }
+  const auto separator = raw.rfind('|');
+  if (separator == std::string::npos || separator == 0 || separator + 1 == raw.size()) {
+    return std::nullopt;
+  }
+  PageCursor cursor{raw.substr(0, separator), raw.substr(separator + 1)};
+  if (!IsTimestamp(cursor.created_at) || !codec::IsUuid(cursor.id)) {
+    return std::nullopt;
+  }
+  return cursor;
+}
+
+MilestoneRecord MilestoneFromJson(const nlohmann::json &value) {
+  MilestoneRecord record;
+  record.id = StringOrEmpty(value, "id");
+  record.job_id = StringOrEmpty(value, "job_id");
+  record.name = StringOrEmpty(value, "name");
+  record.amount_cents = IntOr(value, "amount_cents", 0);
+  record.due_date = StringOrEmpty(value, "due_date");
+  record.status = StringOrEmpty(value, "status");
+  return record;
+}
+
+DocumentRecord DocumentFromJson(const nlohmann::json &value) {
+  DocumentRecord record;
+  record.id = StringOrEmpty(value, "id");
+  record.job_id = StringOrEmpty(value, "job_id");
+  record.doc_type = StringOrEmpty(value, "doc_type");
+  record.url = StringOrEmpty(value, "url");
+  record.checksum = StringOrEmpty(value, "checksum");
+  record.uploaded_by = StringOrEmpty(value, "uploaded_by");
+  record.version = IntOr(value, "version", 1);
+  record.created_at = StringOrEmpty(value, "created_at");
+  if (value.contains("scan_status")) {
+    record.scan_status = StringOrEmpty(value, "scan_status");
+  }
+  return record;
+}
+
+std::vector<MilestoneRecord> ParseMilestones(std::string_view json_array) {
+  std::vector<MilestoneRecord> milestones;
+  const auto parsed = nlohmann::json::parse(json_array.empty() ? std::string_view("[]") : json_array);
+  milestones.reserve(parsed.size());
+  for (const auto &item : parsed) {
+    milestones.push_back(MilestoneFromJson(item));
+  }
+  return milestones;
+}
+
+std::vector<DocumentRecord> ParseDocuments(std::string_view json_array) {
+  std::vector<DocumentRecord> documents;
+  const auto parsed = nlohmann::json::parse(json_array.empty() ? std::string_view("[]") : json_array);
+  documents.reserve(parsed.size());
+  for (const auto &item : parsed) {
+    documents.push_back(DocumentFromJson(item));
+  }
+  return documents;
+}
+
+std::vector<nlohmann::json> ParseMessages(std::string_view json_array) {
+  auto parsed = nlohmann::json::parse(json_array.empty() ? std::string_view("[]") : json_array);
+  std::vector<nlohmann::json> messages;
+  messages.reserve(parsed.size());
+  for (auto &item : parsed) {
+    messages.push_back(std::move(item));
+  }
+  return messages;
+}
+
 }  // namespace persistence::detail
@@ -3,6 +3,8 @@
 
 #include <optional>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include <nlohmann/json.hpp>
 
@@ -10,21 +12,36 @@
 
 namespace persistence::detail {
 
+// Views into the pqxx::result being decoded; BuildTemplateRecord copies what it keeps.
 struct TemplateRowData {
-  std::string id;
-  std::string name;
-  std::optional<std::string> jurisdiction;
-  std::optional<std::string> description;
-  std::optional<std::string> integration_url;
-  std::optional<std::string> integration_auth_json;
+  std::string_view id;
+  std::string_view name;
+  std::optional<std::string_view> jurisdiction;
+  std::optional<std::string_view> description;
+  std::optional<std::string_view> integration_url;
+  std::optional<std::string_view> integration_auth_json;
   std::optional<int> latest_version;
-  std::optional<std::string> payload_json;
+  std::optional<std::string_view> payload_json;
 };
 
 TemplateRecord BuildTemplateRecord(const TemplateRowData &data);
 
 TemplateTaskRecord MakeTaskRecord(const nlohmann::json &task);
 
+// Cursor tokens are unpadded base64url of "created_at|id". Decoding returns nullopt for
+// anything that was not produced by EncodeCursor, including a well-formed token whose halves
+// are not a timestamptz and a uuid, so a crafted token is a 400 rather than a failed query.
+std::string EncodeCursor(const PageCursor &cursor);
+std::optional<PageCursor> DecodeCursor(std::string_view token);
+
+// Decode the json_agg columns of the job detail query, whose objects use the column names.
+MilestoneRecord MilestoneFromJson(const nlohmann::json &value);
+DocumentRecord DocumentFromJson(const nlohmann::json &value);
+std::vector<MilestoneRecord> ParseMilestones(std::string_view json_array);
+std::vector<DocumentRecord> ParseDocuments(std::string_view json_array);
+// Message objects are already in the FetchMessages shape.
+std::vector<nlohmann::json> ParseMessages(std::string_view json_array);
+
 }  // namespace persistence::detail
 
 #endif  // CONVEYANCERS_MARKETPLACE_PERSISTENCE_JOBS_REPOSITORY_UTILS_H
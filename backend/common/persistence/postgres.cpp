@@ -1,14 +1,369 @@
 #include "postgres.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cstdlib>
+#include <sstream>
 #include <stdexcept>
+#include <utility>
+#include <vector>
 
 namespace persistence {
+namespace {
 
-PostgresConfig::PostgresConfig(std::string conninfo) : conninfo_(std::move(conninfo)) {
+long long EnvInteger(const char *key, long long fallback) {
+  const char *value = std::getenv(key);
+  if (value == nullptr || *value == '\0') {
+    return fallback;
+  }
+  try {
+    const long long parsed = std::stoll(value);
+    return parsed < 0 ? fallback : parsed;
+  } catch (...) {
+    return fallback;
+  }
+}
+
+// Replay lag in milliseconds. A replica with a live WAL receiver that has replayed everything it
+// received reads as zero, since pg_last_xact_replay_timestamp() stops moving while the primary is
+// idle; so does a server that is not in recovery at all. Without a live receiver nothing new
+// arrives, so the lag is the time since the last message (or since startup), however caught up
+// replay looks. The receiver counts as live when it is streaming and has heard from the primary
+// within a minute, which its keepalives (every wal_sender_timeout / 2) guarantee; a role without
+// pg_read_all_stats sees only the receiver's pid, and then its presence is all that is checked.
+constexpr const char *kReplayLagSql =
+    "select case when not pg_is_in_recovery() then 0 "
+    "when r.pid is not null and coalesce(r.status = 'streaming' and "
+    "r.last_msg_receipt_time > now() - interval '1 minute', r.status is null) then "
+    "case when pg_last_wal_receive_lsn() = pg_last_wal_replay_lsn() then 0 "
+    "else coalesce(extract(epoch from now() - pg_last_xact_replay_timestamp()) * 1000, 0) end "
+    "else extract(epoch from now() - coalesce(r.last_msg_receipt_time, pg_postmaster_start_time())) * 1000 "
+    "end::bigint from (select 1) probe left join pg_stat_wal_receiver r on true";
+
+std::optional<std::chrono::milliseconds> ReplayLag(pqxx::connection &connection) {
+  try {
+    pqxx::nontransaction probe(connection);
+    return std::chrono::milliseconds(probe.exec1(kReplayLagSql)[0].as<long long>());
+  } catch (...) {
+    return std::nullopt;
+  }
+}
+
+// The request that last wrote on this thread. httplib serves each request on one worker thread,
+// and the trace id (generated for every request, sampled or not) tells it apart from the next
+// one served there. Threads outside a request share the zero id and rely on the window alone.
+struct LastWrite {
+  const void *owner = nullptr;
+  std::array<std::uint8_t, 16> trace_id{};
+  std::chrono::steady_clock::time_point at;
+};
+
+LastWrite &ThreadLastWrite() {
+  static thread_local LastWrite last;
+  return last;
+}
+
+std::vector<std::string> SplitConnInfos(const std::string &value) {
+  std::vector<std::string> conninfos;
+  std::size_t start = 0;
+  while (start <= value.size()) {
+    const auto end = std::min(value.find(',', start), value.size());
+    const auto first = value.find_first_not_of(" \t", start);
+    if (first != std::string::npos && first < end) {
+      const auto last = value.find_last_not_of(" \t", end - 1);
+      conninfos.push_back(value.substr(first, last - first + 1));
+    }
+    start = end + 1;
+  }
+  return conninfos;
+}
+
+}  // namespace
+
+struct PostgresConfig::Replicas {
+  enum class State { kReady, kLagging, kUnavailable };
+
+  struct Replica {
+    std::shared_ptr<ConnectionPool> pool;
+    std::mutex mutex;
+    State state = State::kReady;
+    std::chrono::milliseconds lag{0};
+    bool checked = false;
+    std::chrono::steady_clock::time_point checked_at;
+    bool checking = false;
+  };
+
+  // Leases a connection from one replica, or nothing while it is lagging or unreachable. The
+  // reader that finds the last sample stale takes the next one on its own lease; readers in the
+  // meantime go by the previous sample.
+  PooledConnection Lease(Replica &replica, bool &saw_lag) const {
+    const auto now = std::chrono::steady_clock::now();
+    bool check = false;
+    {
+      std::lock_guard<std::mutex> lock(replica.mutex);
+      if ((!replica.checked || now - replica.checked_at >= options.check_interval) && !replica.checking) {
+        replica.checking = true;
+        check = true;
+      } else if (replica.state != State::kReady) {
+        saw_lag = saw_lag || replica.state == State::kLagging;
+        return {};
+      }
+    }
+
+    PooledConnection lease;
+    State state = State::kReady;
+    std::optional<std::chrono::milliseconds> lag;
+    try {
+      lease = replica.pool->Acquire();
+    } catch (...) {
+      state = State::kUnavailable;
+    }
+    if (check && lease) {
+      lag = ReplayLag(*lease);
+      if (!lag) {
+        lease.Discard();
+        state = State::kUnavailable;
+      } else if (*lag > options.max_lag) {
+        state = State::kLagging;
+      }
+    }
+    if (check || state != State::kReady) {
+      std::lock_guard<std::mutex> lock(replica.mutex);
+      if (check) {
+        replica.checking = false;
+      }
+      replica.state = state;
+      replica.checked = true;
+      replica.checked_at = now;
+      if (lag) {
+        replica.lag = *lag;
+      }
+    }
+    if (state != State::kReady) {
+      saw_lag = saw_lag || state == State::kLagging;
+      return {};
+    }
+    return lease;
+  }
+
+  ReplicaOptions options;
+  std::vector<std::unique_ptr<Replica>> members;
+  std::atomic<std::size_t> next{0};
+  std::atomic<std::uint64_t> replica_reads{0};
+  std::atomic<std::uint64_t> read_your_writes{0};
+  std::atomic<std::uint64_t> lagging{0};
+  std::atomic<std::uint64_t> unavailable{0};
+};
+
+PooledConnection::PooledConnection(std::shared_ptr<ConnectionPool> pool,
+                                   std::unique_ptr<pqxx::connection> connection, std::size_t prepared)
+    : pool_(std::move(pool)), connection_(std::move(connection)), prepared_(prepared) {}
+
+PooledConnection::PooledConnection(PooledConnection &&other) noexcept
+    : pool_(std::move(other.pool_)), connection_(std::move(other.connection_)), prepared_(other.prepared_) {}
+
+PooledConnection &PooledConnection::operator=(PooledConnection &&other) noexcept {
+  if (this != &other) {
+    Release();
+    pool_ = std::move(other.pool_);
+    connection_ = std::move(other.connection_);
+    prepared_ = other.prepared_;
+  }
+  return *this;
+}
+
+PooledConnection::~PooledConnection() {
+  Release();
+}
+
+void PooledConnection::Discard() {
+  if (!pool_) {
+    return;
+  }
+  connection_.reset();
+  pool_->Forget();
+  pool_.reset();
+}
+
+void PooledConnection::Release() {
+  if (!pool_) {
+    return;
+  }
+  pool_->Return(std::move(connection_), prepared_);
+  pool_.reset();
+}
+
+ConnectionPool::ConnectionPool(std::string conninfo, PoolOptions options)
+    : conninfo_(std::move(conninfo)), options_(options) {
+  options_.max_size = std::max<std::size_t>(options_.max_size, 1);
+  options_.min_size = std::min(options_.min_size, options_.max_size);
+}
+
+PooledConnection ConnectionPool::Acquire() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  const auto deadline = std::chrono::steady_clock::now() + options_.wait_timeout;
+  while (true) {
+    const auto now = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<pqxx::connection>> evicted;
+    EvictIdleLocked(now, evicted);
+
+    if (!idle_.empty()) {
+      // Most recently returned first: it is the least likely to have been dropped server-side.
+      IdleConnection entry = std::move(idle_.back());
+      idle_.pop_back();
+      lock.unlock();
+      evicted.clear();
+      const bool needs_probe = now - entry.returned_at >= options_.health_check_after;
+      if (!entry.connection->is_open() || (needs_probe && !Healthy(*entry.connection))) {
+        entry.connection.reset();
+        lock.lock();
+        --total_;
+        ++health_check_failures_total_;
+        continue;
+      }
+      lock.lock();
+      return Lease(lock, std::move(entry.connection), entry.prepared);
+    }
+
+    if (total_ < options_.max_size) {
+      ++total_;
+      lock.unlock();
+      evicted.clear();
+      std::unique_ptr<pqxx::connection> connection;
+      try {
+        connection = std::make_unique<pqxx::connection>(conninfo_);
+      } catch (...) {
+        lock.lock();
+        --total_;
+        available_.notify_one();
+        throw;
+      }
+      lock.lock();
+      ++created_total_;
+      return Lease(lock, std::move(connection), 0);
+    }
+
+    ++waiting_;
+    const bool ready = available_.wait_until(
+        lock, deadline, [this]() { return !idle_.empty() || total_ < options_.max_size; });
+    --waiting_;
+    if (!ready) {
+      ++timeouts_total_;
+      throw std::runtime_error("connection_pool_timeout");
+    }
+  }
+}
+
+PoolStats ConnectionPool::Stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  PoolStats stats;
+  stats.total = total_;
+  stats.idle = idle_.size();
+  stats.in_use = total_ - idle_.size();
+  stats.waiting = waiting_;
+  stats.max_size = options_.max_size;
+  stats.acquired_total = acquired_total_;
+  stats.created_total = created_total_;
+  stats.evicted_total = evicted_total_;
+  stats.timeouts_total = timeouts_total_;
+  stats.health_check_failures_total = health_check_failures_total_;
+  return stats;
+}
+
+const PoolOptions &ConnectionPool::Options() const {
+  return options_;
+}
+
+void ConnectionPool::RegisterStatements(std::span<const PreparedStatement> statements) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto &statement : statements) {
+    const auto existing = std::find_if(statements_.begin(), statements_.end(),
+                                       [&](const RegisteredStatement &item) { return item.name == statement.name; });
+    if (existing == statements_.end()) {
+      statements_.push_back(RegisteredStatement{statement.name, statement.sql});
+    } else if (existing->sql != statement.sql) {
+      throw std::invalid_argument(std::string("prepared statement redefined: ") + statement.name);
+    }
+  }
+}
+
+PooledConnection ConnectionPool::Lease(std::unique_lock<std::mutex> &lock,
+                                       std::unique_ptr<pqxx::connection> connection, std::size_t prepared) {
+  ++acquired_total_;
+  const std::vector<RegisteredStatement> pending(statements_.begin() + static_cast<std::ptrdiff_t>(prepared),
+                                                 statements_.end());
+  lock.unlock();
+  PooledConnection lease(shared_from_this(), std::move(connection), prepared);
+  for (const auto &statement : pending) {
+    lease.connection_->prepare(statement.name, statement.sql);
+    ++lease.prepared_;
+  }
+  return lease;
+}
+
+void ConnectionPool::Return(std::unique_ptr<pqxx::connection> connection, std::size_t prepared) {
+  if (!connection || !connection->is_open()) {
+    connection.reset();
+    Forget();
+    return;
+  }
+  std::vector<std::unique_ptr<pqxx::connection>> evicted;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto now = std::chrono::steady_clock::now();
+    idle_.push_back(IdleConnection{std::move(connection), now, prepared});
+    EvictIdleLocked(now, evicted);
+  }
+  available_.notify_one();
+}
+
+void ConnectionPool::Forget() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --total_;
+  }
+  available_.notify_one();
+}
+
+void ConnectionPool::EvictIdleLocked(std::chrono::steady_clock::time_point now,
+                                     std::vector<std::unique_ptr<pqxx::connection>> &evicted) {
+  // idle_ is ordered by return time, so the stalest connections sit at the front.
+  while (!idle_.empty() && total_ > options_.min_size &&
+         now - idle_.front().returned_at >= options_.idle_timeout) {
+    evicted.push_back(std::move(idle_.front().connection));
+    idle_.pop_front();
+    --total_;
+    ++evicted_total_;
+  }
+}
+
+bool ConnectionPool::Healthy(pqxx::connection &connection) {
+  try {
+    pqxx::nontransaction probe(connection);
+    probe.exec("select 1");
+    return true;
+  } catch (...) {
+    return false;
+  }
+}
+
+PostgresConfig::PostgresConfig(std::string conninfo, PoolOptions options, std::vector<std::string> replicas,
+                               ReplicaOptions replica_options)
+    : conninfo_(std::move(conninfo)), replicas_(std::make_shared<Replicas>()) {
   if (conninfo_.empty()) {
     throw std::invalid_argument("connection string must not be empty");
   }
+  pool_ = std::make_shared<ConnectionPool>(conninfo_, options);
+  replicas_->options = replica_options;
+  for (auto &replica : replicas) {
+    if (replica.empty()) {
+      throw std::invalid_argument("replica connection string must not be empty");
+    }
+    auto member = std::make_unique<Replicas::Replica>();
+    member->pool = std::make_shared<ConnectionPool>(std::move(replica), options);
+    replicas_->members.push_back(std::move(member));
+  }
 }
 
 const std::string &PostgresConfig::ConnInfo() const {
@@ -19,11 +374,167 @@ pqxx::connection PostgresConfig::Connect() const {
   return pqxx::connection(conninfo_);
 }
 
+PooledConnection PostgresConfig::Acquire() const {
+  auto lease = pool_->Acquire();
+  if (!replicas_->members.empty()) {
+    ThreadLastWrite() =
+        LastWrite{replicas_.get(), tracing::CurrentContext().trace_id, std::chrono::steady_clock::now()};
+  }
+  return lease;
+}
+
+PooledConnection PostgresConfig::AcquireRead(ReadRoute route) const {
+  auto &replicas = *replicas_;
+  if (route == ReadRoute::kPrimary || replicas.members.empty()) {
+    return pool_->Acquire();
+  }
+  const auto &last = ThreadLastWrite();
+  if (last.owner == &replicas && last.trace_id == tracing::CurrentContext().trace_id &&
+      std::chrono::steady_clock::now() - last.at < replicas.options.read_your_writes_window) {
+    replicas.read_your_writes.fetch_add(1, std::memory_order_relaxed);
+    return pool_->Acquire();
+  }
+
+  const auto count = replicas.members.size();
+  const auto start = replicas.next.fetch_add(1, std::memory_order_relaxed);
+  bool saw_lag = false;
+  for (std::size_t i = 0; i < count; ++i) {
+    if (auto lease = replicas.Lease(*replicas.members[(start + i) % count], saw_lag)) {
+      replicas.replica_reads.fetch_add(1, std::memory_order_relaxed);
+      return lease;
+    }
+  }
+  (saw_lag ? replicas.lagging : replicas.unavailable).fetch_add(1, std::memory_order_relaxed);
+  return pool_->Acquire();
+}
+
+PoolStats PostgresConfig::Stats() const {
+  return pool_->Stats();
+}
+
+RoutingStats PostgresConfig::Routing() const {
+  RoutingStats stats;
+  stats.replica_reads_total = replicas_->replica_reads.load(std::memory_order_relaxed);
+  stats.read_your_writes_total = replicas_->read_your_writes.load(std::memory_order_relaxed);
+  stats.lagging_total = replicas_->lagging.load(std::memory_order_relaxed);
+  stats.unavailable_total = replicas_->unavailable.load(std::memory_order_relaxed);
+  for (const auto &member : replicas_->members) {
+    ReplicaStats replica;
+    replica.pool = member->pool->Stats();
+    std::lock_guard<std::mutex> lock(member->mutex);
+    replica.lag = member->lag;
+    replica.available = member->state == Replicas::State::kReady;
+    stats.replicas.push_back(replica);
+  }
+  return stats;
+}
+
+void PostgresConfig::RegisterStatements(std::span<const PreparedStatement> statements) const {
+  pool_->RegisterStatements(statements);
+  for (const auto &member : replicas_->members) {
+    member->pool->RegisterStatements(statements);
+  }
+}
+
+PoolOptions MakePoolOptionsFromEnv() {
+  PoolOptions options;
+  options.min_size = static_cast<std::size_t>(EnvInteger("DATABASE_POOL_MIN_SIZE", options.min_size));
+  options.max_size = static_cast<std::size_t>(EnvInteger("DATABASE_POOL_MAX_SIZE", options.max_size));
+  options.idle_timeout =
+      std::chrono::milliseconds(EnvInteger("DATABASE_POOL_IDLE_TIMEOUT_MS", options.idle_timeout.count()));
+  options.wait_timeout =
+      std::chrono::milliseconds(EnvInteger("DATABASE_POOL_WAIT_TIMEOUT_MS", options.wait_timeout.count()));
+  options.health_check_after =
+      std::chrono::milliseconds(EnvInteger("DATABASE_POOL_HEALTH_CHECK_MS", options.health_check_after.count()));
+  return options;
+}
+
+ReplicaOptions MakeReplicaOptionsFromEnv() {
+  ReplicaOptions options;
+  options.max_lag = std::chrono::milliseconds(EnvInteger("DATABASE_REPLICA_MAX_LAG_MS", options.max_lag.count()));
+  options.check_interval =
+      std::chrono::milliseconds(EnvInteger("DATABASE_REPLICA_CHECK_MS", options.check_interval.count()));
+  options.read_your_writes_window = std::chrono::milliseconds(
+      EnvInteger("DATABASE_READ_YOUR_WRITES_MS", options.read_your_writes_window.count()));
+  return options;
+}
+
 std::shared_ptr<PostgresConfig> MakePostgresConfigFromEnv(const std::string &env_var,
                                                           const std::string &default_url) {
   const char *value = std::getenv(env_var.c_str());
   std::string conninfo = (value && *value) ? std::string(value) : default_url;
-  return std::make_shared<PostgresConfig>(std::move(conninfo));
+  const char *replicas = std::getenv("DATABASE_REPLICA_URLS");
+  return std::make_shared<PostgresConfig>(std::move(conninfo), MakePoolOptionsFromEnv(),
+                                          SplitConnInfos(replicas ? replicas : ""), MakeReplicaOptionsFromEnv());
+}
+
+std::string RenderPoolMetrics(const PoolStats &stats, std::string_view service) {
+  std::ostringstream oss;
+  oss << "# HELP db_pool_connections Postgres connections held by the pool" << '\n';
+  oss << "# TYPE db_pool_connections gauge" << '\n';
+  oss << "db_pool_connections{service=\"" << service << "\",state=\"idle\"} " << stats.idle << '\n';
+  oss << "db_pool_connections{service=\"" << service << "\",state=\"in_use\"} " << stats.in_use << '\n';
+  oss << "# HELP db_pool_max_connections Upper bound on pooled Postgres connections" << '\n';
+  oss << "# TYPE db_pool_max_connections gauge" << '\n';
+  oss << "db_pool_max_connections{service=\"" << service << "\"} " << stats.max_size << '\n';
+  oss << "# HELP db_pool_waiting Callers blocked waiting for a pooled connection" << '\n';
+  oss << "# TYPE db_pool_waiting gauge" << '\n';
+  oss << "db_pool_waiting{service=\"" << service << "\"} " << stats.waiting << '\n';
+
+  const auto counter = [&](std::string_view name, std::string_view help, std::uint64_t value) {
+    oss << "# HELP " << name << ' ' << help << '\n';
+    oss << "# TYPE " << name << " counter" << '\n';
+    oss << name << "{service=\"" << service << "\"} " << value << '\n';
+  };
+  counter("db_pool_acquired_total", "Connection leases handed out by the pool", stats.acquired_total);
+  counter("db_pool_created_total", "Postgres connections opened by the pool", stats.created_total);
+  counter("db_pool_evicted_total", "Idle connections closed after the idle timeout", stats.evicted_total);
+  counter("db_pool_timeouts_total", "Acquire calls that gave up waiting for a connection", stats.timeouts_total);
+  counter("db_pool_health_check_failures_total", "Pooled connections discarded by the checkout probe",
+          stats.health_check_failures_total);
+  return oss.str();
+}
+
+std::string RenderRoutingMetrics(const RoutingStats &stats, std::string_view service) {
+  if (stats.replicas.empty()) {
+    return {};
+  }
+  std::ostringstream oss;
+  oss << "# HELP db_replica_reads_total Replica-routed reads served by a replica" << '\n';
+  oss << "# TYPE db_replica_reads_total counter" << '\n';
+  oss << "db_replica_reads_total{service=\"" << service << "\"} " << stats.replica_reads_total << '\n';
+  oss << "# HELP db_replica_fallbacks_total Replica-routed reads served by the primary" << '\n';
+  oss << "# TYPE db_replica_fallbacks_total counter" << '\n';
+  const auto fallback = [&](std::string_view reason, std::uint64_t value) {
+    oss << "db_replica_fallbacks_total{service=\"" << service << "\",reason=\"" << reason << "\"} " << value
+        << '\n';
+  };
+  fallback("read_your_writes", stats.read_your_writes_total);
+  fallback("lagging", stats.lagging_total);
+  fallback("unavailable", stats.unavailable_total);
+
+  oss << "# HELP db_replica_lag_seconds Replay lag at the replica's last check" << '\n';
+  oss << "# TYPE db_replica_lag_seconds gauge" << '\n';
+  for (std::size_t i = 0; i < stats.replicas.size(); ++i) {
+    oss << "db_replica_lag_seconds{service=\"" << service << "\",replica=\"" << i << "\"} "
+        << static_cast<double>(stats.replicas[i].lag.count()) / 1000.0 << '\n';
+  }
+  oss << "# HELP db_replica_available Whether the replica is serving reads" << '\n';
+  oss << "# TYPE db_replica_available gauge" << '\n';
+  for (std::size_t i = 0; i < stats.replicas.size(); ++i) {
+    oss << "db_replica_available{service=\"" << service << "\",replica=\"" << i << "\"} "
+        << (stats.replicas[i].available ? 1 : 0) << '\n';
+  }
+  oss << "# HELP db_replica_pool_connections Replica connections held by the pool" << '\n';
+  oss << "# TYPE db_replica_pool_connections gauge" << '\n';
+  for (std::size_t i = 0; i < stats.replicas.size(); ++i) {
+    const auto &pool = stats.replicas[i].pool;
+    oss << "db_replica_pool_connections{service=\"" << service << "\",replica=\"" << i << "\",state=\"idle\"} "
+        << pool.idle << '\n';
+    oss << "db_replica_pool_connections{service=\"" << service << "\",replica=\"" << i
+        << "\",state=\"in_use\"} " << pool.in_use << '\n';
+  }
+  return oss.str();
 }
 
 }  // namespace persistence
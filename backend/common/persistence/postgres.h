@@ -3,9 +3,21 @@
 
 #include "pqxx_compat.h"
 
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "../tracing.h"
 
 #ifndef PQXX_COMPAT_NULL_DEFINED
 #define PQXX_COMPAT_NULL_DEFINED
@@ -16,20 +28,232 @@ inline std::nullptr_t null() noexcept { return nullptr; }
 
 namespace persistence {
 
+struct PoolOptions {
+  std::size_t min_size = 1;
+  std::size_t max_size = 8;
+  // Idle connections above min_size are closed once they have been unused for this long.
+  std::chrono::milliseconds idle_timeout{std::chrono::minutes(5)};
+  // How long Acquire() blocks for a free connection before giving up.
+  std::chrono::milliseconds wait_timeout{std::chrono::seconds(2)};
+  // Connections idle for longer than this are probed with `select 1` before being handed out.
+  std::chrono::milliseconds health_check_after{std::chrono::seconds(30)};
+};
+
+// A named statement prepared once per pooled connection. Repositories keep static tables of
+// these and execute by name so Postgres parses and plans each statement only once.
+struct PreparedStatement {
+  const char *name;
+  const char *sql;
+};
+
+// Executes a registry statement inside a client span named after it, so every query shows up
+// under the request that issued it.
+template <typename... Args>
+pqxx::result Exec(pqxx::transaction_base &txn, const PreparedStatement &statement, Args &&...args) {
+  tracing::Span span(statement.name, tracing::SpanKind::kClient);
+  span.SetAttribute("db.system", "postgresql").SetAttribute("db.query.text", statement.sql);
+  return txn.exec_prepared(statement.name, std::forward<Args>(args)...);
+}
+
+// As Exec, for statements that return exactly one row.
+template <typename... Args>
+pqxx::row Exec1(pqxx::transaction_base &txn, const PreparedStatement &statement, Args &&...args) {
+  tracing::Span span(statement.name, tracing::SpanKind::kClient);
+  span.SetAttribute("db.system", "postgresql").SetAttribute("db.query.text", statement.sql);
+  return txn.exec_prepared1(statement.name, std::forward<Args>(args)...);
+}
+
+// Row decoders resolve their column positions once per result with result.column_number() and
+// index rows by position, so a page of N rows costs one name lookup per column rather than N.
+// The views below point into the result and are only valid while it is alive; copying a view
+// into a record avoids the strlen that constructing from c_str() costs. NULL reads as empty.
+inline std::string_view Text(const pqxx::field &field) {
+  return field.is_null() ? std::string_view{} : std::string_view(field.c_str(), field.size());
+}
+
+inline std::optional<std::string_view> OptionalText(const pqxx::field &field) {
+  if (field.is_null()) {
+    return std::nullopt;
+  }
+  return std::string_view(field.c_str(), field.size());
+}
+
+struct PoolStats {
+  std::size_t total = 0;
+  std::size_t idle = 0;
+  std::size_t in_use = 0;
+  std::size_t waiting = 0;
+  std::size_t max_size = 0;
+  std::uint64_t acquired_total = 0;
+  std::uint64_t created_total = 0;
+  std::uint64_t evicted_total = 0;
+  std::uint64_t timeouts_total = 0;
+  std::uint64_t health_check_failures_total = 0;
+};
+
+class ConnectionPool;
+
+// RAII lease on a pooled connection. The connection goes back to the pool when the lease is
+// destroyed; leases are move-only and must outlive any transaction opened on them.
+class PooledConnection {
+ public:
+  PooledConnection() = default;
+  PooledConnection(const PooledConnection &) = delete;
+  PooledConnection &operator=(const PooledConnection &) = delete;
+  PooledConnection(PooledConnection &&other) noexcept;
+  PooledConnection &operator=(PooledConnection &&other) noexcept;
+  ~PooledConnection();
+
+  pqxx::connection &operator*() const { return *connection_; }
+  pqxx::connection *operator->() const { return connection_.get(); }
+  explicit operator bool() const { return connection_ != nullptr; }
+
+  // Drops the connection instead of returning it, e.g. after a protocol-level failure.
+  void Discard();
+
+ private:
+  friend class ConnectionPool;
+  PooledConnection(std::shared_ptr<ConnectionPool> pool, std::unique_ptr<pqxx::connection> connection,
+                   std::size_t prepared);
+
+  void Release();
+
+  std::shared_ptr<ConnectionPool> pool_;
+  std::unique_ptr<pqxx::connection> connection_;
+  // Number of registry statements already prepared on connection_.
+  std::size_t prepared_ = 0;
+};
+
+class ConnectionPool : public std::enable_shared_from_this<ConnectionPool> {
+ public:
+  ConnectionPool(std::string conninfo, PoolOptions options);
+
+  ConnectionPool(const ConnectionPool &) = delete;
+  ConnectionPool &operator=(const ConnectionPool &) = delete;
+
+  PooledConnection Acquire();
+  PoolStats Stats() const;
+  const PoolOptions &Options() const;
+
+  // Adds statements to the registry. Each connection prepares any statements it has not seen yet
+  // on its next checkout. Re-registering a name with identical SQL is a no-op.
+  void RegisterStatements(std::span<const PreparedStatement> statements);
+
+ private:
+  friend class PooledConnection;
+
+  struct IdleConnection {
+    std::unique_ptr<pqxx::connection> connection;
+    std::chrono::steady_clock::time_point returned_at;
+    std::size_t prepared = 0;
+  };
+
+  struct RegisteredStatement {
+    std::string name;
+    std::string sql;
+  };
+
+  PooledConnection Lease(std::unique_lock<std::mutex> &lock, std::unique_ptr<pqxx::connection> connection,
+                         std::size_t prepared);
+  void Return(std::unique_ptr<pqxx::connection> connection, std::size_t prepared);
+  void Forget();
+  void EvictIdleLocked(std::chrono::steady_clock::time_point now,
+                       std::vector<std::unique_ptr<pqxx::connection>> &evicted);
+  bool Healthy(pqxx::connection &connection);
+
+  std::string conninfo_;
+  PoolOptions options_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable available_;
+  std::deque<IdleConnection> idle_;
+  std::vector<RegisteredStatement> statements_;
+  std::size_t total_ = 0;
+  std::size_t waiting_ = 0;
+  std::uint64_t acquired_total_ = 0;
+  std::uint64_t created_total_ = 0;
+  std::uint64_t evicted_total_ = 0;
+  std::uint64_t timeouts_total_ = 0;
+  std::uint64_t health_check_failures_total_ = 0;
+};
+
+struct ReplicaOptions {
+  // Replicas replaying further behind the primary than this serve no reads until they catch up.
+  std::chrono::milliseconds max_lag{std::chrono::seconds(5)};
+  // How often each replica's replay lag is sampled, and how long an unreachable one is skipped.
+  std::chrono::milliseconds check_interval{std::chrono::seconds(2)};
+  // Once a request has written, its replica reads go to the primary for up to this long.
+  std::chrono::milliseconds read_your_writes_window{std::chrono::seconds(30)};
+};
+
+// Where a read-only repository method runs.
+enum class ReadRoute {
+  // Reads that must see every committed write: authorization lookups, uniqueness checks and
+  // reads that feed a write.
+  kPrimary,
+  // Listings and searches that tolerate up to ReplicaOptions::max_lag of staleness.
+  kReplica,
+};
+
+struct ReplicaStats {
+  PoolStats pool;
+  std::chrono::milliseconds lag{0};
+  bool available = false;
+};
+
+struct RoutingStats {
+  std::uint64_t replica_reads_total = 0;
+  // Replica-routed reads served by the primary, by reason.
+  std::uint64_t read_your_writes_total = 0;
+  std::uint64_t lagging_total = 0;
+  std::uint64_t unavailable_total = 0;
+  std::vector<ReplicaStats> replicas;
+};
+
 class PostgresConfig {
  public:
-  explicit PostgresConfig(std::string conninfo);
+  // Each replica gets a pool of its own with the same options and statement registry.
+  explicit PostgresConfig(std::string conninfo, PoolOptions options = {}, std::vector<std::string> replicas = {},
+                          ReplicaOptions replica_options = {});
 
   const std::string &ConnInfo() const;
+  // Opens a dedicated, unpooled connection.
   pqxx::connection Connect() const;
+  // Leases a primary connection for a transaction that writes; repositories should prefer this
+  // over Connect(). The rest of the calling request reads from the primary as well, so it sees
+  // its own writes.
+  PooledConnection Acquire() const;
+  // Leases a connection for a read-only transaction. kReplica reads rotate over the replicas
+  // and fall back to the primary when there are none, when the request has already written, or
+  // when every replica is lagging or unreachable.
+  PooledConnection AcquireRead(ReadRoute route) const;
+  PoolStats Stats() const;
+  RoutingStats Routing() const;
+  void RegisterStatements(std::span<const PreparedStatement> statements) const;
 
  private:
+  struct Replicas;
+
   std::string conninfo_;
+  std::shared_ptr<ConnectionPool> pool_;
+  std::shared_ptr<Replicas> replicas_;
 };
 
+PoolOptions MakePoolOptionsFromEnv();
+
+ReplicaOptions MakeReplicaOptionsFromEnv();
+
+// Replica conninfos come from DATABASE_REPLICA_URLS, separated by commas.
 std::shared_ptr<PostgresConfig> MakePostgresConfigFromEnv(const std::string &env_var,
                                                           const std::string &default_url);
 
+// Prometheus exposition of the pool counters, appended to a service's /metrics output.
+std::string RenderPoolMetrics(const PoolStats &stats, std::string_view service);
+
+// Read routing counters and per-replica lag and pool gauges; replicas are labelled by position
+// in DATABASE_REPLICA_URLS so credentials stay out of the output.
+std::string RenderRoutingMetrics(const RoutingStats &stats, std::string_view service);
+
 }  // namespace persistence
 
 #endif  // CONVEYANCERS_MARKETPLACE_PERSISTENCE_POSTGRES_H
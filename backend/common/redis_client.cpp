@@ -0,0 +1,226 @@
+#include "redis_client.h"
+
+#include <charconv>
+#include <stdexcept>
+#include <utility>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace redis {
+namespace {
+
+std::int64_t ParseRespInteger(std::string_view text) {
+  std::int64_t value = 0;
+  const auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+  if (ec != std::errc() || ptr != text.data() + text.size()) {
+    throw std::runtime_error("redis_protocol_error");
+  }
+  return value;
+}
+
+timeval ToTimeval(std::chrono::milliseconds timeout) {
+  timeval tv{};
+  tv.tv_sec = static_cast<decltype(tv.tv_sec)>(timeout.count() / 1000);
+  tv.tv_usec = static_cast<decltype(tv.tv_usec)>((timeout.count() % 1000) * 1000);
+  return tv;
+}
+
+}  // namespace
+
+void AppendRespCommand(std::string &out, std::initializer_list<std::string_view> args) {
+  out.push_back('*');
+  out.append(std::to_string(args.size()));
+  out.append("\r\n");
+  for (const auto arg : args) {
+    out.push_back('$');
+    out.append(std::to_string(arg.size()));
+    out.append("\r\n");
+    out.append(arg);
+    out.append("\r\n");
+  }
+}
+
+void RespParser::Feed(const char *data, std::size_t length) {
+  if (offset_ > 0 && offset_ == buffer_.size()) {
+    buffer_.clear();
+    offset_ = 0;
+  } else if (offset_ >= 4096 && offset_ * 2 >= buffer_.size()) {
+    buffer_.erase(0, offset_);
+    offset_ = 0;
+  }
+  buffer_.append(data, length);
+}
+
+std::optional<RespReply> RespParser::Next() {
+  std::size_t pos = offset_;
+  RespReply reply;
+  if (!Parse(&pos, &reply)) {
+    return std::nullopt;
+  }
+  offset_ = pos;
+  return reply;
+}
+
+bool RespParser::ReadLine(std::size_t *pos, std::string_view *line) const {
+  const std::size_t end = buffer_.find("\r\n", *pos);
+  if (end == std::string::npos) {
+    return false;
+  }
+  *line = std::string_view(buffer_).substr(*pos, end - *pos);
+  *pos = end + 2;
+  return true;
+}
+
+bool RespParser::Parse(std::size_t *pos, RespReply *reply) const {
+  std::string_view line;
+  if (!ReadLine(pos, &line)) {
+    return false;
+  }
+  if (line.empty()) {
+    throw std::runtime_error("redis_protocol_error");
+  }
+  const std::string_view body = line.substr(1);
+  switch (line.front()) {
+    case '+':
+      reply->type = RespReply::Type::kSimple;
+      reply->text.assign(body);
+      return true;
+    case '-':
+      reply->type = RespReply::Type::kError;
+      reply->text.assign(body);
+      return true;
+    case ':':
+      reply->type = RespReply::Type::kInteger;
+      reply->integer = ParseRespInteger(body);
+      return true;
+    case '$': {
+      const std::int64_t length = ParseRespInteger(body);
+      if (length < 0) {
+        reply->type = RespReply::Type::kNull;
+        return true;
+      }
+      const auto size = static_cast<std::size_t>(length);
+      if (buffer_.size() - *pos < size + 2) {
+        return false;
+      }
+      if (buffer_.compare(*pos + size, 2, "\r\n") != 0) {
+        throw std::runtime_error("redis_protocol_error");
+      }
+      reply->type = RespReply::Type::kBulk;
+      reply->text.assign(buffer_, *pos, size);
+      *pos += size + 2;
+      return true;
+    }
+    case '*': {
+      const std::int64_t count = ParseRespInteger(body);
+      if (count < 0) {
+        reply->type = RespReply::Type::kNull;
+        return true;
+      }
+      reply->type = RespReply::Type::kArray;
+      reply->elements.resize(static_cast<std::size_t>(count));
+      for (auto &element : reply->elements) {
+        if (!Parse(pos, &element)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    default:
+      throw std::runtime_error("redis_protocol_error");
+  }
+}
+
+Connection::Connection(const std::string &host, int port, const std::string &password,
+                       std::chrono::milliseconds timeout) {
+  if (host.empty() || port <= 0) {
+    throw std::runtime_error("invalid_target");
+  }
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *result = nullptr;
+  const std::string port_str = std::to_string(port);
+  if (getaddrinfo(host.c_str(), port_str.c_str(), &hints, &result) != 0) {
+    throw std::runtime_error("getaddrinfo_failed");
+  }
+  for (auto *entry = result; entry != nullptr; entry = entry->ai_next) {
+    fd_ = ::socket(entry->ai_family, entry->ai_socktype, entry->ai_protocol);
+    if (fd_ < 0) {
+      continue;
+    }
+    if (::connect(fd_, entry->ai_addr, entry->ai_addrlen) == 0) {
+      break;
+    }
+    ::close(fd_);
+    fd_ = -1;
+  }
+  freeaddrinfo(result);
+  if (fd_ < 0) {
+    throw std::runtime_error("connect_failed");
+  }
+  const timeval tv = ToTimeval(timeout);
+  ::setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  ::setsockopt(fd_, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  const int one = 1;
+  ::setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  if (!password.empty()) {
+    std::string auth;
+    AppendRespCommand(auth, {"AUTH", password});
+    try {
+      Write(auth);
+      if (Read().type == RespReply::Type::kError) {
+        throw std::runtime_error("redis_auth_failed");
+      }
+    } catch (...) {
+      ::close(fd_);
+      throw;
+    }
+  }
+}
+
+Connection::~Connection() {
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+}
+
+void Connection::Write(std::string_view data) {
+  std::size_t sent = 0;
+  while (sent < data.size()) {
+    const ssize_t rc = ::send(fd_, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (rc < 0) {
+      throw std::runtime_error("send_failed");
+    }
+    sent += static_cast<std::size_t>(rc);
+  }
+}
+
+void Connection::SetReadTimeout(std::chrono::milliseconds timeout) {
+  const timeval tv = ToTimeval(timeout);
+  ::setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+void Connection::Shutdown() { ::shutdown(fd_, SHUT_RDWR); }
+
+RespReply Connection::Read() {
+  char buffer[16 * 1024];
+  while (true) {
+    if (auto reply = parser_.Next()) {
+      return std::move(*reply);
+    }
+    const ssize_t rc = ::recv(fd_, buffer, sizeof(buffer), 0);
+    if (rc <= 0) {
+      throw std::runtime_error(rc == 0 ? "connection_closed" : "recv_failed");
+    }
+    parser_.Feed(buffer, static_cast<std::size_t>(rc));
+  }
+}
+
+}  // namespace redis
@@ -0,0 +1,72 @@
+#ifndef CONVEYANCERS_MARKETPLACE_REDIS_CLIENT_H
+#define CONVEYANCERS_MARKETPLACE_REDIS_CLIENT_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// RESP encoding and one blocking connection, shared by the jobs pub/sub clients and the
+// gateway's rate limit store.
+namespace redis {
+
+// Appends one command to out as a RESP array of bulk strings.
+void AppendRespCommand(std::string &out, std::initializer_list<std::string_view> args);
+
+struct RespReply {
+  enum class Type { kSimple, kError, kInteger, kBulk, kNull, kArray };
+
+  Type type = Type::kNull;
+  std::string text;
+  std::int64_t integer = 0;
+  std::vector<RespReply> elements;
+};
+
+// Incremental RESP2 decoder. Feed it whatever recv() returned and pull complete replies out;
+// partial replies stay buffered until the rest arrives.
+class RespParser {
+ public:
+  void Feed(const char *data, std::size_t length);
+  // Throws std::runtime_error on malformed input.
+  std::optional<RespReply> Next();
+  std::size_t Buffered() const { return buffer_.size() - offset_; }
+
+ private:
+  // Parses one reply starting at *pos; false when more bytes are needed.
+  bool Parse(std::size_t *pos, RespReply *reply) const;
+  bool ReadLine(std::size_t *pos, std::string_view *line) const;
+
+  std::string buffer_;
+  std::size_t offset_ = 0;
+};
+
+// One blocking connection with buffered reads. AUTH is sent on connect when a password is set.
+class Connection {
+ public:
+  Connection(const std::string &host, int port, const std::string &password,
+             std::chrono::milliseconds timeout);
+  ~Connection();
+
+  Connection(const Connection &) = delete;
+  Connection &operator=(const Connection &) = delete;
+
+  void Write(std::string_view data);
+  // Zero lets Read() wait indefinitely, which is what an idle subscriber connection needs.
+  void SetReadTimeout(std::chrono::milliseconds timeout);
+  // Blocks until a full reply has been read. Throws on timeout or disconnect.
+  RespReply Read();
+  // Unblocks a Read() in progress on another thread; the connection is unusable afterwards.
+  void Shutdown();
+
+ private:
+  int fd_ = -1;
+  RespParser parser_;
+};
+
+}  // namespace redis
+
+#endif  // CONVEYANCERS_MARKETPLACE_REDIS_CLIENT_H
@@ -0,0 +1,377 @@
+#ifndef CONVEYANCERS_MARKETPLACE_RESPONSE_FILTER_H
+#define CONVEYANCERS_MARKETPLACE_RESPONSE_FILTER_H
+
+#include <brotli/encode.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "../third_party/httplib.h"
+#include "metrics.h"
+
+namespace response_filter {
+
+struct FilterOptions {
+  bool compress = true;
+  // Smaller bodies go out as they are: below about a kilobyte the gzip framing and the CPU cost
+  // outweigh the bytes saved.
+  std::size_t min_compress_bytes = 1024;
+};
+
+enum class Encoding { kIdentity, kGzip, kBrotli };
+
+// Compression happens on the request path, so both levels favour speed over ratio.
+constexpr int kGzipLevel = 6;
+constexpr int kBrotliQuality = 4;
+
+// Thread-local scratch buffers grown past this are released after use, so one large response
+// does not pin its size on every worker.
+constexpr std::size_t kMaxRetainedScratchBytes = 1024 * 1024;
+
+struct FilterStats {
+  metrics::Counter gzip;
+  metrics::Counter brotli;
+  metrics::Counter not_modified;
+  metrics::Counter bytes_in;
+  metrics::Counter bytes_out;
+};
+
+namespace detail {
+
+inline std::string_view Trim(std::string_view value) {
+  while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+    value.remove_prefix(1);
+  }
+  while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+    value.remove_suffix(1);
+  }
+  return value;
+}
+
+inline bool EqualsIgnoreCase(std::string_view a, std::string_view b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Parses the q parameter of one Accept-Encoding element; 1 when absent, 0 when malformed.
+inline double Quality(std::string_view params) {
+  while (!params.empty()) {
+    const auto end = params.find(';');
+    const auto param = Trim(params.substr(0, end));
+    if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+      const std::string value(param.substr(2));
+      char *parsed_end = nullptr;
+      const double q = std::strtod(value.c_str(), &parsed_end);
+      return parsed_end == value.c_str() + value.size() && q >= 0 && q <= 1 ? q : 0;
+    }
+    if (end == std::string_view::npos) {
+      break;
+    }
+    params.remove_prefix(end + 1);
+  }
+  return 1;
+}
+
+inline bool Compressible(std::string_view content_type) {
+  content_type = Trim(content_type.substr(0, content_type.find(';')));
+  if (content_type.substr(0, 5) == "text/") {
+    return content_type != "text/event-stream";
+  }
+  return content_type == "application/json" || content_type == "application/javascript" ||
+         content_type == "application/xml" || content_type == "image/svg+xml";
+}
+
+inline std::uint64_t Mix(std::uint64_t value) {
+  value ^= value >> 33;
+  value *= 0xff51afd7ed558ccdULL;
+  value ^= value >> 33;
+  value *= 0xc4ceb9fe1a85ec53ULL;
+  value ^= value >> 33;
+  return value;
+}
+
+// 64-bit content hash read a word at a time; it only has to tell successive versions of one
+// resource apart, not resist an adversary.
+inline std::uint64_t BodyHash(std::string_view body) {
+  std::uint64_t hash = 0x9e3779b97f4a7c15ULL ^ body.size();
+  std::size_t i = 0;
+  for (; i + 8 <= body.size(); i += 8) {
+    std::uint64_t word;
+    std::memcpy(&word, body.data() + i, sizeof(word));
+    hash = (hash ^ Mix(word)) * 0x100000001b3ULL;
+  }
+  std::uint64_t tail = 0;
+  std::memcpy(&tail, body.data() + i, body.size() - i);
+  return Mix(hash ^ Mix(tail));
+}
+
+inline void AppendHex(std::string &out, std::uint64_t value) {
+  static constexpr char kDigits[] = "0123456789abcdef";
+  char buffer[16];
+  int length = 0;
+  do {
+    buffer[length++] = kDigits[value & 0xf];
+    value >>= 4;
+  } while (value != 0);
+  while (length > 0) {
+    out.push_back(buffer[--length]);
+  }
+}
+
+inline std::string_view EncodingSuffix(Encoding encoding) {
+  switch (encoding) {
+    case Encoding::kGzip:
+      return "-gzip";
+    case Encoding::kBrotli:
+      return "-br";
+    case Encoding::kIdentity:
+      break;
+  }
+  return {};
+}
+
+// Reused for every gzip response on this thread; deflateReset keeps the allocated window and
+// hash tables instead of setting them up per response.
+class GzipContext {
+ public:
+  GzipContext() {
+    std::memset(&stream_, 0, sizeof(stream_));
+    ready_ = deflateInit2(&stream_, kGzipLevel, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+  }
+
+  GzipContext(const GzipContext &) = delete;
+  GzipContext &operator=(const GzipContext &) = delete;
+
+  ~GzipContext() {
+    if (ready_) {
+      deflateEnd(&stream_);
+    }
+  }
+
+  bool Compress(std::string_view input, std::string &out) {
+    if (!ready_ || deflateReset(&stream_) != Z_OK) {
+      return false;
+    }
+    out.resize(deflateBound(&stream_, static_cast<uLong>(input.size())));
+    stream_.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+    stream_.avail_in = static_cast<uInt>(input.size());
+    stream_.next_out = reinterpret_cast<Bytef *>(out.data());
+    stream_.avail_out = static_cast<uInt>(out.size());
+    if (deflate(&stream_, Z_FINISH) != Z_STREAM_END) {
+      return false;
+    }
+    out.resize(stream_.total_out);
+    return true;
+  }
+
+ private:
+  z_stream stream_;
+  bool ready_ = false;
+};
+
+}  // namespace detail
+
+// Picks the coding with the highest q value the client accepts, preferring brotli on a tie.
+// Codings listed with q=0 are refused even when "*" would allow them.
+inline Encoding Negotiate(std::string_view accept_encoding) {
+  double brotli = -1;
+  double gzip = -1;
+  double any = -1;
+  while (!accept_encoding.empty()) {
+    const auto end = accept_encoding.find(',');
+    const auto element = accept_encoding.substr(0, end);
+    const auto params_at = element.find(';');
+    const auto name = detail::Trim(element.substr(0, params_at));
+    const double q = params_at == std::string_view::npos ? 1 : detail::Quality(element.substr(params_at + 1));
+    if (detail::EqualsIgnoreCase(name, "br")) {
+      brotli = q;
+    } else if (detail::EqualsIgnoreCase(name, "gzip") || detail::EqualsIgnoreCase(name, "x-gzip")) {
+      gzip = q;
+    } else if (name == "*") {
+      any = q;
+    }
+    if (end == std::string_view::npos) {
+      break;
+    }
+    accept_encoding.remove_prefix(end + 1);
+  }
+  brotli = brotli < 0 ? std::max(any, 0.0) : brotli;
+  gzip = gzip < 0 ? std::max(any, 0.0) : gzip;
+  if (brotli > 0 && brotli >= gzip) {
+    return Encoding::kBrotli;
+  }
+  return gzip > 0 ? Encoding::kGzip : Encoding::kIdentity;
+}
+
+// Compresses input into out, which is overwritten. False when the codec fails.
+inline bool Compress(Encoding encoding, std::string_view input, std::string &out) {
+  if (encoding == Encoding::kGzip) {
+    thread_local detail::GzipContext gzip;
+    return gzip.Compress(input, out);
+  }
+  if (encoding == Encoding::kBrotli) {
+    // The brotli encoder has no reset, so only the output buffer is reused across responses.
+    std::size_t size = BrotliEncoderMaxCompressedSize(input.size());
+    if (size == 0) {
+      return false;
+    }
+    out.resize(size);
+    if (!BrotliEncoderCompress(kBrotliQuality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, input.size(),
+                               reinterpret_cast<const std::uint8_t *>(input.data()), &size,
+                               reinterpret_cast<std::uint8_t *>(out.data()))) {
+      return false;
+    }
+    out.resize(size);
+    return true;
+  }
+  return false;
+}
+
+// Strong validator for a body: its length and a content hash, e.g. "2f1-9c0e5d7a41b3f286".
+inline std::string StrongEtag(std::string_view body) {
+  std::string etag = "\"";
+  detail::AppendHex(etag, body.size());
+  etag.push_back('-');
+  detail::AppendHex(etag, detail::BodyHash(body));
+  etag.push_back('"');
+  return etag;
+}
+
+// A compressed body is a different representation, so a strong tag gets the coding appended
+// inside the quotes. Weak tags already tolerate that difference and are returned as they are.
+inline std::string RepresentationEtag(std::string_view etag, Encoding encoding) {
+  const auto suffix = detail::EncodingSuffix(encoding);
+  if (suffix.empty() || etag.size() < 2 || etag.substr(0, 2) == "W/" || etag.back() != '"') {
+    return std::string(etag);
+  }
+  std::string tagged(etag.substr(0, etag.size() - 1));
+  tagged.append(suffix).push_back('"');
+  return tagged;
+}
+
+// True when an If-None-Match header value lists etag (or is "*"). Candidates may carry a coding
+// suffix from RepresentationEtag: a cached gzip copy of the current body is still current.
+inline bool EtagMatches(std::string_view if_none_match, std::string_view etag) {
+  if (etag.empty()) {
+    return false;
+  }
+  std::size_t pos = 0;
+  while (pos < if_none_match.size()) {
+    std::size_t end = if_none_match.find(',', pos);
+    if (end == std::string_view::npos) {
+      end = if_none_match.size();
+    }
+    std::string_view candidate = detail::Trim(if_none_match.substr(pos, end - pos));
+    // If-None-Match uses weak comparison, so W/"x" matches "x".
+    if (candidate.substr(0, 2) == "W/") {
+      candidate.remove_prefix(2);
+    }
+    if (candidate == "*" || candidate == etag) {
+      return true;
+    }
+    for (const auto encoding : {Encoding::kGzip, Encoding::kBrotli}) {
+      if (candidate == RepresentationEtag(etag, encoding)) {
+        return true;
+      }
+    }
+    pos = end + 1;
+  }
+  return false;
+}
+
+// Post-routing step for buffered 200 responses to GET and HEAD. Tags the body with a strong
+// ETag unless the handler set one, answers a matching If-None-Match with 304 and no body, and
+// otherwise compresses bodies above the threshold in the coding the client prefers. Handlers
+// that can tell a response is unchanged before rendering it (see jobs' template list) can still
+// answer 304 themselves with EtagMatches. Streamed responses, ranges and errors pass through.
+inline void Apply(const httplib::Request &req, httplib::Response &res, const FilterOptions &options,
+                  FilterStats &stats) {
+  if ((req.method != "GET" && req.method != "HEAD") || res.status != 200 || res.body.empty() ||
+      res.has_header("Content-Encoding") || res.has_header("Content-Range")) {
+    return;
+  }
+  if (!res.has_header("ETag")) {
+    res.set_header("ETag", StrongEtag(res.body));
+  }
+  const auto etag = res.get_header_value("ETag");
+  if (EtagMatches(req.get_header_value("If-None-Match"), etag)) {
+    res.status = 304;
+    res.body.clear();
+    res.headers.erase("Content-Length");
+    res.headers.erase("Content-Type");
+    stats.not_modified.Add();
+    return;
+  }
+  if (!options.compress || res.body.size() < options.min_compress_bytes ||
+      !detail::Compressible(res.get_header_value("Content-Type"))) {
+    return;
+  }
+  if (!res.has_header("Vary")) {
+    res.set_header("Vary", "Accept-Encoding");
+  }
+  const auto encoding = Negotiate(req.get_header_value("Accept-Encoding"));
+  if (encoding == Encoding::kIdentity) {
+    return;
+  }
+  thread_local std::string scratch;
+  if (Compress(encoding, res.body, scratch) && scratch.size() < res.body.size()) {
+    stats.bytes_in.Add(res.body.size());
+    stats.bytes_out.Add(scratch.size());
+    (encoding == Encoding::kGzip ? stats.gzip : stats.brotli).Add();
+    // The uncompressed body becomes the next scratch buffer.
+    res.body.swap(scratch);
+    res.headers.erase("Content-Length");
+    res.set_header("Content-Length", std::to_string(res.body.size()));
+    res.set_header("Content-Encoding", encoding == Encoding::kGzip ? "gzip" : "br");
+    res.headers.erase("ETag");
+    res.set_header("ETag", RepresentationEtag(etag, encoding));
+  }
+  if (scratch.capacity() > kMaxRetainedScratchBytes) {
+    std::string().swap(scratch);
+  }
+}
+
+inline void Attach(httplib::Server &server, const FilterOptions &options, std::shared_ptr<FilterStats> stats) {
+  server.set_post_routing_handler([options, stats](const httplib::Request &req, httplib::Response &res) {
+    Apply(req, res, options, *stats);
+  });
+}
+
+inline std::string RenderMetrics(const FilterStats &stats, std::string_view service) {
+  std::ostringstream labels;
+  labels << "service=\"" << service << '"';
+  std::ostringstream oss;
+  oss << "# HELP http_responses_compressed_total Response bodies sent compressed" << '\n';
+  oss << "# TYPE http_responses_compressed_total counter" << '\n';
+  oss << "http_responses_compressed_total{" << labels.str() << ",encoding=\"gzip\"} " << stats.gzip.Value() << '\n';
+  oss << "http_responses_compressed_total{" << labels.str() << ",encoding=\"br\"} " << stats.brotli.Value() << '\n';
+  oss << "# HELP http_compression_bytes_total Bytes of compressed response bodies before and after compression"
+      << '\n';
+  oss << "# TYPE http_compression_bytes_total counter" << '\n';
+  oss << "http_compression_bytes_total{" << labels.str() << ",stage=\"input\"} " << stats.bytes_in.Value() << '\n';
+  oss << "http_compression_bytes_total{" << labels.str() << ",stage=\"output\"} " << stats.bytes_out.Value() << '\n';
+  oss << "# HELP http_responses_not_modified_total GET requests answered 304 from If-None-Match" << '\n';
+  oss << "# TYPE http_responses_not_modified_total counter" << '\n';
+  oss << "http_responses_not_modified_total{" << labels.str() << "} " << stats.not_modified.Value() << '\n';
+  return oss.str();
+}
+
+}  // namespace response_filter
+
+#endif  // CONVEYANCERS_MARKETPLACE_RESPONSE_FILTER_H
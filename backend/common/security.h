@@ -2,19 +2,25 @@
 #define CONVEYANCERS_MARKETPLACE_SECURITY_H
 
 #include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
 #include <functional>
 #include <initializer_list>
 #include <map>
 #include <mutex>
+#include <optional>
 #include <sstream>
 #include <string>
 #include <string_view>
-#include <tuple>
 #include <utility>
+#include <vector>
 
 #include "../third_party/httplib.h"
 #include "logger.h"
+#include "metrics.h"
+#include "tracing.h"
 
 namespace security {
 
@@ -25,50 +31,126 @@ class MetricsRegistry {
     return instance;
   }
 
-  void RecordRequest(std::string_view service, std::string_view method, int status) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    auto &service_bucket = request_totals_[std::string(service)];
-    service_bucket[{std::string(method), status}] += 1;
+  // path is the raw request path; identifiers are folded into ":id" for the route label, and
+  // 4xx responses, which include every unmatched path, share metrics::kUnmatchedRoute. Label
+  // sets past the family's cap are counted under route "overflow".
+  void RecordRequest(std::string_view service, std::string_view path, std::string_view method, int status,
+                     std::chrono::nanoseconds duration) {
+    thread_local std::string key;
+    thread_local std::string overflow_key;
+    thread_local std::string route;
+    route.clear();
+    if (status >= 400 && status < 500) {
+      route.append(metrics::kUnmatchedRoute);
+    } else {
+      metrics::AppendRouteLabel(route, path);
+    }
+    char status_text[8];
+    const int length = std::snprintf(status_text, sizeof(status_text), "%d", status);
+    const std::string_view status_label(status_text, static_cast<std::size_t>(length));
+    metrics::JoinLabels(key, {service, route, method, status_label});
+    metrics::JoinLabels(overflow_key, {service, "overflow", method, status_label});
+    requests_.Get(key, overflow_key).Observe(duration);
   }
 
   void RecordAuthFailure(std::string_view service, std::string_view category) {
+    thread_local std::string key;
+    metrics::JoinLabels(key, {service, category});
+    auth_failures_.Get(key).Add();
+  }
+
+  // Callers resolve the gauge once and adjust it around each request.
+  metrics::Gauge &InFlight(std::string_view service) { return in_flight_.Get(service); }
+
+  // Collectors append exposition owned by other modules (e.g. the Postgres pool) to Render().
+  void RegisterCollector(std::string_view service, std::function<std::string()> collector) {
     std::lock_guard<std::mutex> lock(mutex_);
-    auth_failures_[std::string(service)][std::string(category)] += 1;
+    collectors_[std::string(service)].push_back(std::move(collector));
   }
 
   std::string Render(std::string_view service) {
-    std::lock_guard<std::mutex> lock(mutex_);
     const auto service_key = std::string(service);
+    const auto requests = requests_.Collect();
     std::ostringstream oss;
+
+    // Counts per method and status are derived from the histograms; route is folded away here
+    // to keep the long-standing service_request_total series unchanged.
+    std::map<std::pair<std::string, std::string>, std::uint64_t> totals;
+    std::vector<std::pair<std::vector<std::string_view>, metrics::Histogram::Snapshot>> histograms;
+    for (const auto &[key, histogram] : requests) {
+      auto labels = metrics::SplitLabels(key);
+      if (labels.size() != 4 || labels[0] != service_key) {
+        continue;
+      }
+      auto snapshot = histogram->Collect();
+      totals[{std::string(labels[2]), std::string(labels[3])}] += snapshot.count;
+      histograms.emplace_back(std::move(labels), snapshot);
+    }
     oss << "# HELP service_request_total Total HTTP requests handled by the service" << '\n';
     oss << "# TYPE service_request_total counter" << '\n';
-    if (auto it = request_totals_.find(service_key); it != request_totals_.end()) {
-      for (const auto &entry : it->second) {
-        const auto &method = std::get<0>(entry.first);
-        const auto status = std::get<1>(entry.first);
-        oss << "service_request_total{service=\"" << service_key << "\",method=\"" << method
-            << "\",status=\"" << status << "\"} " << entry.second << '\n';
-      }
+    for (const auto &[labels, count] : totals) {
+      oss << "service_request_total{service=\"" << service_key << "\",method=\"" << labels.first
+          << "\",status=\"" << labels.second << "\"} " << count << '\n';
+    }
+    oss << "# HELP service_request_duration_seconds HTTP request latency by route, method and status" << '\n';
+    oss << "# TYPE service_request_duration_seconds histogram" << '\n';
+    for (const auto &[labels, snapshot] : histograms) {
+      std::ostringstream label_oss;
+      label_oss << "service=\"" << service_key << "\",route=\"" << labels[1] << "\",method=\"" << labels[2]
+                << "\",status=\"" << labels[3] << '"';
+      metrics::WriteHistogram(oss, "service_request_duration_seconds", label_oss.str(), snapshot);
     }
+    oss << "# HELP service_requests_in_flight HTTP requests currently being handled" << '\n';
+    oss << "# TYPE service_requests_in_flight gauge" << '\n';
+    oss << "service_requests_in_flight{service=\"" << service_key << "\"} " << InFlight(service_key).Value() << '\n';
     oss << "# HELP service_auth_failures_total Authentication and authorization failures" << '\n';
     oss << "# TYPE service_auth_failures_total counter" << '\n';
-    if (auto it = auth_failures_.find(service_key); it != auth_failures_.end()) {
-      for (const auto &entry : it->second) {
-        oss << "service_auth_failures_total{service=\"" << service_key << "\",category=\""
-            << entry.first << "\"} " << entry.second << '\n';
+    for (const auto &[key, counter] : auth_failures_.Collect()) {
+      const auto labels = metrics::SplitLabels(key);
+      if (labels.size() != 2 || labels[0] != service_key) {
+        continue;
       }
+      oss << "service_auth_failures_total{service=\"" << service_key << "\",category=\"" << labels[1]
+          << "\"} " << counter->Value() << '\n';
+    }
+    std::vector<std::function<std::string()>> collectors;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (auto it = collectors_.find(service_key); it != collectors_.end()) {
+        collectors = it->second;
+      }
+    }
+    if (logging::AsyncLogWriter::Enabled()) {
+      const auto stats = logging::AsyncLogWriter::Instance().Stats();
+      oss << "# HELP service_log_entries_total Log entries handled by the async writer" << '\n';
+      oss << "# TYPE service_log_entries_total counter" << '\n';
+      oss << "service_log_entries_total{service=\"" << service_key << "\",outcome=\"written\"} " << stats.written
+          << '\n';
+      oss << "service_log_entries_total{service=\"" << service_key << "\",outcome=\"dropped\"} " << stats.dropped
+          << '\n';
+      oss << "# HELP service_log_queue_depth Log entries waiting for the async writer" << '\n';
+      oss << "# TYPE service_log_queue_depth gauge" << '\n';
+      oss << "service_log_queue_depth{service=\"" << service_key << "\"} "
+          << (stats.enqueued > stats.written ? stats.enqueued - stats.written : 0) << '\n';
+      oss << "# HELP service_log_rotations_total Log files rotated by the async writer" << '\n';
+      oss << "# TYPE service_log_rotations_total counter" << '\n';
+      oss << "service_log_rotations_total{service=\"" << service_key << "\"} " << stats.rotations << '\n';
+    }
+    for (const auto &collector : collectors) {
+      oss << collector();
     }
     return oss.str();
   }
 
  private:
-  using RequestKey = std::tuple<std::string, int>;
-
   MetricsRegistry() = default;
 
+  metrics::Family<metrics::Histogram> requests_;
+  metrics::Family<metrics::Counter> auth_failures_;
+  metrics::Family<metrics::Gauge> in_flight_;
+
   std::mutex mutex_;
-  std::map<std::string, std::map<RequestKey, long long>> request_totals_;
-  std::map<std::string, std::map<std::string, long long>> auth_failures_;
+  std::map<std::string, std::vector<std::function<std::string()>>> collectors_;
 };
 
 inline void LogEvent(std::string_view service, std::string_view category, std::string_view message,
@@ -101,11 +183,18 @@ inline bool VerifyScopedToken(std::string_view scope, std::string_view subject,
   return token == DeriveScopedToken(scope, subject);
 }
 
+// Falls back to the trace id of the request being served, so log lines of one request share
+// an id that also finds its spans.
 inline std::string RequestId(const httplib::Request &req) {
   if (auto value = req.get_header_value("X-Request-Id"); !value.empty()) {
     return value;
   }
-  return "generated-" + std::to_string(std::hash<std::string>{}(req.path + req.method));
+  if (const auto &context = tracing::CurrentContext(); context.Valid()) {
+    return tracing::TraceIdHex(context);
+  }
+  tracing::SpanContext generated;
+  tracing::detail::FillRandom(generated.trace_id);
+  return "generated-" + tracing::TraceIdHex(generated);
 }
 
 inline bool Authorize(const httplib::Request &req, httplib::Response &res,
@@ -149,17 +238,75 @@ inline bool RequireRole(const httplib::Request &req, httplib::Response &res,
   return true;
 }
 
+// Set on the thread that answers connections the worker pool has no room for (see
+// http_server::WorkerPool); requests served there are refused before routing.
+inline bool &SheddingLoad() {
+  static thread_local bool shedding = false;
+  return shedding;
+}
+
 inline void ConfigureServer(httplib::Server &server, std::string_view service_name) {
-  server.set_logger([service_name](const auto &req, const auto &res) {
+  // Resolved once: the registry lookup takes a lock and every request is logged.
+  auto *logger = &logging::ServiceLogger::Instance(service_name);
+  auto *in_flight = &MetricsRegistry::Instance().InFlight(service_name);
+
+  // httplib routes, handles and logs a request on one worker thread, so the start time and the
+  // server span can live in a thread_local. Requests rejected before routing never set them and
+  // are neither timed nor traced.
+  struct RequestTiming {
+    bool started = false;
+    std::chrono::steady_clock::time_point start;
+    std::optional<tracing::Span> span;
+  };
+  static thread_local RequestTiming timing;
+  server.set_pre_routing_handler([in_flight](const auto &req, auto &res) {
+    timing.started = true;
+    timing.start = std::chrono::steady_clock::now();
+    in_flight->Add(1);
+    const auto parent = tracing::ParseTraceparent(req.get_header_value("traceparent"));
+    timing.span.emplace("HTTP", tracing::SpanKind::kServer, parent.value_or(tracing::SpanContext{}));
+    if (timing.span->Recording()) {
+      std::string route;
+      metrics::AppendRouteLabel(route, req.path);
+      timing.span->SetName(req.method + " " + route)
+          .SetAttribute("http.request.method", req.method)
+          .SetAttribute("http.route", route)
+          .SetAttribute("url.path", req.path);
+    }
+    if (SheddingLoad()) {
+      res.status = 503;
+      res.set_header("Retry-After", "1");
+      res.set_header("Connection", "close");
+      res.set_content(R"({"error":"overloaded"})", "application/json");
+      return httplib::Server::HandlerResponse::Handled;
+    }
+    return httplib::Server::HandlerResponse::Unhandled;
+  });
+
+  server.set_logger([service_name, logger, in_flight](const auto &req, const auto &res) {
+    std::chrono::nanoseconds duration{0};
+    if (timing.started) {
+      duration = std::chrono::steady_clock::now() - timing.start;
+      timing.started = false;
+      in_flight->Add(-1);
+    }
+    MetricsRegistry::Instance().RecordRequest(service_name, req.path, req.method, res.status, duration);
+    const auto request_id = RequestId(req);
+    if (timing.span) {
+      timing.span->SetAttribute("http.response.status_code", static_cast<std::int64_t>(res.status));
+      if (res.status >= 500) {
+        timing.span->SetError("HTTP " + std::to_string(res.status));
+      }
+    }
     std::ostringstream oss;
     oss << req.method << ' ' << req.path << " -> " << res.status;
-    LogEvent(service_name, "http", oss.str(), RequestId(req));
-    MetricsRegistry::Instance().RecordRequest(service_name, req.method, res.status);
+    logger->Log("http", oss.str(), request_id);
     if (res.status >= 400) {
       std::ostringstream error_oss;
       error_oss << "HTTP error " << req.method << ' ' << req.path << " -> " << res.status;
-      LogEvent(service_name, "error", error_oss.str(), RequestId(req));
+      logger->Log("error", error_oss.str(), request_id);
     }
+    timing.span.reset();
   });
 
   server.set_exception_handler([service_name](const auto &req, auto &res, std::exception_ptr ep) {
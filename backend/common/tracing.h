@@ -0,0 +1,544 @@
+#ifndef CONVEYANCERS_MARKETPLACE_TRACING_H
+#define CONVEYANCERS_MARKETPLACE_TRACING_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../third_party/httplib.h"
+#include "codec.h"
+#include "json_writer.h"
+#include "logger.h"
+
+namespace tracing {
+
+// W3C trace context: 16-byte trace id, 8-byte span id and the sampled flag.
+struct SpanContext {
+  std::array<std::uint8_t, 16> trace_id{};
+  std::array<std::uint8_t, 8> span_id{};
+  bool sampled = false;
+
+  bool Valid() const {
+    return std::any_of(trace_id.begin(), trace_id.end(), [](std::uint8_t byte) { return byte != 0; });
+  }
+};
+
+namespace detail {
+
+template <std::size_t N>
+std::string ToHex(const std::array<std::uint8_t, N> &bytes) {
+  return codec::HexEncode(bytes.data(), N);
+}
+
+template <std::size_t N>
+bool FromHex(std::string_view text, std::array<std::uint8_t, N> &bytes) {
+  if (text.size() != N * 2) {
+    return false;
+  }
+  const auto nibble = [](char ch) -> int {
+    if (ch >= '0' && ch <= '9') {
+      return ch - '0';
+    }
+    if (ch >= 'a' && ch <= 'f') {
+      return ch - 'a' + 10;
+    }
+    return -1;
+  };
+  for (std::size_t i = 0; i < N; ++i) {
+    const int high = nibble(text[2 * i]);
+    const int low = nibble(text[2 * i + 1]);
+    if (high < 0 || low < 0) {
+      return false;
+    }
+    bytes[i] = static_cast<std::uint8_t>((high << 4) | low);
+  }
+  return true;
+}
+
+template <std::size_t N>
+bool AllZero(const std::array<std::uint8_t, N> &bytes) {
+  for (const auto byte : bytes) {
+    if (byte != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline std::mt19937_64 &Random() {
+  thread_local std::mt19937_64 engine([]() {
+    std::random_device device;
+    return (static_cast<std::uint64_t>(device()) << 32) ^ device() ^
+           std::hash<std::thread::id>{}(std::this_thread::get_id());
+  }());
+  return engine;
+}
+
+template <std::size_t N>
+void FillRandom(std::array<std::uint8_t, N> &bytes) {
+  for (std::size_t i = 0; i < N; i += 8) {
+    std::uint64_t value = Random()();
+    for (std::size_t j = i; j < N && j < i + 8; ++j) {
+      bytes[j] = static_cast<std::uint8_t>(value);
+      value >>= 8;
+    }
+  }
+}
+
+inline std::uint64_t UnixNanos() {
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch())
+          .count());
+}
+
+}  // namespace detail
+
+inline std::string TraceIdHex(const SpanContext &context) { return detail::ToHex(context.trace_id); }
+inline std::string SpanIdHex(const SpanContext &context) { return detail::ToHex(context.span_id); }
+
+// Accepts version 00 headers, and later versions as long as they keep the version 00 prefix.
+inline std::optional<SpanContext> ParseTraceparent(std::string_view header) {
+  if (header.size() < 55 || header[2] != '-' || header[35] != '-' || header[52] != '-' ||
+      (header.size() > 55 && header[55] != '-')) {
+    return std::nullopt;
+  }
+  std::array<std::uint8_t, 1> version{};
+  std::array<std::uint8_t, 1> flags{};
+  SpanContext context;
+  if (!detail::FromHex(header.substr(0, 2), version) || version[0] == 0xff ||
+      (version[0] == 0 && header.size() != 55) || !detail::FromHex(header.substr(3, 32), context.trace_id) ||
+      !detail::FromHex(header.substr(36, 16), context.span_id) || !detail::FromHex(header.substr(53, 2), flags) ||
+      detail::AllZero(context.trace_id) || detail::AllZero(context.span_id)) {
+    return std::nullopt;
+  }
+  context.sampled = (flags[0] & 0x01) != 0;
+  return context;
+}
+
+inline std::string FormatTraceparent(const SpanContext &context) {
+  return "00-" + TraceIdHex(context) + "-" + SpanIdHex(context) + (context.sampled ? "-01" : "-00");
+}
+
+// The span the calling thread is currently inside. httplib serves a request on one worker
+// thread, so the server span started in pre-routing is the parent of everything the handler
+// does; work handed to other threads carries the context across with ContextScope.
+inline SpanContext &CurrentContext() {
+  static thread_local SpanContext current;
+  return current;
+}
+
+class ContextScope {
+ public:
+  explicit ContextScope(const SpanContext &context) : previous_(CurrentContext()) { CurrentContext() = context; }
+  ~ContextScope() { CurrentContext() = previous_; }
+
+  ContextScope(const ContextScope &) = delete;
+  ContextScope &operator=(const ContextScope &) = delete;
+
+ private:
+  SpanContext previous_;
+};
+
+enum class SpanKind { kInternal = 1, kServer = 2, kClient = 3 };
+
+struct Attribute {
+  std::string key;
+  std::string text;
+  std::int64_t number = 0;
+  bool is_number = false;
+};
+
+struct SpanData {
+  SpanContext context;
+  std::array<std::uint8_t, 8> parent_span_id{};
+  bool has_parent = false;
+  std::string name;
+  SpanKind kind = SpanKind::kInternal;
+  std::uint64_t start_unix_nanos = 0;
+  std::uint64_t end_unix_nanos = 0;
+  std::vector<Attribute> attributes;
+  bool error = false;
+  std::string status_message;
+};
+
+struct TracerOptions {
+  std::string service_name;
+  // Base OTLP/HTTP endpoint; spans are POSTed to <endpoint>/v1/traces. Empty disables export.
+  std::string endpoint;
+  httplib::Headers headers;
+  // Fraction of new traces that are recorded; requests arriving with a traceparent follow the
+  // caller's sampled flag instead.
+  double sample_ratio = 1.0;
+  std::size_t batch_size = 512;
+  std::size_t queue_limit = 4096;
+  std::chrono::milliseconds flush_interval{1000};
+  std::chrono::milliseconds export_timeout{2000};
+};
+
+// Standard OpenTelemetry SDK variables: OTEL_EXPORTER_OTLP_ENDPOINT, OTEL_EXPORTER_OTLP_HEADERS
+// (comma-separated key=value), OTEL_SERVICE_NAME, OTEL_TRACES_SAMPLER_ARG,
+// OTEL_BSP_MAX_EXPORT_BATCH_SIZE, OTEL_BSP_MAX_QUEUE_SIZE, OTEL_BSP_SCHEDULE_DELAY and
+// OTEL_BSP_EXPORT_TIMEOUT (milliseconds).
+inline TracerOptions MakeTracerOptionsFromEnv(std::string_view service) {
+  using logging::detail::EnvInteger;
+  TracerOptions options;
+  const char *service_name = std::getenv("OTEL_SERVICE_NAME");
+  options.service_name = service_name && *service_name ? std::string(service_name) : std::string(service);
+  if (const char *endpoint = std::getenv("OTEL_EXPORTER_OTLP_ENDPOINT"); endpoint && *endpoint) {
+    options.endpoint = endpoint;
+    while (!options.endpoint.empty() && options.endpoint.back() == '/') {
+      options.endpoint.pop_back();
+    }
+  }
+  if (const char *headers = std::getenv("OTEL_EXPORTER_OTLP_HEADERS"); headers && *headers) {
+    std::stringstream stream(headers);
+    std::string pair;
+    while (std::getline(stream, pair, ',')) {
+      const auto equals = pair.find('=');
+      if (equals != std::string::npos && equals > 0) {
+        options.headers.emplace(pair.substr(0, equals), pair.substr(equals + 1));
+      }
+    }
+  }
+  if (const char *ratio = std::getenv("OTEL_TRACES_SAMPLER_ARG"); ratio && *ratio) {
+    try {
+      options.sample_ratio = std::clamp(std::stod(ratio), 0.0, 1.0);
+    } catch (...) {
+    }
+  }
+  options.batch_size = static_cast<std::size_t>(
+      std::max<long long>(1, EnvInteger("OTEL_BSP_MAX_EXPORT_BATCH_SIZE", static_cast<long long>(options.batch_size))));
+  options.queue_limit = static_cast<std::size_t>(EnvInteger("OTEL_BSP_MAX_QUEUE_SIZE", options.queue_limit));
+  options.flush_interval =
+      std::chrono::milliseconds(EnvInteger("OTEL_BSP_SCHEDULE_DELAY", options.flush_interval.count()));
+  options.export_timeout =
+      std::chrono::milliseconds(EnvInteger("OTEL_BSP_EXPORT_TIMEOUT", options.export_timeout.count()));
+  return options;
+}
+
+// OTLP/HTTP JSON encoding of one batch (ids are hex, 64-bit values are decimal strings).
+inline std::string EncodeSpans(const TracerOptions &options, const std::vector<SpanData> &spans) {
+  return json_writer::Render([&](json_writer::Writer &out) {
+    out.Reserve(256 + spans.size() * 320);
+    out.BeginObject().Key("resourceSpans").BeginArray().BeginObject();
+    out.Key("resource").BeginObject().Key("attributes").BeginArray();
+    out.BeginObject()
+        .Field("key", "service.name")
+        .Key("value")
+        .BeginObject()
+        .Field("stringValue", options.service_name)
+        .EndObject()
+        .EndObject();
+    out.EndArray().EndObject();
+    out.Key("scopeSpans").BeginArray().BeginObject();
+    out.Key("scope").BeginObject().Field("name", "conveyancers-marketplace").EndObject();
+    out.Key("spans").BeginArray();
+    for (const auto &span : spans) {
+      out.BeginObject()
+          .Field("traceId", detail::ToHex(span.context.trace_id))
+          .Field("spanId", detail::ToHex(span.context.span_id));
+      if (span.has_parent) {
+        out.Field("parentSpanId", detail::ToHex(span.parent_span_id));
+      }
+      out.Field("name", span.name)
+          .Field("kind", static_cast<int>(span.kind))
+          .Field("startTimeUnixNano", std::to_string(span.start_unix_nanos))
+          .Field("endTimeUnixNano", std::to_string(span.end_unix_nanos))
+          .Key("attributes")
+          .BeginArray();
+      for (const auto &attribute : span.attributes) {
+        out.BeginObject().Field("key", attribute.key).Key("value").BeginObject();
+        if (attribute.is_number) {
+          out.Field("intValue", std::to_string(attribute.number));
+        } else {
+          out.Field("stringValue", attribute.text);
+        }
+        out.EndObject().EndObject();
+      }
+      out.EndArray();
+      // STATUS_CODE_ERROR is 2; unset status is left out.
+      if (span.error) {
+        out.Key("status").BeginObject().Field("code", 2).Field("message", span.status_message).EndObject();
+      }
+      out.EndObject();
+    }
+    out.EndArray().EndObject().EndArray().EndObject().EndArray().EndObject();
+  });
+}
+
+// Collects finished spans and exports them in batches from a background thread. A full queue
+// drops spans rather than blocking requests; a failed export drops that batch.
+class Tracer {
+ public:
+  using Exporter = std::function<bool(const std::string &body)>;
+
+  struct Stats {
+    std::uint64_t exported = 0;
+    std::uint64_t dropped = 0;
+    std::uint64_t failed_exports = 0;
+  };
+
+  Tracer(TracerOptions options, Exporter exporter)
+      : options_(std::move(options)), exporter_(std::move(exporter)) {
+    thread_ = std::thread([this]() { Run(); });
+  }
+
+  Tracer(const Tracer &) = delete;
+  Tracer &operator=(const Tracer &) = delete;
+
+  ~Tracer() { Stop(); }
+
+  // Installs the process-wide tracer; later calls are ignored. Without an OTLP endpoint nothing
+  // is installed and spans only carry ids for propagation. exporter defaults to an OTLP/HTTP
+  // POST. Leaked like the async log writer so spans ending during static destruction never
+  // reach a destroyed tracer.
+  static void Install(const TracerOptions &options, Exporter exporter = {}) {
+    static std::once_flag once;
+    std::call_once(once, [&options, &exporter]() {
+      if (options.endpoint.empty()) {
+        return;
+      }
+      auto *tracer = new Tracer(options, exporter ? std::move(exporter) : MakeHttpExporter(options));
+      Slot().store(tracer, std::memory_order_release);
+      std::atexit([]() { Slot().load(std::memory_order_acquire)->Stop(); });
+    });
+  }
+
+  static Tracer *Active() { return Slot().load(std::memory_order_acquire); }
+
+  bool ShouldSample() const {
+    if (options_.sample_ratio >= 1.0) {
+      return true;
+    }
+    return std::uniform_real_distribution<double>(0.0, 1.0)(detail::Random()) < options_.sample_ratio;
+  }
+
+  void Submit(SpanData &&span) {
+    bool flush = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_ || queue_.size() >= options_.queue_limit) {
+        ++stats_.dropped;
+        return;
+      }
+      queue_.push_back(std::move(span));
+      flush = queue_.size() >= options_.batch_size;
+    }
+    if (flush) {
+      wake_.notify_one();
+    }
+  }
+
+  // Exports whatever is queued, then joins the export thread. Idempotent.
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    wake_.notify_one();
+    std::lock_guard<std::mutex> join(join_mutex_);
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  Stats GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+  std::string RenderMetrics(std::string_view service) const {
+    const auto stats = GetStats();
+    std::ostringstream oss;
+    oss << "# HELP trace_spans_total Finished spans by export outcome" << '\n';
+    oss << "# TYPE trace_spans_total counter" << '\n';
+    oss << "trace_spans_total{service=\"" << service << "\",outcome=\"exported\"} " << stats.exported << '\n';
+    oss << "trace_spans_total{service=\"" << service << "\",outcome=\"dropped\"} " << stats.dropped << '\n';
+    oss << "# HELP trace_export_failures_total OTLP export requests that failed" << '\n';
+    oss << "# TYPE trace_export_failures_total counter" << '\n';
+    oss << "trace_export_failures_total{service=\"" << service << "\"} " << stats.failed_exports << '\n';
+    return oss.str();
+  }
+
+ private:
+  static std::atomic<Tracer *> &Slot() {
+    static std::atomic<Tracer *> tracer{nullptr};
+    return tracer;
+  }
+
+  static Exporter MakeHttpExporter(const TracerOptions &options) {
+    return [options](const std::string &body) {
+      httplib::Client client(options.endpoint);
+      client.set_connection_timeout(options.export_timeout);
+      client.set_read_timeout(options.export_timeout);
+      client.set_write_timeout(options.export_timeout);
+      const auto result = client.Post("/v1/traces", options.headers, body, "application/json");
+      return result && result->status < 300;
+    };
+  }
+
+  void Run() {
+    std::vector<SpanData> batch;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      wake_.wait_for(lock, options_.flush_interval,
+                     [this]() { return stopping_ || queue_.size() >= options_.batch_size; });
+      while (!queue_.empty()) {
+        const auto count = std::min(queue_.size(), options_.batch_size);
+        batch.assign(std::make_move_iterator(queue_.begin()), std::make_move_iterator(queue_.begin() + count));
+        queue_.erase(queue_.begin(), queue_.begin() + static_cast<std::ptrdiff_t>(count));
+        lock.unlock();
+        bool exported = false;
+        try {
+          exported = exporter_(EncodeSpans(options_, batch));
+        } catch (...) {
+        }
+        lock.lock();
+        if (exported) {
+          stats_.exported += batch.size();
+        } else {
+          stats_.dropped += batch.size();
+          ++stats_.failed_exports;
+        }
+        if (!stopping_ && queue_.size() < options_.batch_size) {
+          break;
+        }
+      }
+      if (stopping_ && queue_.empty()) {
+        return;
+      }
+    }
+  }
+
+  const TracerOptions options_;
+  const Exporter exporter_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  std::vector<SpanData> queue_;
+  bool stopping_ = false;
+  Stats stats_;
+
+  std::mutex join_mutex_;
+  std::thread thread_;
+};
+
+// RAII span. Becomes the thread's current context until it ends, so spans on one thread must
+// end in reverse order of creation; spans whose lifetime does not nest (a scan that runs
+// alongside other work) pass make_current=false. Ids are always generated so the context can be
+// propagated; attributes are only kept when the span is sampled and a tracer is installed.
+class Span {
+ public:
+  explicit Span(std::string_view name, SpanKind kind = SpanKind::kInternal) : Span(name, kind, CurrentContext()) {}
+
+  // parent may come from another thread or an incoming traceparent; an invalid one starts a trace.
+  Span(std::string_view name, SpanKind kind, const SpanContext &parent, bool make_current = true)
+      : tracer_(Tracer::Active()),
+        previous_(CurrentContext()),
+        uncaught_(std::uncaught_exceptions()),
+        current_(make_current) {
+    if (parent.Valid()) {
+      data_.context.trace_id = parent.trace_id;
+      data_.context.sampled = parent.sampled;
+    } else {
+      detail::FillRandom(data_.context.trace_id);
+      data_.context.sampled = tracer_ != nullptr && tracer_->ShouldSample();
+    }
+    detail::FillRandom(data_.context.span_id);
+    recording_ = tracer_ != nullptr && data_.context.sampled;
+    if (recording_) {
+      data_.name = std::string(name);
+      data_.kind = kind;
+      data_.has_parent = parent.Valid();
+      data_.parent_span_id = parent.span_id;
+      data_.start_unix_nanos = detail::UnixNanos();
+    }
+    if (current_) {
+      CurrentContext() = data_.context;
+    }
+  }
+
+  ~Span() {
+    if (std::uncaught_exceptions() > uncaught_ && recording_ && !data_.error) {
+      SetError("exception");
+    }
+    End();
+  }
+
+  Span(const Span &) = delete;
+  Span &operator=(const Span &) = delete;
+
+  const SpanContext &Context() const { return data_.context; }
+  bool Recording() const { return recording_ && !ended_; }
+
+  Span &SetName(std::string_view name) {
+    if (Recording()) {
+      data_.name = std::string(name);
+    }
+    return *this;
+  }
+
+  Span &SetAttribute(std::string_view key, std::string_view value) {
+    if (Recording()) {
+      data_.attributes.push_back(Attribute{std::string(key), std::string(value), 0, false});
+    }
+    return *this;
+  }
+
+  Span &SetAttribute(std::string_view key, std::int64_t value) {
+    if (Recording()) {
+      data_.attributes.push_back(Attribute{std::string(key), {}, value, true});
+    }
+    return *this;
+  }
+
+  Span &SetError(std::string_view message) {
+    if (Recording()) {
+      data_.error = true;
+      data_.status_message = std::string(message);
+    }
+    return *this;
+  }
+
+  void End() {
+    if (ended_) {
+      return;
+    }
+    ended_ = true;
+    if (current_) {
+      CurrentContext() = previous_;
+    }
+    if (recording_) {
+      data_.end_unix_nanos = detail::UnixNanos();
+      tracer_->Submit(std::move(data_));
+    }
+  }
+
+ private:
+  Tracer *tracer_;
+  SpanContext previous_;
+  int uncaught_;
+  bool current_;
+  bool recording_ = false;
+  bool ended_ = false;
+  SpanData data_;
+};
+
+}  // namespace tracing
+
+#endif  // CONVEYANCERS_MARKETPLACE_TRACING_H
@@ -3,6 +3,10 @@
 #include <cstdlib>
 #include <sstream>
 #include <string>
+#include <utility>
+
+#include "../common/security.h"
+#include "json.hpp"
 
 namespace gateway::http_utils {
 
@@ -24,6 +28,18 @@ int ResolveIdentityPort(const char *env_value) {
   return 7001;
 }
 
+int ResolvePositiveInt(const char *env_value, int fallback) {
+  if (env_value == nullptr || *env_value == '\0') {
+    return fallback;
+  }
+  try {
+    const int value = std::stoi(env_value);
+    return value > 0 ? value : fallback;
+  } catch (...) {
+    return fallback;
+  }
+}
+
 std::string ForwardQueryString(const httplib::Params &params) {
   if (params.empty()) {
     return {};
@@ -45,4 +61,75 @@ std::string ForwardQueryString(const httplib::Params &params) {
   return oss.str();
 }
 
+ServiceAddress ResolveServiceAddress(const char *env_value, const std::string &default_host, int default_port) {
+  ServiceAddress address{default_host, default_port};
+  if (env_value == nullptr || *env_value == '\0') {
+    return address;
+  }
+  std::string value = env_value;
+  if (const auto scheme = value.find("://"); scheme != std::string::npos) {
+    value.erase(0, scheme + 3);
+  }
+  if (const auto slash = value.find('/'); slash != std::string::npos) {
+    value.erase(slash);
+  }
+  const auto colon = value.rfind(':');
+  const std::string host = colon == std::string::npos ? value : value.substr(0, colon);
+  if (!host.empty()) {
+    address.host = host;
+  }
+  if (colon != std::string::npos) {
+    address.port = ResolvePositiveInt(value.c_str() + colon + 1, default_port);
+  }
+  return address;
+}
+
+std::string StitchJobDetail(const std::string &detail_body, const std::string *escrow_body) {
+  auto detail = nlohmann::json::parse(detail_body);
+  detail["escrow"] = nullptr;
+  if (escrow_body != nullptr) {
+    const auto escrow = nlohmann::json::parse(*escrow_body, nullptr, false);
+    if (escrow.is_object() && escrow.contains("escrow")) {
+      detail["escrow"] = escrow["escrow"];
+    }
+  }
+  return detail.dump();
+}
+
+std::string_view Trim(std::string_view value) {
+  const auto first = value.find_first_not_of(" \t");
+  if (first == std::string_view::npos) {
+    return {};
+  }
+  const auto last = value.find_last_not_of(" \t");
+  return value.substr(first, last - first + 1);
+}
+
+void SendError(httplib::Response &res, int status, const std::string &error) {
+  res.status = status;
+  res.set_content(nlohmann::json{{"error", error}}.dump(), "application/json");
+}
+
+httplib::Headers UpstreamHeaders(const httplib::Request &req) {
+  httplib::Headers headers = {{"X-API-Key", security::ExpectedApiKey()}, {"X-Request-Id", security::RequestId(req)}};
+  for (const char *name : {"X-Actor-Role", "Content-Type", "Accept", "Idempotency-Key", "If-None-Match"}) {
+    if (auto value = req.get_header_value(name); !value.empty()) {
+      headers.emplace(name, std::move(value));
+    }
+  }
+  return headers;
+}
+
+void Relay(const httplib::Response &upstream, httplib::Response &res) {
+  res.status = upstream.status;
+  for (const char *name : {"ETag", "Last-Modified", "Cache-Control", "Location", "Retry-After",
+                           "Idempotent-Replayed"}) {
+    if (upstream.has_header(name)) {
+      res.set_header(name, upstream.get_header_value(name));
+    }
+  }
+  const auto content_type = upstream.get_header_value("Content-Type");
+  res.set_content(upstream.body, content_type.empty() ? "application/json" : content_type);
+}
+
 }  // namespace gateway::http_utils
@@ -2,6 +2,7 @@
 #define CONVEYANCERS_MARKETPLACE_GATEWAY_HTTP_UTILS_H
 
 #include <string>
+#include <string_view>
 
 #include "../third_party/httplib.h"
 
@@ -9,8 +10,36 @@ namespace gateway::http_utils {
 
 std::string ResolveIdentityHost(const char *env_value);
 int ResolveIdentityPort(const char *env_value);
+int ResolvePositiveInt(const char *env_value, int fallback);
 std::string ForwardQueryString(const httplib::Params &params);
 
+// Strips leading and trailing spaces and tabs.
+std::string_view Trim(std::string_view value);
+
+struct ServiceAddress {
+  std::string host;
+  int port = 0;
+};
+
+// Parses *_SERVICE_URL values such as "http://jobs:9002"; missing parts take the defaults.
+ServiceAddress ResolveServiceAddress(const char *env_value, const std::string &default_host, int default_port);
+
+// Adds the "escrow" array from a payments /jobs/:id/escrow body to a jobs /detail body.
+// escrow_body is null when payments could not answer; the job page then gets "escrow": null.
+std::string StitchJobDetail(const std::string &detail_body, const std::string *escrow_body);
+
+// Sets status and a {"error": error} JSON body.
+void SendError(httplib::Response &res, int status, const std::string &error);
+
+// Headers for an upstream call: the internal API key in place of the caller's, the request id,
+// and the caller's role, content and conditional headers for the service to act on, so a
+// service that can answer 304 before rendering gets to.
+httplib::Headers UpstreamHeaders(const httplib::Request &req);
+
+// Copies an upstream response with the headers a client or cache acts on, including whether
+// an idempotent request was answered from its first attempt.
+void Relay(const httplib::Response &upstream, httplib::Response &res);
+
 }  // namespace gateway::http_utils
 
 #endif  // CONVEYANCERS_MARKETPLACE_GATEWAY_HTTP_UTILS_H
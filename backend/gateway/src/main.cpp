@@ -1,37 +1,104 @@
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "../common/env_loader.h"
+#include "../common/http_server.h"
 #include "../common/security.h"
 #include "httplib.h"
 #include "http_utils.h"
+#include "json.hpp"
+#include "profile_search.h"
+#include "rate_limiter.h"
+#include "redis_rate_store.h"
+#include "response_cache.h"
+#include "route_table.h"
+#include "upstream_pool.h"
 
 int main() {
   env::LoadEnvironment();
+  http_server::ServerOptions server_defaults;
+  server_defaults.worker_threads =
+      static_cast<std::size_t>(std::max(8, static_cast<int>(std::thread::hardware_concurrency()) - 1));
+  server_defaults.max_payload_bytes = 1024 * 1024;
+  const auto server_options = http_server::MakeServerOptionsFromEnv("GATEWAY", server_defaults);
+  const std::size_t workers = server_options.worker_threads;
+  gateway::UpstreamPool identity(gateway::MakeUpstreamOptionsFromEnv(
+      "identity", gateway::http_utils::ResolveIdentityHost(std::getenv("IDENTITY_HOST")),
+      gateway::http_utils::ResolveIdentityPort(std::getenv("IDENTITY_PORT")), workers));
+  const auto jobs_address =
+      gateway::http_utils::ResolveServiceAddress(std::getenv("JOBS_SERVICE_URL"), "127.0.0.1", 8082);
+  gateway::UpstreamPool jobs(
+      gateway::MakeUpstreamOptionsFromEnv("jobs", jobs_address.host, jobs_address.port, workers));
+  const auto payments_address =
+      gateway::http_utils::ResolveServiceAddress(std::getenv("PAYMENTS_SERVICE_URL"), "127.0.0.1", 8083);
+  gateway::UpstreamPool payments(gateway::MakeUpstreamOptionsFromEnv(
+      "payments", payments_address.host, payments_address.port, workers));
+  gateway::ResponseCache search_cache(gateway::MakeSearchCacheOptionsFromEnv("profile_search"));
+  const gateway::RouteTable routes(gateway::MakeRoutesFromEnv(), {&identity, &jobs, &payments});
+  const auto fanout = gateway::MakeFanoutExecutorFromEnv(workers);
+
+  // Admission control runs first in every handler, so excess requests are turned away before
+  // they hold an upstream connection. Login limits are shared across replicas through Redis
+  // when it is configured, since a password-guessing client can spread over every gateway.
+  const char *redis_host = std::getenv("REDIS_HOST");
+  const char *redis_password = std::getenv("REDIS_PASSWORD");
+  gateway::RedisRateStore rate_store(redis_host != nullptr ? redis_host : "",
+                                     gateway::http_utils::ResolvePositiveInt(std::getenv("REDIS_PORT"), 0),
+                                     redis_password != nullptr ? redis_password : "");
+  gateway::RateLimiter::SharedCheck shared_check;
+  if (rate_store.Configured()) {
+    shared_check = [&rate_store](std::string_view limiter, std::string_view key, std::int64_t interval_us,
+                                 std::int64_t tolerance_us) {
+      return rate_store.Check(limiter, key, interval_us, tolerance_us);
+    };
+  }
+  const auto rate_slots =
+      static_cast<std::size_t>(gateway::http_utils::ResolvePositiveInt(std::getenv("GATEWAY_RATE_LIMIT_SLOTS"), 65536));
+  gateway::RateLimiter ip_limiter("ip", gateway::ParseRateLimit(std::getenv("GATEWAY_RATE_LIMIT_IP"), {20, 40}),
+                                  rate_slots, shared_check);
+  gateway::RateLimiter api_key_limiter(
+      "api_key", gateway::ParseRateLimit(std::getenv("GATEWAY_RATE_LIMIT_API_KEY"), {}), rate_slots, shared_check);
+  gateway::RateLimiter login_ip_limiter(
+      "login_ip", gateway::ParseRateLimit(std::getenv("GATEWAY_RATE_LIMIT_LOGIN_IP"), {0.2, 10, true}), rate_slots,
+      shared_check);
+  gateway::RateLimiter login_email_limiter(
+      "login_email", gateway::ParseRateLimit(std::getenv("GATEWAY_RATE_LIMIT_LOGIN_EMAIL"), {0.05, 5, true}),
+      rate_slots, shared_check);
+  const int trusted_proxies = gateway::http_utils::ResolvePositiveInt(std::getenv("GATEWAY_TRUSTED_PROXIES"), 0);
+  const gateway::Admission admission({&ip_limiter, &api_key_limiter, &login_ip_limiter, &login_email_limiter},
+                                     trusted_proxies);
+
   httplib::Server svr;
-  security::AttachStandardHandlers(svr, "gateway");
+  http_server::Bootstrap(svr, "gateway", server_options);
   security::ExposeMetrics(svr, "gateway");
+  security::MetricsRegistry::Instance().RegisterCollector("gateway", [&identity, &jobs, &payments]() {
+    return gateway::UpstreamPool::RenderMetrics({&identity, &jobs, &payments});
+  });
+  security::MetricsRegistry::Instance().RegisterCollector("gateway",
+                                                          [&search_cache]() { return search_cache.RenderMetrics(); });
+  security::MetricsRegistry::Instance().RegisterCollector(
+      "gateway", [&ip_limiter, &api_key_limiter, &login_ip_limiter, &login_email_limiter]() {
+        return gateway::RateLimiter::RenderMetrics(
+            {&ip_limiter, &api_key_limiter, &login_ip_limiter, &login_email_limiter});
+      });
   svr.Get("/healthz", [](const httplib::Request &, httplib::Response &res) {
     res.set_content("{\"ok\":true}", "application/json");
   });
   // Minimal facade endpoints
-  svr.Post("/api/auth/login", [](const httplib::Request &req, httplib::Response &res) {
-    const char *host_env = std::getenv("IDENTITY_HOST");
-    const char *port_env = std::getenv("IDENTITY_PORT");
-    httplib::Client client(gateway::http_utils::ResolveIdentityHost(host_env).c_str(),
-                           gateway::http_utils::ResolveIdentityPort(port_env));
-    client.set_connection_timeout(1, 0);
-    client.set_read_timeout(1, 0);
-    client.set_write_timeout(1, 0);
-
-    httplib::Headers headers = {{"X-Request-Id", security::RequestId(req)}};
-    client.set_default_headers(headers);
-
+  svr.Post("/api/auth/login", [&identity, &admission](const httplib::Request &req, httplib::Response &res) {
+    if (!admission.Check(req, res, true)) {
+      return;
+    }
+    const httplib::Headers headers = {{"X-Request-Id", security::RequestId(req)}};
     const auto content_type = req.get_header_value("Content-Type");
-    const char *body_type = content_type.empty() ? "application/json" : content_type.c_str();
-    if (auto identity_res = client.Post("/auth/login", req.body, body_type)) {
+    const std::string body_type = content_type.empty() ? "application/json" : content_type;
+    if (auto identity_res = identity.Post("/sessions/login", headers, req.body, body_type)) {
       res.status = identity_res->status;
       std::string response_type = identity_res->get_header_value("Content-Type");
       if (response_type.empty()) {
@@ -44,48 +111,106 @@ int main() {
     res.status = 503;
     res.set_content(R"({"error":"identity_unavailable"})", "application/json");
   });
-  svr.Get("/api/profiles/search", [](const httplib::Request &req, httplib::Response &res) {
-    if (!security::Authorize(req, res, "gateway")) {
+  svr.Get("/api/profiles/search", [&identity, &search_cache, &admission](const httplib::Request &req,
+                                                                         httplib::Response &res) {
+    gateway::SearchProfiles(identity, search_cache, admission, req, res);
+  });
+  // Job page: the jobs composite read, with payments' escrow list fetched alongside it. "templates"
+  // is the jobs template list rather than a job, and falls through to the route table.
+  constexpr const char *kJobPage = R"(/api/jobs/((?!templates$)[^/]+))";
+  svr.Get(kJobPage, [&jobs, &payments, &fanout, &admission](const httplib::Request &req, httplib::Response &res) {
+    if (!admission.Check(req, res) || !security::Authorize(req, res, "gateway")) {
       return;
     }
-    if (!security::RequireRole(req, res, {"buyer", "seller", "conveyancer", "admin"}, "gateway",
-                               "search_profiles")) {
+    if (!security::RequireRole(req, res, {"buyer", "seller", "conveyancer", "admin"}, "gateway", "view_job")) {
       return;
     }
-    const char *host_env = std::getenv("IDENTITY_HOST");
-    const char *port_env = std::getenv("IDENTITY_PORT");
-    httplib::Client client(gateway::http_utils::ResolveIdentityHost(host_env).c_str(),
-                           gateway::http_utils::ResolveIdentityPort(port_env));
-    client.set_connection_timeout(1, 0);    // 1 second
-    client.set_read_timeout(1, 0);          // 1 second
-    client.set_write_timeout(1, 0);         // 1 second
-
-    const auto request_id = security::RequestId(req);
-    httplib::Headers headers = {{"X-API-Key", security::ExpectedApiKey()},
-                                {"X-Request-Id", request_id}};
-    if (const auto role = req.get_header_value("X-Actor-Role"); !role.empty()) {
-      headers.emplace("X-Actor-Role", role);
-    }
-    client.set_default_headers(headers);
-
-    std::string path = "/profiles/search";
+    const std::string job_path = "/jobs/" + httplib::detail::encode_url(req.matches[1]);
+    std::string detail_path = job_path + "/detail";
     if (!req.params.empty()) {
-      path += '?' + gateway::http_utils::ForwardQueryString(req.params);
+      detail_path += '?' + gateway::http_utils::ForwardQueryString(req.params);
     }
 
-    if (auto identity_res = client.Get(path.c_str())) {
-      res.status = identity_res->status;
-      std::string content_type = identity_res->get_header_value("Content-Type");
-      if (content_type.empty()) {
-        content_type = "application/json";
+    const auto results = gateway::Fanout(*fanout, {{&jobs, detail_path}, {&payments, job_path + "/escrow"}},
+                                         gateway::http_utils::UpstreamHeaders(req));
+    const auto &detail = results[0];
+    const auto &escrow_res = results[1];
+    if (!detail) {
+      res.status = 503;
+      res.set_content(R"({"error":"jobs_unavailable"})", "application/json");
+      return;
+    }
+    if (detail->status != 200) {
+      res.status = detail->status;
+      res.set_content(detail->body, "application/json");
+      return;
+    }
+    const std::string *escrow_body = escrow_res && escrow_res->status == 200 ? &escrow_res->body : nullptr;
+    res.set_content(gateway::http_utils::StitchJobDetail(detail->body, escrow_body), "application/json");
+  });
+  // Several reads in one round trip: each query parameter names a part and gives its gateway path,
+  // e.g. ?job=/api/jobs/7/detail&escrow=/api/payments/jobs/7/escrow. Parts are fetched at once and
+  // returned together with their own statuses, so the page waits for the slowest service only.
+  svr.Get("/api/aggregate", [&routes, &fanout, &admission](const httplib::Request &req, httplib::Response &res) {
+    if (!admission.Check(req, res) || !security::Authorize(req, res, "gateway")) {
+      return;
+    }
+    if (req.params.empty() || req.params.size() > gateway::kMaxAggregateParts) {
+      gateway::http_utils::SendError(res, 400, "invalid_aggregate");
+      return;
+    }
+    std::vector<std::string> names;
+    std::vector<gateway::UpstreamCall> calls;
+    for (const auto &[name, path] : req.params) {
+      auto target = routes.Resolve(path);
+      const char *error = !target                                  ? "no_route"
+                          : gateway::IsEventStream(*target, req) ? "event_stream_not_proxied"
+                          : req.params.count(name) > 1           ? "duplicate_part"
+                                                                 : nullptr;
+      if (error != nullptr) {
+        res.status = 400;
+        res.set_content(nlohmann::json{{"error", error}, {"part", name}}.dump(), "application/json");
+        return;
       }
-      res.set_content(identity_res->body, content_type.c_str());
+      names.push_back(name);
+      calls.push_back({target->upstream, std::move(target->path)});
+    }
+    const auto results = gateway::Fanout(*fanout, calls, gateway::http_utils::UpstreamHeaders(req));
+    res.set_content(gateway::MergeResponses(names, results), "application/json");
+  });
+  // Everything else under a routed prefix passes through to its service; see gateway::Proxy for
+  // what it refuses. Document uploads are routed before httplib reads the body, so a raw upload is
+  // refused at once instead of hitting the payload limit, and the connection is closed rather
+  // than left holding its unread body. The legacy JSON upload is buffered and passed through.
+  const auto proxy = [&routes, &admission](const httplib::Request &req, httplib::Response &res) {
+    gateway::Proxy(routes, admission, req, res);
+  };
+  svr.Post(R"(/api/.*/documents)", [&routes, &admission](const httplib::Request &req, httplib::Response &res,
+                                                         const httplib::ContentReader &content_reader) {
+    const auto target = routes.Resolve(req.target);
+    if (req.is_multipart_form_data() || (target && gateway::IsDocumentUpload(*target, req))) {
+      res.set_header("Connection", "close");
+      gateway::Proxy(routes, admission, req, res);
       return;
     }
-
-    res.status = 503;
-    res.set_content(R"({"error":"identity_unavailable"})", "application/json");
+    httplib::Request buffered = req;
+    const bool received = content_reader([&buffered](const char *data, std::size_t length) {
+      buffered.body.append(data, length);
+      return true;
+    });
+    if (!received) {
+      // httplib has set 413 past the payload limit and 400 for a broken body.
+      res.set_header("Connection", "close");
+      gateway::http_utils::SendError(res, res.status, res.status == 413 ? "payload_too_large" : "invalid_body");
+      return;
+    }
+    gateway::Proxy(routes, admission, buffered, res);
   });
+  svr.Get(R"(/api/.*)", proxy);
+  svr.Post(R"(/api/.*)", proxy);
+  svr.Put(R"(/api/.*)", proxy);
+  svr.Patch(R"(/api/.*)", proxy);
+  svr.Delete(R"(/api/.*)", proxy);
   std::cout << "Gateway listening on :8080\n";
   svr.listen("0.0.0.0", 8080);
   return 0;
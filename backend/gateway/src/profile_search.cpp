@@ -0,0 +1,62 @@
+#include "profile_search.h"
+
+#include <memory>
+#include <utility>
+
+#include "../common/security.h"
+
+namespace gateway {
+
+std::string ProfileSearchPath(const httplib::Params &params) {
+  std::string path = "/profiles";
+  char separator = '?';
+  for (const char *name : {"limit", "q", "state"}) {
+    const auto it = params.find(name);
+    if (it == params.end() || it->second.empty()) {
+      continue;
+    }
+    path.push_back(separator);
+    path.append(name).append("=").append(httplib::detail::encode_query_param(it->second));
+    separator = '&';
+  }
+  return path;
+}
+
+void SearchProfiles(UpstreamPool &identity, ResponseCache &cache, const Admission &admission,
+                    const httplib::Request &req, httplib::Response &res) {
+  if (!admission.Check(req, res) || !security::Authorize(req, res, "gateway")) {
+    return;
+  }
+  if (!security::RequireRole(req, res, {"buyer", "seller", "conveyancer", "admin"}, "gateway", "search_profiles")) {
+    return;
+  }
+  const auto role = req.get_header_value("X-Actor-Role");
+  httplib::Headers headers = {{"X-API-Key", security::ExpectedApiKey()}, {"X-Request-Id", security::RequestId(req)}};
+  if (!role.empty()) {
+    headers.emplace("X-Actor-Role", role);
+  }
+  const auto path = ProfileSearchPath(req.params);
+
+  const auto response = cache.GetOrFetch(role + ' ' + path, [&identity, &path, &headers]() {
+    ResponseCache::Value fetched;
+    if (auto identity_res = identity.Get(path, headers)) {
+      std::string content_type = identity_res->get_header_value("Content-Type");
+      if (content_type.empty()) {
+        content_type = "application/json";
+      }
+      fetched = std::make_shared<const CachedResponse>(
+          CachedResponse{identity_res->status, std::move(content_type), std::move(identity_res->body)});
+    }
+    return fetched;
+  });
+  if (response) {
+    res.status = response->status;
+    res.set_content(response->body, response->content_type.c_str());
+    return;
+  }
+
+  res.status = 503;
+  res.set_content(R"({"error":"identity_unavailable"})", "application/json");
+}
+
+}  // namespace gateway
@@ -0,0 +1,25 @@
+#ifndef CONVEYANCERS_MARKETPLACE_GATEWAY_PROFILE_SEARCH_H
+#define CONVEYANCERS_MARKETPLACE_GATEWAY_PROFILE_SEARCH_H
+
+#include <string>
+
+#include "../third_party/httplib.h"
+#include "rate_limiter.h"
+#include "response_cache.h"
+#include "upstream_pool.h"
+
+namespace gateway {
+
+// Identity's /profiles with only the parameters it reads (limit, q, state), in that order and
+// fully encoded, so equivalent searches share one cache entry and a value cannot add parameters.
+std::string ProfileSearchPath(const httplib::Params &params);
+
+// GET /api/profiles/search. Public search results are the same for every caller with a given
+// role, so identical queries are answered from cache and concurrent misses share one identity
+// call.
+void SearchProfiles(UpstreamPool &identity, ResponseCache &cache, const Admission &admission,
+                    const httplib::Request &req, httplib::Response &res);
+
+}  // namespace gateway
+
+#endif  // CONVEYANCERS_MARKETPLACE_GATEWAY_PROFILE_SEARCH_H
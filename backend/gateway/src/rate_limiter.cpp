@@ -0,0 +1,255 @@
+#include "rate_limiter.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <utility>
+
+#include "http_utils.h"
+#include "json.hpp"
+
+namespace gateway {
+namespace {
+
+// A slot holds a 16-bit key tag above a 48-bit TAT in microseconds since the limiter started,
+// which lasts about nine years. Zero is an empty slot.
+constexpr int kTagShift = 48;
+constexpr std::uint64_t kTatMask = (std::uint64_t{1} << kTagShift) - 1;
+
+std::uint64_t Mix(std::uint64_t value) {
+  value ^= value >> 30;
+  value *= 0xbf58476d1ce4e5b9ULL;
+  value ^= value >> 27;
+  value *= 0x94d049bb133111ebULL;
+  return value ^ (value >> 31);
+}
+
+long long CeilSeconds(std::chrono::microseconds value) {
+  return (value.count() + 999999) / 1000000;
+}
+
+}  // namespace
+
+RateLimit ParseRateLimit(const char *env_value, RateLimit fallback) {
+  if (env_value == nullptr || *env_value == '\0') {
+    return fallback;
+  }
+  const std::string value = env_value;
+  if (value == "0") {
+    return RateLimit{};
+  }
+  RateLimit limit;
+  try {
+    std::size_t used = 0;
+    limit.per_second = std::stod(value, &used);
+    if (used >= value.size() || value[used] != ':') {
+      return fallback;
+    }
+    const auto rest = value.substr(used + 1);
+    const long long burst = std::stoll(rest, &used);
+    if (!(limit.per_second > 0) || burst < 1 || burst > 1000000) {
+      return fallback;
+    }
+    limit.burst = static_cast<std::uint32_t>(burst);
+    if (used < rest.size()) {
+      if (rest.substr(used) != ":shared") {
+        return fallback;
+      }
+      limit.shared = true;
+    }
+  } catch (...) {
+    return fallback;
+  }
+  return limit;
+}
+
+GcraStep Gcra(std::int64_t tat_us, std::int64_t now_us, std::int64_t interval_us, std::int64_t tolerance_us) {
+  const auto base = std::max(tat_us, now_us);
+  const auto ahead = base + interval_us - now_us;
+  if (ahead > tolerance_us) {
+    return GcraStep{false, base - now_us};
+  }
+  return GcraStep{true, ahead};
+}
+
+RateLimiter::RateLimiter(std::string name, RateLimit limit, std::size_t slots, SharedCheck shared)
+    : name_(std::move(name)), limit_(limit), shared_(std::move(shared)), epoch_(Clock::now()) {
+  if (limit_.per_second > 0) {
+    interval_us_ = std::max<std::int64_t>(1, std::llround(1e6 / limit_.per_second));
+    tolerance_us_ = interval_us_ * std::max<std::uint32_t>(limit_.burst, 1);
+  }
+  std::size_t size = 2;
+  while (size < slots) {
+    size <<= 1;
+  }
+  mask_ = size - 1;
+  slots_ = std::make_unique<std::atomic<std::uint64_t>[]>(size);
+  std::random_device random;
+  seed_ = (static_cast<std::uint64_t>(random()) << 32) ^ random();
+}
+
+RateDecision RateLimiter::Check(std::string_view key, Clock::time_point now) {
+  if (!Enabled()) {
+    return RateDecision{};
+  }
+  const auto now_us =
+      std::max<std::int64_t>(1, std::chrono::duration_cast<std::chrono::microseconds>(now - epoch_).count() + 1);
+  auto step = CheckLocal(Hash(key), now_us);
+  // Only requests the local bucket lets through cost a round trip, so a flood stays local.
+  if (step.allowed && limit_.shared && shared_) {
+    if (auto remote = shared_(name_, key, interval_us_, tolerance_us_)) {
+      step = *remote;
+    } else {
+      shared_errors_.Add();
+    }
+  }
+  (step.allowed ? allowed_ : limited_).Add();
+  return Decide(step);
+}
+
+std::uint64_t RateLimiter::Hash(std::string_view key) const {
+  std::uint64_t hash = seed_ ^ 0xcbf29ce484222325ULL;
+  for (const char ch : key) {
+    hash = (hash ^ static_cast<unsigned char>(ch)) * 0x100000001b3ULL;
+  }
+  return Mix(hash ^ key.size());
+}
+
+GcraStep RateLimiter::CheckLocal(std::uint64_t hash, std::int64_t now_us) {
+  const std::uint64_t tag = hash >> kTagShift;
+  auto &first = slots_[hash & mask_];
+  auto &second = slots_[(hash >> 24) & mask_];
+  const auto idle = [now_us](std::uint64_t value) { return static_cast<std::int64_t>(value & kTatMask) <= now_us; };
+  while (true) {
+    const auto first_value = first.load(std::memory_order_relaxed);
+    const auto second_value = second.load(std::memory_order_relaxed);
+    auto *slot = &first;
+    auto current = first_value;
+    if ((first_value >> kTagShift) != tag &&
+        ((second_value >> kTagShift) == tag || (!idle(first_value) && idle(second_value)))) {
+      slot = &second;
+      current = second_value;
+    }
+    const auto step = Gcra(static_cast<std::int64_t>(current & kTatMask), now_us, interval_us_, tolerance_us_);
+    if (!step.allowed) {
+      return step;
+    }
+    const auto next = (tag << kTagShift) | (static_cast<std::uint64_t>(now_us + step.ahead_us) & kTatMask);
+    if (slot->compare_exchange_weak(current, next, std::memory_order_relaxed)) {
+      return step;
+    }
+  }
+}
+
+RateDecision RateLimiter::Decide(const GcraStep &step) const {
+  RateDecision decision;
+  decision.allowed = step.allowed;
+  decision.limit = limit_.burst;
+  decision.reset = std::chrono::microseconds(std::max<std::int64_t>(0, step.ahead_us));
+  if (step.allowed) {
+    decision.remaining = static_cast<std::uint32_t>(std::max<std::int64_t>(0, tolerance_us_ - step.ahead_us) /
+                                                    interval_us_);
+  } else {
+    decision.retry_after = std::chrono::microseconds(std::max<std::int64_t>(
+        1, step.ahead_us + interval_us_ - tolerance_us_));
+  }
+  return decision;
+}
+
+std::string RateLimiter::RenderMetrics(const std::vector<const RateLimiter *> &limiters) {
+  std::ostringstream oss;
+  oss << "# HELP gateway_rate_limit_requests_total Requests checked against a rate limiter by outcome" << '\n';
+  oss << "# TYPE gateway_rate_limit_requests_total counter" << '\n';
+  for (const auto *limiter : limiters) {
+    oss << "gateway_rate_limit_requests_total{limiter=\"" << limiter->name_ << "\",outcome=\"allowed\"} "
+        << limiter->allowed_.Value() << '\n';
+    oss << "gateway_rate_limit_requests_total{limiter=\"" << limiter->name_ << "\",outcome=\"limited\"} "
+        << limiter->limited_.Value() << '\n';
+  }
+  oss << "# HELP gateway_rate_limit_shared_errors_total Checks decided locally because the shared store failed"
+      << '\n';
+  oss << "# TYPE gateway_rate_limit_shared_errors_total counter" << '\n';
+  for (const auto *limiter : limiters) {
+    oss << "gateway_rate_limit_shared_errors_total{limiter=\"" << limiter->name_ << "\"} "
+        << limiter->shared_errors_.Value() << '\n';
+  }
+  return oss.str();
+}
+
+bool Admit(httplib::Response &res, std::initializer_list<RateCheck> checks) {
+  std::optional<RateDecision> tightest;
+  for (const auto &check : checks) {
+    if (check.key.empty() || !check.limiter->Enabled()) {
+      continue;
+    }
+    const auto decision = check.limiter->Check(check.key);
+    if (!tightest || !decision.allowed || decision.remaining < tightest->remaining) {
+      tightest = decision;
+    }
+    if (!decision.allowed) {
+      break;
+    }
+  }
+  if (!tightest) {
+    return true;
+  }
+  res.set_header("X-RateLimit-Limit", std::to_string(tightest->limit));
+  res.set_header("X-RateLimit-Remaining", std::to_string(tightest->remaining));
+  res.set_header("X-RateLimit-Reset", std::to_string(CeilSeconds(tightest->reset)));
+  if (tightest->allowed) {
+    return true;
+  }
+  res.status = 429;
+  res.set_header("Retry-After", std::to_string(std::max<long long>(1, CeilSeconds(tightest->retry_after))));
+  res.set_content(R"({"error":"rate_limited"})", "application/json");
+  return false;
+}
+
+std::string ClientAddress(const httplib::Request &req, int trusted_proxies) {
+  if (trusted_proxies <= 0) {
+    return req.remote_addr;
+  }
+  const auto forwarded = req.get_header_value("X-Forwarded-For");
+  std::vector<std::string_view> hops;
+  std::string_view rest = forwarded;
+  while (!rest.empty()) {
+    const auto comma = rest.find(',');
+    if (const auto hop = http_utils::Trim(rest.substr(0, comma)); !hop.empty()) {
+      hops.push_back(hop);
+    }
+    rest = comma == std::string_view::npos ? std::string_view{} : rest.substr(comma + 1);
+  }
+  if (hops.empty()) {
+    return req.remote_addr;
+  }
+  const auto index = hops.size() > static_cast<std::size_t>(trusted_proxies) ? hops.size() - trusted_proxies : 0;
+  return std::string(hops[index]);
+}
+
+std::string LoginEmail(const std::string &body) {
+  const auto parsed = nlohmann::json::parse(body, nullptr, false);
+  if (!parsed.is_object() || !parsed.contains("email") || !parsed["email"].is_string()) {
+    return {};
+  }
+  auto email = parsed["email"].get<std::string>();
+  std::transform(email.begin(), email.end(), email.begin(),
+                 [](unsigned char ch) { return static_cast<char>(std::tolower(ch)); });
+  return email;
+}
+
+bool Admission::Check(const httplib::Request &req, httplib::Response &res, bool login) const {
+  const auto address = ClientAddress(req, trusted_proxies_);
+  const auto api_key = req.get_header_value("X-API-Key");
+  if (!login) {
+    return Admit(res, {{limiters_.ip, address}, {limiters_.api_key, api_key}});
+  }
+  const auto email = LoginEmail(req.body);
+  return Admit(res, {{limiters_.ip, address},
+                     {limiters_.api_key, api_key},
+                     {limiters_.login_ip, address},
+                     {limiters_.login_email, email}});
+}
+
+}  // namespace gateway
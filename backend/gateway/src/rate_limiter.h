@@ -0,0 +1,144 @@
+#ifndef CONVEYANCERS_MARKETPLACE_GATEWAY_RATE_LIMITER_H
+#define CONVEYANCERS_MARKETPLACE_GATEWAY_RATE_LIMITER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../common/metrics.h"
+#include "../third_party/httplib.h"
+
+namespace gateway {
+
+struct RateLimit {
+  // Sustained requests per second; zero turns the limiter off.
+  double per_second = 0;
+  // Requests an idle caller may make at once.
+  std::uint32_t burst = 1;
+  // Also enforced across gateway replicas when a shared store is configured.
+  bool shared = false;
+};
+
+// "<per_second>:<burst>" with an optional ":shared", e.g. "0.2:10:shared". Unset or malformed
+// values give fallback; "0" turns the limiter off.
+RateLimit ParseRateLimit(const char *env_value, RateLimit fallback);
+
+// One step of the generic cell rate algorithm, the token bucket kept as a single timestamp:
+// the theoretical arrival time (TAT) at which the bucket would be full again. A request costs
+// interval and passes while TAT stays within tolerance (interval * burst) of now.
+struct GcraStep {
+  bool allowed = false;
+  // TAT minus now after the step, in microseconds.
+  std::int64_t ahead_us = 0;
+};
+
+GcraStep Gcra(std::int64_t tat_us, std::int64_t now_us, std::int64_t interval_us, std::int64_t tolerance_us);
+
+struct RateDecision {
+  bool allowed = true;
+  std::uint32_t limit = 0;
+  std::uint32_t remaining = 0;
+  // Until the bucket is full again.
+  std::chrono::microseconds reset{0};
+  // Until the next request would pass; zero when this one did.
+  std::chrono::microseconds retry_after{0};
+};
+
+// Token buckets for one kind of key (client IP, API key, login email) in a fixed table of
+// one-word slots updated by compare-and-swap, so a check is a hash, two loads and a CAS with
+// no lock and no allocation. Each key may live in either of two slots; a key finding both
+// held by other active keys shares the first, which can only make limiting stricter.
+// Slots are keyed by a per-process random seed, so callers cannot aim keys at one another.
+class RateLimiter {
+ public:
+  using Clock = std::chrono::steady_clock;
+  // Consults state shared with other gateway replicas; nullopt when the store cannot answer,
+  // in which case the local decision stands.
+  using SharedCheck = std::function<std::optional<GcraStep>(std::string_view limiter, std::string_view key,
+                                                            std::int64_t interval_us, std::int64_t tolerance_us)>;
+
+  // slots is rounded up to a power of two. shared is only used when limit.shared is set.
+  RateLimiter(std::string name, RateLimit limit, std::size_t slots = 65536, SharedCheck shared = {});
+
+  RateLimiter(const RateLimiter &) = delete;
+  RateLimiter &operator=(const RateLimiter &) = delete;
+
+  bool Enabled() const { return interval_us_ > 0; }
+  const std::string &Name() const { return name_; }
+
+  // Takes one token for key. Always allowed while the limiter is off.
+  RateDecision Check(std::string_view key, Clock::time_point now = Clock::now());
+
+  // One exposition block for several limiters.
+  static std::string RenderMetrics(const std::vector<const RateLimiter *> &limiters);
+
+ private:
+  std::uint64_t Hash(std::string_view key) const;
+  GcraStep CheckLocal(std::uint64_t hash, std::int64_t now_us);
+  RateDecision Decide(const GcraStep &step) const;
+
+  const std::string name_;
+  const RateLimit limit_;
+  const SharedCheck shared_;
+  std::int64_t interval_us_ = 0;
+  std::int64_t tolerance_us_ = 0;
+  std::uint64_t seed_ = 0;
+  std::size_t mask_ = 0;
+  std::unique_ptr<std::atomic<std::uint64_t>[]> slots_;
+  const Clock::time_point epoch_;
+
+  metrics::Counter allowed_;
+  metrics::Counter limited_;
+  metrics::Counter shared_errors_;
+};
+
+struct RateCheck {
+  RateLimiter *limiter;
+  std::string_view key;
+};
+
+// Runs the checks in order, skipping empty keys and disabled limiters, and stops at the first
+// rejection. Sets X-RateLimit-Limit, -Remaining and -Reset (seconds) from the tightest limiter
+// consulted; a rejection becomes a 429 with Retry-After. Returns whether the request may go on.
+bool Admit(httplib::Response &res, std::initializer_list<RateCheck> checks);
+
+// The caller's address: remote_addr, or with trusted_proxies > 0 the X-Forwarded-For entry
+// that many hops from the right, which the outermost trusted proxy appended.
+std::string ClientAddress(const httplib::Request &req, int trusted_proxies);
+
+// The account a login is for, lowercased, or empty when the body names none.
+std::string LoginEmail(const std::string &body);
+
+// The gateway's limiters and how a request is keyed against them. Every request is checked by
+// caller address and API key; one that checks a password is also held to the login limits, by
+// address and by the account its body names, since those are what password guessing spends.
+class Admission {
+ public:
+  struct Limiters {
+    RateLimiter *ip;
+    RateLimiter *api_key;
+    RateLimiter *login_ip;
+    RateLimiter *login_email;
+  };
+
+  Admission(Limiters limiters, int trusted_proxies) : limiters_(limiters), trusted_proxies_(trusted_proxies) {}
+
+  // Admit() over the limits that apply to req.
+  bool Check(const httplib::Request &req, httplib::Response &res, bool login = false) const;
+
+ private:
+  const Limiters limiters_;
+  const int trusted_proxies_;
+};
+
+}  // namespace gateway
+
+#endif  // CONVEYANCERS_MARKETPLACE_GATEWAY_RATE_LIMITER_H
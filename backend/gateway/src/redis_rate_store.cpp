@@ -0,0 +1,115 @@
+#include "redis_rate_store.h"
+
+#include <stdexcept>
+#include <utility>
+
+namespace gateway {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Gcra() against the stored TAT, in microseconds of Redis's clock. The key expires once the
+// bucket is full again, since an absent key reads the same. Integers are formatted explicitly
+// because Lua would otherwise write a TAT in exponent notation.
+constexpr const char *kGcraScript = R"(
+local time = redis.call('TIME')
+local now = tonumber(time[1]) * 1000000 + tonumber(time[2])
+local interval = tonumber(ARGV[1])
+local tolerance = tonumber(ARGV[2])
+local tat = math.max(tonumber(redis.call('GET', KEYS[1]) or now), now)
+local ahead = tat + interval - now
+if ahead > tolerance then
+  return {0, tat - now}
+end
+redis.call('SET', KEYS[1], string.format('%d', tat + interval), 'PX', string.format('%d', math.ceil(ahead / 1000)))
+return {1, ahead}
+)";
+
+}  // namespace
+
+RedisRateStore::RedisRateStore(std::string host, int port, std::string password, RedisRateStoreOptions options)
+    : host_(std::move(host)), port_(port), password_(std::move(password)), options_(options) {}
+
+std::optional<GcraStep> RedisRateStore::Check(std::string_view limiter, std::string_view key,
+                                              std::int64_t interval_us, std::int64_t tolerance_us) {
+  if (!Configured() || Clock::now().time_since_epoch().count() < retry_at_.load(std::memory_order_relaxed)) {
+    return std::nullopt;
+  }
+  std::unique_ptr<redis::Connection> connection;
+  try {
+    connection = Checkout();
+    if (!connection) {
+      return std::nullopt;
+    }
+    std::string sha;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      sha = script_sha_;
+    }
+    std::string redis_key = "ratelimit:";
+    redis_key.append(limiter).append(":").append(key);
+    std::string command;
+    redis::AppendRespCommand(command, {"EVALSHA", sha, "1", redis_key, std::to_string(interval_us),
+                                       std::to_string(tolerance_us)});
+    connection->Write(command);
+    const auto reply = connection->Read();
+    if (reply.type != redis::RespReply::Type::kArray || reply.elements.size() != 2) {
+      // NOSCRIPT after a script flush lands here too; the replacement connection reloads it.
+      throw std::runtime_error(reply.type == redis::RespReply::Type::kError ? reply.text : "redis_protocol_error");
+    }
+    const GcraStep step{reply.elements[0].integer == 1, reply.elements[1].integer};
+    Checkin(std::move(connection));
+    return step;
+  } catch (const std::exception &) {
+    if (connection) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --open_;
+    }
+    Fail();
+    return std::nullopt;
+  }
+}
+
+std::unique_ptr<redis::Connection> RedisRateStore::Checkout() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!idle_.empty()) {
+      auto connection = std::move(idle_.back());
+      idle_.pop_back();
+      return connection;
+    }
+    if (open_ >= options_.max_connections) {
+      return nullptr;
+    }
+    ++open_;
+  }
+  try {
+    auto connection = std::make_unique<redis::Connection>(host_, port_, password_, options_.timeout);
+    std::string command;
+    redis::AppendRespCommand(command, {"SCRIPT", "LOAD", kGcraScript});
+    connection->Write(command);
+    auto reply = connection->Read();
+    if (reply.type != redis::RespReply::Type::kBulk) {
+      throw std::runtime_error("redis_script_load_failed");
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    script_sha_ = std::move(reply.text);
+    return connection;
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --open_;
+    throw;
+  }
+}
+
+void RedisRateStore::Checkin(std::unique_ptr<redis::Connection> connection) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  idle_.push_back(std::move(connection));
+}
+
+void RedisRateStore::Fail() {
+  const auto retry_at = Clock::now() + options_.retry_interval;
+  retry_at_.store(retry_at.time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+}  // namespace gateway
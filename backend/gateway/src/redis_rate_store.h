@@ -0,0 +1,65 @@
+#ifndef CONVEYANCERS_MARKETPLACE_GATEWAY_REDIS_RATE_STORE_H
+#define CONVEYANCERS_MARKETPLACE_GATEWAY_REDIS_RATE_STORE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../common/redis_client.h"
+#include "rate_limiter.h"
+
+namespace gateway {
+
+struct RedisRateStoreOptions {
+  // Per command; a check that takes longer is decided locally.
+  std::chrono::milliseconds timeout{50};
+  // How long checks stay local after Redis fails, instead of each one retrying it.
+  std::chrono::milliseconds retry_interval{1000};
+  std::size_t max_connections = 16;
+};
+
+// Keeps GCRA state for shared limiters in Redis so a limit holds across every gateway replica.
+// A check is one EVALSHA of a script that reads Redis's own clock, so replicas need not agree on
+// the time. When Redis cannot answer, Check() returns nullopt and the local decision stands.
+class RedisRateStore {
+ public:
+  RedisRateStore(std::string host, int port, std::string password, RedisRateStoreOptions options = {});
+
+  RedisRateStore(const RedisRateStore &) = delete;
+  RedisRateStore &operator=(const RedisRateStore &) = delete;
+
+  bool Configured() const { return !host_.empty() && port_ > 0; }
+
+  // Matches RateLimiter::SharedCheck.
+  std::optional<GcraStep> Check(std::string_view limiter, std::string_view key, std::int64_t interval_us,
+                                std::int64_t tolerance_us);
+
+ private:
+  // Connects and loads the script when no idle connection is left; nullptr at the connection cap.
+  std::unique_ptr<redis::Connection> Checkout();
+  void Checkin(std::unique_ptr<redis::Connection> connection);
+  void Fail();
+
+  const std::string host_;
+  const int port_;
+  const std::string password_;
+  const RedisRateStoreOptions options_;
+
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<redis::Connection>> idle_;
+  std::size_t open_ = 0;
+  std::string script_sha_;
+  // steady_clock ticks before which checks skip Redis.
+  std::atomic<std::int64_t> retry_at_{0};
+};
+
+}  // namespace gateway
+
+#endif  // CONVEYANCERS_MARKETPLACE_GATEWAY_REDIS_RATE_STORE_H
@@ -0,0 +1,118 @@
+#include "response_cache.h"
+
+#include <cstdlib>
+#include <exception>
+#include <sstream>
+#include <utility>
+
+#include "http_utils.h"
+
+namespace gateway {
+
+ResponseCacheOptions MakeSearchCacheOptionsFromEnv(std::string name) {
+  using http_utils::ResolvePositiveInt;
+  ResponseCacheOptions options;
+  options.name = std::move(name);
+  options.capacity = static_cast<std::size_t>(
+      ResolvePositiveInt(std::getenv("GATEWAY_SEARCH_CACHE_ENTRIES"), static_cast<int>(options.capacity)));
+  options.ttl = std::chrono::milliseconds(
+      ResolvePositiveInt(std::getenv("GATEWAY_SEARCH_CACHE_TTL_MS"), static_cast<int>(options.ttl.count())));
+  return options;
+}
+
+ResponseCache::ResponseCache(ResponseCacheOptions options) : options_(std::move(options)) {
+  if (options_.capacity == 0) {
+    options_.capacity = 1;
+  }
+  entries_.reserve(options_.capacity);
+}
+
+ResponseCache::Value ResponseCache::GetOrFetch(const std::string &key, const Fetcher &fetch, Clock::time_point now) {
+  std::promise<Value> promise;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (const auto it = entries_.find(key); it != entries_.end()) {
+      if (now < it->second.expires_at) {
+        recency_.splice(recency_.begin(), recency_, it->second.position);
+        hits_.Add();
+        return it->second.value;
+      }
+      recency_.erase(it->second.position);
+      entries_.erase(it);
+      evicted_expired_.Add();
+    }
+    if (const auto it = in_flight_.find(key); it != in_flight_.end()) {
+      auto pending = it->second;
+      lock.unlock();
+      coalesced_.Add();
+      return pending.get();
+    }
+    in_flight_.emplace(key, promise.get_future().share());
+  }
+  misses_.Add();
+
+  Value value;
+  try {
+    value = fetch();
+  } catch (...) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      in_flight_.erase(key);
+    }
+    promise.set_exception(std::current_exception());
+    throw;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    in_flight_.erase(key);
+    if (value && value->status == 200) {
+      Store(key, value, now);
+    }
+  }
+  promise.set_value(value);
+  return value;
+}
+
+void ResponseCache::Store(const std::string &key, Value value, Clock::time_point now) {
+  if (const auto it = entries_.find(key); it != entries_.end()) {
+    recency_.erase(it->second.position);
+    entries_.erase(it);
+  }
+  while (entries_.size() >= options_.capacity && !recency_.empty()) {
+    entries_.erase(recency_.back());
+    recency_.pop_back();
+    evicted_capacity_.Add();
+  }
+  recency_.push_front(key);
+  entries_.emplace(key, Entry{std::move(value), now + options_.ttl, recency_.begin()});
+}
+
+std::size_t ResponseCache::Size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+std::string ResponseCache::RenderMetrics() const {
+  std::ostringstream labels;
+  labels << "cache=\"" << options_.name << '"';
+  std::ostringstream oss;
+  oss << "# HELP gateway_response_cache_requests_total Cached upstream reads by outcome" << '\n';
+  oss << "# TYPE gateway_response_cache_requests_total counter" << '\n';
+  oss << "gateway_response_cache_requests_total{" << labels.str() << ",outcome=\"hit\"} " << hits_.Value() << '\n';
+  oss << "gateway_response_cache_requests_total{" << labels.str() << ",outcome=\"miss\"} " << misses_.Value()
+      << '\n';
+  oss << "gateway_response_cache_requests_total{" << labels.str() << ",outcome=\"coalesced\"} "
+      << coalesced_.Value() << '\n';
+  oss << "# HELP gateway_response_cache_evictions_total Cached responses dropped by reason" << '\n';
+  oss << "# TYPE gateway_response_cache_evictions_total counter" << '\n';
+  oss << "gateway_response_cache_evictions_total{" << labels.str() << ",reason=\"capacity\"} "
+      << evicted_capacity_.Value() << '\n';
+  oss << "gateway_response_cache_evictions_total{" << labels.str() << ",reason=\"expired\"} "
+      << evicted_expired_.Value() << '\n';
+  oss << "# HELP gateway_response_cache_entries Responses currently cached" << '\n';
+  oss << "# TYPE gateway_response_cache_entries gauge" << '\n';
+  oss << "gateway_response_cache_entries{" << labels.str() << "} " << Size() << '\n';
+  return oss.str();
+}
+
+}  // namespace gateway
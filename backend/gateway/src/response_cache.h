@@ -0,0 +1,82 @@
+#ifndef CONVEYANCERS_MARKETPLACE_GATEWAY_RESPONSE_CACHE_H
+#define CONVEYANCERS_MARKETPLACE_GATEWAY_RESPONSE_CACHE_H
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "../common/metrics.h"
+
+namespace gateway {
+
+struct CachedResponse {
+  int status = 200;
+  std::string content_type;
+  std::string body;
+};
+
+struct ResponseCacheOptions {
+  std::string name;
+  std::size_t capacity = 1024;
+  std::chrono::milliseconds ttl{5000};
+};
+
+// Reads GATEWAY_SEARCH_CACHE_ENTRIES and GATEWAY_SEARCH_CACHE_TTL_MS on top of the defaults.
+ResponseCacheOptions MakeSearchCacheOptionsFromEnv(std::string name);
+
+// Bounded LRU cache of upstream responses with a fixed time-to-live. Concurrent misses for the
+// same key are coalesced: the first caller fetches and the others wait for its result, so a
+// burst of identical queries costs one upstream call. Only 200 responses are stored.
+class ResponseCache {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using Value = std::shared_ptr<const CachedResponse>;
+  // Returns null when the upstream could not be reached.
+  using Fetcher = std::function<Value()>;
+
+  explicit ResponseCache(ResponseCacheOptions options);
+
+  ResponseCache(const ResponseCache &) = delete;
+  ResponseCache &operator=(const ResponseCache &) = delete;
+
+  // Rethrows whatever fetch throws, to the caller that ran it and to every coalesced waiter.
+  Value GetOrFetch(const std::string &key, const Fetcher &fetch, Clock::time_point now = Clock::now());
+
+  std::size_t Size() const;
+  const ResponseCacheOptions &Options() const { return options_; }
+  std::string RenderMetrics() const;
+
+ private:
+  struct Entry {
+    Value value;
+    Clock::time_point expires_at;
+    std::list<std::string>::iterator position;
+  };
+
+  void Store(const std::string &key, Value value, Clock::time_point now);
+
+  ResponseCacheOptions options_;
+
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, Entry> entries_;
+  // Most recently used key at the front.
+  std::list<std::string> recency_;
+  std::unordered_map<std::string, std::shared_future<Value>> in_flight_;
+
+  metrics::Counter hits_;
+  metrics::Counter misses_;
+  metrics::Counter coalesced_;
+  metrics::Counter evicted_capacity_;
+  metrics::Counter evicted_expired_;
+};
+
+}  // namespace gateway
+
+#endif  // CONVEYANCERS_MARKETPLACE_GATEWAY_RESPONSE_CACHE_H
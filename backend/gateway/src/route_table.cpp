@@ -0,0 +1,312 @@
+#include "route_table.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <stdexcept>
+#include <utility>
+
+#include "../common/security.h"
+#include "../common/tracing.h"
+#include "http_utils.h"
+#include "json.hpp"
+
+namespace gateway {
+namespace {
+
+constexpr const char *kDefaultRoutes = "/api/identity=identity,/api/jobs=jobs:/jobs,/api/payments=payments";
+
+bool HasParentSegment(std::string_view path) {
+  std::size_t start = 0;
+  while (start <= path.size()) {
+    const auto end = std::min(path.find('/', start), path.size());
+    if (path.substr(start, end - start) == "..") {
+      return true;
+    }
+    start = end + 1;
+  }
+  return false;
+}
+
+// The target's path without its query, decoded as the service's router decodes it, so an
+// escaped path cannot slip past a check.
+std::string RoutedPath(const RouteTable::Target &target) {
+  return httplib::detail::decode_url(target.path.substr(0, target.path.find('?')), false);
+}
+
+// Whether target is "/jobs/<id>/<leaf>" on the jobs service.
+bool IsJobResource(const RouteTable::Target &target, std::string_view leaf) {
+  if (target.upstream->Options().name != "jobs") {
+    return false;
+  }
+  constexpr std::string_view kJobs = "/jobs/";
+  const auto path = RoutedPath(target);
+  if (path.compare(0, kJobs.size(), kJobs) != 0) {
+    return false;
+  }
+  const auto rest = std::string_view(path).substr(kJobs.size());
+  const auto slash = rest.find('/');
+  return slash != 0 && slash != std::string_view::npos && rest.substr(slash + 1) == leaf;
+}
+
+}  // namespace
+
+std::vector<Route> ParseRoutes(std::string_view spec) {
+  std::vector<Route> routes;
+  std::size_t start = 0;
+  while (start <= spec.size()) {
+    const auto end = std::min(spec.find(',', start), spec.size());
+    const auto entry = http_utils::Trim(spec.substr(start, end - start));
+    start = end + 1;
+    if (entry.empty()) {
+      continue;
+    }
+    const auto equals = entry.find('=');
+    if (equals == std::string_view::npos) {
+      throw std::invalid_argument("invalid_route: " + std::string(entry));
+    }
+    Route route;
+    route.prefix = std::string(http_utils::Trim(entry.substr(0, equals)));
+    auto upstream = http_utils::Trim(entry.substr(equals + 1));
+    if (const auto colon = upstream.find(':'); colon != std::string_view::npos) {
+      route.upstream_prefix = std::string(http_utils::Trim(upstream.substr(colon + 1)));
+      upstream = http_utils::Trim(upstream.substr(0, colon));
+    }
+    route.upstream = std::string(upstream);
+    // A trailing slash would stop the prefix matching its own root.
+    while (route.prefix.size() > 1 && route.prefix.back() == '/') {
+      route.prefix.pop_back();
+    }
+    while (!route.upstream_prefix.empty() && route.upstream_prefix.back() == '/') {
+      route.upstream_prefix.pop_back();
+    }
+    if (route.prefix.empty() || route.prefix.front() != '/' || route.upstream.empty() ||
+        (!route.upstream_prefix.empty() && route.upstream_prefix.front() != '/')) {
+      throw std::invalid_argument("invalid_route: " + std::string(entry));
+    }
+    routes.push_back(std::move(route));
+  }
+  return routes;
+}
+
+std::vector<Route> MakeRoutesFromEnv() {
+  const char *value = std::getenv("GATEWAY_ROUTES");
+  return ParseRoutes(value != nullptr && *value != '\0' ? value : kDefaultRoutes);
+}
+
+RouteTable::RouteTable(std::vector<Route> routes, const std::vector<UpstreamPool *> &pools) {
+  entries_.reserve(routes.size());
+  for (auto &route : routes) {
+    const auto pool = std::find_if(pools.begin(), pools.end(), [&route](const UpstreamPool *item) {
+      return item->Options().name == route.upstream;
+    });
+    if (pool == pools.end()) {
+      throw std::invalid_argument("unknown_upstream: " + route.upstream);
+    }
+    entries_.push_back(Entry{std::move(route), *pool});
+  }
+  std::stable_sort(entries_.begin(), entries_.end(), [](const Entry &left, const Entry &right) {
+    return left.route.prefix.size() > right.route.prefix.size();
+  });
+}
+
+std::optional<RouteTable::Target> RouteTable::Resolve(std::string_view target) const {
+  const auto query = target.find('?');
+  const auto path = target.substr(0, query);
+  if (HasParentSegment(path)) {
+    return std::nullopt;
+  }
+  for (const auto &entry : entries_) {
+    const auto &prefix = entry.route.prefix;
+    if (path.substr(0, prefix.size()) != prefix) {
+      continue;
+    }
+    const auto rest = path.substr(prefix.size());
+    if (!rest.empty() && rest.front() != '/' && prefix != "/") {
+      continue;
+    }
+    Target resolved{entry.upstream, entry.route.upstream_prefix};
+    resolved.path.append(prefix == "/" ? path : rest);
+    if (resolved.path.empty()) {
+      resolved.path = "/";
+    }
+    if (query != std::string_view::npos) {
+      resolved.path.append(target.substr(query));
+    }
+    return resolved;
+  }
+  return std::nullopt;
+}
+
+bool ChecksPassword(const RouteTable::Target &target) {
+  if (target.upstream->Options().name != "identity") {
+    return false;
+  }
+  const auto path = RoutedPath(target);
+  return path == "/sessions/login" || path == "/accounts/register";
+}
+
+bool IsEventStream(const RouteTable::Target &target, const httplib::Request &req) {
+  return IsJobResource(target, "events") ||
+         req.get_header_value("Accept").find("text/event-stream") != std::string::npos;
+}
+
+bool IsDocumentUpload(const RouteTable::Target &target, const httplib::Request &req) {
+  return req.method == "POST" && IsJobResource(target, "documents") &&
+         req.get_header_value("Content-Type").rfind("application/json", 0) != 0;
+}
+
+struct FanoutExecutor::Batch {
+  // Owned by the caller of Run(), so only dereferenced after claiming an index below size.
+  const std::vector<std::function<void()>> *tasks = nullptr;
+  std::size_t size = 0;
+  // Next task index to claim; whoever takes an index runs that task.
+  std::atomic<std::size_t> next{0};
+  std::mutex mutex;
+  std::condition_variable finished;
+  std::size_t done = 0;
+
+  // Claims and runs tasks until none are left.
+  void Drain() {
+    std::size_t index;
+    while ((index = next.fetch_add(1)) < size) {
+      (*tasks)[index]();
+      std::lock_guard<std::mutex> lock(mutex);
+      if (++done == size) {
+        finished.notify_all();
+      }
+    }
+  }
+};
+
+FanoutExecutor::FanoutExecutor(std::size_t threads, std::size_t queue_limit) : queue_limit_(queue_limit) {
+  threads_.reserve(threads);
+  for (std::size_t i = 0; i < threads; ++i) {
+    threads_.emplace_back([this]() { Work(); });
+  }
+}
+
+FanoutExecutor::~FanoutExecutor() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  ready_.notify_all();
+  for (auto &thread : threads_) {
+    thread.join();
+  }
+}
+
+void FanoutExecutor::Run(const std::vector<std::function<void()>> &tasks) {
+  if (tasks.empty()) {
+    return;
+  }
+  auto batch = std::make_shared<Batch>();
+  batch->tasks = &tasks;
+  batch->size = tasks.size();
+  std::size_t offered = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // One queue entry per task beyond the caller's own; an entry whose tasks were all claimed by
+    // the time a worker reaches it is dropped.
+    while (!threads_.empty() && offered + 1 < tasks.size() && queue_.size() < queue_limit_) {
+      queue_.push_back(batch);
+      ++offered;
+    }
+  }
+  for (std::size_t i = 0; i < offered; ++i) {
+    ready_.notify_one();
+  }
+  batch->Drain();
+  std::unique_lock<std::mutex> lock(batch->mutex);
+  batch->finished.wait(lock, [&batch]() { return batch->done == batch->size; });
+}
+
+void FanoutExecutor::Work() {
+  while (true) {
+    std::shared_ptr<Batch> batch;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ready_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      batch = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    batch->Drain();
+  }
+}
+
+std::unique_ptr<FanoutExecutor> MakeFanoutExecutorFromEnv(std::size_t threads) {
+  const auto count = static_cast<std::size_t>(
+      http_utils::ResolvePositiveInt(std::getenv("GATEWAY_FANOUT_THREADS"), static_cast<int>(threads)));
+  return std::make_unique<FanoutExecutor>(count, count * 4);
+}
+
+std::vector<httplib::Result> Fanout(FanoutExecutor &executor, const std::vector<UpstreamCall> &calls,
+                                    const httplib::Headers &headers) {
+  std::vector<httplib::Result> results(calls.size());
+  std::vector<std::function<void()>> tasks;
+  tasks.reserve(calls.size());
+  const auto context = tracing::CurrentContext();
+  for (std::size_t i = 0; i < calls.size(); ++i) {
+    tasks.emplace_back([&call = calls[i], &result = results[i], &headers, context]() {
+      tracing::ContextScope scope(context);
+      result = call.upstream->Get(call.path, headers);
+    });
+  }
+  executor.Run(tasks);
+  return results;
+}
+
+std::string MergeResponses(const std::vector<std::string> &names, const std::vector<httplib::Result> &results) {
+  auto merged = nlohmann::json::object();
+  for (std::size_t i = 0; i < names.size() && i < results.size(); ++i) {
+    const auto &result = results[i];
+    if (!result) {
+      merged[names[i]] = {{"status", 503}, {"body", {{"error", "upstream_unavailable"}}}};
+      continue;
+    }
+    nlohmann::json body = result->body;
+    if (result->get_header_value("Content-Type").find("json") != std::string::npos) {
+      if (auto parsed = nlohmann::json::parse(result->body, nullptr, false); !parsed.is_discarded()) {
+        body = std::move(parsed);
+      }
+    }
+    merged[names[i]] = {{"status", result->status}, {"body", std::move(body)}};
+  }
+  return merged.dump();
+}
+
+void Proxy(const RouteTable &routes, const Admission &admission, const httplib::Request &req,
+           httplib::Response &res) {
+  const auto target = routes.Resolve(req.target);
+  if (!admission.Check(req, res, target && ChecksPassword(*target)) || !security::Authorize(req, res, "gateway")) {
+    return;
+  }
+  if (!target) {
+    http_utils::SendError(res, 404, "no_route");
+    return;
+  }
+  if (req.is_multipart_form_data()) {
+    http_utils::SendError(res, 415, "multipart_not_proxied");
+    return;
+  }
+  if (IsEventStream(*target, req)) {
+    http_utils::SendError(res, 406, "event_stream_not_proxied");
+    return;
+  }
+  if (IsDocumentUpload(*target, req)) {
+    http_utils::SendError(res, 415, "upload_not_proxied");
+    return;
+  }
+  if (auto upstream_res =
+          target->upstream->Forward(req.method, target->path, http_utils::UpstreamHeaders(req), req.body)) {
+    http_utils::Relay(*upstream_res, res);
+    return;
+  }
+  http_utils::SendError(res, 503, target->upstream->Options().name + "_unavailable");
+}
+
+}  // namespace gateway
@@ -0,0 +1,139 @@
+#ifndef CONVEYANCERS_MARKETPLACE_GATEWAY_ROUTE_TABLE_H
+#define CONVEYANCERS_MARKETPLACE_GATEWAY_ROUTE_TABLE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "../third_party/httplib.h"
+#include "rate_limiter.h"
+#include "upstream_pool.h"
+
+namespace gateway {
+
+struct Route {
+  // Matched a whole segment at a time: "/api/jobs" covers "/api/jobs" and "/api/jobs/7" but not
+  // "/api/jobsearch".
+  std::string prefix;
+  // UpstreamOptions::name of the pool that serves the route.
+  std::string upstream;
+  // Replaces prefix in the forwarded path.
+  std::string upstream_prefix;
+};
+
+// Comma-separated "prefix=upstream" or "prefix=upstream:/upstream_prefix" entries. Throws
+// std::invalid_argument("invalid_route: <entry>").
+std::vector<Route> ParseRoutes(std::string_view spec);
+
+// GATEWAY_ROUTES, or /api/identity, /api/jobs and /api/payments onto their services.
+std::vector<Route> MakeRoutesFromEnv();
+
+// Maps gateway paths onto upstream pools by longest prefix.
+class RouteTable {
+ public:
+  struct Target {
+    UpstreamPool *upstream = nullptr;
+    // Upstream path with the original query string, still percent-encoded.
+    std::string path;
+  };
+
+  // Throws std::invalid_argument("unknown_upstream: <name>") for a route naming none of pools.
+  RouteTable(std::vector<Route> routes, const std::vector<UpstreamPool *> &pools);
+
+  // target is a raw request target ("/api/jobs/7/documents?limit=5"). Targets outside every
+  // route, or with a ".." segment, resolve to nothing.
+  std::optional<Target> Resolve(std::string_view target) const;
+
+ private:
+  struct Entry {
+    Route route;
+    UpstreamPool *upstream;
+  };
+
+  // Longest prefix first, so the first match is the most specific.
+  std::vector<Entry> entries_;
+};
+
+// Whether target is an identity call that checks a password (sign-in or registration), which
+// the login limits cover whichever gateway path reached it.
+bool ChecksPassword(const RouteTable::Target &target);
+
+// Whether req is for one of jobs' event streams or asks for any stream. Responses are buffered
+// here, so a stream would hold a worker and an upstream client until the read timeout.
+bool IsEventStream(const RouteTable::Target &target, const httplib::Request &req);
+
+// Whether req is a raw-body document upload to jobs. Those stream into the virus scanner and can
+// be far larger than the gateway's payload limit, so they are not buffered here.
+bool IsDocumentUpload(const RouteTable::Target &target, const httplib::Request &req);
+
+struct UpstreamCall {
+  UpstreamPool *upstream = nullptr;
+  std::string path;
+};
+
+// Fixed threads shared by every request's fanout, so a burst of aggregate reads queues work
+// rather than starting threads. The caller runs parts too: it takes whatever no worker has
+// picked up, so with every worker busy a fanout degrades to sequential calls instead of
+// waiting in the queue. The only wait is for parts already running, which the upstream pool's
+// acquire and read timeouts bound.
+class FanoutExecutor {
+ public:
+  // queue_limit is how many parts may wait for a worker; more run on their caller.
+  FanoutExecutor(std::size_t threads, std::size_t queue_limit);
+  ~FanoutExecutor();
+
+  FanoutExecutor(const FanoutExecutor &) = delete;
+  FanoutExecutor &operator=(const FanoutExecutor &) = delete;
+
+  // Runs every task once, on the workers and the calling thread, and returns when all are done.
+  void Run(const std::vector<std::function<void()>> &tasks);
+
+ private:
+  struct Batch;
+
+  void Work();
+
+  const std::size_t queue_limit_;
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<std::shared_ptr<Batch>> queue_;
+  bool stopping_ = false;
+  std::vector<std::thread> threads_;
+};
+
+// GATEWAY_FANOUT_THREADS workers (default threads) with room for four queued parts each.
+std::unique_ptr<FanoutExecutor> MakeFanoutExecutorFromEnv(std::size_t threads);
+
+// GETs every call at once on executor and the calling thread, and returns the results in call
+// order once all have finished, so the wait is the slowest call rather than the sum. Every
+// call continues the caller's trace.
+std::vector<httplib::Result> Fanout(FanoutExecutor &executor, const std::vector<UpstreamCall> &calls,
+                                    const httplib::Headers &headers);
+
+// Most aggregate requests a client may ask for at once.
+inline constexpr std::size_t kMaxAggregateParts = 8;
+
+// Body of an aggregate response, {"<name>": {"status": ..., "body": ...}, ...} with names and
+// results paired by position. JSON bodies are embedded as JSON and anything else as a string; a
+// call that got no response reads as status 503 with {"error": "upstream_unavailable"}.
+std::string MergeResponses(const std::vector<std::string> &names, const std::vector<httplib::Result> &results);
+
+// Passes a request under a routed prefix through to its service, which applies its own role
+// checks, once admission and the API key allow it. What the gateway cannot buffer is refused
+// with an error naming it, and clients send it to the service directly: event streams get 406,
+// multipart bodies (which httplib parses before a handler sees them) and raw document uploads
+// get 415.
+void Proxy(const RouteTable &routes, const Admission &admission, const httplib::Request &req,
+           httplib::Response &res);
+
+}  // namespace gateway
+
+#endif  // CONVEYANCERS_MARKETPLACE_GATEWAY_ROUTE_TABLE_H
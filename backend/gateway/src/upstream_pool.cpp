@@ -0,0 +1,260 @@
+#include "upstream_pool.h"
+
+#include <cstdlib>
+#include <sstream>
+#include <utility>
+
+#include "../common/tracing.h"
+#include "http_utils.h"
+
+namespace gateway {
+
+UpstreamOptions MakeUpstreamOptionsFromEnv(std::string name, std::string host, int port, std::size_t pool_size) {
+  using http_utils::ResolvePositiveInt;
+  UpstreamOptions options;
+  options.name = std::move(name);
+  options.host = std::move(host);
+  options.port = port;
+  options.pool_size = static_cast<std::size_t>(
+      ResolvePositiveInt(std::getenv("GATEWAY_UPSTREAM_POOL_SIZE"), static_cast<int>(pool_size)));
+  options.connect_timeout = std::chrono::milliseconds(ResolvePositiveInt(
+      std::getenv("GATEWAY_UPSTREAM_CONNECT_TIMEOUT_MS"), static_cast<int>(options.connect_timeout.count())));
+  options.read_timeout = std::chrono::milliseconds(ResolvePositiveInt(
+      std::getenv("GATEWAY_UPSTREAM_READ_TIMEOUT_MS"), static_cast<int>(options.read_timeout.count())));
+  options.write_timeout = std::chrono::milliseconds(ResolvePositiveInt(
+      std::getenv("GATEWAY_UPSTREAM_WRITE_TIMEOUT_MS"), static_cast<int>(options.write_timeout.count())));
+  options.acquire_timeout = std::chrono::milliseconds(ResolvePositiveInt(
+      std::getenv("GATEWAY_UPSTREAM_ACQUIRE_TIMEOUT_MS"), static_cast<int>(options.acquire_timeout.count())));
+  options.failure_threshold =
+      ResolvePositiveInt(std::getenv("GATEWAY_BREAKER_FAILURE_THRESHOLD"), options.failure_threshold);
+  options.open_interval = std::chrono::milliseconds(
+      ResolvePositiveInt(std::getenv("GATEWAY_BREAKER_OPEN_MS"), static_cast<int>(options.open_interval.count())));
+  return options;
+}
+
+CircuitBreaker::CircuitBreaker(int failure_threshold, std::chrono::milliseconds open_interval)
+    : failure_threshold_(failure_threshold > 0 ? failure_threshold : 1), open_interval_(open_interval) {}
+
+bool CircuitBreaker::Allow(Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  switch (state_) {
+    case State::kClosed:
+      return true;
+    case State::kOpen:
+      if (now - opened_at_ < open_interval_) {
+        return false;
+      }
+      state_ = State::kHalfOpen;
+      probe_in_flight_ = true;
+      return true;
+    case State::kHalfOpen:
+      if (probe_in_flight_) {
+        return false;
+      }
+      probe_in_flight_ = true;
+      return true;
+  }
+  return true;
+}
+
+void CircuitBreaker::RecordSuccess() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  state_ = State::kClosed;
+  consecutive_failures_ = 0;
+  probe_in_flight_ = false;
+}
+
+void CircuitBreaker::RecordFailure(Clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  probe_in_flight_ = false;
+  if (state_ == State::kHalfOpen) {
+    state_ = State::kOpen;
+    opened_at_ = now;
+    return;
+  }
+  if (++consecutive_failures_ >= failure_threshold_ && state_ == State::kClosed) {
+    state_ = State::kOpen;
+    opened_at_ = now;
+  }
+}
+
+CircuitBreaker::State CircuitBreaker::CurrentState() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return state_;
+}
+
+UpstreamPool::UpstreamPool(UpstreamOptions options)
+    : options_(std::move(options)), breaker_(options_.failure_threshold, options_.open_interval) {
+  if (options_.pool_size == 0) {
+    options_.pool_size = 1;
+  }
+  idle_.reserve(options_.pool_size);
+}
+
+httplib::Result UpstreamPool::Get(const std::string &path, const httplib::Headers &headers) {
+  return Send("GET", path, headers,
+              [&](httplib::Client &client, const httplib::Headers &traced) { return client.Get(path, traced); });
+}
+
+httplib::Result UpstreamPool::Post(const std::string &path, const httplib::Headers &headers,
+                                   const std::string &body, const std::string &content_type) {
+  return Send("POST", path, headers, [&](httplib::Client &client, const httplib::Headers &traced) {
+    return client.Post(path, traced, body, content_type);
+  });
+}
+
+httplib::Result UpstreamPool::Forward(const std::string &method, const std::string &path,
+                                      const httplib::Headers &headers, const std::string &body) {
+  return Send(method, path, headers, [&](httplib::Client &client, const httplib::Headers &traced) {
+    httplib::Request request;
+    request.method = method;
+    request.path = path;
+    request.headers = traced;
+    request.body = body;
+    return client.send(request);
+  });
+}
+
+const UpstreamOptions &UpstreamPool::Options() const {
+  return options_;
+}
+
+std::string UpstreamPool::RenderMetrics() const { return RenderMetrics({this}); }
+
+std::string UpstreamPool::RenderMetrics(const std::vector<const UpstreamPool *> &pools) {
+  struct Sample {
+    const std::string *name;
+    std::uint64_t successes;
+    std::uint64_t failures;
+    std::uint64_t rejected;
+    CircuitBreaker::State state;
+  };
+  std::vector<Sample> samples;
+  samples.reserve(pools.size());
+  for (const auto *pool : pools) {
+    const auto state = pool->breaker_.CurrentState();
+    std::lock_guard<std::mutex> lock(pool->stats_mutex_);
+    samples.push_back({&pool->options_.name, pool->successes_total_, pool->failures_total_, pool->rejected_total_,
+                       state});
+  }
+  std::ostringstream oss;
+  oss << "# HELP gateway_upstream_requests_total Upstream calls by outcome" << '\n';
+  oss << "# TYPE gateway_upstream_requests_total counter" << '\n';
+  for (const auto &sample : samples) {
+    oss << "gateway_upstream_requests_total{upstream=\"" << *sample.name << "\",outcome=\"success\"} "
+        << sample.successes << '\n';
+    oss << "gateway_upstream_requests_total{upstream=\"" << *sample.name << "\",outcome=\"failure\"} "
+        << sample.failures << '\n';
+    oss << "gateway_upstream_requests_total{upstream=\"" << *sample.name << "\",outcome=\"rejected\"} "
+        << sample.rejected << '\n';
+  }
+  oss << "# HELP gateway_upstream_breaker_state Current circuit breaker state per upstream" << '\n';
+  oss << "# TYPE gateway_upstream_breaker_state gauge" << '\n';
+  const std::pair<CircuitBreaker::State, const char *> states[] = {{CircuitBreaker::State::kClosed, "closed"},
+                                                                    {CircuitBreaker::State::kOpen, "open"},
+                                                                    {CircuitBreaker::State::kHalfOpen, "half_open"}};
+  for (const auto &sample : samples) {
+    for (const auto &[value, label] : states) {
+      oss << "gateway_upstream_breaker_state{upstream=\"" << *sample.name << "\",state=\"" << label << "\"} "
+          << (sample.state == value ? 1 : 0) << '\n';
+    }
+  }
+  return oss.str();
+}
+
+httplib::Result UpstreamPool::Send(std::string_view method, const std::string &path, const httplib::Headers &headers,
+                                   const Call &call) {
+  tracing::Span span(method, tracing::SpanKind::kClient);
+  if (span.Recording()) {
+    span.SetName(std::string(method) + " " + options_.name)
+        .SetAttribute("http.request.method", method)
+        .SetAttribute("server.address", options_.host)
+        .SetAttribute("server.port", static_cast<std::int64_t>(options_.port))
+        .SetAttribute("url.path", path);
+  }
+  if (!breaker_.Allow()) {
+    span.SetError("circuit_open");
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    ++rejected_total_;
+    return httplib::Result(nullptr, httplib::Error::Connection);
+  }
+  // The upstream continues this trace; any traceparent from the original caller is replaced.
+  httplib::Headers traced = headers;
+  traced.erase("traceparent");
+  traced.emplace("traceparent", tracing::FormatTraceparent(span.Context()));
+  auto lease = Checkout();
+  if (!lease) {
+    span.SetError("pool_exhausted");
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    ++rejected_total_;
+    return httplib::Result(nullptr, httplib::Error::Connection);
+  }
+  auto result = call(lease->Client(), traced);
+  lease.reset();
+  if (result) {
+    span.SetAttribute("http.response.status_code", static_cast<std::int64_t>(result->status));
+    if (result->status >= 500) {
+      span.SetError("HTTP " + std::to_string(result->status));
+    }
+  } else {
+    span.SetError(httplib::to_string(result.error()));
+  }
+
+  // Transport errors and upstream 5xx both count against the breaker; 4xx are caller errors.
+  const bool failed = !result || result->status >= 500;
+  if (failed) {
+    breaker_.RecordFailure();
+  } else {
+    breaker_.RecordSuccess();
+  }
+  std::lock_guard<std::mutex> lock(stats_mutex_);
+  ++(failed ? failures_total_ : successes_total_);
+  return result;
+}
+
+UpstreamPool::Lease::~Lease() {
+  if (pool_ != nullptr) {
+    pool_->Checkin(std::move(client_));
+  }
+}
+
+std::optional<UpstreamPool::Lease> UpstreamPool::Checkout() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!available_.wait_for(lock, options_.acquire_timeout,
+                           [this]() { return !idle_.empty() || created_ < options_.pool_size; })) {
+    return std::nullopt;
+  }
+  std::optional<Lease> lease(std::in_place, this);
+  if (!idle_.empty()) {
+    lease->client_ = std::move(idle_.back());
+    idle_.pop_back();
+    return lease;
+  }
+  ++created_;
+  lock.unlock();
+  lease->client_ = MakeClient();
+  return lease;
+}
+
+void UpstreamPool::Checkin(std::unique_ptr<httplib::Client> client) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (client) {
+      idle_.push_back(std::move(client));
+    } else {
+      --created_;
+    }
+  }
+  available_.notify_one();
+}
+
+std::unique_ptr<httplib::Client> UpstreamPool::MakeClient() const {
+  auto client = std::make_unique<httplib::Client>(options_.host, options_.port);
+  client->set_keep_alive(true);
+  client->set_connection_timeout(options_.connect_timeout);
+  client->set_read_timeout(options_.read_timeout);
+  client->set_write_timeout(options_.write_timeout);
+  return client;
+}
+
+}  // namespace gateway
@@ -0,0 +1,135 @@
+#ifndef CONVEYANCERS_MARKETPLACE_GATEWAY_UPSTREAM_POOL_H
+#define CONVEYANCERS_MARKETPLACE_GATEWAY_UPSTREAM_POOL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "../third_party/httplib.h"
+
+namespace gateway {
+
+struct UpstreamOptions {
+  std::string name;
+  std::string host;
+  int port = 0;
+  // Number of persistent keep-alive clients; normally matches the gateway worker count.
+  std::size_t pool_size = 8;
+  std::chrono::milliseconds connect_timeout{1000};
+  std::chrono::milliseconds read_timeout{1000};
+  std::chrono::milliseconds write_timeout{1000};
+  // How long a call waits for a free client when all of them are busy before giving up.
+  std::chrono::milliseconds acquire_timeout{1000};
+  // Consecutive failures that open the breaker, and how long it stays open before a probe.
+  int failure_threshold = 5;
+  std::chrono::milliseconds open_interval{5000};
+};
+
+// Reads GATEWAY_UPSTREAM_* and GATEWAY_BREAKER_* overrides on top of the given defaults.
+UpstreamOptions MakeUpstreamOptionsFromEnv(std::string name, std::string host, int port, std::size_t pool_size);
+
+class CircuitBreaker {
+ public:
+  enum class State { kClosed, kOpen, kHalfOpen };
+
+  using Clock = std::chrono::steady_clock;
+
+  CircuitBreaker(int failure_threshold, std::chrono::milliseconds open_interval);
+
+  // Returns false while the breaker is open. Once the open interval has elapsed a single caller
+  // is let through as a half-open probe; its outcome decides whether the breaker closes again.
+  bool Allow(Clock::time_point now = Clock::now());
+  void RecordSuccess();
+  void RecordFailure(Clock::time_point now = Clock::now());
+  State CurrentState() const;
+
+ private:
+  const int failure_threshold_;
+  const std::chrono::milliseconds open_interval_;
+
+  mutable std::mutex mutex_;
+  State state_ = State::kClosed;
+  int consecutive_failures_ = 0;
+  bool probe_in_flight_ = false;
+  Clock::time_point opened_at_{};
+};
+
+// Fixed set of keep-alive httplib clients for one upstream service. Each call leases a client,
+// so sockets are reused across requests instead of reconnecting per call.
+class UpstreamPool {
+ public:
+  explicit UpstreamPool(UpstreamOptions options);
+
+  UpstreamPool(const UpstreamPool &) = delete;
+  UpstreamPool &operator=(const UpstreamPool &) = delete;
+
+  // Both return an empty result with httplib::Error::Connection when the breaker is open or no
+  // client frees up within acquire_timeout.
+  httplib::Result Get(const std::string &path, const httplib::Headers &headers);
+  httplib::Result Post(const std::string &path, const httplib::Headers &headers, const std::string &body,
+                       const std::string &content_type);
+  // Any method, for proxied requests; path carries the query string and headers the Content-Type.
+  httplib::Result Forward(const std::string &method, const std::string &path, const httplib::Headers &headers,
+                          const std::string &body);
+
+  const UpstreamOptions &Options() const;
+  std::string RenderMetrics() const;
+  // One exposition block covering several upstreams, so HELP/TYPE lines are not repeated.
+  static std::string RenderMetrics(const std::vector<const UpstreamPool *> &pools);
+
+ private:
+  using Call = std::function<httplib::Result(httplib::Client &, const httplib::Headers &)>;
+
+  // Runs call on a leased client inside a client span, with traceparent added to headers.
+  httplib::Result Send(std::string_view method, const std::string &path, const httplib::Headers &headers,
+                       const Call &call);
+  // A leased client, returned to the pool when the lease ends however the call exits. A lease
+  // whose client could not be created gives its slot back instead.
+  class Lease {
+   public:
+    explicit Lease(UpstreamPool *pool) : pool_(pool) {}
+    Lease(Lease &&other) noexcept : pool_(std::exchange(other.pool_, nullptr)), client_(std::move(other.client_)) {}
+    Lease(const Lease &) = delete;
+    Lease &operator=(const Lease &) = delete;
+    Lease &operator=(Lease &&) = delete;
+    ~Lease();
+
+    httplib::Client &Client() { return *client_; }
+
+   private:
+    friend class UpstreamPool;
+    UpstreamPool *pool_;
+    std::unique_ptr<httplib::Client> client_;
+  };
+
+  // Waits up to acquire_timeout for an idle client or a free slot; nullopt on expiry.
+  std::optional<Lease> Checkout();
+  void Checkin(std::unique_ptr<httplib::Client> client);
+  std::unique_ptr<httplib::Client> MakeClient() const;
+
+  UpstreamOptions options_;
+  CircuitBreaker breaker_;
+
+  std::mutex mutex_;
+  std::condition_variable available_;
+  std::vector<std::unique_ptr<httplib::Client>> idle_;
+  std::size_t created_ = 0;
+
+  mutable std::mutex stats_mutex_;
+  std::uint64_t successes_total_ = 0;
+  std::uint64_t failures_total_ = 0;
+  std::uint64_t rejected_total_ = 0;
+};
+
+}  // namespace gateway
+
+#endif  // CONVEYANCERS_MARKETPLACE_GATEWAY_UPSTREAM_POOL_H
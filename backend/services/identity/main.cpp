@@ -1,21 +1,33 @@
 #include <algorithm>
 #include <array>
 #include <cctype>
+#include <chrono>
+#include <condition_variable>
 #include <cstdlib>
+#include <mutex>
 #include <optional>
 #include <random>
+#include <sstream>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <utility>
 #include <vector>
 
+#include "../../common/codec.h"
 #include "../../common/env_loader.h"
+#include "../../common/http_server.h"
+#include "../../common/json_writer.h"
 #include "../../common/logger.h"
 #include "../../common/persistence/accounts_repository.h"
 #include "../../common/persistence/audit_repository.h"
 #include "../../common/persistence/postgres.h"
+#include "../../common/security.h"
 #include "../../third_party/httplib.h"
 #include "../../third_party/json.hpp"
+#include "password_hasher.h"
+#include "search_index.h"
 
 #include <openssl/evp.h>
 #include <openssl/rand.h>
@@ -48,45 +60,16 @@ void SendJson(httplib::Response &res, const json &payload, int status = 200) {
   res.body = payload.dump();
 }
 
-std::string HexEncode(const unsigned char *data, std::size_t len) {
-  static const char *kHex = "0123456789abcdef";
-  std::string output;
-  output.reserve(len * 2);
-  for (std::size_t i = 0; i < len; ++i) {
-    const unsigned char value = data[i];
-    output.push_back(kHex[value >> 4]);
-    output.push_back(kHex[value & 0x0F]);
-  }
-  return output;
+// For bodies serialised with json_writer::Writer.
+void SendJsonBody(httplib::Response &res, std::string body, int status = 200) {
+  res.status = status;
+  res.set_header("Content-Type", "application/json");
+  res.body = std::move(body);
 }
 
-std::vector<unsigned char> HexDecode(const std::string &hex) {
-  if (hex.size() % 2 != 0) {
-    throw std::runtime_error("invalid_hex");
-  }
-  std::vector<unsigned char> output;
-  output.reserve(hex.size() / 2);
-  for (std::size_t i = 0; i < hex.size(); i += 2) {
-    auto decode = [](char ch) -> int {
-      if (ch >= '0' && ch <= '9') {
-        return ch - '0';
-      }
-      if (ch >= 'a' && ch <= 'f') {
-        return 10 + (ch - 'a');
-      }
-      if (ch >= 'A' && ch <= 'F') {
-        return 10 + (ch - 'A');
-      }
-      return -1;
-    };
-    const int high = decode(hex[i]);
-    const int low = decode(hex[i + 1]);
-    if (high < 0 || low < 0) {
-      throw std::runtime_error("invalid_hex");
-    }
-    output.push_back(static_cast<unsigned char>((high << 4) | low));
-  }
-  return output;
+void SendBusy(httplib::Response &res) {
+  res.set_header("Retry-After", "1");
+  SendJson(res, json{{"error", "busy"}}, 503);
 }
 
 bool ConstantTimeEquals(const std::string &lhs, const std::string &rhs) {
@@ -105,18 +88,21 @@ std::string GenerateSalt() {
   if (RAND_bytes(buffer.data(), static_cast<int>(buffer.size())) != 1) {
     throw std::runtime_error("salt_generation_failed");
   }
-  return HexEncode(buffer.data(), buffer.size());
+  return codec::HexEncode(buffer.data(), buffer.size());
 }
 
 std::string DerivePasswordHash(const std::string &password, const std::string &salt_hex) {
-  const auto salt_bytes = HexDecode(salt_hex);
+  std::vector<unsigned char> salt_bytes;
+  if (!codec::HexDecode(salt_hex, salt_bytes)) {
+    throw std::runtime_error("invalid_hex");
+  }
   std::array<unsigned char, 32> output{};
   if (PKCS5_PBKDF2_HMAC(password.c_str(), static_cast<int>(password.size()), salt_bytes.data(),
                          static_cast<int>(salt_bytes.size()), 100000, EVP_sha256(),
                          static_cast<int>(output.size()), output.data()) != 1) {
     throw std::runtime_error("password_hash_failed");
   }
-  return HexEncode(output.data(), output.size());
+  return codec::HexEncode(output.data(), output.size());
 }
 
 std::string GenerateSecret() {
@@ -148,21 +134,35 @@ std::vector<std::string> ExtractStringArray(const json &payload, const std::stri
   return values;
 }
 
-json AccountToJson(const persistence::AccountRecord &account) {
-  json payload = {{"id", account.id},
-                  {"email", account.email},
-                  {"role", account.role},
-                  {"fullName", account.full_name},
-                  {"state", account.state},
-                  {"suburb", account.suburb},
-                  {"phone", account.phone},
-                  {"verified", account.verified},
-                  {"services", account.services},
-                  {"specialties", account.specialties},
-                  {"licenceNumber", account.licence_number},
-                  {"licenceState", account.licence_state},
-                  {"biography", account.biography}};
-  return payload;
+void WriteAccount(json_writer::Writer &out, const persistence::PublicProfileRecord &account) {
+  out.BeginObject()
+      .Field("id", account.id)
+      .Field("email", account.email)
+      .Field("role", account.role)
+      .Field("fullName", account.full_name)
+      .Field("state", account.state)
+      .Field("suburb", account.suburb)
+      .Field("phone", account.phone)
+      .Field("verified", account.verified)
+      .Field("services", account.services)
+      .Field("specialties", account.specialties)
+      .Field("licenceNumber", account.licence_number)
+      .Field("licenceState", account.licence_state)
+      .Field("biography", account.biography)
+      .EndObject();
+}
+
+std::string RenderSearchIndexMetrics(const identity::ConveyancerSearchIndex &index) {
+  const auto stats = index.Snapshot();
+  std::ostringstream oss;
+  oss << "# HELP identity_search_index_documents Conveyancer profiles held by the search index" << '\n';
+  oss << "# TYPE identity_search_index_documents gauge" << '\n';
+  oss << "identity_search_index_documents " << stats.documents << '\n';
+  oss << "# HELP identity_search_index_terms Distinct tokens and trigrams in the search index" << '\n';
+  oss << "# TYPE identity_search_index_terms gauge" << '\n';
+  oss << "identity_search_index_terms{kind=\"token\"} " << stats.tokens << '\n';
+  oss << "identity_search_index_terms{kind=\"trigram\"} " << stats.trigrams << '\n';
+  return oss.str();
 }
 
 }  // namespace
@@ -176,9 +176,66 @@ int main() {
   auto config = persistence::MakePostgresConfigFromEnv("DATABASE_URL", database_url);
 
   persistence::AccountsRepository accounts(config);
-  persistence::AuditRepository audit(config);
+  persistence::AuditRepository audit_repository(config);
+  persistence::AsyncAuditWriter audit(
+      [&audit_repository](const std::vector<persistence::AuditEvent> &events) {
+        audit_repository.RecordEvents(events);
+      },
+      persistence::MakeAuditWriterOptionsFromEnv("identity"));
 
+  // PBKDF2 runs on its own small pool so login bursts cannot occupy every HTTP worker. The
+  // queue limit keeps the number of request threads parked on a hash bounded as well.
+  const int hardware_threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  const int hash_threads =
+      std::max(1, ParseInt(GetEnvOrDefault("IDENTITY_HASH_THREADS", ""), std::max(2, hardware_threads / 2)));
+  const int hash_queue_limit =
+      std::max(0, ParseInt(GetEnvOrDefault("IDENTITY_HASH_QUEUE_LIMIT", ""), hash_threads * 2));
+  identity::PasswordHasher hasher(DerivePasswordHash, static_cast<std::size_t>(hash_threads),
+                                  static_cast<std::size_t>(hash_queue_limit));
+
+  // /profiles is answered from memory. Registrations update the index directly; the periodic
+  // reload picks up profile edits made outside this service. Until the first load succeeds,
+  // searches fall back to SQL.
+  identity::ConveyancerSearchIndex search_index;
+  const auto reload_search_index = [&]() {
+    try {
+      search_index.Replace(accounts.ListConveyancers());
+    } catch (const std::exception &ex) {
+      logger.Error("search_index_reload_failed", ex.what());
+    }
+  };
+  reload_search_index();
+  const int refresh_seconds = ParseInt(GetEnvOrDefault("IDENTITY_SEARCH_REFRESH_S", "300"), 300);
+  std::mutex refresh_mutex;
+  std::condition_variable refresh_cv;
+  bool stopping = false;
+  std::thread refresher;
+  if (refresh_seconds > 0) {
+    refresher = std::thread([&]() {
+      std::unique_lock<std::mutex> lock(refresh_mutex);
+      while (!refresh_cv.wait_for(lock, std::chrono::seconds(refresh_seconds), [&]() { return stopping; })) {
+        lock.unlock();
+        reload_search_index();
+        lock.lock();
+      }
+    });
+  }
+
+  http_server::ServerOptions server_defaults;
+  server_defaults.max_payload_bytes = 1024 * 1024;
   httplib::Server server;
+  http_server::Bootstrap(server, "identity", http_server::MakeServerOptionsFromEnv("IDENTITY", server_defaults));
+  security::ExposeMetrics(server, "identity");
+  security::MetricsRegistry::Instance().RegisterCollector("identity", [config]() {
+    return persistence::RenderPoolMetrics(config->Stats(), "identity") +
+           persistence::RenderRoutingMetrics(config->Routing(), "identity");
+  });
+  security::MetricsRegistry::Instance().RegisterCollector(
+      "identity", [&audit]() { return audit.RenderMetrics("identity"); });
+  security::MetricsRegistry::Instance().RegisterCollector(
+      "identity", [&search_index]() { return RenderSearchIndexMetrics(search_index); });
+  security::MetricsRegistry::Instance().RegisterCollector(
+      "identity", [&hasher]() { return hasher.RenderMetrics("identity"); });
 
   server.Get("/health", [](const httplib::Request &, httplib::Response &res) {
     SendJson(res, json{{"status", "ok"}});
@@ -199,18 +256,22 @@ int main() {
         SendJson(res, json{{"error", "invalid_role"}}, 400);
         return;
       }
-      if (accounts.FindByEmail(email)) {
+      if (accounts.EmailExists(email)) {
         SendJson(res, json{{"error", "account_exists"}}, 409);
         return;
       }
 
       const std::string salt = GenerateSalt();
-      const std::string hash = DerivePasswordHash(password, salt);
+      const auto hash = hasher.Hash(password, salt);
+      if (!hash) {
+        SendBusy(res);
+        return;
+      }
       const std::string secret = GenerateSecret();
 
       persistence::AccountRegistrationInput input;
       input.email = email;
-      input.password_hash = hash;
+      input.password_hash = *hash;
       input.password_salt = salt;
       input.two_factor_secret = secret;
       input.role = role;
@@ -228,6 +289,7 @@ int main() {
       input.verified = body.value("verified", false);
 
       const auto account = accounts.CreateAccount(input);
+      search_index.Upsert(account);
       audit.RecordEvent(account.id, "account_registered", account.id,
                         json{{"email", email}, {"role", role}}, req.remote_addr);
 
@@ -252,8 +314,12 @@ int main() {
         SendJson(res, json{{"error", "invalid_credentials"}}, 401);
         return;
       }
-      const std::string computed = DerivePasswordHash(password, account->password_salt);
-      if (!ConstantTimeEquals(computed, account->password_hash)) {
+      const auto computed = hasher.Hash(password, account->password_salt);
+      if (!computed) {
+        SendBusy(res);
+        return;
+      }
+      if (!ConstantTimeEquals(*computed, account->password_hash)) {
         SendJson(res, json{{"error", "invalid_credentials"}}, 401);
         return;
       }
@@ -273,7 +339,7 @@ int main() {
         SendJson(res, json{{"error", "not_found"}}, 404);
         return;
       }
-      SendJson(res, AccountToJson(*account));
+      SendJsonBody(res, json_writer::Render([&](json_writer::Writer &out) { WriteAccount(out, *account); }));
     } catch (const std::exception &ex) {
       logger.Error("profile_lookup_failed", ex.what());
       SendJson(res, json{{"error", "profile_lookup_failed"}}, 500);
@@ -292,12 +358,18 @@ int main() {
           limit = 25;
         }
       }
-      const auto results = accounts.SearchConveyancers(state, query, limit);
-      json response = json::array();
+      const auto results = search_index.Loaded()
+                               ? search_index.Search(state, query, static_cast<std::size_t>(limit))
+                               : accounts.SearchConveyancers(state, query, limit);
+      std::string body;
+      json_writer::Writer out(body);
+      out.Reserve(16 + results.size() * 512);
+      out.BeginObject().Key("profiles").BeginArray();
       for (const auto &account : results) {
-        response.push_back(AccountToJson(account));
+        WriteAccount(out, account);
       }
-      SendJson(res, json{{"profiles", response}});
+      out.EndArray().EndObject();
+      SendJsonBody(res, std::move(body));
     } catch (const std::exception &ex) {
       logger.Error("search_failed", ex.what());
       SendJson(res, json{{"error", "search_failed"}}, 500);
@@ -307,5 +379,13 @@ int main() {
   const int port = ParseInt(GetEnvOrDefault("IDENTITY_PORT", "8081"), 8081);
   logger.Info("starting_identity_service", json{{"port", port}}.dump());
   server.listen("0.0.0.0", port);
+  {
+    std::lock_guard<std::mutex> lock(refresh_mutex);
+    stopping = true;
+  }
+  refresh_cv.notify_all();
+  if (refresher.joinable()) {
+    refresher.join();
+  }
   return 0;
 }
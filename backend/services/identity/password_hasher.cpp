@@ -0,0 +1,102 @@
+#include "password_hasher.h"
+
+#include <exception>
+#include <sstream>
+#include <utility>
+
+namespace identity {
+
+PasswordHasher::PasswordHasher(DeriveFn derive, std::size_t threads, std::size_t max_queued)
+    : derive_(std::move(derive)), max_queued_(max_queued) {
+  if (threads == 0) {
+    threads = 1;
+  }
+  workers_.reserve(threads);
+  for (std::size_t i = 0; i < threads; ++i) {
+    workers_.emplace_back([this]() { Work(); });
+  }
+}
+
+PasswordHasher::~PasswordHasher() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  ready_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+std::optional<std::string> PasswordHasher::Hash(const std::string &password, const std::string &salt) {
+  std::future<std::string> result;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queue_.size() >= max_queued_) {
+      rejected_.Add();
+      return std::nullopt;
+    }
+    Job job{password, salt, std::chrono::steady_clock::now(), {}};
+    result = job.result.get_future();
+    queue_.push_back(std::move(job));
+  }
+  ready_.notify_one();
+  return result.get();
+}
+
+std::size_t PasswordHasher::QueueDepth() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return queue_.size();
+}
+
+std::string PasswordHasher::RenderMetrics(std::string_view service) const {
+  std::ostringstream labels;
+  labels << "service=\"" << service << '"';
+  std::ostringstream oss;
+  oss << "# HELP password_hash_queue_wait_seconds Time a password hash waited for a hashing thread" << '\n';
+  oss << "# TYPE password_hash_queue_wait_seconds histogram" << '\n';
+  metrics::WriteHistogram(oss, "password_hash_queue_wait_seconds", labels.str(), queue_wait_.Collect());
+  oss << "# HELP password_hash_duration_seconds Time spent deriving a password hash" << '\n';
+  oss << "# TYPE password_hash_duration_seconds histogram" << '\n';
+  metrics::WriteHistogram(oss, "password_hash_duration_seconds", labels.str(), hash_duration_.Collect());
+  oss << "# HELP password_hash_queue_depth Password hashes waiting for a hashing thread" << '\n';
+  oss << "# TYPE password_hash_queue_depth gauge" << '\n';
+  oss << "password_hash_queue_depth{" << labels.str() << "} " << QueueDepth() << '\n';
+  oss << "# HELP password_hash_rejected_total Password hashes refused because the queue was full" << '\n';
+  oss << "# TYPE password_hash_rejected_total counter" << '\n';
+  oss << "password_hash_rejected_total{" << labels.str() << "} " << rejected_.Value() << '\n';
+  return oss.str();
+}
+
+void PasswordHasher::Work() {
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ready_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      job = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    const auto started = std::chrono::steady_clock::now();
+    queue_wait_.Observe(started - job.enqueued_at);
+    // Observed before the caller is woken, so a Hash() that has returned is already counted.
+    std::string derived;
+    std::exception_ptr error;
+    try {
+      derived = derive_(job.password, job.salt);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    hash_duration_.Observe(std::chrono::steady_clock::now() - started);
+    if (error) {
+      job.result.set_exception(error);
+    } else {
+      job.result.set_value(std::move(derived));
+    }
+  }
+}
+
+}  // namespace identity
@@ -0,0 +1,68 @@
+#ifndef CONVEYANCERS_MARKETPLACE_IDENTITY_PASSWORD_HASHER_H
+#define CONVEYANCERS_MARKETPLACE_IDENTITY_PASSWORD_HASHER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "../../common/metrics.h"
+
+namespace identity {
+
+// Runs password derivation on a fixed set of worker threads so a login burst is capped at
+// `threads` concurrent PBKDF2 runs instead of occupying every HTTP worker. At most
+// `max_queued` requests wait behind them; beyond that Hash() refuses immediately and the
+// caller answers 503.
+class PasswordHasher {
+ public:
+  using DeriveFn = std::function<std::string(const std::string &password, const std::string &salt)>;
+
+  PasswordHasher(DeriveFn derive, std::size_t threads, std::size_t max_queued);
+  ~PasswordHasher();
+
+  PasswordHasher(const PasswordHasher &) = delete;
+  PasswordHasher &operator=(const PasswordHasher &) = delete;
+
+  // Blocks until the hash is ready. Returns nullopt without queueing when the queue is full;
+  // exceptions from the derive function are rethrown here.
+  std::optional<std::string> Hash(const std::string &password, const std::string &salt);
+
+  std::size_t QueueDepth() const;
+  std::string RenderMetrics(std::string_view service) const;
+
+ private:
+  struct Job {
+    std::string password;
+    std::string salt;
+    std::chrono::steady_clock::time_point enqueued_at;
+    std::promise<std::string> result;
+  };
+
+  void Work();
+
+  const DeriveFn derive_;
+  const std::size_t max_queued_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<Job> queue_;
+  bool stopping_ = false;
+  std::vector<std::thread> workers_;
+
+  metrics::Histogram queue_wait_;
+  metrics::Histogram hash_duration_;
+  metrics::Counter rejected_;
+};
+
+}  // namespace identity
+
+#endif  // CONVEYANCERS_MARKETPLACE_IDENTITY_PASSWORD_HASHER_H
@@ -0,0 +1,366 @@
+#include "search_index.h"
+
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+#include <utility>
+
+namespace identity {
+namespace {
+
+// Bytes above 0x7f are kept so UTF-8 names survive tokenisation intact.
+bool IsTokenChar(unsigned char ch) {
+  return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch >= 0x80;
+}
+
+char Lower(unsigned char ch) {
+  return (ch >= 'A' && ch <= 'Z') ? static_cast<char>(ch - 'A' + 'a') : static_cast<char>(ch);
+}
+
+// Lowercases and turns separators into single spaces so substring checks and trigrams only
+// ever see token characters.
+std::string NormaliseText(std::string_view text) {
+  std::string normalised;
+  normalised.reserve(text.size());
+  for (const unsigned char ch : text) {
+    if (IsTokenChar(ch)) {
+      normalised += Lower(ch);
+    } else if (!normalised.empty() && normalised.back() != ' ') {
+      normalised += ' ';
+    }
+  }
+  if (!normalised.empty() && normalised.back() == ' ') {
+    normalised.pop_back();
+  }
+  return normalised;
+}
+
+std::string JoinValues(const std::vector<std::string> &values) {
+  std::string joined;
+  for (const auto &value : values) {
+    if (!joined.empty()) {
+      joined += ' ';
+    }
+    joined += value;
+  }
+  return joined;
+}
+
+std::uint32_t PackTrigram(std::string_view text, std::size_t offset) {
+  return (static_cast<std::uint32_t>(static_cast<unsigned char>(text[offset])) << 16) |
+         (static_cast<std::uint32_t>(static_cast<unsigned char>(text[offset + 1])) << 8) |
+         static_cast<std::uint32_t>(static_cast<unsigned char>(text[offset + 2]));
+}
+
+void AppendTrigrams(std::string_view text, std::vector<std::uint32_t> &out) {
+  for (std::size_t i = 0; i + 3 <= text.size(); ++i) {
+    if (text[i] == ' ' || text[i + 1] == ' ' || text[i + 2] == ' ') {
+      continue;
+    }
+    out.push_back(PackTrigram(text, i));
+  }
+}
+
+template <typename T>
+void SortUnique(std::vector<T> &values) {
+  std::sort(values.begin(), values.end());
+  values.erase(std::unique(values.begin(), values.end()), values.end());
+}
+
+template <typename T>
+void InsertSorted(std::vector<T> &values, T value) {
+  values.insert(std::lower_bound(values.begin(), values.end(), value), value);
+}
+
+template <typename T>
+void EraseSorted(std::vector<T> &values, T value) {
+  const auto it = std::lower_bound(values.begin(), values.end(), value);
+  if (it != values.end() && *it == value) {
+    values.erase(it);
+  }
+}
+
+template <typename T>
+std::vector<T> Intersect(const std::vector<T> &left, const std::vector<T> &right) {
+  std::vector<T> result;
+  std::set_intersection(left.begin(), left.end(), right.begin(), right.end(), std::back_inserter(result));
+  return result;
+}
+
+// Name matches outrank specialty/service matches, which outrank suburb and biography.
+constexpr double kFieldWeights[] = {3.0, 2.0, 2.0, 1.5, 1.0};
+constexpr double kExactMatch = 1.0;
+constexpr double kPrefixMatch = 0.7;
+constexpr double kSubstringMatch = 0.4;
+constexpr double kVerifiedBonus = 0.25;
+
+}  // namespace
+
+std::vector<std::string> Tokenize(std::string_view text) {
+  std::vector<std::string> tokens;
+  std::string current;
+  for (const unsigned char ch : text) {
+    if (IsTokenChar(ch)) {
+      current += Lower(ch);
+    } else if (!current.empty()) {
+      tokens.push_back(std::move(current));
+      current.clear();
+    }
+  }
+  if (!current.empty()) {
+    tokens.push_back(std::move(current));
+  }
+  return tokens;
+}
+
+void ConveyancerSearchIndex::Replace(const std::vector<persistence::PublicProfileRecord> &records) {
+  Index rebuilt;
+  rebuilt.documents.reserve(records.size());
+  for (const auto &record : records) {
+    if (record.role == "conveyancer") {
+      Insert(rebuilt, record);
+    }
+  }
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  index_ = std::move(rebuilt);
+  loaded_ = true;
+}
+
+void ConveyancerSearchIndex::Upsert(const persistence::PublicProfileRecord &record) {
+  if (record.role != "conveyancer") {
+    return;
+  }
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  if (auto it = index_.by_id.find(record.id); it != index_.by_id.end()) {
+    Erase(index_, it->second);
+  }
+  Insert(index_, record);
+}
+
+void ConveyancerSearchIndex::Remove(const std::string &account_id) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  if (auto it = index_.by_id.find(account_id); it != index_.by_id.end()) {
+    Erase(index_, it->second);
+  }
+}
+
+std::vector<persistence::PublicProfileRecord> ConveyancerSearchIndex::Search(std::string_view state,
+                                                                             std::string_view query,
+                                                                             std::size_t limit) const {
+  const auto terms = Tokenize(query);
+  const auto state_key = NormaliseText(state);
+
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  std::vector<DocId> candidates;
+  bool filtered = false;
+  if (!state_key.empty()) {
+    const auto it = index_.states.find(state_key);
+    if (it == index_.states.end()) {
+      return {};
+    }
+    candidates = it->second;
+    filtered = true;
+  }
+
+  for (const auto &term : terms) {
+    std::vector<DocId> matches;
+    for (auto it = index_.tokens.lower_bound(term); it != index_.tokens.end() && it->first.starts_with(term); ++it) {
+      matches.insert(matches.end(), it->second.begin(), it->second.end());
+    }
+    if (term.size() >= 3) {
+      // Docs holding every trigram of the term are substring candidates; ScoreTerm confirms them.
+      std::vector<std::uint32_t> grams;
+      AppendTrigrams(term, grams);
+      SortUnique(grams);
+      std::vector<DocId> substring;
+      bool first = true;
+      for (const auto gram : grams) {
+        const auto it = index_.trigrams.find(gram);
+        if (it == index_.trigrams.end()) {
+          substring.clear();
+          break;
+        }
+        substring = first ? it->second : Intersect(substring, it->second);
+        first = false;
+        if (substring.empty()) {
+          break;
+        }
+      }
+      matches.insert(matches.end(), substring.begin(), substring.end());
+    }
+    SortUnique(matches);
+    candidates = filtered ? Intersect(candidates, matches) : std::move(matches);
+    filtered = true;
+    if (candidates.empty()) {
+      return {};
+    }
+  }
+
+  if (!filtered) {
+    candidates.reserve(index_.live_count);
+    for (DocId doc = 0; doc < index_.documents.size(); ++doc) {
+      if (index_.documents[doc].live) {
+        candidates.push_back(doc);
+      }
+    }
+  }
+
+  std::vector<std::pair<double, DocId>> ranked;
+  ranked.reserve(candidates.size());
+  for (const auto doc : candidates) {
+    const auto &document = index_.documents[doc];
+    double score = 0.0;
+    bool matched = true;
+    for (const auto &term : terms) {
+      const double term_score = ScoreTerm(document, term);
+      if (term_score <= 0.0) {
+        matched = false;
+        break;
+      }
+      score += term_score;
+    }
+    if (!matched) {
+      continue;
+    }
+    if (!terms.empty() && document.record.verified) {
+      score += kVerifiedBonus;
+    }
+    ranked.emplace_back(score, doc);
+  }
+
+  const auto better = [this](const std::pair<double, DocId> &left, const std::pair<double, DocId> &right) {
+    if (left.first != right.first) {
+      return left.first > right.first;
+    }
+    const auto &left_doc = index_.documents[left.second];
+    const auto &right_doc = index_.documents[right.second];
+    if (left_doc.name_key != right_doc.name_key) {
+      return left_doc.name_key < right_doc.name_key;
+    }
+    return left_doc.record.id < right_doc.record.id;
+  };
+  const auto count = std::min(limit, ranked.size());
+  std::partial_sort(ranked.begin(), ranked.begin() + static_cast<std::ptrdiff_t>(count), ranked.end(), better);
+
+  std::vector<persistence::PublicProfileRecord> results;
+  results.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    results.push_back(index_.documents[ranked[i].second].record);
+  }
+  return results;
+}
+
+bool ConveyancerSearchIndex::Loaded() const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  return loaded_;
+}
+
+ConveyancerSearchIndex::Stats ConveyancerSearchIndex::Snapshot() const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  Stats stats;
+  stats.documents = index_.live_count;
+  stats.tokens = index_.tokens.size();
+  stats.trigrams = index_.trigrams.size();
+  return stats;
+}
+
+void ConveyancerSearchIndex::Insert(Index &index, const persistence::PublicProfileRecord &record) {
+  DocId doc;
+  if (!index.free_slots.empty()) {
+    doc = index.free_slots.back();
+    index.free_slots.pop_back();
+  } else {
+    doc = static_cast<DocId>(index.documents.size());
+    index.documents.emplace_back();
+  }
+
+  Document &document = index.documents[doc];
+  document = Document{};
+  document.record = record;
+  document.state_key = NormaliseText(record.state);
+  document.name_key = NormaliseText(record.full_name);
+  document.fields[kName] = document.name_key;
+  document.fields[kSpecialty] = NormaliseText(JoinValues(record.specialties));
+  document.fields[kService] = NormaliseText(JoinValues(record.services));
+  document.fields[kSuburb] = NormaliseText(record.suburb);
+  document.fields[kBiography] = NormaliseText(record.biography);
+  for (const auto &field : document.fields) {
+    auto tokens = Tokenize(field);
+    document.tokens.insert(document.tokens.end(), std::make_move_iterator(tokens.begin()),
+                           std::make_move_iterator(tokens.end()));
+    AppendTrigrams(field, document.trigrams);
+  }
+  SortUnique(document.tokens);
+  SortUnique(document.trigrams);
+  document.live = true;
+
+  for (const auto &token : document.tokens) {
+    auto it = index.tokens.find(token);
+    if (it == index.tokens.end()) {
+      it = index.tokens.emplace(token, std::vector<DocId>{}).first;
+    }
+    InsertSorted(it->second, doc);
+  }
+  for (const auto gram : document.trigrams) {
+    InsertSorted(index.trigrams[gram], doc);
+  }
+  if (!document.state_key.empty()) {
+    InsertSorted(index.states[document.state_key], doc);
+  }
+  index.by_id[record.id] = doc;
+  ++index.live_count;
+}
+
+void ConveyancerSearchIndex::Erase(Index &index, DocId doc) {
+  Document &document = index.documents[doc];
+  for (const auto &token : document.tokens) {
+    if (auto it = index.tokens.find(token); it != index.tokens.end()) {
+      EraseSorted(it->second, doc);
+      if (it->second.empty()) {
+        index.tokens.erase(it);
+      }
+    }
+  }
+  for (const auto gram : document.trigrams) {
+    if (auto it = index.trigrams.find(gram); it != index.trigrams.end()) {
+      EraseSorted(it->second, doc);
+      if (it->second.empty()) {
+        index.trigrams.erase(it);
+      }
+    }
+  }
+  if (auto it = index.states.find(document.state_key); it != index.states.end()) {
+    EraseSorted(it->second, doc);
+    if (it->second.empty()) {
+      index.states.erase(it);
+    }
+  }
+  index.by_id.erase(document.record.id);
+  document = Document{};
+  index.free_slots.push_back(doc);
+  --index.live_count;
+}
+
+double ConveyancerSearchIndex::ScoreTerm(const Document &document, std::string_view term) {
+  double best = 0.0;
+  for (std::size_t field = 0; field < kFieldCount; ++field) {
+    const std::string_view text = document.fields[field];
+    double kind = 0.0;
+    std::size_t position = text.find(term);
+    while (position != std::string_view::npos) {
+      const bool starts_token = position == 0 || text[position - 1] == ' ';
+      const auto end = position + term.size();
+      const bool ends_token = end == text.size() || text[end] == ' ';
+      const double match = starts_token ? (ends_token ? kExactMatch : kPrefixMatch) : kSubstringMatch;
+      kind = std::max(kind, match);
+      if (kind == kExactMatch) {
+        break;
+      }
+      position = text.find(term, position + 1);
+    }
+    best = std::max(best, kind * kFieldWeights[field]);
+  }
+  return best;
+}
+
+}  // namespace identity
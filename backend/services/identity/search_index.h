@@ -0,0 +1,85 @@
+#ifndef CONVEYANCERS_MARKETPLACE_IDENTITY_SEARCH_INDEX_H
+#define CONVEYANCERS_MARKETPLACE_IDENTITY_SEARCH_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "../../common/persistence/accounts_repository.h"
+
+namespace identity {
+
+// Splits text into lowercase alphanumeric tokens.
+std::vector<std::string> Tokenize(std::string_view text);
+
+// In-memory replacement for AccountsRepository::SearchConveyancers. Holds every conveyancer
+// profile with an inverted token index (exact and prefix lookups), a trigram index for
+// substring matches, and a state facet. Readers share a lock; writers replace single
+// profiles or swap in a freshly built index.
+class ConveyancerSearchIndex {
+ public:
+  struct Stats {
+    std::size_t documents = 0;
+    std::size_t tokens = 0;
+    std::size_t trigrams = 0;
+  };
+
+  // Atomically swaps the whole index for one built from records; non-conveyancers are ignored.
+  void Replace(const std::vector<persistence::PublicProfileRecord> &records);
+  // Adds or refreshes a single profile.
+  void Upsert(const persistence::PublicProfileRecord &record);
+  void Remove(const std::string &account_id);
+
+  // Every whitespace-separated term of query must match a profile's name, biography,
+  // specialties, services or suburb. An empty query lists the state in name order, like the
+  // SQL search; otherwise results are ranked best match first.
+  std::vector<persistence::PublicProfileRecord> Search(std::string_view state, std::string_view query,
+                                                       std::size_t limit) const;
+
+  bool Loaded() const;
+  Stats Snapshot() const;
+
+ private:
+  using DocId = std::uint32_t;
+
+  enum Field : std::uint8_t { kName = 0, kSpecialty, kService, kSuburb, kBiography, kFieldCount };
+
+  struct Document {
+    persistence::PublicProfileRecord record;
+    std::string state_key;
+    std::string name_key;
+    // Lowercased field text, used to confirm trigram candidates.
+    std::string fields[kFieldCount];
+    std::vector<std::string> tokens;
+    std::vector<std::uint32_t> trigrams;
+    bool live = false;
+  };
+
+  struct Index {
+    std::vector<Document> documents;
+    std::unordered_map<std::string, DocId> by_id;
+    std::vector<DocId> free_slots;
+    // Ordered so a prefix is a contiguous range.
+    std::map<std::string, std::vector<DocId>, std::less<>> tokens;
+    std::unordered_map<std::uint32_t, std::vector<DocId>> trigrams;
+    std::unordered_map<std::string, std::vector<DocId>> states;
+    std::size_t live_count = 0;
+  };
+
+  static void Insert(Index &index, const persistence::PublicProfileRecord &record);
+  static void Erase(Index &index, DocId doc);
+  static double ScoreTerm(const Document &document, std::string_view term);
+
+  mutable std::shared_mutex mutex_;
+  Index index_;
+  bool loaded_ = false;
+};
+
+}  // namespace identity
+
+#endif  // CONVEYANCERS_MARKETPLACE_IDENTITY_SEARCH_INDEX_H
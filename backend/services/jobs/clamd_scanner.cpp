@@ -0,0 +1,429 @@
+#include "clamd_scanner.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "../../common/logger.h"
+
+namespace jobs {
+namespace {
+
+timeval ToTimeval(std::chrono::milliseconds timeout) {
+  timeval tv{};
+  tv.tv_sec = static_cast<decltype(tv.tv_sec)>(timeout.count() / 1000);
+  tv.tv_usec = static_cast<decltype(tv.tv_usec)>((timeout.count() % 1000) * 1000);
+  return tv;
+}
+
+void Log(const std::string &event, const std::string &detail) {
+  logging::ServiceLogger::Instance("jobs").Warn(event, detail);
+}
+
+const char *ResultLabel(ScanVerdict::Result result) {
+  switch (result) {
+    case ScanVerdict::Result::kClean:
+      return "clean";
+    case ScanVerdict::Result::kInfected:
+      return "infected";
+    case ScanVerdict::Result::kError:
+      break;
+  }
+  return "error";
+}
+
+}  // namespace
+
+ScanVerdict ParseClamdReply(std::string_view reply, unsigned *id) {
+  *id = 0;
+  // Session replies are prefixed with the request id: "<id>: stream: OK".
+  if (const auto colon = reply.find(": "); colon != std::string_view::npos && colon > 0 &&
+                                           std::all_of(reply.begin(), reply.begin() + colon,
+                                                       [](char ch) { return ch >= '0' && ch <= '9'; })) {
+    *id = static_cast<unsigned>(std::stoul(std::string(reply.substr(0, colon))));
+    reply.remove_prefix(colon + 2);
+  }
+  if (reply.substr(0, 8) == "stream: ") {
+    reply.remove_prefix(8);
+  }
+  ScanVerdict verdict;
+  constexpr std::string_view kFound = " FOUND";
+  constexpr std::string_view kError = " ERROR";
+  if (reply == "OK") {
+    verdict.result = ScanVerdict::Result::kClean;
+  } else if (reply.size() > kFound.size() && reply.substr(reply.size() - kFound.size()) == kFound) {
+    verdict.result = ScanVerdict::Result::kInfected;
+    verdict.detail = std::string(reply.substr(0, reply.size() - kFound.size()));
+  } else if (reply.size() > kError.size() && reply.substr(reply.size() - kError.size()) == kError) {
+    verdict.detail = std::string(reply.substr(0, reply.size() - kError.size()));
+  } else {
+    verdict.detail = reply.empty() ? "empty_reply" : std::string(reply);
+  }
+  return verdict;
+}
+
+ClamdSession::ClamdSession(const ClamdOptions &options)
+    : chunk_bytes_(std::max<std::size_t>(options.chunk_bytes, 1024)), last_used_(std::chrono::steady_clock::now()) {
+  if (options.host.empty() || options.port <= 0) {
+    throw std::runtime_error("invalid_target");
+  }
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *result = nullptr;
+  const std::string port_str = std::to_string(options.port);
+  if (getaddrinfo(options.host.c_str(), port_str.c_str(), &hints, &result) != 0) {
+    throw std::runtime_error("getaddrinfo_failed");
+  }
+  for (auto *entry = result; entry != nullptr; entry = entry->ai_next) {
+    fd_ = ::socket(entry->ai_family, entry->ai_socktype, entry->ai_protocol);
+    if (fd_ < 0) {
+      continue;
+    }
+    if (::connect(fd_, entry->ai_addr, entry->ai_addrlen) == 0) {
+      break;
+    }
+    ::close(fd_);
+    fd_ = -1;
+  }
+  freeaddrinfo(result);
+  if (fd_ < 0) {
+    throw std::runtime_error("connect_failed");
+  }
+  const timeval tv = ToTimeval(options.timeout);
+  ::setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  ::setsockopt(fd_, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  frame_.reserve(sizeof(std::uint32_t) + chunk_bytes_);
+  try {
+    // Commands are NUL-terminated ("z" prefix), and so are the replies.
+    Write("zIDSESSION", sizeof("zIDSESSION"));
+  } catch (...) {
+    ::close(fd_);
+    throw;
+  }
+}
+
+ClamdSession::~ClamdSession() {
+  if (fd_ < 0) {
+    return;
+  }
+  try {
+    Write("zEND", sizeof("zEND"));
+  } catch (const std::exception &) {
+    // The daemon may already have closed the session.
+  }
+  ::close(fd_);
+}
+
+void ClamdSession::Write(const char *data, std::size_t length) {
+  std::size_t sent = 0;
+  while (sent < length) {
+    const ssize_t rc = ::send(fd_, data + sent, length - sent, MSG_NOSIGNAL);
+    if (rc < 0) {
+      throw std::runtime_error("send_failed");
+    }
+    sent += static_cast<std::size_t>(rc);
+  }
+}
+
+void ClamdSession::FlushChunk() {
+  const std::size_t length = frame_.size() - sizeof(std::uint32_t);
+  if (length == 0) {
+    return;
+  }
+  const std::uint32_t prefix = htonl(static_cast<std::uint32_t>(length));
+  std::memcpy(frame_.data(), &prefix, sizeof(prefix));
+  Write(frame_.data(), frame_.size());
+  frame_.resize(sizeof(std::uint32_t));
+}
+
+std::string ClamdSession::ReadReply() {
+  while (true) {
+    if (const auto end = pending_.find('\0'); end != std::string::npos) {
+      std::string reply = pending_.substr(0, end);
+      pending_.erase(0, end + 1);
+      return reply;
+    }
+    char buffer[512];
+    const ssize_t rc = ::recv(fd_, buffer, sizeof(buffer), 0);
+    if (rc <= 0) {
+      throw std::runtime_error(rc == 0 ? "connection_closed" : "recv_failed");
+    }
+    pending_.append(buffer, static_cast<std::size_t>(rc));
+  }
+}
+
+ScanVerdict ClamdSession::Scan(const ScanSource &source) {
+  const unsigned id = next_id_++;
+  Write("zINSTREAM", sizeof("zINSTREAM"));
+  frame_.assign(sizeof(std::uint32_t), '\0');
+  const bool complete = source([this](const char *data, std::size_t length) {
+    while (length > 0) {
+      const std::size_t room = sizeof(std::uint32_t) + chunk_bytes_ - frame_.size();
+      const std::size_t take = std::min(room, length);
+      frame_.append(data, take);
+      data += take;
+      length -= take;
+      if (take == room) {
+        FlushChunk();
+      }
+    }
+    return true;
+  });
+  FlushChunk();
+  const std::uint32_t terminator = 0;
+  Write(reinterpret_cast<const char *>(&terminator), sizeof(terminator));
+  const std::string reply = ReadReply();
+  last_used_ = std::chrono::steady_clock::now();
+
+  unsigned reply_id = 0;
+  auto verdict = ParseClamdReply(reply, &reply_id);
+  if (reply_id != id) {
+    throw std::runtime_error("clamd_reply_out_of_order");
+  }
+  if (!complete) {
+    return ScanVerdict{ScanVerdict::Result::kError, "source_incomplete"};
+  }
+  return verdict;
+}
+
+ClamdScanner::ClamdScanner(ClamdOptions options) : options_(std::move(options)) {
+  if (options_.sessions == 0) {
+    options_.sessions = 1;
+  }
+  idle_.reserve(options_.sessions);
+}
+
+ScanVerdict ClamdScanner::Scan(const ScanSource &source) {
+  if (!Configured()) {
+    return ScanVerdict{ScanVerdict::Result::kError, "clamd_not_configured"};
+  }
+  const auto started = std::chrono::steady_clock::now();
+  tracing::Span span("clamav INSTREAM", tracing::SpanKind::kClient);
+  span.SetAttribute("server.address", options_.host);
+  ScanVerdict verdict;
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    std::unique_ptr<ClamdSession> session;
+    try {
+      session = Checkout();
+    } catch (const std::exception &ex) {
+      Log("clamav_unavailable", ex.what());
+      verdict = ScanVerdict{ScanVerdict::Result::kError, ex.what()};
+      continue;
+    }
+    try {
+      verdict = session->Scan(source);
+      Checkin(std::move(session));
+      break;
+    } catch (const std::exception &ex) {
+      Log("clamav_session_failed", ex.what());
+      verdict = ScanVerdict{ScanVerdict::Result::kError, ex.what()};
+      // Frees the slot so the retry (or the next scan) opens a fresh session.
+      session.reset();
+      Checkin(nullptr);
+    }
+  }
+  span.SetAttribute("clamav.result", ResultLabel(verdict.result));
+  switch (verdict.result) {
+    case ScanVerdict::Result::kClean:
+      clean_.Add();
+      break;
+    case ScanVerdict::Result::kInfected:
+      infected_.Add();
+      break;
+    case ScanVerdict::Result::kError:
+      span.SetError(verdict.detail);
+      errors_.Add();
+      break;
+  }
+  latency_.Observe(std::chrono::steady_clock::now() - started);
+  return verdict;
+}
+
+std::unique_ptr<ClamdSession> ClamdScanner::Checkout() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  available_.wait(lock, [this]() { return !idle_.empty() || created_ < options_.sessions; });
+  const auto now = std::chrono::steady_clock::now();
+  while (!idle_.empty()) {
+    auto session = std::move(idle_.back());
+    idle_.pop_back();
+    if (now - session->LastUsed() < options_.max_idle) {
+      return session;
+    }
+    // Likely closed by clamd already; its slot is reused for a new session below.
+    --created_;
+  }
+  ++created_;
+  lock.unlock();
+  try {
+    auto session = std::make_unique<ClamdSession>(options_);
+    sessions_opened_.Add();
+    return session;
+  } catch (...) {
+    lock.lock();
+    --created_;
+    lock.unlock();
+    available_.notify_one();
+    throw;
+  }
+}
+
+void ClamdScanner::Checkin(std::unique_ptr<ClamdSession> session) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (session) {
+      idle_.push_back(std::move(session));
+    } else {
+      --created_;
+    }
+  }
+  available_.notify_one();
+}
+
+std::string ClamdScanner::RenderMetrics(std::string_view service) const {
+  std::ostringstream labels;
+  labels << "service=\"" << service << '"';
+  std::ostringstream oss;
+  oss << "# HELP clamav_scans_total Documents scanned by clamd, by verdict" << '\n';
+  oss << "# TYPE clamav_scans_total counter" << '\n';
+  oss << "clamav_scans_total{" << labels.str() << ",result=\"clean\"} " << clean_.Value() << '\n';
+  oss << "clamav_scans_total{" << labels.str() << ",result=\"infected\"} " << infected_.Value() << '\n';
+  oss << "clamav_scans_total{" << labels.str() << ",result=\"error\"} " << errors_.Value() << '\n';
+  oss << "# HELP clamav_sessions_opened_total clamd IDSESSION connections opened" << '\n';
+  oss << "# TYPE clamav_sessions_opened_total counter" << '\n';
+  oss << "clamav_sessions_opened_total{" << labels.str() << "} " << sessions_opened_.Value() << '\n';
+  oss << "# HELP clamav_scan_seconds Time to stream one document through clamd" << '\n';
+  oss << "# TYPE clamav_scan_seconds histogram" << '\n';
+  metrics::WriteHistogram(oss, "clamav_scan_seconds", labels.str(), latency_.Collect());
+  return oss.str();
+}
+
+ScanQueue::ScanQueue(Scanner scan, Completion done, ScanQueueOptions options)
+    : scan_(std::move(scan)), done_(std::move(done)), options_(options) {
+  const std::size_t workers = std::max<std::size_t>(options_.workers, 1);
+  workers_.reserve(workers);
+  for (std::size_t i = 0; i < workers; ++i) {
+    workers_.emplace_back([this]() { Run(); });
+  }
+}
+
+ScanQueue::~ScanQueue() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  ready_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+bool ScanQueue::Submit(std::string document_id, ScanSource source) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_ || queue_.size() >= options_.queue_limit) {
+      rejected_.Add();
+      return false;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    queue_.push_back(Job{std::move(document_id), std::move(source), 0, now, now, tracing::CurrentContext()});
+  }
+  submitted_.Add();
+  ready_.notify_one();
+  return true;
+}
+
+bool ScanQueue::Saturated() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return queue_.size() >= options_.queue_limit;
+}
+
+std::size_t ScanQueue::Depth() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return queue_.size();
+}
+
+void ScanQueue::Run() {
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (true) {
+        if (stopping_) {
+          return;
+        }
+        // Retries wait at the back of the queue for their backoff; fresh uploads go first.
+        const auto now = std::chrono::steady_clock::now();
+        const auto due = std::find_if(queue_.begin(), queue_.end(),
+                                      [now](const Job &queued) { return queued.not_before <= now; });
+        if (due != queue_.end()) {
+          job = std::move(*due);
+          queue_.erase(due);
+          break;
+        }
+        if (queue_.empty()) {
+          ready_.wait(lock);
+        } else {
+          const auto next = std::min_element(queue_.begin(), queue_.end(), [](const Job &a, const Job &b) {
+            return a.not_before < b.not_before;
+          });
+          ready_.wait_until(lock, next->not_before);
+        }
+      }
+    }
+    if (job.attempts == 0) {
+      queued_latency_.Observe(std::chrono::steady_clock::now() - job.queued_at);
+    }
+
+    tracing::ContextScope scope(job.context);
+    auto verdict = scan_(job.source);
+    if (verdict.result == ScanVerdict::Result::kError && ++job.attempts < options_.max_attempts) {
+      retried_.Add();
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_) {
+        // Left quarantined; the startup sweep queues it again.
+        return;
+      }
+      job.not_before = std::chrono::steady_clock::now() + options_.retry_backoff * (1 << (job.attempts - 1));
+      queue_.push_back(std::move(job));
+      continue;
+    }
+    if (verdict.result == ScanVerdict::Result::kError) {
+      Log("clamav_scan_failed", job.document_id + ": " + verdict.detail);
+    }
+    try {
+      done_(job.document_id, verdict);
+    } catch (const std::exception &ex) {
+      Log("scan_completion_failed", ex.what());
+    }
+  }
+}
+
+std::string ScanQueue::RenderMetrics(std::string_view service) const {
+  std::ostringstream labels;
+  labels << "service=\"" << service << '"';
+  std::ostringstream oss;
+  oss << "# HELP document_scan_queue_depth Quarantined documents waiting for a scan" << '\n';
+  oss << "# TYPE document_scan_queue_depth gauge" << '\n';
+  oss << "document_scan_queue_depth{" << labels.str() << "} " << Depth() << '\n';
+  oss << "# HELP document_scan_jobs_total Scan queue submissions by outcome" << '\n';
+  oss << "# TYPE document_scan_jobs_total counter" << '\n';
+  oss << "document_scan_jobs_total{" << labels.str() << ",outcome=\"queued\"} " << submitted_.Value() << '\n';
+  oss << "document_scan_jobs_total{" << labels.str() << ",outcome=\"rejected\"} " << rejected_.Value() << '\n';
+  oss << "document_scan_jobs_total{" << labels.str() << ",outcome=\"retried\"} " << retried_.Value() << '\n';
+  oss << "# HELP document_scan_wait_seconds Time an upload waited in the queue before its first scan" << '\n';
+  oss << "# TYPE document_scan_wait_seconds histogram" << '\n';
+  metrics::WriteHistogram(oss, "document_scan_wait_seconds", labels.str(), queued_latency_.Collect());
+  return oss.str();
+}
+
+}  // namespace jobs
@@ -0,0 +1,179 @@
+#ifndef CONVEYANCERS_MARKETPLACE_JOBS_CLAMD_SCANNER_H
+#define CONVEYANCERS_MARKETPLACE_JOBS_CLAMD_SCANNER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "../../common/metrics.h"
+#include "../../common/tracing.h"
+
+namespace jobs {
+
+struct ScanVerdict {
+  enum class Result { kClean, kInfected, kError };
+
+  Result result = Result::kError;
+  // Signature name when infected, the failure otherwise.
+  std::string detail;
+};
+
+// Receives document bytes; returning false stops the source.
+using ChunkSink = std::function<bool(const char *data, std::size_t length)>;
+// Feeds a whole document to sink and returns false if it could not be read in full. Sources
+// may be invoked more than once, since a scan is retried when a session drops mid-stream.
+using ScanSource = std::function<bool(const ChunkSink &sink)>;
+
+// Splits a reply such as "3: stream: Eicar-Signature FOUND" into its verdict. id receives the
+// session request id, or 0 when the reply carries none.
+ScanVerdict ParseClamdReply(std::string_view reply, unsigned *id);
+
+struct ClamdOptions {
+  std::string host;
+  int port = 0;
+  // Persistent sessions kept open; scans beyond this many wait for one to come back.
+  std::size_t sessions = 4;
+  // INSTREAM chunk size. clamd accepts up to StreamMaxLength in total, in chunks of any size.
+  std::size_t chunk_bytes = 256 * 1024;
+  std::chrono::milliseconds timeout{30000};
+  // clamd closes sessions idle for longer than its IdleTimeout (30s by default); older idle
+  // sessions are replaced instead of being used and failing.
+  std::chrono::milliseconds max_idle{20000};
+};
+
+// One clamd connection in IDSESSION mode, so many INSTREAM scans share one TCP handshake.
+// Throws std::runtime_error on transport failures; the session is unusable afterwards.
+class ClamdSession {
+ public:
+  explicit ClamdSession(const ClamdOptions &options);
+  ~ClamdSession();
+
+  ClamdSession(const ClamdSession &) = delete;
+  ClamdSession &operator=(const ClamdSession &) = delete;
+
+  // A source that fails part way still finishes the INSTREAM so the session stays in step;
+  // the verdict is then an error.
+  ScanVerdict Scan(const ScanSource &source);
+
+  std::chrono::steady_clock::time_point LastUsed() const { return last_used_; }
+
+ private:
+  void Write(const char *data, std::size_t length);
+  // Flushes the staged chunk as one length-prefixed INSTREAM frame.
+  void FlushChunk();
+  std::string ReadReply();
+
+  int fd_ = -1;
+  const std::size_t chunk_bytes_;
+  unsigned next_id_ = 1;
+  // 4-byte length prefix followed by up to chunk_bytes_ of data.
+  std::string frame_;
+  std::string pending_;
+  std::chrono::steady_clock::time_point last_used_;
+};
+
+// Fixed set of persistent clamd sessions shared by the scan workers.
+class ClamdScanner {
+ public:
+  explicit ClamdScanner(ClamdOptions options);
+
+  ClamdScanner(const ClamdScanner &) = delete;
+  ClamdScanner &operator=(const ClamdScanner &) = delete;
+
+  bool Configured() const { return !options_.host.empty() && options_.port > 0; }
+
+  // A session that fails mid-scan is dropped and the scan retried once on a new connection,
+  // because clamd may have closed it while it sat idle. Never throws.
+  ScanVerdict Scan(const ScanSource &source);
+
+  const ClamdOptions &Options() const { return options_; }
+  std::string RenderMetrics(std::string_view service) const;
+
+ private:
+  std::unique_ptr<ClamdSession> Checkout();
+  void Checkin(std::unique_ptr<ClamdSession> session);
+
+  ClamdOptions options_;
+
+  std::mutex mutex_;
+  std::condition_variable available_;
+  std::vector<std::unique_ptr<ClamdSession>> idle_;
+  std::size_t created_ = 0;
+
+  metrics::Counter clean_;
+  metrics::Counter infected_;
+  metrics::Counter errors_;
+  metrics::Counter sessions_opened_;
+  metrics::Histogram latency_;
+};
+
+struct ScanQueueOptions {
+  std::size_t workers = 2;
+  // Uploads are refused with 503 rather than queued past this many waiting scans.
+  std::size_t queue_limit = 256;
+  // Scanner errors are retried with doubling backoff; after the last attempt the document is
+  // reported as failed and stays quarantined.
+  int max_attempts = 3;
+  std::chrono::milliseconds retry_backoff{1000};
+};
+
+// Scans quarantined uploads on background workers so the upload request only waits for
+// storage. done runs on a worker thread with the final verdict for each document.
+class ScanQueue {
+ public:
+  using Scanner = std::function<ScanVerdict(const ScanSource &source)>;
+  using Completion = std::function<void(const std::string &document_id, const ScanVerdict &verdict)>;
+
+  ScanQueue(Scanner scan, Completion done, ScanQueueOptions options = {});
+  // Stops the workers; queued documents stay quarantined and are picked up again at startup.
+  ~ScanQueue();
+
+  ScanQueue(const ScanQueue &) = delete;
+  ScanQueue &operator=(const ScanQueue &) = delete;
+
+  // False when the queue is full or shutting down.
+  bool Submit(std::string document_id, ScanSource source);
+  bool Saturated() const;
+  std::size_t Depth() const;
+  std::string RenderMetrics(std::string_view service) const;
+
+ private:
+  struct Job {
+    std::string document_id;
+    ScanSource source;
+    int attempts = 0;
+    std::chrono::steady_clock::time_point queued_at{};
+    std::chrono::steady_clock::time_point not_before{};
+    // Span of the upload that queued it; the scan span joins the upload's trace.
+    tracing::SpanContext context;
+  };
+
+  void Run();
+
+  const Scanner scan_;
+  const Completion done_;
+  const ScanQueueOptions options_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<Job> queue_;
+  bool stopping_ = false;
+  std::vector<std::thread> workers_;
+
+  metrics::Counter submitted_;
+  metrics::Counter rejected_;
+  metrics::Counter retried_;
+  metrics::Histogram queued_latency_;
+};
+
+}  // namespace jobs
+
+#endif  // CONVEYANCERS_MARKETPLACE_JOBS_CLAMD_SCANNER_H
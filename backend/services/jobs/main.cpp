@@ -1,41 +1,46 @@
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <charconv>
 #include <chrono>
 #include <cctype>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
-#include <ctime>
-#include <iomanip>
 #include <memory>
 #include <optional>
 #include <random>
-#include <regex>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#include "../../common/codec.h"
 #include "../../common/env_loader.h"
+#include "../../common/http_server.h"
+#include "../../common/json_writer.h"
 #include "../../common/logger.h"
 #include "../../common/persistence/audit_repository.h"
 #include "../../common/persistence/jobs_repository.h"
+#include "../../common/persistence/jobs_repository_utils.h"
 #include "../../common/persistence/postgres.h"
+#include "../../common/response_filter.h"
+#include "../../common/security.h"
+#include "../../common/tracing.h"
 #include "../../third_party/httplib.h"
 #include "../../third_party/json.hpp"
-
-#include <openssl/bio.h>
-#include <openssl/buffer.h>
-#include <openssl/evp.h>
-#include <openssl/hmac.h>
-#include <openssl/rand.h>
-#include <openssl/sha.h>
-
-#include <arpa/inet.h>
-#include <netdb.h>
-#include <sys/socket.h>
-#include <unistd.h>
+#include "clamd_scanner.h"
+#include "message_hub.h"
+#include "object_signing.h"
+#include "redis_client.h"
+#include "template_cache.h"
+#include "template_sync.h"
+#include "upload_stream.h"
 
 using json = nlohmann::json;
 
@@ -46,126 +51,6 @@ logging::ServiceLogger &JobsLogger() {
   return logger;
 }
 
-int ParseInt(const std::string &value, int fallback);
-
-struct ParsedUrl {
-  std::string scheme;
-  std::string host;
-  int port = 0;
-  std::string path;
-  bool secure = false;
-};
-
-ParsedUrl ParseUrl(const std::string &url) {
-  static const std::regex kRegex(R"(^([a-zA-Z][a-zA-Z0-9+.-]*)://([^/ :]+)(:([0-9]+))?(.*)$)");
-  std::smatch matches;
-  if (!std::regex_match(url, matches, kRegex)) {
-    throw std::runtime_error("invalid_url");
-  }
-  ParsedUrl parsed;
-  parsed.scheme = matches[1];
-  parsed.host = matches[2];
-  parsed.path = matches[5].str().empty() ? std::string{"/"} : matches[5].str();
-  parsed.secure = parsed.scheme == "https" || parsed.scheme == "wss";
-  if (matches[4].matched) {
-    parsed.port = ParseInt(matches[4], parsed.secure ? 443 : 80);
-  } else {
-    parsed.port = parsed.secure ? 443 : 80;
-  }
-  return parsed;
-}
-
-class TcpSocket {
- public:
-  TcpSocket(const std::string &host, int port) {
-    if (host.empty() || port <= 0) {
-      throw std::runtime_error("invalid_target");
-    }
-    struct addrinfo hints {};
-    std::memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
-    struct addrinfo *result = nullptr;
-    const std::string port_str = std::to_string(port);
-    if (const int rc = getaddrinfo(host.c_str(), port_str.c_str(), &hints, &result); rc != 0) {
-      throw std::runtime_error("getaddrinfo_failed");
-    }
-    int fd = -1;
-    for (auto *entry = result; entry != nullptr; entry = entry->ai_next) {
-      fd = ::socket(entry->ai_family, entry->ai_socktype, entry->ai_protocol);
-      if (fd < 0) {
-        continue;
-      }
-      if (::connect(fd, entry->ai_addr, entry->ai_addrlen) == 0) {
-        break;
-      }
-      ::close(fd);
-      fd = -1;
-    }
-    freeaddrinfo(result);
-    if (fd < 0) {
-      throw std::runtime_error("connect_failed");
-    }
-    fd_ = fd;
-  }
-
-  TcpSocket(const TcpSocket &) = delete;
-  TcpSocket &operator=(const TcpSocket &) = delete;
-
-  TcpSocket(TcpSocket &&other) noexcept : fd_(other.fd_) { other.fd_ = -1; }
-
-  TcpSocket &operator=(TcpSocket &&other) noexcept {
-    if (this != &other) {
-      if (fd_ >= 0) {
-        ::close(fd_);
-      }
-      fd_ = other.fd_;
-      other.fd_ = -1;
-    }
-    return *this;
-  }
-
-  ~TcpSocket() {
-    if (fd_ >= 0) {
-      ::close(fd_);
-    }
-  }
-
-  void Send(const std::string &data) const { SendRaw(data.data(), data.size()); }
-
-  void SendRaw(const char *data, std::size_t length) const {
-    std::size_t sent = 0;
-    while (sent < length) {
-      const ssize_t rc = ::send(fd_, data + sent, length - sent, 0);
-      if (rc < 0) {
-        throw std::runtime_error("send_failed");
-      }
-      sent += static_cast<std::size_t>(rc);
-    }
-  }
-
-  std::string ReadLine() const {
-    std::string line;
-    char ch = 0;
-    while (true) {
-      const ssize_t rc = ::recv(fd_, &ch, 1, 0);
-      if (rc <= 0) {
-        break;
-      }
-      if (ch == '\n') {
-        break;
-      }
-      if (ch != '\r') {
-        line.push_back(ch);
-      }
-    }
-    return line;
-  }
-
- private:
-  int fd_ = -1;
-};
-
 std::string GetEnvOrDefault(const std::string &key, const std::string &fallback) {
   if (const char *value = std::getenv(key.c_str()); value && *value) {
     return value;
@@ -190,158 +75,38 @@ void SendJson(httplib::Response &res, const json &payload, int status = 200) {
   res.body = payload.dump();
 }
 
-std::vector<unsigned char> Base64Decode(const std::string &value) {
-  BIO *b64 = BIO_new(BIO_f_base64());
-  BIO_set_flags(b64, BIO_FLAGS_BASE64_NO_NL);
-  BIO *source = BIO_new_mem_buf(value.data(), static_cast<int>(value.size()));
-  BIO *bio = BIO_push(b64, source);
-  std::vector<unsigned char> buffer(value.size());
-  const int decoded = BIO_read(bio, buffer.data(), static_cast<int>(buffer.size()));
-  BIO_free_all(bio);
-  if (decoded < 0) {
-    throw std::runtime_error("base64_decode_failed");
+// Content-Length of a request, or nullopt when it is missing or not a plain decimal number.
+std::optional<std::size_t> DeclaredLength(const httplib::Request &req) {
+  const auto value = req.get_header_value("Content-Length");
+  std::size_t length = 0;
+  const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), length);
+  if (value.empty() || ec != std::errc{} || end != value.data() + value.size()) {
+    return std::nullopt;
   }
-  buffer.resize(static_cast<std::size_t>(decoded));
-  return buffer;
+  return length;
 }
 
-std::string Sha256Hex(const std::vector<unsigned char> &data) {
-  std::array<unsigned char, SHA256_DIGEST_LENGTH> digest{};
-  SHA256(data.data(), data.size(), digest.data());
-  static const char *kHex = "0123456789abcdef";
-  std::string output;
-  output.reserve(digest.size() * 2);
-  for (const auto value : digest) {
-    output.push_back(kHex[value >> 4]);
-    output.push_back(kHex[value & 0x0F]);
-  }
-  return output;
-}
-
-struct TemplateSyncResult {
-  std::vector<persistence::TemplateTaskRecord> tasks;
-  json metadata;
-  json source;
-};
+// Largest upload body read and dropped before an early rejection; longer ones are left unread.
+constexpr std::size_t kRejectDrainBytes = 64 * 1024;
 
-TemplateSyncResult SyncTemplateFromPortal(const std::string &url, const json &auth) {
-  if (url.empty()) {
-    throw std::runtime_error("portal_url_missing");
-  }
-  const ParsedUrl parsed = ParseUrl(url);
-  std::unique_ptr<httplib::Client> client;
-  if (parsed.secure) {
-#ifdef CPPHTTPLIB_OPENSSL_SUPPORT
-    auto ssl_client = std::make_unique<httplib::SSLClient>(parsed.host, parsed.port);
-    ssl_client->enable_server_certificate_verification(false);
-    client = std::move(ssl_client);
-#else
-    throw std::runtime_error("ssl_not_supported");
-#endif
-  } else {
-    client = std::make_unique<httplib::Client>(parsed.host, parsed.port);
-  }
-  if (!client) {
-    throw std::runtime_error("client_init_failed");
-  }
-  client->set_read_timeout(10, 0);
-  client->set_connection_timeout(5, 0);
-  httplib::Headers headers;
-  if (auth.is_object()) {
-    if (const auto api_key = auth.find("apiKey"); api_key != auth.end() && api_key->is_string()) {
-      headers.emplace("Authorization", "Bearer " + api_key->get<std::string>());
-    }
-    if (const auto header_values = auth.find("headers"); header_values != auth.end() && header_values->is_object()) {
-      for (const auto &item : header_values->items()) {
-        if (item.value().is_string()) {
-          headers.emplace(item.key(), item.value().get<std::string>());
-        }
-      }
-    }
-  }
-  const auto response = client->Get(parsed.path.c_str(), headers);
-  if (!response) {
-    throw std::runtime_error("portal_request_failed");
+// Answers an upload whose body the handler has not read. Unread bytes would be parsed as the next
+// request on a keep-alive connection, so a short body is drained first, and the response asks the
+// client to close the connection either way.
+void RejectUpload(const httplib::Request &req, httplib::Response &res, const httplib::ContentReader &content_reader,
+                  const json &payload, int status) {
+  if (const auto length = DeclaredLength(req); length && *length > 0 && *length <= kRejectDrainBytes) {
+    content_reader([](const char *, std::size_t) { return true; });
   }
-  if (response->status >= 400) {
-    throw std::runtime_error("portal_request_failed");
-  }
-  json payload = json::parse(response->body);
-  TemplateSyncResult result;
-  result.metadata = json::object();
-  const auto now = std::chrono::system_clock::now();
-  std::time_t now_time = std::chrono::system_clock::to_time_t(now);
-  std::tm tm{};
-#ifdef _WIN32
-  gmtime_s(&tm, &now_time);
-#else
-  gmtime_r(&now_time, &tm);
-#endif
-  std::ostringstream timestamp;
-  timestamp << std::put_time(&tm, "%FT%TZ");
-  result.metadata["syncedAt"] = timestamp.str();
-  result.metadata["statusCode"] = response->status;
-  result.source = json{{"type", "portal"}, {"url", url}, {"statusCode", response->status}};
-  if (payload.contains("version")) {
-    result.metadata["portalVersion"] = payload["version"];
-    result.source["version"] = payload["version"];
-  }
-  const auto *tasks_ptr = &payload;
-  if (payload.contains("tasks")) {
-    tasks_ptr = &payload["tasks"];
-  } else if (payload.contains("workflow") && payload["workflow"].is_object() && payload["workflow"].contains("tasks")) {
-    tasks_ptr = &payload["workflow"]["tasks"];
-  }
-  if (!tasks_ptr->is_array()) {
-    throw std::runtime_error("portal_tasks_missing");
-  }
-  for (const auto &task : *tasks_ptr) {
-    persistence::TemplateTaskRecord task_record;
-    if (task.is_object()) {
-      task_record.name = task.value("name", task.value("title", ""));
-      task_record.due_days = task.value("dueDays", task.value("due_days", 0));
-      task_record.assigned_role = task.value("assignedRole", task.value("owner", ""));
-    }
-    result.tasks.push_back(std::move(task_record));
-  }
-  return result;
+  res.set_header("Connection", "close");
+  SendJson(res, payload, status);
 }
 
-class RedisAdapter {
- public:
-  RedisAdapter(std::string host, int port, std::string password)
-      : host_(std::move(host)), port_(port), password_(std::move(password)) {}
-
-  bool Publish(const std::string &channel, const json &message) const {
-    if (host_.empty() || port_ <= 0) {
-      return false;
-    }
-    try {
-      TcpSocket socket(host_, port_);
-      if (!password_.empty()) {
-        std::ostringstream auth;
-        auth << "*2\r\n$4\r\nAUTH\r\n$" << password_.size() << "\r\n" << password_ << "\r\n";
-        socket.Send(auth.str());
-        socket.ReadLine();
-      }
-      const std::string payload = message.dump();
-      std::ostringstream cmd;
-      cmd << "*3\r\n$7\r\nPUBLISH\r\n$" << channel.size() << "\r\n" << channel << "\r\n$" << payload.size() << "\r\n"
-          << payload << "\r\n";
-      socket.Send(cmd.str());
-      socket.ReadLine();
-      return true;
-    } catch (const std::exception &ex) {
-      JobsLogger().Error("redis_publish_failed", ex.what());
-      return false;
-    }
-  }
-
- private:
-  std::string host_;
-  int port_ = 0;
-  std::string password_;
-};
+// For bodies serialised with json_writer::Writer.
+void SendJsonBody(httplib::Response &res, std::string body, int status = 200) {
+  res.status = status;
+  res.set_header("Content-Type", "application/json");
+  res.body = std::move(body);
+}
 
 std::string TrimScheme(const std::string &endpoint, std::string *scheme) {
   const std::string http = "http://";
@@ -358,63 +123,16 @@ std::string TrimScheme(const std::string &endpoint, std::string *scheme) {
   return endpoint;
 }
 
-std::string HmacSha256(const std::string &key, const std::string &data) {
-  unsigned int len = 0;
-  std::array<unsigned char, EVP_MAX_MD_SIZE> buffer{};
-  HMAC(EVP_sha256(), key.data(), static_cast<int>(key.size()),
-       reinterpret_cast<const unsigned char *>(data.data()), static_cast<int>(data.size()), buffer.data(), &len);
-  return std::string(reinterpret_cast<char *>(buffer.data()), len);
-}
-
-std::string ToHex(const std::string &data) {
-  static const char *kHex = "0123456789abcdef";
-  std::string output;
-  output.reserve(data.size() * 2);
-  for (unsigned char ch : data) {
-    output.push_back(kHex[ch >> 4]);
-    output.push_back(kHex[ch & 0x0F]);
-  }
-  return output;
-}
-
-std::string Sha256Hex(const std::string &data) {
-  std::array<unsigned char, SHA256_DIGEST_LENGTH> digest{};
-  SHA256(reinterpret_cast<const unsigned char *>(data.data()), data.size(), digest.data());
-  static const char *kHex = "0123456789abcdef";
-  std::string output;
-  output.reserve(digest.size() * 2);
-  for (const auto value : digest) {
-    output.push_back(kHex[value >> 4]);
-    output.push_back(kHex[value & 0x0F]);
-  }
-  return output;
-}
-
-std::string UrlEncode(std::string_view value) {
-  std::ostringstream oss;
-  for (unsigned char ch : value) {
-    if (std::isalnum(ch) || ch == '-' || ch == '_' || ch == '.' || ch == '~' || ch == '/') {
-      oss << static_cast<char>(ch);
-    } else {
-      oss << '%' << std::uppercase << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(ch)
-          << std::nouppercase << std::setfill(' ') << std::dec;
-    }
-  }
-  return oss.str();
-}
-
 class MinioAdapter {
  public:
   MinioAdapter(std::string endpoint, std::string bucket, std::string access_key, std::string secret_key,
                std::string region)
-      : bucket_(std::move(bucket)), access_key_(std::move(access_key)), secret_key_(std::move(secret_key)),
-        region_(std::move(region)) {
-    scheme_ = "https";
-    host_ = TrimScheme(endpoint, &scheme_);
-    if (region_.empty()) {
-      region_ = "us-east-1";
-    }
-  }
+      : host_(TrimScheme(endpoint, &scheme_)),
+        bucket_(std::move(bucket)),
+        access_key_(std::move(access_key)),
+        secret_key_(std::move(secret_key)),
+        region_(region.empty() ? "us-east-1" : std::move(region)),
+        presigner_(host_, bucket_, access_key_, secret_key_, region_) {}
 
   bool Configured() const {
     return !host_.empty() && !bucket_.empty() && !access_key_.empty() && !secret_key_.empty();
@@ -428,153 +146,336 @@ class MinioAdapter {
     if (!Configured()) {
       return {};
     }
-    const auto now = std::chrono::system_clock::now();
-    const auto time = std::chrono::system_clock::to_time_t(now);
-    std::tm tm{};
-#if defined(_WIN32)
-    gmtime_s(&tm, &time);
-#else
-    gmtime_r(&time, &tm);
-#endif
-    char date[9];
-    std::strftime(date, sizeof(date), "%Y%m%d", &tm);
-    char timestamp[17];
-    std::strftime(timestamp, sizeof(timestamp), "%Y%m%dT%H%M%SZ", &tm);
-
-    const std::string credential_scope = std::string(date) + "/" + region_ + "/s3/aws4_request";
-    const std::string canonical_uri = "/" + bucket_ + "/" + object_key;
-    const std::string signed_headers = "host";
-    std::ostringstream canonical_query;
-    canonical_query << "X-Amz-Algorithm=AWS4-HMAC-SHA256";
-    canonical_query << "&X-Amz-Credential=" << UrlEncode(access_key_ + "/" + credential_scope);
-    canonical_query << "&X-Amz-Date=" << timestamp;
-    canonical_query << "&X-Amz-Expires=" << std::chrono::duration_cast<std::chrono::seconds>(expiry).count();
-    canonical_query << "&X-Amz-SignedHeaders=" << signed_headers;
-
-    const std::string canonical_headers = "host:" + host_ + "\n";
-    const std::string payload_hash = Sha256Hex("");
-    const std::string canonical_request = "PUT\n" + canonical_uri + "\n" + canonical_query.str() + "\n" +
-                                          canonical_headers + "\n" + signed_headers + "\n" + payload_hash;
-    const std::string string_to_sign =
-        "AWS4-HMAC-SHA256\n" + std::string(timestamp) + "\n" + credential_scope + "\n" + Sha256Hex(canonical_request);
-    const std::string k_date = HmacSha256("AWS4" + secret_key_, date);
-    const std::string k_region = HmacSha256(k_date, region_);
-    const std::string k_service = HmacSha256(k_region, "s3");
-    const std::string k_signing = HmacSha256(k_service, "aws4_request");
-    const std::string signature = ToHex(HmacSha256(k_signing, string_to_sign));
-
-    std::ostringstream url;
-    url << scheme_ << "://" << host_ << canonical_uri << "?" << canonical_query.str()
-        << "&X-Amz-Signature=" << signature;
-    return url.str();
+    return scheme_ + "://" + host_ + PresignedTarget("PUT", object_key, expiry);
+  }
+
+  // Presigned URLs for many objects in one pass (one timestamp, one signing key), in
+  // object_keys order. Empty when storage is not configured.
+  std::vector<std::string> GeneratePresignedUrls(const std::string &method, const std::vector<std::string> &object_keys,
+                                                 std::chrono::seconds expiry) const {
+    if (!Configured()) {
+      return {};
+    }
+    auto urls = presigner_.Targets(method, object_keys, expiry, std::chrono::system_clock::now());
+    const std::string origin = scheme_ + "://" + host_;
+    for (auto &url : urls) {
+      url.insert(0, origin);
+    }
+    return urls;
+  }
+
+  // Streams content_length bytes from pipe into the object. Runs on the uploader thread while
+  // the request thread keeps filling the pipe.
+  bool PutObject(const std::string &object_key, std::size_t content_length, const std::string &content_type,
+                 jobs::ChunkPipe &pipe, std::string *error) const {
+    tracing::Span span("minio PutObject", tracing::SpanKind::kClient);
+    span.SetAttribute("server.address", host_)
+        .SetAttribute("aws.s3.bucket", bucket_)
+        .SetAttribute("http.request.body.size", static_cast<std::int64_t>(content_length));
+    httplib::Client client(scheme_ + "://" + host_);
+    client.set_url_encode(false);
+    client.set_connection_timeout(std::chrono::seconds(5));
+    client.set_write_timeout(std::chrono::seconds(30));
+    client.set_read_timeout(std::chrono::seconds(30));
+    std::vector<char> buffer(64 * 1024);
+    const auto result = client.Put(
+        PresignedTarget("PUT", object_key, std::chrono::minutes(15)), httplib::Headers{}, content_length,
+        [&](std::size_t, std::size_t length, httplib::DataSink &sink) {
+          const std::size_t read = pipe.Read(buffer.data(), std::min(length, buffer.size()));
+          return read > 0 && sink.write(buffer.data(), read);
+        },
+        content_type);
+    if (!result) {
+      *error = httplib::to_string(result.error());
+      span.SetError(*error);
+      return false;
+    }
+    span.SetAttribute("http.response.status_code", static_cast<std::int64_t>(result->status));
+    if (result->status >= 300) {
+      *error = "status " + std::to_string(result->status);
+      span.SetError(*error);
+      return false;
+    }
+    return true;
+  }
+
+  // Streams the object to sink as it is received. False when it could not be read in full.
+  bool GetObject(const std::string &object_key, const jobs::ChunkSink &sink, std::string *error) const {
+    tracing::Span span("minio GetObject", tracing::SpanKind::kClient);
+    span.SetAttribute("server.address", host_).SetAttribute("aws.s3.bucket", bucket_);
+    httplib::Client client(scheme_ + "://" + host_);
+    client.set_url_encode(false);
+    client.set_connection_timeout(std::chrono::seconds(5));
+    client.set_read_timeout(std::chrono::seconds(30));
+    const auto result = client.Get(
+        PresignedTarget("GET", object_key, std::chrono::minutes(5)),
+        [](const httplib::Response &response) { return response.status < 300; },
+        [&sink](const char *data, std::size_t length) { return sink(data, length); });
+    if (!result || result->status >= 300) {
+      // A refused status cancels the read, so the status is only known when a response came back.
+      *error = result ? "status " + std::to_string(result->status) : httplib::to_string(result.error());
+      span.SetError(*error);
+      return false;
+    }
+    return true;
+  }
+
+  // Inverse of ObjectUrl; empty when object_url does not point into this bucket.
+  std::string ObjectKey(const std::string &object_url) const {
+    const std::string prefix = ObjectUrl("");
+    return object_url.size() > prefix.size() && object_url.compare(0, prefix.size(), prefix) == 0
+               ? object_url.substr(prefix.size())
+               : std::string{};
+  }
+
+  bool DeleteObject(const std::string &object_key) const {
+    tracing::Span span("minio DeleteObject", tracing::SpanKind::kClient);
+    span.SetAttribute("server.address", host_).SetAttribute("aws.s3.bucket", bucket_);
+    httplib::Client client(scheme_ + "://" + host_);
+    client.set_url_encode(false);
+    client.set_connection_timeout(std::chrono::seconds(5));
+    const auto result = client.Delete(PresignedTarget("DELETE", object_key, std::chrono::minutes(5)));
+    if (!result || result->status >= 300) {
+      span.SetError(result ? "status " + std::to_string(result->status) : httplib::to_string(result.error()));
+      return false;
+    }
+    return true;
   }
 
  private:
+  std::string PresignedTarget(const std::string &method, const std::string &object_key,
+                              std::chrono::minutes expiry) const {
+    return presigner_.Target(method, object_key, expiry, std::chrono::system_clock::now());
+  }
+
   std::string scheme_;
   std::string host_;
   std::string bucket_;
   std::string access_key_;
   std::string secret_key_;
   std::string region_ = "us-east-1";
+  jobs::SigV4Presigner presigner_;
 };
 
-class ClamAvAdapter {
+// Owns the uploader thread for one streamed document. The request thread writes chunks;
+// the destructor aborts and joins if the request bails out early.
+class StorageUpload {
  public:
-  ClamAvAdapter(std::string host, int port) : host_(std::move(host)), port_(port) {}
-
-  bool Scan(const std::vector<unsigned char> &data, std::string *reason) const {
-    if (ContainsEicar(data)) {
-      if (reason) {
-        *reason = "EICAR test string detected";
+  StorageUpload(const MinioAdapter &minio, std::string object_key, std::size_t content_length,
+                std::string content_type, std::size_t buffer_bytes)
+      : pipe_(buffer_bytes) {
+    thread_ = std::thread([this, &minio, object_key = std::move(object_key), content_length,
+                           content_type = std::move(content_type), context = tracing::CurrentContext()]() {
+      tracing::ContextScope scope(context);
+      stored_ = minio.PutObject(object_key, content_length, content_type, pipe_, &error_);
+      if (!stored_) {
+        pipe_.Abort();
       }
-      return false;
-    }
-    if (host_.empty() || port_ <= 0) {
-      return true;
+    });
+  }
+
+  StorageUpload(const StorageUpload &) = delete;
+  StorageUpload &operator=(const StorageUpload &) = delete;
+
+  ~StorageUpload() {
+    if (thread_.joinable()) {
+      pipe_.Abort();
+      thread_.join();
     }
-    try {
-      TcpSocket socket(host_, port_);
-      socket.Send("zINSTREAM\0");
-      std::size_t offset = 0;
-      while (offset < data.size()) {
-        const std::size_t chunk = std::min<std::size_t>(8192, data.size() - offset);
-        const uint32_t len = htonl(static_cast<uint32_t>(chunk));
-        socket.SendRaw(reinterpret_cast<const char *>(&len), sizeof(len));
-        socket.SendRaw(reinterpret_cast<const char *>(data.data() + offset), chunk);
-        offset += chunk;
-      }
-      const uint32_t terminator = 0;
-      socket.SendRaw(reinterpret_cast<const char *>(&terminator), sizeof(terminator));
-      const std::string response = socket.ReadLine();
-      if (response.find("FOUND") != std::string::npos) {
-        if (reason) {
-          *reason = response;
-        }
-        return false;
-      }
-      return true;
-    } catch (const std::exception &ex) {
-      JobsLogger().Warn("clamav_unavailable", ex.what());
-      return true;
+  }
+
+  // False once the upload has failed, which stops the request body from being read further.
+  bool Write(const char *data, std::size_t length) { return pipe_.Write(data, length); }
+
+  // Waits for the upload to finish; received=false abandons it.
+  bool Finish(bool received, std::string *error) {
+    if (received) {
+      pipe_.Close();
+    } else {
+      pipe_.Abort();
     }
+    thread_.join();
+    *error = error_;
+    return stored_ && received;
   }
 
  private:
-  static bool ContainsEicar(const std::vector<unsigned char> &data) {
-    static const std::string kEicar =
-        "X5O!P%@AP[4\\PZX54(P^)7CC)7}$EICAR-STANDARD-ANTIVIRUS-TEST-FILE!$H+H*";
-    const std::string sample(reinterpret_cast<const char *>(data.data()), data.size());
-    return sample.find(kEicar) != std::string::npos;
+  jobs::ChunkPipe pipe_;
+  std::thread thread_;
+  bool stored_ = false;
+  std::string error_;
+};
+
+void WriteJob(json_writer::Writer &out, const persistence::JobRecord &job) {
+  out.BeginObject()
+      .Field("id", job.id)
+      .Field("customerId", job.customer_id)
+      .Field("conveyancerId", job.conveyancer_id)
+      .Field("state", job.state)
+      .Field("propertyType", job.property_type)
+      .Field("status", job.status)
+      .Field("createdAt", job.created_at)
+      .EndObject();
+}
+
+void WriteMilestone(json_writer::Writer &out, const persistence::MilestoneRecord &milestone) {
+  out.BeginObject()
+      .Field("id", milestone.id)
+      .Field("jobId", milestone.job_id)
+      .Field("name", milestone.name)
+      .Field("amountCents", milestone.amount_cents)
+      .Field("dueDate", milestone.due_date)
+      .Field("status", milestone.status)
+      .EndObject();
+}
+
+void WriteDocumentFields(json_writer::Writer &out, const persistence::DocumentRecord &document) {
+  out.Field("id", document.id)
+      .Field("jobId", document.job_id)
+      .Field("docType", document.doc_type)
+      .Field("url", document.url)
+      .Field("checksum", document.checksum)
+      .Field("uploadedBy", document.uploaded_by)
+      .Field("version", document.version)
+      .Field("createdAt", document.created_at)
+      .Field("scanStatus", document.scan_status);
+}
+
+void WriteDocument(json_writer::Writer &out, const persistence::DocumentRecord &document) {
+  out.BeginObject();
+  WriteDocumentFields(out, document);
+  out.EndObject();
+}
+
+// Reply to an upload: the stored document plus where the client should PUT the object.
+void WriteUploadedDocument(json_writer::Writer &out, const persistence::DocumentRecord &document,
+                           const std::string &upload_url) {
+  out.BeginObject();
+  WriteDocumentFields(out, document);
+  out.Field("uploadUrl", upload_url).EndObject();
+}
+
+void WriteMessage(json_writer::Writer &out, const json &message) { out.Value(message); }
+
+// Writes "key": [items...] inside an open object.
+template <typename T, typename WriteItem>
+void WriteArray(json_writer::Writer &out, std::string_view key, const std::vector<T> &items, WriteItem write_item) {
+  out.Key(key).BeginArray();
+  for (const auto &item : items) {
+    write_item(out, item);
   }
+  out.EndArray();
+}
 
-  std::string host_;
-  int port_ = 0;
-};
+// Writes the page's items under key followed by its "nextCursor" token.
+template <typename T, typename WriteItem>
+void WritePage(json_writer::Writer &out, std::string_view key, const persistence::Page<T> &page,
+               WriteItem write_item) {
+  WriteArray(out, key, page.items, write_item);
+  out.Key("nextCursor");
+  if (page.next) {
+    out.Value(persistence::detail::EncodeCursor(*page.next));
+  } else {
+    out.Value(nullptr);
+  }
+}
 
-json JobToJson(const persistence::JobRecord &job) {
-  return {{"id", job.id},
-          {"customerId", job.customer_id},
-          {"conveyancerId", job.conveyancer_id},
-          {"state", job.state},
-          {"propertyType", job.property_type},
-          {"status", job.status},
-          {"createdAt", job.created_at}};
+// item_bytes is a rough per-item size used to allocate the body once.
+template <typename T, typename WriteItem>
+std::string RenderPage(std::string_view key, const persistence::Page<T> &page, WriteItem write_item,
+                       std::size_t item_bytes) {
+  std::string body;
+  json_writer::Writer out(body);
+  out.Reserve(64 + page.items.size() * item_bytes);
+  out.BeginObject();
+  WritePage(out, key, page, write_item);
+  out.EndObject();
+  return body;
 }
 
-json MilestoneToJson(const persistence::MilestoneRecord &milestone) {
-  return {{"id", milestone.id},
-          {"jobId", milestone.job_id},
-          {"name", milestone.name},
-          {"amountCents", milestone.amount_cents},
-          {"dueDate", milestone.due_date},
-          {"status", milestone.status}};
+int ParseLimit(const httplib::Request &req, int fallback, int max) {
+  if (!req.has_param("limit")) {
+    return fallback;
+  }
+  return std::clamp(ParseInt(req.get_param_value("limit"), fallback), 1, max);
 }
 
-json DocumentToJson(const persistence::DocumentRecord &document) {
-  return {{"id", document.id},
-          {"jobId", document.job_id},
-          {"docType", document.doc_type},
-          {"url", document.url},
-          {"checksum", document.checksum},
-          {"uploadedBy", document.uploaded_by},
-          {"version", document.version},
-          {"createdAt", document.created_at}};
+// Reads an opaque page token from the named query parameter. Answers 400 and returns false
+// when the token is present but malformed.
+bool ParseCursorParam(const httplib::Request &req, httplib::Response &res, const char *name,
+                      std::optional<persistence::PageCursor> *cursor) {
+  if (!req.has_param(name)) {
+    return true;
+  }
+  *cursor = persistence::detail::DecodeCursor(req.get_param_value(name));
+  if (!*cursor) {
+    SendJson(res, json{{"error", "invalid_cursor"}, {"parameter", name}}, 400);
+    return false;
+  }
+  return true;
 }
 
-json TemplateToJson(const persistence::TemplateRecord &record) {
-  json tasks = json::array();
+// Audit rows key the actor as a uuid. Answers 400 and returns nullopt for a malformed actorId.
+std::optional<std::string> ReadActorId(const json &body, httplib::Response &res) {
+  auto actor_id = body.value("actorId", std::string{});
+  if (!actor_id.empty() && !codec::IsUuid(actor_id)) {
+    SendJson(res, json{{"error", "invalid_actor_id"}}, 400);
+    return std::nullopt;
+  }
+  return actor_id;
+}
+
+// A stored message (FetchMessages shape) as pushed to stream clients: the job, the author as
+// authorId and the message's page token as cursor are added.
+json MessagePayload(const std::string &job_id, json message) {
+  message["jobId"] = job_id;
+  message["authorId"] = message["from"].is_string() ? message["from"] : json("");
+  message["cursor"] = persistence::detail::EncodeCursor(
+      persistence::PageCursor{message.value("createdAt", std::string{}), message.value("id", std::string{})});
+  return message;
+}
+
+// One server-sent "message" event. The event id is the message's cursor, so a reconnecting
+// EventSource sends it back as Last-Event-ID and the stream resumes after it.
+std::string MessageEvent(const json &payload) {
+  std::string event = "id: " + payload.value("cursor", std::string{}) + "\nevent: message\ndata: ";
+  event += payload.dump();
+  event += "\n\n";
+  return event;
+}
+
+// The id of an event rendered by MessageEvent, or empty.
+std::string_view MessageEventId(std::string_view event) {
+  if (event.rfind("id: ", 0) != 0) {
+    return {};
+  }
+  return event.substr(4, event.find('\n') - 4);
+}
+
+void WriteTemplate(json_writer::Writer &out, const persistence::TemplateRecord &record) {
+  out.BeginObject()
+      .Field("id", record.id)
+      .Field("name", record.name)
+      .Field("jurisdiction", record.jurisdiction)
+      .Field("description", record.description)
+      .Field("integrationUrl", record.integration_url)
+      .Field("integrationAuthConfigured", !record.integration_auth.empty())
+      .Field("latestVersion", record.latest_version)
+      .Key("tasks")
+      .BeginArray();
   for (const auto &task : record.tasks) {
-    tasks.push_back({{"name", task.name}, {"dueDays", task.due_days}, {"assignedRole", task.assigned_role}});
+    out.BeginObject()
+        .Field("name", task.name)
+        .Field("dueDays", task.due_days)
+        .Field("assignedRole", task.assigned_role)
+        .EndObject();
   }
-  return {{"id", record.id},
-          {"name", record.name},
-          {"jurisdiction", record.jurisdiction},
-          {"description", record.description},
-          {"integrationUrl", record.integration_url},
-          {"integrationAuthConfigured", !record.integration_auth.empty()},
-          {"latestVersion", record.latest_version},
-          {"tasks", tasks},
-          {"metadata", record.metadata}};
+  out.EndArray().Field("metadata", record.metadata).EndObject();
+}
+
+template <typename Record, typename WriteFn>
+std::string RenderRecord(const Record &record, WriteFn write) {
+  return json_writer::Render([&](json_writer::Writer &out) { write(out, record); });
 }
 
 }  // namespace
@@ -586,17 +487,212 @@ int main() {
   auto config = persistence::MakePostgresConfigFromEnv("DATABASE_URL", database_url);
 
   persistence::JobsRepository jobs(config);
-  persistence::AuditRepository audit(config);
+  persistence::AuditRepository audit_repository(config);
+  persistence::AsyncAuditWriter audit(
+      [&audit_repository](const std::vector<persistence::AuditEvent> &events) {
+        audit_repository.RecordEvents(events);
+      },
+      persistence::MakeAuditWriterOptionsFromEnv("jobs"));
+
+  jobs::RedisPublisherOptions redis_options;
+  redis_options.queue_limit =
+      static_cast<std::size_t>(std::max(1, ParseInt(GetEnvOrDefault("JOBS_REDIS_QUEUE_LIMIT", ""), 10000)));
+  jobs::RedisPublisher redis(GetEnvOrDefault("REDIS_HOST", ""), ParseInt(GetEnvOrDefault("REDIS_PORT", ""), 0),
+                             GetEnvOrDefault("REDIS_PASSWORD", ""), redis_options);
+  constexpr const char *kTemplatesChannel = "templates:changed";
+  jobs::TemplateListCache templates(
+      [&jobs]() { return jobs.TemplateListVersion(); },
+      [&jobs]() {
+        const auto records = jobs.ListTemplates();
+        return json_writer::Render([&records](json_writer::Writer &out) {
+          out.BeginObject();
+          WriteArray(out, "templates", records, WriteTemplate);
+          out.EndObject();
+        });
+      },
+      std::chrono::milliseconds(std::max(0, ParseInt(GetEnvOrDefault("JOBS_TEMPLATE_REVALIDATE_MS", ""), 5000))));
+
+  // Stream clients share one Redis subscription per job channel. Without Redis, posts are only
+  // fanned out to clients connected to this instance.
+  std::unique_ptr<jobs::RedisSubscriber> subscriber;
+  jobs::MessageHub hub(
+      static_cast<std::size_t>(std::max(1, ParseInt(GetEnvOrDefault("JOBS_STREAM_QUEUE_LIMIT", ""), 256))),
+      [&subscriber](const std::string &channel) {
+        if (subscriber) {
+          subscriber->Subscribe(channel);
+        }
+      },
+      [&subscriber](const std::string &channel) {
+        if (subscriber) {
+          subscriber->Unsubscribe(channel);
+        }
+      });
+  if (redis.Configured()) {
+    subscriber = std::make_unique<jobs::RedisSubscriber>(
+        GetEnvOrDefault("REDIS_HOST", ""), ParseInt(GetEnvOrDefault("REDIS_PORT", ""), 0),
+        GetEnvOrDefault("REDIS_PASSWORD", ""),
+        [&hub, &templates, kTemplatesChannel](const std::string &channel, const std::string &payload) {
+          if (channel == kTemplatesChannel) {
+            templates.Invalidate();
+            return;
+          }
+          hub.Deliver(channel, payload);
+        },
+        [&hub, kTemplatesChannel]() {
+          auto channels = hub.Channels();
+          channels.emplace_back(kTemplatesChannel);
+          return channels;
+        },
+        redis_options);
+  }
+  const int stream_limit = std::max(1, ParseInt(GetEnvOrDefault("JOBS_STREAM_MAX_CLIENTS", ""), 64));
+  std::atomic<int> active_streams{0};
+  constexpr auto kStreamHeartbeat = std::chrono::seconds(15);
+  // Messages replayed to a reconnecting stream before it is told to resync instead.
+  constexpr int kStreamBacklogLimit = 100;
 
-  RedisAdapter redis(GetEnvOrDefault("REDIS_HOST", ""),
-                     ParseInt(GetEnvOrDefault("REDIS_PORT", ""), 0),
-                     GetEnvOrDefault("REDIS_PASSWORD", ""));
   MinioAdapter minio(GetEnvOrDefault("MINIO_ENDPOINT", ""), GetEnvOrDefault("MINIO_BUCKET", "documents"),
                      GetEnvOrDefault("MINIO_ACCESS_KEY", ""), GetEnvOrDefault("MINIO_SECRET_KEY", ""),
                      GetEnvOrDefault("MINIO_REGION", "us-east-1"));
-  ClamAvAdapter clamav(GetEnvOrDefault("CLAMAV_HOST", ""), ParseInt(GetEnvOrDefault("CLAMAV_PORT", ""), 0));
-
+  jobs::ClamdOptions clamd_options;
+  clamd_options.host = GetEnvOrDefault("CLAMAV_HOST", "");
+  clamd_options.port = ParseInt(GetEnvOrDefault("CLAMAV_PORT", ""), 0);
+  clamd_options.sessions = static_cast<std::size_t>(
+      std::max(1, ParseInt(GetEnvOrDefault("CLAMAV_SESSIONS", ""), static_cast<int>(clamd_options.sessions))));
+  clamd_options.chunk_bytes = static_cast<std::size_t>(
+      std::max(1024, ParseInt(GetEnvOrDefault("CLAMAV_CHUNK_BYTES", ""), static_cast<int>(clamd_options.chunk_bytes))));
+  jobs::ClamdScanner clamav(clamd_options);
+  const std::size_t max_upload_bytes =
+      static_cast<std::size_t>(std::max(1, ParseInt(GetEnvOrDefault("JOBS_MAX_UPLOAD_BYTES", ""), 50 * 1024 * 1024)));
+  constexpr std::size_t kUploadBufferBytes = 1024 * 1024;
+
+  // Every open stream pins a worker thread, so the pool is sized for streams on top of requests.
+  // Raw-body uploads stream and are checked against JOBS_MAX_UPLOAD_BYTES as they arrive. The
+  // payload limit binds the buffered legacy JSON upload, whose base64 content is a third larger
+  // than the file; the extra 1 MiB covers its other fields.
+  http_server::ServerOptions server_defaults;
+  server_defaults.worker_threads += static_cast<std::size_t>(stream_limit);
+  server_defaults.max_payload_bytes = max_upload_bytes + 1024 * 1024;
   httplib::Server server;
+  http_server::Bootstrap(server, "jobs", http_server::MakeServerOptionsFromEnv("JOBS", server_defaults));
+  security::ExposeMetrics(server, "jobs");
+  security::MetricsRegistry::Instance().RegisterCollector("jobs", [config]() {
+    return persistence::RenderPoolMetrics(config->Stats(), "jobs") +
+           persistence::RenderRoutingMetrics(config->Routing(), "jobs");
+  });
+  security::MetricsRegistry::Instance().RegisterCollector(
+      "jobs", [&audit]() { return audit.RenderMetrics("jobs"); });
+  security::MetricsRegistry::Instance().RegisterCollector("jobs", [&redis]() { return redis.RenderMetrics("jobs"); });
+  security::MetricsRegistry::Instance().RegisterCollector(
+      "jobs", [&templates]() { return templates.RenderMetrics("jobs"); });
+  security::MetricsRegistry::Instance().RegisterCollector("jobs", [&hub, &subscriber]() {
+    return hub.RenderMetrics("jobs") + (subscriber ? subscriber->RenderMetrics("jobs") : std::string());
+  });
+
+  const auto announce_template = [&templates, &redis, kTemplatesChannel](const std::string &template_id) {
+    templates.Invalidate();
+    if (redis.Configured() && !redis.Publish(kTemplatesChannel, template_id)) {
+      JobsLogger().Warn("redis_publish_dropped", kTemplatesChannel);
+    }
+  };
+  const auto audit_template_version = [&audit](const std::string &actor_id, const persistence::TemplateRecord &record,
+                                               const persistence::TemplateUpsertInput &input,
+                                               const std::string &remote_addr) {
+    json audit_details = {{"latestVersion", record.latest_version},
+                          {"templateName", record.name},
+                          {"tasks", record.tasks.size()},
+                          {"source", input.source}};
+    if (!input.metadata.empty()) {
+      audit_details["metadata"] = input.metadata;
+    }
+    audit.RecordEvent(actor_id, "template_version_created", record.id, audit_details, remote_addr);
+  };
+
+  // Portal-backed templates are refreshed in the background and only versioned when the portal
+  // reports a change. The background pass is off unless JOBS_TEMPLATE_SYNC_INTERVAL_S is set,
+  // which should be on exactly one instance; POST /jobs/templates/sync still starts a pass on
+  // any of them.
+  jobs::PortalClient portal;
+  jobs::TemplateSyncOptions sync_options;
+  const int sync_interval_s = static_cast<int>(sync_options.interval.count());
+  sync_options.interval = std::chrono::seconds(
+      std::max(0, ParseInt(GetEnvOrDefault("JOBS_TEMPLATE_SYNC_INTERVAL_S", ""), sync_interval_s)));
+  sync_options.concurrency = static_cast<std::size_t>(std::max(
+      1, ParseInt(GetEnvOrDefault("JOBS_TEMPLATE_SYNC_CONCURRENCY", ""), static_cast<int>(sync_options.concurrency))));
+  jobs::TemplateSyncScheduler template_sync(
+      [&jobs]() { return jobs.ListTemplates(); },
+      [&portal](const persistence::TemplateRecord &record, const jobs::PortalValidators &validators) {
+        return portal.Fetch(record.integration_url, record.integration_auth, validators);
+      },
+      [&](const persistence::TemplateRecord &current, const jobs::TemplateSyncResult &sync) {
+        persistence::TemplateUpsertInput input;
+        input.template_id = current.id;
+        input.name = current.name;
+        input.jurisdiction = current.jurisdiction;
+        input.description = current.description;
+        input.integration_url = current.integration_url;
+        input.integration_auth = current.integration_auth;
+        input.tasks = sync.tasks;
+        input.source = sync.source;
+        input.metadata = sync.metadata;
+        input.metadata["syncedFromPortal"] = true;
+        const auto record = jobs.UpsertTemplateVersion(input);
+        announce_template(record.id);
+        audit_template_version("", record, input, "");
+        return record.latest_version;
+      },
+      sync_options);
+  security::MetricsRegistry::Instance().RegisterCollector(
+      "jobs", [&template_sync]() { return template_sync.RenderMetrics("jobs"); });
+
+  // Uploads are stored quarantined ("pending") and answered straight away; scan workers stream
+  // each one through a clamd session and then promote it to "clean" or mark it "infected" and
+  // delete the object. Scanner failures keep the document quarantined as "scan_failed".
+  const auto storage_source = [&minio](std::string object_key) -> jobs::ScanSource {
+    return [&minio, object_key = std::move(object_key)](const jobs::ChunkSink &sink) {
+      std::string error;
+      if (!minio.GetObject(object_key, sink, &error)) {
+        JobsLogger().Warn("scan_source_failed", object_key + ": " + error);
+        return false;
+      }
+      return true;
+    };
+  };
+  jobs::ScanQueueOptions scan_options;
+  scan_options.workers = clamd_options.sessions;
+  scan_options.queue_limit = static_cast<std::size_t>(
+      std::max(1, ParseInt(GetEnvOrDefault("JOBS_SCAN_QUEUE_LIMIT", ""), static_cast<int>(scan_options.queue_limit))));
+  jobs::ScanQueue scans(
+      [&clamav](const jobs::ScanSource &source) { return clamav.Scan(source); },
+      [&](const std::string &document_id, const jobs::ScanVerdict &verdict) {
+        const char *status = verdict.result == jobs::ScanVerdict::Result::kClean      ? "clean"
+                             : verdict.result == jobs::ScanVerdict::Result::kInfected ? "infected"
+                                                                                      : "scan_failed";
+        const auto document = jobs.ResolveDocumentScan(document_id, status);
+        if (!document || verdict.result != jobs::ScanVerdict::Result::kInfected) {
+          return;
+        }
+        if (const auto object_key = minio.Configured() ? minio.ObjectKey(document->url) : std::string{};
+            !object_key.empty()) {
+          minio.DeleteObject(object_key);
+        }
+        audit.RecordEvent(document->uploaded_by, "document_infected", document->job_id,
+                          json{{"documentId", document->id}, {"signature", verdict.detail}}, "");
+      },
+      scan_options);
+  if (clamav.Configured() && minio.Configured()) {
+    try {
+      for (const auto &document : jobs.ListPendingScans(static_cast<int>(scan_options.queue_limit))) {
+        if (const auto object_key = minio.ObjectKey(document.url); !object_key.empty()) {
+          scans.Submit(document.id, storage_source(object_key));
+        }
+      }
+    } catch (const std::exception &ex) {
+      JobsLogger().Error("scan_recovery_failed", ex.what());
+    }
+  }
+  security::MetricsRegistry::Instance().RegisterCollector(
+      "jobs", [&clamav, &scans]() { return clamav.RenderMetrics("jobs") + scans.RenderMetrics("jobs"); });
 
   server.Get("/health", [](const httplib::Request &, httplib::Response &res) {
     SendJson(res, json{{"status", "ok"}});
@@ -614,7 +710,7 @@ int main() {
       const auto job = jobs.CreateJob(input);
       audit.RecordEvent(input.customer_id, "job_created", job.id,
                         json{{"conveyancerId", input.conveyancer_id}, {"state", input.state}}, req.remote_addr);
-      SendJson(res, JobToJson(job), 201);
+      SendJsonBody(res, RenderRecord(job, WriteJob), 201);
     } catch (const std::exception &ex) {
       JobsLogger().Error("create_job_failed", ex.what());
       SendJson(res, json{{"error", "create_job_failed"}}, 500);
@@ -624,34 +720,31 @@ int main() {
   server.Get("/jobs", [&](const httplib::Request &req, httplib::Response &res) {
     try {
       const std::string account_id = req.get_param_value("accountId");
-      int limit = 25;
-      if (const auto limit_param = req.get_param_value("limit"); !limit_param.empty()) {
-        try {
-          limit = std::clamp(std::stoi(limit_param), 1, 100);
-        } catch (...) {
-          limit = 25;
-        }
-      }
-      const auto records = jobs.ListJobsForAccount(account_id, limit);
-      json array = json::array();
-      for (const auto &record : records) {
-        array.push_back(JobToJson(record));
+      const int limit = ParseLimit(req, 25, 100);
+      std::optional<persistence::PageCursor> cursor;
+      if (!ParseCursorParam(req, res, "cursor", &cursor)) {
+        return;
       }
-      SendJson(res, json{{"jobs", array}});
+      const auto page = jobs.ListJobsForAccount(account_id, limit, cursor);
+      SendJsonBody(res, RenderPage("jobs", page, WriteJob, 192));
     } catch (const std::exception &ex) {
       JobsLogger().Error("list_jobs_failed", ex.what());
       SendJson(res, json{{"error", "list_jobs_failed"}}, 500);
     }
   });
 
-  server.Get("/jobs/templates", [&](const httplib::Request &, httplib::Response &res) {
+  server.Get("/jobs/templates", [&](const httplib::Request &req, httplib::Response &res) {
     try {
-      const auto templates = jobs.ListTemplates();
-      json payload = json::array();
-      for (const auto &record : templates) {
-        payload.push_back(TemplateToJson(record));
+      const auto snapshot = templates.Get();
+      res.set_header("ETag", snapshot->etag);
+      res.set_header("Cache-Control", "no-cache");
+      if (response_filter::EtagMatches(req.get_header_value("If-None-Match"), snapshot->etag)) {
+        templates.RecordNotModified();
+        res.status = 304;
+        return;
       }
-      SendJson(res, json{{"templates", payload}});
+      res.status = 200;
+      res.set_content(snapshot->body, "application/json");
     } catch (const std::exception &ex) {
       JobsLogger().Error("list_templates_failed", ex.what());
       SendJson(res, json{{"error", "list_templates_failed"}}, 500);
@@ -661,7 +754,10 @@ int main() {
   server.Post("/jobs/templates", [&](const httplib::Request &req, httplib::Response &res) {
     try {
       const auto body = json::parse(req.body);
-      const std::string actor_id = body.value("actorId", "");
+      const auto actor_id = ReadActorId(body, res);
+      if (!actor_id) {
+        return;
+      }
       persistence::TemplateUpsertInput input;
       input.template_id = body.value("templateId", std::string{});
       input.name = body.value("name", std::string{});
@@ -680,10 +776,10 @@ int main() {
 
       bool synced_from_portal = false;
       if (input.source.value("type", "") == "portal" || body.value("syncFromPortal", false)) {
-        const auto sync = SyncTemplateFromPortal(input.integration_url, input.integration_auth);
-        input.tasks = sync.tasks;
-        input.metadata = sync.metadata;
-        input.source = sync.source;
+        auto sync = portal.Fetch(input.integration_url, input.integration_auth).result;
+        input.tasks = std::move(sync.tasks);
+        input.metadata = std::move(sync.metadata);
+        input.source = std::move(sync.source);
         synced_from_portal = true;
       } else {
         const auto tasks_json = body.value("tasks", json::array());
@@ -721,29 +817,79 @@ int main() {
       }
 
       const auto record = jobs.UpsertTemplateVersion(input);
-      json audit_details = {{"latestVersion", record.latest_version},
-                            {"templateName", record.name},
-                            {"tasks", record.tasks.size()},
-                            {"source", input.source}};
-      if (!input.metadata.empty()) {
-        audit_details["metadata"] = input.metadata;
-      }
-      audit.RecordEvent(actor_id, "template_version_created", record.id, audit_details, req.remote_addr);
-      SendJson(res, TemplateToJson(record), input.template_id.empty() ? 201 : 200);
+      announce_template(record.id);
+      audit_template_version(*actor_id, record, input, req.remote_addr);
+      SendJsonBody(res, RenderRecord(record, WriteTemplate), input.template_id.empty() ? 201 : 200);
     } catch (const std::exception &ex) {
       JobsLogger().Error("upsert_template_failed", ex.what());
       SendJson(res, json{{"error", "upsert_template_failed"}}, 500);
     }
   });
 
-  server.Get(R"(/jobs/(.+))", [&](const httplib::Request &req, httplib::Response &res) {
+  server.Get("/jobs/templates/sync", [&](const httplib::Request &, httplib::Response &res) {
+    const auto statuses = template_sync.Statuses();
+    std::string body;
+    json_writer::Writer out(body);
+    out.Reserve(32 + statuses.size() * 192);
+    out.BeginObject().Key("templates").BeginArray();
+    for (const auto &status : statuses) {
+      out.BeginObject()
+          .Field("templateId", status.template_id)
+          .Field("name", status.name)
+          .Field("outcome", status.outcome)
+          .Field("latestVersion", status.version)
+          .Field("durationMs", static_cast<std::int64_t>(status.duration.count()))
+          .Field("finishedAt", status.finished_at);
+      if (!status.error.empty()) {
+        out.Field("error", status.error);
+      }
+      out.EndObject();
+    }
+    out.EndArray().EndObject();
+    SendJsonBody(res, std::move(body));
+  });
+
+  server.Post("/jobs/templates/sync", [&](const httplib::Request &, httplib::Response &res) {
+    template_sync.Trigger();
+    SendJson(res, json{{"status", "scheduled"}}, 202);
+  });
+
+  // Composite read for the job page: one statement instead of four round trips.
+  server.Get(R"(/jobs/([^/]+)/detail)", [&](const httplib::Request &req, httplib::Response &res) {
+    try {
+      int message_limit = 50;
+      if (req.has_param("messages")) {
+        message_limit = std::clamp(ParseInt(req.get_param_value("messages"), message_limit), 1, 100);
+      }
+      const auto detail = jobs.GetJobDetail(req.matches[1], message_limit);
+      if (!detail) {
+        SendJson(res, json{{"error", "not_found"}}, 404);
+        return;
+      }
+      std::string body;
+      json_writer::Writer out(body);
+      out.Reserve(256 + (detail->milestones.size() + detail->documents.size() + detail->messages.size()) * 256);
+      out.BeginObject().Key("job");
+      WriteJob(out, detail->job);
+      WriteArray(out, "milestones", detail->milestones, WriteMilestone);
+      WriteArray(out, "documents", detail->documents, WriteDocument);
+      WriteArray(out, "messages", detail->messages, WriteMessage);
+      out.EndObject();
+      SendJsonBody(res, std::move(body));
+    } catch (const std::exception &ex) {
+      JobsLogger().Error("get_job_detail_failed", ex.what());
+      SendJson(res, json{{"error", "get_job_detail_failed"}}, 500);
+    }
+  });
+
+  server.Get(R"(/jobs/([^/]+))", [&](const httplib::Request &req, httplib::Response &res) {
     try {
       const auto job = jobs.GetJobById(req.matches[1]);
       if (!job) {
         SendJson(res, json{{"error", "not_found"}}, 404);
         return;
       }
-      SendJson(res, JobToJson(*job));
+      SendJsonBody(res, RenderRecord(*job, WriteJob));
     } catch (const std::exception &ex) {
       JobsLogger().Error("get_job_failed", ex.what());
       SendJson(res, json{{"error", "get_job_failed"}}, 500);
@@ -753,15 +899,19 @@ int main() {
   server.Post(R"(/jobs/(.+)/milestones)", [&](const httplib::Request &req, httplib::Response &res) {
     try {
       const auto body = json::parse(req.body);
+      const auto actor_id = ReadActorId(body, res);
+      if (!actor_id) {
+        return;
+      }
       persistence::MilestoneInput input;
       input.job_id = req.matches[1];
       input.name = body.value("name", "");
       input.amount_cents = body.value("amountCents", 0);
       input.due_date = body.value("dueDate", "");
       const auto milestone = jobs.CreateMilestone(input);
-      audit.RecordEvent(body.value("actorId", ""), "milestone_created", input.job_id,
+      audit.RecordEvent(*actor_id, "milestone_created", input.job_id,
                         json{{"milestoneId", milestone.id}, {"amountCents", milestone.amount_cents}}, req.remote_addr);
-      SendJson(res, MilestoneToJson(milestone), 201);
+      SendJsonBody(res, RenderRecord(milestone, WriteMilestone), 201);
     } catch (const std::exception &ex) {
       JobsLogger().Error("create_milestone_failed", ex.what());
       SendJson(res, json{{"error", "create_milestone_failed"}}, 500);
@@ -771,74 +921,257 @@ int main() {
   server.Get(R"(/jobs/(.+)/milestones)", [&](const httplib::Request &req, httplib::Response &res) {
     try {
       const auto milestones = jobs.ListMilestones(req.matches[1]);
-      json array = json::array();
-      for (const auto &item : milestones) {
-        array.push_back(MilestoneToJson(item));
-      }
-      SendJson(res, json{{"milestones", array}});
+      SendJsonBody(res, json_writer::Render([&milestones](json_writer::Writer &out) {
+        out.BeginObject();
+        WriteArray(out, "milestones", milestones, WriteMilestone);
+        out.EndObject();
+      }));
     } catch (const std::exception &ex) {
       JobsLogger().Error("list_milestones_failed", ex.what());
       SendJson(res, json{{"error", "list_milestones_failed"}}, 500);
     }
   });
 
-  server.Post(R"(/jobs/(.+)/documents)", [&](const httplib::Request &req, httplib::Response &res) {
+  // Records the document and, when a scanner is configured, queues source for scanning. The
+  // document is only promoted from "pending" once the scan comes back clean.
+  const auto store_document = [&](const httplib::Request &req, httplib::Response &res, const std::string &job_id,
+                                  const std::string &document_id, const std::string &uploader,
+                                  const std::string &doc_type, const std::string &object_key,
+                                  const std::string &checksum, const std::string &upload_url,
+                                  jobs::ScanSource source) {
+    const std::string object_url =
+        minio.Configured() ? minio.ObjectUrl(object_key) : ("https://storage.local/" + object_key);
+    persistence::DocumentRecord record;
+    record.id = document_id;
+    record.job_id = job_id;
+    record.doc_type = doc_type;
+    record.url = object_url;
+    record.checksum = checksum;
+    record.uploaded_by = uploader;
+    record.version = 1;
+    record.scan_status = clamav.Configured() ? "pending" : "unscanned";
+    auto document = jobs.StoreDocument(record);
+    if (clamav.Configured() && !scans.Submit(document.id, std::move(source))) {
+      JobsLogger().Warn("scan_queue_full", document.id);
+      document.scan_status = "scan_failed";
+      jobs.ResolveDocumentScan(document.id, document.scan_status);
+    }
+    audit.RecordEvent(uploader, "document_uploaded", job_id,
+                      json{{"documentId", document.id}, {"checksum", checksum}}, req.remote_addr);
+    const auto write = [&](json_writer::Writer &out) { WriteUploadedDocument(out, document, upload_url); };
+    SendJsonBody(res, json_writer::Render(write), document.scan_status == "pending" ? 202 : 201);
+  };
+
+  // Legacy upload: base64 content inside a JSON body, held in memory and handed back a
+  // presigned URL for the client to PUT the object itself. The decoded copy is what gets scanned.
+  const auto store_json_document = [&](const httplib::Request &req, httplib::Response &res,
+                                       const std::string &job_id, const std::string &payload) {
+    const auto body = json::parse(payload);
+    const std::string uploader = body.value("uploadedBy", "");
+    const std::string file_name = body.value("fileName", "document.bin");
+    const std::string doc_type = body.value("docType", "general");
+    const std::string content_base64 = body.value("content", "");
+    if (content_base64.empty()) {
+      SendJson(res, json{{"error", "content_required"}}, 400);
+      return;
+    }
+    auto decoded = std::make_shared<std::vector<unsigned char>>();
+    if (!codec::Base64Decode(content_base64, *decoded)) {
+      SendJson(res, json{{"error", "invalid_content"}}, 400);
+      return;
+    }
+    const std::shared_ptr<const std::vector<unsigned char>> data = std::move(decoded);
+    jobs::UploadInspector inspector;
+    inspector.Update(reinterpret_cast<const char *>(data->data()), data->size());
+    if (inspector.EicarDetected()) {
+      SendJson(res, json{{"error", "virus_detected"}, {"reason", "EICAR test string detected"}}, 422);
+      return;
+    }
+    const std::string document_id = jobs::NewDocumentId();
+    const std::string object_key = jobs::DocumentObjectKey(job_id, document_id, file_name);
+    const std::string upload_url =
+        minio.Configured() ? minio.GeneratePresignedPut(object_key, std::chrono::minutes(15)) : std::string{};
+    store_document(req, res, job_id, document_id, uploader, doc_type, object_key, inspector.FinishChecksum(),
+                   upload_url, [data](const jobs::ChunkSink &sink) {
+                     return sink(reinterpret_cast<const char *>(data->data()), data->size());
+                   });
+  };
+
+  // Raw upload: the request body is the document. Each chunk is hashed and checked for the
+  // EICAR signature and forwarded to object storage as it arrives, so memory per upload stays
+  // at the pipe size; the clamd scan reads the stored object back afterwards. Without object
+  // storage the body is kept in memory for the scanner instead.
+  const auto stream_document = [&](const httplib::Request &req, httplib::Response &res,
+                                   const httplib::ContentReader &content_reader, const std::string &job_id) {
+    if (!req.has_header("Content-Length")) {
+      RejectUpload(req, res, content_reader, json{{"error", "content_length_required"}}, 411);
+      return;
+    }
+    const auto declared_length = DeclaredLength(req);
+    if (!declared_length) {
+      RejectUpload(req, res, content_reader, json{{"error", "invalid_content_length"}}, 400);
+      return;
+    }
+    const std::size_t content_length = *declared_length;
+    if (content_length == 0) {
+      RejectUpload(req, res, content_reader, json{{"error", "content_required"}}, 400);
+      return;
+    }
+    if (content_length > max_upload_bytes) {
+      RejectUpload(req, res, content_reader, json{{"error", "payload_too_large"}, {"maxBytes", max_upload_bytes}},
+                   413);
+      return;
+    }
+    const std::string uploader = req.get_param_value("uploadedBy");
+    const std::string file_name = req.has_param("fileName") ? req.get_param_value("fileName") : "document.bin";
+    const std::string doc_type = req.has_param("docType") ? req.get_param_value("docType") : "general";
+    const std::string content_type =
+        req.has_header("Content-Type") ? req.get_header_value("Content-Type") : "application/octet-stream";
+    const std::string document_id = jobs::NewDocumentId();
+    const std::string object_key = jobs::DocumentObjectKey(job_id, document_id, file_name);
+
+    jobs::UploadInspector inspector;
+    std::optional<StorageUpload> upload;
+    std::shared_ptr<std::string> held;
+    if (minio.Configured()) {
+      upload.emplace(minio, object_key, content_length, content_type, kUploadBufferBytes);
+    } else if (clamav.Configured()) {
+      held = std::make_shared<std::string>();
+      held->reserve(content_length);
+    }
+    const bool received = content_reader([&](const char *data, std::size_t length) {
+      inspector.Update(data, length);
+      if (held) {
+        held->append(data, length);
+      }
+      return !upload || upload->Write(data, length);
+    });
+    const bool complete = received && inspector.BytesSeen() == content_length;
+    if (!received) {
+      // Storage refused a chunk and the rest of the body was never read.
+      res.set_header("Connection", "close");
+    }
+    std::string storage_error;
+    const bool stored = upload ? upload->Finish(complete, &storage_error) : complete;
+
+    if (inspector.EicarDetected()) {
+      if (upload && stored) {
+        minio.DeleteObject(object_key);
+      }
+      SendJson(res, json{{"error", "virus_detected"}, {"reason", "EICAR test string detected"}}, 422);
+      return;
+    }
+    if (!complete) {
+      SendJson(res, json{{"error", "upload_incomplete"}}, 400);
+      return;
+    }
+    if (!stored) {
+      JobsLogger().Error("storage_upload_failed", storage_error);
+      SendJson(res, json{{"error", "storage_upload_failed"}}, 502);
+      return;
+    }
+    jobs::ScanSource source;
+    if (held) {
+      source = [held](const jobs::ChunkSink &sink) { return sink(held->data(), held->size()); };
+    } else {
+      source = storage_source(object_key);
+    }
+    store_document(req, res, job_id, document_id, uploader, doc_type, object_key, inspector.FinishChecksum(),
+                   std::string{}, std::move(source));
+  };
+
+  server.Post(R"(/jobs/([^/]+)/documents)", [&](const httplib::Request &req, httplib::Response &res,
+                                                 const httplib::ContentReader &content_reader) {
     try {
-      const auto body = json::parse(req.body);
       const std::string job_id = req.matches[1];
-      const std::string uploader = body.value("uploadedBy", "");
-      const std::string file_name = body.value("fileName", "document.bin");
-      const std::string doc_type = body.value("docType", "general");
-      const std::string content_base64 = body.value("content", "");
-      if (content_base64.empty()) {
-        SendJson(res, json{{"error", "content_required"}}, 400);
+      if (clamav.Configured() && scans.Saturated()) {
+        res.set_header("Retry-After", "5");
+        RejectUpload(req, res, content_reader, json{{"error", "scan_queue_full"}}, 503);
         return;
       }
-      const auto data = Base64Decode(content_base64);
-      std::string reason;
-      if (!clamav.Scan(data, &reason)) {
-        SendJson(res, json{{"error", "virus_detected"}, {"reason", reason}}, 422);
+      if (req.get_header_value("Content-Type").rfind("application/json", 0) == 0) {
+        std::string payload;
+        content_reader([&](const char *data, std::size_t length) {
+          payload.append(data, length);
+          return true;
+        });
+        store_json_document(req, res, job_id, payload);
         return;
       }
-      const std::string object_key = job_id + "/" + file_name;
-      const std::string checksum = Sha256Hex(data);
-      const std::string upload_url =
-          minio.Configured() ? minio.GeneratePresignedPut(object_key, std::chrono::minutes(15)) : std::string{};
-      const std::string object_url =
-          minio.Configured() ? minio.ObjectUrl(object_key) : ("https://storage.local/" + object_key);
-      persistence::DocumentRecord record;
-      record.job_id = job_id;
-      record.doc_type = doc_type;
-      record.url = object_url;
-      record.checksum = checksum;
-      record.uploaded_by = uploader;
-      record.version = 1;
-      const auto document = jobs.StoreDocument(record);
-      audit.RecordEvent(uploader, "document_uploaded", job_id,
-                        json{{"documentId", document.id}, {"checksum", checksum}}, req.remote_addr);
-      json response = DocumentToJson(document);
-      response["uploadUrl"] = upload_url;
-      SendJson(res, response, 201);
+      stream_document(req, res, content_reader, job_id);
     } catch (const std::exception &ex) {
       JobsLogger().Error("store_document_failed", ex.what());
+      res.set_header("Connection", "close");
       SendJson(res, json{{"error", "store_document_failed"}}, 500);
     }
   });
 
-  server.Get(R"(/jobs/(.+)/documents)", [&](const httplib::Request &req, httplib::Response &res) {
+  server.Get(R"(/jobs/([^/]+)/documents)", [&](const httplib::Request &req, httplib::Response &res) {
     try {
-      const auto documents = jobs.ListDocuments(req.matches[1]);
-      json array = json::array();
-      for (const auto &doc : documents) {
-        array.push_back(DocumentToJson(doc));
+      std::optional<persistence::PageCursor> cursor;
+      if (!ParseCursorParam(req, res, "cursor", &cursor)) {
+        return;
       }
-      SendJson(res, json{{"documents", array}});
+      const auto page = jobs.ListDocuments(req.matches[1], ParseLimit(req, 50, 100), cursor);
+      SendJsonBody(res, RenderPage("documents", page, WriteDocument, 256));
     } catch (const std::exception &ex) {
       JobsLogger().Error("list_documents_failed", ex.what());
       SendJson(res, json{{"error", "list_documents_failed"}}, 500);
     }
   });
 
+  // Bulk download links: one page of documents, each with a presigned GET URL. Quarantined
+  // and infected documents are listed without one.
+  server.Get(R"(/jobs/([^/]+)/documents/links)", [&](const httplib::Request &req, httplib::Response &res) {
+    try {
+      if (!minio.Configured()) {
+        SendJson(res, json{{"error", "storage_unavailable"}}, 503);
+        return;
+      }
+      std::optional<persistence::PageCursor> cursor;
+      if (!ParseCursorParam(req, res, "cursor", &cursor)) {
+        return;
+      }
+      // SigV4 caps presigned URLs at seven days.
+      const std::chrono::seconds expiry(
+          req.has_param("expiresIn") ? std::clamp(ParseInt(req.get_param_value("expiresIn"), 900), 60, 604800) : 900);
+      const auto page = jobs.ListDocuments(req.matches[1], ParseLimit(req, 50, 100), cursor);
+      std::vector<std::string> object_keys;
+      std::vector<std::size_t> signed_items;
+      for (std::size_t i = 0; i < page.items.size(); ++i) {
+        if (page.items[i].scan_status != "clean") {
+          continue;
+        }
+        if (auto object_key = minio.ObjectKey(page.items[i].url); !object_key.empty()) {
+          object_keys.push_back(std::move(object_key));
+          signed_items.push_back(i);
+        }
+      }
+      const auto urls = minio.GeneratePresignedUrls("GET", object_keys, expiry);
+      std::vector<std::string> download_urls(page.items.size());
+      for (std::size_t i = 0; i < signed_items.size(); ++i) {
+        download_urls[signed_items[i]] = urls[i];
+      }
+      std::size_t item = 0;
+      SendJsonBody(res, RenderPage("documents", page,
+                                   [&](json_writer::Writer &out, const persistence::DocumentRecord &document) {
+                                     out.BeginObject();
+                                     WriteDocumentFields(out, document);
+                                     out.Key("downloadUrl");
+                                     if (const auto &url = download_urls[item++]; !url.empty()) {
+                                       out.Value(url);
+                                     } else {
+                                       out.Value(nullptr);
+                                     }
+                                     out.EndObject();
+                                   },
+                                   768));
+    } catch (const std::exception &ex) {
+      JobsLogger().Error("document_links_failed", ex.what());
+      SendJson(res, json{{"error", "document_links_failed"}}, 500);
+    }
+  });
+
   server.Post(R"(/jobs/(.+)/messages)", [&](const httplib::Request &req, httplib::Response &res) {
     try {
       const auto body = json::parse(req.body);
@@ -846,9 +1179,13 @@ int main() {
       const std::string author_id = body.value("authorId", "");
       const std::string content = body.value("content", "");
       const json attachments = body.value("attachments", json::array());
-      jobs.AppendMessage(job_id, author_id, content, attachments);
-      json payload{{"jobId", job_id}, {"authorId", author_id}, {"content", content}, {"attachments", attachments}};
-      redis.Publish("jobs:" + job_id, payload);
+      const auto payload = MessagePayload(job_id, jobs.AppendMessage(job_id, author_id, content, attachments));
+      const std::string event = MessageEvent(payload);
+      if (!redis.Configured()) {
+        hub.Deliver("jobs:" + job_id, event);
+      } else if (!redis.Publish("jobs:" + job_id, event)) {
+        JobsLogger().Warn("redis_publish_dropped", job_id);
+      }
       SendJson(res, payload, 201);
     } catch (const std::exception &ex) {
       JobsLogger().Error("append_message_failed", ex.what());
@@ -856,10 +1193,103 @@ int main() {
     }
   });
 
-  server.Get(R"(/jobs/(.+)/messages)", [&](const httplib::Request &req, httplib::Response &res) {
+  // Server-sent events for new messages on a job. Clients load history from /messages first and
+  // are sent a "resync" event if they fall far enough behind that events were dropped. Each
+  // message event carries its cursor as the event id; a client reconnecting with Last-Event-ID
+  // (or ?since=) is first sent what it missed, or a "resync" if that is more than a page.
+  server.Get(R"(/jobs/([^/]+)/events)", [&](const httplib::Request &req, httplib::Response &res) {
+    std::optional<persistence::PageCursor> since;
+    if (req.has_header("Last-Event-ID")) {
+      since = persistence::detail::DecodeCursor(req.get_header_value("Last-Event-ID"));
+      if (!since) {
+        SendJson(res, json{{"error", "invalid_cursor"}, {"parameter", "Last-Event-ID"}}, 400);
+        return;
+      }
+    } else if (!ParseCursorParam(req, res, "since", &since)) {
+      return;
+    }
+    if (active_streams.fetch_add(1) >= stream_limit) {
+      active_streams.fetch_sub(1);
+      SendJson(res, json{{"error", "too_many_streams"}}, 503);
+      return;
+    }
+    const std::string job_id = req.matches[1];
+    // Subscribe before reading the backlog so nothing committed in between is missed; live
+    // events already sent from the backlog are skipped by id.
+    auto subscription = hub.Subscribe("jobs:" + job_id);
+    auto backlog = std::make_shared<std::string>();
+    auto replayed = std::make_shared<std::unordered_set<std::string>>();
+    if (since) {
+      try {
+        const auto page = jobs.FetchMessagesSince(job_id, *since, kStreamBacklogLimit);
+        if (static_cast<int>(page.items.size()) == kStreamBacklogLimit) {
+          *backlog = "event: resync\ndata: {}\n\n";
+        } else {
+          for (const auto &message : page.items) {
+            const auto payload = MessagePayload(job_id, message);
+            replayed->insert(payload.value("cursor", std::string{}));
+            *backlog += MessageEvent(payload);
+          }
+        }
+      } catch (const std::exception &ex) {
+        JobsLogger().Warn("stream_backlog_failed", ex.what());
+        *backlog = "event: resync\ndata: {}\n\n";
+      }
+    }
+    res.set_header("Cache-Control", "no-cache");
+    res.set_header("X-Accel-Buffering", "no");
+    res.set_chunked_content_provider(
+        "text/event-stream",
+        [subscription, backlog, replayed, kStreamHeartbeat](std::size_t, httplib::DataSink &sink) {
+          if (subscription->Closed()) {
+            sink.done();
+            return true;
+          }
+          std::string chunk;
+          if (!backlog->empty()) {
+            chunk.swap(*backlog);
+          } else if (auto payload = subscription->Next(kStreamHeartbeat)) {
+            if (subscription->TakeOverflow()) {
+              chunk += "event: resync\ndata: {}\n\n";
+            }
+            if (replayed->empty() || !replayed->contains(std::string(MessageEventId(*payload)))) {
+              chunk += *payload;
+            }
+          } else {
+            chunk = ": keepalive\n\n";
+          }
+          return chunk.empty() || sink.write(chunk.data(), chunk.size());
+        },
+        [subscription, &active_streams](bool) { active_streams.fetch_sub(1); });
+  });
+
+  // ?cursor= pages back through history, newest first. ?since= returns only messages newer than
+  // the token, oldest first, and hands back the token to poll from next.
+  server.Get(R"(/jobs/([^/]+)/messages)", [&](const httplib::Request &req, httplib::Response &res) {
     try {
-      const auto messages = jobs.FetchMessages(req.matches[1], 100);
-      SendJson(res, json{{"messages", messages}});
+      const std::string job_id = req.matches[1];
+      const int limit = ParseLimit(req, 100, 100);
+      std::optional<persistence::PageCursor> cursor;
+      std::optional<persistence::PageCursor> since;
+      if (!ParseCursorParam(req, res, "cursor", &cursor) || !ParseCursorParam(req, res, "since", &since)) {
+        return;
+      }
+      if (since) {
+        auto page = jobs.FetchMessagesSince(job_id, *since, limit);
+        const bool more = static_cast<int>(page.items.size()) == limit;
+        if (!page.next) {
+          page.next = since;
+        }
+        std::string body;
+        json_writer::Writer out(body);
+        out.Reserve(64 + page.items.size() * 256);
+        out.BeginObject();
+        WritePage(out, "messages", page, WriteMessage);
+        out.Field("hasMore", more).EndObject();
+        SendJsonBody(res, std::move(body));
+        return;
+      }
+      SendJsonBody(res, RenderPage("messages", jobs.FetchMessages(job_id, limit, cursor), WriteMessage, 256));
     } catch (const std::exception &ex) {
       JobsLogger().Error("list_messages_failed", ex.what());
       SendJson(res, json{{"error", "list_messages_failed"}}, 500);
@@ -869,5 +1299,7 @@ int main() {
   const int port = ParseInt(GetEnvOrDefault("JOBS_PORT", "8082"), 8082);
   JobsLogger().Info("starting_jobs_service", json{{"port", port}}.dump());
   server.listen("0.0.0.0", port);
+  // The subscriber thread delivers into hub, so it has to stop first.
+  subscriber.reset();
   return 0;
 }
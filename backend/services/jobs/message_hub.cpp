@@ -0,0 +1,167 @@
+#include "message_hub.h"
+
+#include <algorithm>
+#include <sstream>
+#include <utility>
+
+namespace jobs {
+
+MessageHub::Subscription::Subscription(MessageHub *hub, std::string channel, std::size_t queue_limit)
+    : hub_(hub), channel_(std::move(channel)), queue_limit_(std::max<std::size_t>(queue_limit, 1)) {}
+
+MessageHub::Subscription::~Subscription() { hub_->Remove(this); }
+
+std::optional<std::string> MessageHub::Subscription::Next(std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  ready_.wait_for(lock, timeout, [this]() { return closed_ || !queue_.empty(); });
+  if (queue_.empty()) {
+    return std::nullopt;
+  }
+  std::string payload = std::move(queue_.front());
+  queue_.pop_front();
+  return payload;
+}
+
+bool MessageHub::Subscription::TakeOverflow() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return std::exchange(overflowed_, false);
+}
+
+bool MessageHub::Subscription::Closed() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return closed_;
+}
+
+bool MessageHub::Subscription::Push(const std::string &payload) {
+  bool kept_all = true;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_) {
+      return true;
+    }
+    if (queue_.size() >= queue_limit_) {
+      // A slow client loses its oldest events and is told to resync rather than stalling the
+      // Redis reader for everyone else on the channel.
+      queue_.pop_front();
+      overflowed_ = true;
+      kept_all = false;
+    }
+    queue_.push_back(payload);
+  }
+  ready_.notify_one();
+  return kept_all;
+}
+
+void MessageHub::Subscription::Close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+  }
+  ready_.notify_all();
+}
+
+MessageHub::MessageHub(std::size_t queue_limit, ChannelHook on_first_subscriber, ChannelHook on_last_subscriber)
+    : queue_limit_(queue_limit),
+      on_first_subscriber_(std::move(on_first_subscriber)),
+      on_last_subscriber_(std::move(on_last_subscriber)) {}
+
+MessageHub::~MessageHub() { CloseAll(); }
+
+std::shared_ptr<MessageHub::Subscription> MessageHub::Subscribe(const std::string &channel) {
+  std::shared_ptr<Subscription> subscription(new Subscription(this, channel, queue_limit_));
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto &subscribers = channels_[channel];
+  subscribers.push_back(subscription.get());
+  ++subscribers_;
+  if (subscribers.size() == 1 && on_first_subscriber_) {
+    on_first_subscriber_(channel);
+  }
+  return subscription;
+}
+
+void MessageHub::Remove(Subscription *subscription) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto it = channels_.find(subscription->channel_);
+  if (it == channels_.end()) {
+    return;
+  }
+  auto &subscribers = it->second;
+  const auto position = std::find(subscribers.begin(), subscribers.end(), subscription);
+  if (position == subscribers.end()) {
+    return;
+  }
+  subscribers.erase(position);
+  --subscribers_;
+  if (subscribers.empty()) {
+    channels_.erase(it);
+    if (on_last_subscriber_) {
+      on_last_subscriber_(subscription->channel_);
+    }
+  }
+}
+
+void MessageHub::Deliver(const std::string &channel, const std::string &payload) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto it = channels_.find(channel);
+  if (it == channels_.end()) {
+    return;
+  }
+  for (Subscription *subscription : it->second) {
+    if (!subscription->Push(payload)) {
+      dropped_.Add();
+    }
+    delivered_.Add();
+  }
+}
+
+std::vector<std::string> MessageHub::Channels() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<std::string> channels;
+  channels.reserve(channels_.size());
+  for (const auto &[channel, subscribers] : channels_) {
+    channels.push_back(channel);
+  }
+  return channels;
+}
+
+std::size_t MessageHub::SubscriberCount() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return subscribers_;
+}
+
+void MessageHub::CloseAll() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto &[channel, subscribers] : channels_) {
+    for (Subscription *subscription : subscribers) {
+      subscription->Close();
+    }
+  }
+}
+
+std::string MessageHub::RenderMetrics(std::string_view service) const {
+  std::size_t channels = 0;
+  std::size_t subscribers = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    channels = channels_.size();
+    subscribers = subscribers_;
+  }
+  std::ostringstream labels;
+  labels << "service=\"" << service << '"';
+  std::ostringstream oss;
+  oss << "# HELP job_event_streams Connected job event stream clients" << '\n';
+  oss << "# TYPE job_event_streams gauge" << '\n';
+  oss << "job_event_streams{" << labels.str() << "} " << subscribers << '\n';
+  oss << "# HELP job_event_channels Job channels with at least one local stream client" << '\n';
+  oss << "# TYPE job_event_channels gauge" << '\n';
+  oss << "job_event_channels{" << labels.str() << "} " << channels << '\n';
+  oss << "# HELP job_events_delivered_total Events queued to stream clients" << '\n';
+  oss << "# TYPE job_events_delivered_total counter" << '\n';
+  oss << "job_events_delivered_total{" << labels.str() << "} " << delivered_.Value() << '\n';
+  oss << "# HELP job_events_dropped_total Events discarded because a stream client fell behind" << '\n';
+  oss << "# TYPE job_events_dropped_total counter" << '\n';
+  oss << "job_events_dropped_total{" << labels.str() << "} " << dropped_.Value() << '\n';
+  return oss.str();
+}
+
+}  // namespace jobs
@@ -0,0 +1,95 @@
+#ifndef CONVEYANCERS_MARKETPLACE_JOBS_MESSAGE_HUB_H
+#define CONVEYANCERS_MARKETPLACE_JOBS_MESSAGE_HUB_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "../../common/metrics.h"
+
+namespace jobs {
+
+// Local fan-out for job message events. Every stream client holds a Subscription with its own
+// bounded queue; the hub tells its owner when a channel gains its first subscriber and loses
+// its last, so Redis is subscribed once per channel however many clients are watching.
+class MessageHub {
+ public:
+  using ChannelHook = std::function<void(const std::string &channel)>;
+
+  class Subscription {
+   public:
+    ~Subscription();
+
+    Subscription(const Subscription &) = delete;
+    Subscription &operator=(const Subscription &) = delete;
+
+    // Waits up to timeout for the next payload; nullopt on timeout or once the hub has closed.
+    std::optional<std::string> Next(std::chrono::milliseconds timeout);
+    // True if events were dropped since the last call because the client fell behind.
+    bool TakeOverflow();
+    bool Closed() const;
+
+   private:
+    friend class MessageHub;
+    Subscription(MessageHub *hub, std::string channel, std::size_t queue_limit);
+
+    // Returns false when the payload displaced an older, undelivered one.
+    bool Push(const std::string &payload);
+    void Close();
+
+    MessageHub *const hub_;
+    const std::string channel_;
+    const std::size_t queue_limit_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<std::string> queue_;
+    bool overflowed_ = false;
+    bool closed_ = false;
+  };
+
+  // The hooks run under the hub lock so subscribe and unsubscribe calls reach Redis in order.
+  MessageHub(std::size_t queue_limit, ChannelHook on_first_subscriber, ChannelHook on_last_subscriber);
+  ~MessageHub();
+
+  MessageHub(const MessageHub &) = delete;
+  MessageHub &operator=(const MessageHub &) = delete;
+
+  // The hub must outlive every subscription it hands out.
+  std::shared_ptr<Subscription> Subscribe(const std::string &channel);
+  void Deliver(const std::string &channel, const std::string &payload);
+
+  std::vector<std::string> Channels() const;
+  std::size_t SubscriberCount() const;
+  // Wakes every stream so handlers can finish before the server shuts down.
+  void CloseAll();
+
+  std::string RenderMetrics(std::string_view service) const;
+
+ private:
+  void Remove(Subscription *subscription);
+
+  const std::size_t queue_limit_;
+  const ChannelHook on_first_subscriber_;
+  const ChannelHook on_last_subscriber_;
+
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, std::vector<Subscription *>> channels_;
+  std::size_t subscribers_ = 0;
+
+  metrics::Counter delivered_;
+  metrics::Counter dropped_;
+};
+
+}  // namespace jobs
+
+#endif  // CONVEYANCERS_MARKETPLACE_JOBS_MESSAGE_HUB_H
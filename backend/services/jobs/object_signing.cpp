@@ -0,0 +1,143 @@
+#include "object_signing.h"
+
+#include <array>
+#include <ctime>
+#include <utility>
+
+#include "../../common/codec.h"
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/sha.h>
+
+namespace jobs {
+
+std::string Sha256Hex(const std::vector<unsigned char> &data) {
+  std::array<unsigned char, SHA256_DIGEST_LENGTH> digest{};
+  SHA256(data.data(), data.size(), digest.data());
+  return codec::HexEncode(digest.data(), digest.size());
+}
+
+std::string Sha256Hex(const std::string &data) {
+  std::array<unsigned char, SHA256_DIGEST_LENGTH> digest{};
+  SHA256(reinterpret_cast<const unsigned char *>(data.data()), data.size(), digest.data());
+  return codec::HexEncode(digest.data(), digest.size());
+}
+
+namespace {
+
+// HMAC-SHA256 into a 32-byte buffer.
+void HmacSha256(const void *key, std::size_t key_length, std::string_view data, unsigned char *out) {
+  unsigned int length = 0;
+  HMAC(EVP_sha256(), key, static_cast<int>(key_length), reinterpret_cast<const unsigned char *>(data.data()),
+       data.size(), out, &length);
+}
+
+bool Unreserved(unsigned char ch) {
+  return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z') || (ch >= '0' && ch <= '9') || ch == '-' ||
+         ch == '_' || ch == '.' || ch == '~' || ch == '/';
+}
+
+}  // namespace
+
+void AppendUrlEncoded(std::string &out, std::string_view value) {
+  static constexpr char kUpperHex[] = "0123456789ABCDEF";
+  for (const char ch : value) {
+    const auto byte = static_cast<unsigned char>(ch);
+    if (Unreserved(byte)) {
+      out.push_back(ch);
+    } else {
+      const char escape[] = {'%', kUpperHex[byte >> 4], kUpperHex[byte & 0x0F]};
+      out.append(escape, sizeof(escape));
+    }
+  }
+}
+
+std::string UrlEncode(std::string_view value) {
+  std::string out;
+  out.reserve(value.size() + 16);
+  AppendUrlEncoded(out, value);
+  return out;
+}
+
+SigV4Presigner::SigV4Presigner(std::string host, std::string bucket, std::string access_key, std::string secret_key,
+                               std::string region)
+    : host_(std::move(host)),
+      bucket_(std::move(bucket)),
+      access_key_(std::move(access_key)),
+      secret_key_(std::move(secret_key)),
+      region_(std::move(region)) {}
+
+SigV4Presigner::SigningKey SigV4Presigner::SigningKeyFor(std::string_view date) const {
+  std::lock_guard<std::mutex> lock(key_mutex_);
+  if (key_date_ != date) {
+    const std::string secret = "AWS4" + secret_key_;
+    SigningKey key{};
+    HmacSha256(secret.data(), secret.size(), date, key.data());
+    HmacSha256(key.data(), key.size(), region_, key.data());
+    HmacSha256(key.data(), key.size(), "s3", key.data());
+    HmacSha256(key.data(), key.size(), "aws4_request", key_.data());
+    key_date_.assign(date);
+  }
+  return key_;
+}
+
+std::string SigV4Presigner::Target(const std::string &method, const std::string &object_key,
+                                   std::chrono::seconds expiry, std::chrono::system_clock::time_point now) const {
+  return std::move(Targets(method, {object_key}, expiry, now).front());
+}
+
+std::vector<std::string> SigV4Presigner::Targets(const std::string &method,
+                                                 const std::vector<std::string> &object_keys,
+                                                 std::chrono::seconds expiry,
+                                                 std::chrono::system_clock::time_point now) const {
+  const auto time = std::chrono::system_clock::to_time_t(now);
+  std::tm tm{};
+#if defined(_WIN32)
+  gmtime_s(&tm, &time);
+#else
+  gmtime_r(&time, &tm);
+#endif
+  char date[9];
+  std::strftime(date, sizeof(date), "%Y%m%d", &tm);
+  char timestamp[17];
+  std::strftime(timestamp, sizeof(timestamp), "%Y%m%dT%H%M%SZ", &tm);
+  const SigningKey key = SigningKeyFor(date);
+
+  const std::string credential_scope = std::string(date) + "/" + region_ + "/s3/aws4_request";
+  std::string query = "X-Amz-Algorithm=AWS4-HMAC-SHA256&X-Amz-Credential=";
+  AppendUrlEncoded(query, access_key_ + "/" + credential_scope);
+  query.append("&X-Amz-Date=").append(timestamp);
+  query.append("&X-Amz-Expires=").append(std::to_string(expiry.count()));
+  query.append("&X-Amz-SignedHeaders=host");
+  // Everything in the canonical request after the path.
+  const std::string canonical_tail = "\n" + query + "\nhost:" + host_ + "\n\nhost\nUNSIGNED-PAYLOAD";
+
+  std::string string_to_sign = "AWS4-HMAC-SHA256\n" + std::string(timestamp) + "\n" + credential_scope + "\n";
+  const std::size_t sign_prefix = string_to_sign.size();
+  std::string canonical_uri;
+  std::string canonical_request;
+  std::array<unsigned char, SHA256_DIGEST_LENGTH> digest{};
+
+  std::vector<std::string> targets;
+  targets.reserve(object_keys.size());
+  for (const auto &object_key : object_keys) {
+    canonical_uri.assign("/").append(bucket_).push_back('/');
+    AppendUrlEncoded(canonical_uri, object_key);
+    canonical_request.assign(method).append("\n").append(canonical_uri).append(canonical_tail);
+
+    SHA256(reinterpret_cast<const unsigned char *>(canonical_request.data()), canonical_request.size(),
+           digest.data());
+    string_to_sign.resize(sign_prefix);
+    string_to_sign.append(codec::HexEncode(digest.data(), digest.size()));
+    HmacSha256(key.data(), key.size(), string_to_sign, digest.data());
+
+    std::string &target = targets.emplace_back();
+    target.reserve(canonical_uri.size() + query.size() + 96);
+    target.append(canonical_uri).append("?").append(query).append("&X-Amz-Signature=");
+    target.append(codec::HexEncode(digest.data(), digest.size()));
+  }
+  return targets;
+}
+
+}  // namespace jobs
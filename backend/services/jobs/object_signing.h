@@ -0,0 +1,58 @@
+#ifndef CONVEYANCERS_MARKETPLACE_JOBS_OBJECT_SIGNING_H
+#define CONVEYANCERS_MARKETPLACE_JOBS_OBJECT_SIGNING_H
+
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace jobs {
+
+std::string Sha256Hex(const std::vector<unsigned char> &data);
+std::string Sha256Hex(const std::string &data);
+// RFC 3986 percent-encoding that leaves '/' alone, as S3 canonical URIs expect.
+std::string UrlEncode(std::string_view value);
+void AppendUrlEncoded(std::string &out, std::string_view value);
+
+// Builds SigV4 query-signed (presigned) request targets for one bucket. Presigned requests sign
+// UNSIGNED-PAYLOAD, so the body can be streamed without hashing it first. The signing key only
+// depends on the UTC date, so it is derived once a day and shared by every thread.
+class SigV4Presigner {
+ public:
+  SigV4Presigner(std::string host, std::string bucket, std::string access_key, std::string secret_key,
+                 std::string region);
+
+  SigV4Presigner(const SigV4Presigner &) = delete;
+  SigV4Presigner &operator=(const SigV4Presigner &) = delete;
+
+  // Path and query of a request for object_key, valid for expiry from now.
+  std::string Target(const std::string &method, const std::string &object_key, std::chrono::seconds expiry,
+                     std::chrono::system_clock::time_point now) const;
+
+  // Targets for many objects at once, in object_keys order. They share one timestamp, so the
+  // query string and string-to-sign prefix are built once and only the path differs per key.
+  std::vector<std::string> Targets(const std::string &method, const std::vector<std::string> &object_keys,
+                                   std::chrono::seconds expiry, std::chrono::system_clock::time_point now) const;
+
+ private:
+  using SigningKey = std::array<unsigned char, 32>;
+
+  // date is YYYYMMDD.
+  SigningKey SigningKeyFor(std::string_view date) const;
+
+  std::string host_;
+  std::string bucket_;
+  std::string access_key_;
+  std::string secret_key_;
+  std::string region_;
+
+  mutable std::mutex key_mutex_;
+  mutable std::string key_date_;
+  mutable SigningKey key_{};
+};
+
+}  // namespace jobs
+
+#endif  // CONVEYANCERS_MARKETPLACE_JOBS_OBJECT_SIGNING_H
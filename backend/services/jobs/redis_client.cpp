@@ -0,0 +1,260 @@
+#include "redis_client.h"
+
+#include <algorithm>
+#include <sstream>
+#include <utility>
+
+#include "../../common/logger.h"
+
+namespace jobs {
+
+RedisPublisher::RedisPublisher(std::string host, int port, std::string password, RedisPublisherOptions options)
+    : host_(std::move(host)), port_(port), password_(std::move(password)), options_(options) {
+  if (Configured()) {
+    worker_ = std::thread([this]() { Run(); });
+  }
+}
+
+RedisPublisher::~RedisPublisher() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  ready_.notify_all();
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+}
+
+bool RedisPublisher::Publish(std::string channel, std::string payload) {
+  if (!Configured()) {
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_ || queue_.size() >= options_.queue_limit) {
+      dropped_.Add();
+      return false;
+    }
+    queue_.push_back(Message{std::move(channel), std::move(payload), 0, tracing::CurrentContext()});
+  }
+  ready_.notify_one();
+  return true;
+}
+
+std::size_t RedisPublisher::QueueDepth() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return queue_.size();
+}
+
+std::string RedisPublisher::RenderMetrics(std::string_view service) const {
+  std::ostringstream labels;
+  labels << "service=\"" << service << '"';
+  std::ostringstream oss;
+  oss << "# HELP redis_publish_queue_depth Messages waiting to be published to Redis" << '\n';
+  oss << "# TYPE redis_publish_queue_depth gauge" << '\n';
+  oss << "redis_publish_queue_depth{" << labels.str() << "} " << QueueDepth() << '\n';
+  oss << "# HELP redis_publish_total Redis publishes by outcome" << '\n';
+  oss << "# TYPE redis_publish_total counter" << '\n';
+  oss << "redis_publish_total{" << labels.str() << ",outcome=\"published\"} " << published_.Value() << '\n';
+  oss << "redis_publish_total{" << labels.str() << ",outcome=\"dropped\"} " << dropped_.Value() << '\n';
+  oss << "redis_publish_total{" << labels.str() << ",outcome=\"failed\"} " << failed_.Value() << '\n';
+  oss << "# HELP redis_reconnects_total Redis connections re-established after a failure" << '\n';
+  oss << "# TYPE redis_reconnects_total counter" << '\n';
+  oss << "redis_reconnects_total{" << labels.str() << "} " << reconnects_.Value() << '\n';
+  oss << "# HELP redis_publish_batch_seconds Round trip of one pipelined publish batch" << '\n';
+  oss << "# TYPE redis_publish_batch_seconds histogram" << '\n';
+  metrics::WriteHistogram(oss, "redis_publish_batch_seconds", labels.str(), batch_latency_.Collect());
+  return oss.str();
+}
+
+void RedisPublisher::Run() {
+  std::vector<Message> batch;
+  std::chrono::milliseconds backoff = options_.min_backoff;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ready_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+      if (queue_.empty()) {
+        return;
+      }
+      const std::size_t count = std::min(queue_.size(), std::max<std::size_t>(options_.batch_size, 1));
+      batch.assign(std::make_move_iterator(queue_.begin()), std::make_move_iterator(queue_.begin() + count));
+      queue_.erase(queue_.begin(), queue_.begin() + count);
+    }
+
+    if (SendBatch(batch)) {
+      backoff = options_.min_backoff;
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (auto it = batch.rbegin(); it != batch.rend(); ++it) {
+      if (++it->attempts < 2 && !stopping_) {
+        queue_.push_front(std::move(*it));
+      } else {
+        failed_.Add();
+      }
+    }
+    if (stopping_) {
+      failed_.Add(queue_.size());
+      queue_.clear();
+      return;
+    }
+    ready_.wait_for(lock, backoff, [this]() { return stopping_; });
+    backoff = std::min(backoff * 2, options_.max_backoff);
+  }
+}
+
+bool RedisPublisher::SendBatch(std::vector<Message> &batch) {
+  const auto started = std::chrono::steady_clock::now();
+  tracing::Span span("redis PUBLISH", tracing::SpanKind::kClient, batch.front().context);
+  span.SetAttribute("db.system", "redis")
+      .SetAttribute("server.address", host_)
+      .SetAttribute("messaging.batch.message_count", static_cast<std::int64_t>(batch.size()));
+  std::size_t acknowledged = 0;
+  try {
+    if (!connection_) {
+      connection_ = std::make_unique<redis::Connection>(host_, port_, password_, options_.timeout);
+      if (connected_before_) {
+        reconnects_.Add();
+      }
+      connected_before_ = true;
+    }
+    std::string pipeline;
+    for (const auto &message : batch) {
+      redis::AppendRespCommand(pipeline, {"PUBLISH", message.channel, message.payload});
+    }
+    connection_->Write(pipeline);
+    for (; acknowledged < batch.size(); ++acknowledged) {
+      if (connection_->Read().type == redis::RespReply::Type::kError) {
+        failed_.Add();
+      } else {
+        published_.Add();
+      }
+    }
+  } catch (const std::exception &ex) {
+    logging::ServiceLogger::Instance("jobs").Warn("redis_publish_failed", ex.what());
+    span.SetError(ex.what());
+    connection_.reset();
+    // Only messages Redis has not answered for are retried.
+    batch.erase(batch.begin(), batch.begin() + static_cast<std::ptrdiff_t>(acknowledged));
+    return false;
+  }
+  batch_latency_.Observe(std::chrono::steady_clock::now() - started);
+  return true;
+}
+
+RedisSubscriber::RedisSubscriber(std::string host, int port, std::string password, Handler handler,
+                                 ChannelList channels, RedisPublisherOptions options)
+    : host_(std::move(host)),
+      port_(port),
+      password_(std::move(password)),
+      handler_(std::move(handler)),
+      channels_(std::move(channels)),
+      options_(options) {
+  if (Configured()) {
+    worker_ = std::thread([this]() { Run(); });
+  }
+}
+
+RedisSubscriber::~RedisSubscriber() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    if (connection_) {
+      connection_->Shutdown();
+    }
+  }
+  stopped_.notify_all();
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+}
+
+void RedisSubscriber::Subscribe(const std::string &channel) { Send("SUBSCRIBE", channel); }
+
+void RedisSubscriber::Unsubscribe(const std::string &channel) { Send("UNSUBSCRIBE", channel); }
+
+void RedisSubscriber::Send(std::string_view command, const std::string &channel) {
+  std::string payload;
+  redis::AppendRespCommand(payload, {command, channel});
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!connection_) {
+    // The reader re-subscribes from channels() once it reconnects.
+    return;
+  }
+  try {
+    connection_->Write(payload);
+  } catch (const std::exception &) {
+    // Wakes the reader, which reconnects and restores the channel list.
+    connection_->Shutdown();
+  }
+}
+
+std::string RedisSubscriber::RenderMetrics(std::string_view service) const {
+  std::ostringstream labels;
+  labels << "service=\"" << service << '"';
+  std::ostringstream oss;
+  oss << "# HELP redis_subscriber_messages_total Pub/sub messages received from Redis" << '\n';
+  oss << "# TYPE redis_subscriber_messages_total counter" << '\n';
+  oss << "redis_subscriber_messages_total{" << labels.str() << "} " << received_.Value() << '\n';
+  oss << "# HELP redis_subscriber_reconnects_total Subscriber connections re-established after a failure" << '\n';
+  oss << "# TYPE redis_subscriber_reconnects_total counter" << '\n';
+  oss << "redis_subscriber_reconnects_total{" << labels.str() << "} " << reconnects_.Value() << '\n';
+  return oss.str();
+}
+
+void RedisSubscriber::Run() {
+  std::chrono::milliseconds backoff = options_.min_backoff;
+  bool connected_before = false;
+  while (true) {
+    try {
+      auto connection = std::make_shared<redis::Connection>(host_, port_, password_, options_.timeout);
+      connection->SetReadTimeout(std::chrono::milliseconds(0));
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_) {
+          return;
+        }
+        connection_ = connection;
+      }
+      if (connected_before) {
+        reconnects_.Add();
+      }
+      connected_before = true;
+      // Channels added from here on are written by Send(); anything added earlier is in this list.
+      std::string resubscribe;
+      for (const auto &channel : channels_()) {
+        redis::AppendRespCommand(resubscribe, {"SUBSCRIBE", channel});
+      }
+      if (!resubscribe.empty()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connection->Write(resubscribe);
+      }
+      backoff = options_.min_backoff;
+      while (true) {
+        const auto reply = connection->Read();
+        if (reply.type == redis::RespReply::Type::kArray && reply.elements.size() == 3 &&
+            reply.elements[0].text == "message") {
+          received_.Add();
+          handler_(reply.elements[1].text, reply.elements[2].text);
+        }
+      }
+    } catch (const std::exception &ex) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      connection_.reset();
+      if (stopping_) {
+        return;
+      }
+      logging::ServiceLogger::Instance("jobs").Warn("redis_subscriber_disconnected", ex.what());
+      stopped_.wait_for(lock, backoff, [this]() { return stopping_; });
+      if (stopping_) {
+        return;
+      }
+      backoff = std::min(backoff * 2, options_.max_backoff);
+    }
+  }
+}
+
+}  // namespace jobs
@@ -0,0 +1,133 @@
+#ifndef CONVEYANCERS_MARKETPLACE_JOBS_REDIS_CLIENT_H
+#define CONVEYANCERS_MARKETPLACE_JOBS_REDIS_CLIENT_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "../../common/metrics.h"
+#include "../../common/redis_client.h"
+#include "../../common/tracing.h"
+
+namespace jobs {
+
+struct RedisPublisherOptions {
+  std::size_t queue_limit = 10000;
+  std::size_t batch_size = 128;
+  std::chrono::milliseconds timeout{2000};
+  std::chrono::milliseconds min_backoff{100};
+  std::chrono::milliseconds max_backoff{5000};
+};
+
+// Publishes on a background thread over one persistent connection. Publish() only queues,
+// so request handlers never wait on Redis; the writer drains the queue in pipelined batches
+// and reconnects with exponential backoff when the connection drops. Messages that were in
+// flight during a disconnect are retried once on the new connection.
+class RedisPublisher {
+ public:
+  RedisPublisher(std::string host, int port, std::string password, RedisPublisherOptions options = {});
+  ~RedisPublisher();
+
+  RedisPublisher(const RedisPublisher &) = delete;
+  RedisPublisher &operator=(const RedisPublisher &) = delete;
+
+  bool Configured() const { return !host_.empty() && port_ > 0; }
+
+  // False when Redis is not configured or the queue is full.
+  bool Publish(std::string channel, std::string payload);
+
+  std::size_t QueueDepth() const;
+  std::string RenderMetrics(std::string_view service) const;
+
+ private:
+  struct Message {
+    std::string channel;
+    std::string payload;
+    int attempts = 0;
+    // Span that published it; the batch span is recorded under the first message's trace.
+    tracing::SpanContext context;
+  };
+
+  void Run();
+  // On failure, batch is left holding the messages that were not acknowledged.
+  bool SendBatch(std::vector<Message> &batch);
+
+  const std::string host_;
+  const int port_;
+  const std::string password_;
+  const RedisPublisherOptions options_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<Message> queue_;
+  bool stopping_ = false;
+
+  // Owned by the worker thread.
+  std::unique_ptr<redis::Connection> connection_;
+  bool connected_before_ = false;
+  std::thread worker_;
+
+  metrics::Counter published_;
+  metrics::Counter dropped_;
+  metrics::Counter failed_;
+  metrics::Counter reconnects_;
+  metrics::Histogram batch_latency_;
+};
+
+// Holds one SUBSCRIBE connection and hands every pub/sub message to handler on its reader
+// thread. Channels are added and removed as local interest changes; after a reconnect the
+// current set is re-subscribed from channels().
+class RedisSubscriber {
+ public:
+  using Handler = std::function<void(const std::string &channel, const std::string &payload)>;
+  using ChannelList = std::function<std::vector<std::string>()>;
+
+  RedisSubscriber(std::string host, int port, std::string password, Handler handler, ChannelList channels,
+                  RedisPublisherOptions options = {});
+  ~RedisSubscriber();
+
+  RedisSubscriber(const RedisSubscriber &) = delete;
+  RedisSubscriber &operator=(const RedisSubscriber &) = delete;
+
+  bool Configured() const { return !host_.empty() && port_ > 0; }
+
+  void Subscribe(const std::string &channel);
+  void Unsubscribe(const std::string &channel);
+
+  std::string RenderMetrics(std::string_view service) const;
+
+ private:
+  void Run();
+  void Send(std::string_view command, const std::string &channel);
+
+  const std::string host_;
+  const int port_;
+  const std::string password_;
+  const Handler handler_;
+  const ChannelList channels_;
+  const RedisPublisherOptions options_;
+
+  // Writers share the connection with the reader thread; mutex_ only guards the pointer and
+  // serialises writes.
+  mutable std::mutex mutex_;
+  std::condition_variable stopped_;
+  std::shared_ptr<redis::Connection> connection_;
+  bool stopping_ = false;
+  std::thread worker_;
+
+  metrics::Counter received_;
+  metrics::Counter reconnects_;
+};
+
+}  // namespace jobs
+
+#endif  // CONVEYANCERS_MARKETPLACE_JOBS_REDIS_CLIENT_H
@@ -0,0 +1,81 @@
+#include "template_cache.h"
+
+#include <sstream>
+#include <utility>
+
+namespace jobs {
+
+TemplateListCache::TemplateListCache(VersionReader read_version, Renderer render,
+                                     std::chrono::milliseconds revalidate_interval)
+    : read_version_(std::move(read_version)),
+      render_(std::move(render)),
+      revalidate_interval_(revalidate_interval) {}
+
+std::shared_ptr<const TemplateListSnapshot> TemplateListCache::Get() {
+  const auto fresh = [this](std::chrono::steady_clock::time_point now) {
+    return snapshot_ && !invalidated_ && now - checked_at_ < revalidate_interval_;
+  };
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fresh(std::chrono::steady_clock::now())) {
+      hits_.Add();
+      return snapshot_;
+    }
+  }
+
+  std::lock_guard<std::mutex> refresh(refresh_mutex_);
+  std::shared_ptr<const TemplateListSnapshot> current;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Another request may have refreshed while this one waited.
+    if (fresh(std::chrono::steady_clock::now())) {
+      hits_.Add();
+      return snapshot_;
+    }
+    current = snapshot_;
+    invalidated_ = false;
+  }
+
+  // Read the stamp before the list: a concurrent upsert can only make the list newer than its
+  // stamp, which costs one extra rebuild on the next check rather than serving stale data.
+  const auto checked_at = std::chrono::steady_clock::now();
+  std::string version = read_version_();
+  if (current && current->version == version) {
+    revalidated_.Add();
+  } else {
+    auto snapshot = std::make_shared<TemplateListSnapshot>();
+    snapshot->body = render_();
+    snapshot->etag = "\"templates-" + version + "\"";
+    snapshot->version = std::move(version);
+    current = std::move(snapshot);
+    rebuilt_.Add();
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  snapshot_ = current;
+  checked_at_ = checked_at;
+  return current;
+}
+
+void TemplateListCache::Invalidate() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  invalidated_ = true;
+}
+
+std::string TemplateListCache::RenderMetrics(std::string_view service) const {
+  std::ostringstream labels;
+  labels << "service=\"" << service << '"';
+  std::ostringstream oss;
+  oss << "# HELP template_cache_requests_total Template list requests by cache outcome" << '\n';
+  oss << "# TYPE template_cache_requests_total counter" << '\n';
+  oss << "template_cache_requests_total{" << labels.str() << ",outcome=\"hit\"} " << hits_.Value() << '\n';
+  oss << "template_cache_requests_total{" << labels.str() << ",outcome=\"revalidated\"} " << revalidated_.Value()
+      << '\n';
+  oss << "template_cache_requests_total{" << labels.str() << ",outcome=\"rebuilt\"} " << rebuilt_.Value() << '\n';
+  oss << "# HELP template_cache_not_modified_total Template list requests answered with 304" << '\n';
+  oss << "# TYPE template_cache_not_modified_total counter" << '\n';
+  oss << "template_cache_not_modified_total{" << labels.str() << "} " << not_modified_.Value() << '\n';
+  return oss.str();
+}
+
+}  // namespace jobs
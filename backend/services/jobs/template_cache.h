@@ -0,0 +1,64 @@
+#ifndef CONVEYANCERS_MARKETPLACE_JOBS_TEMPLATE_CACHE_H
+#define CONVEYANCERS_MARKETPLACE_JOBS_TEMPLATE_CACHE_H
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "../../common/metrics.h"
+
+namespace jobs {
+
+struct TemplateListSnapshot {
+  std::string version;
+  std::string etag;
+  // Pre-serialised response body.
+  std::string body;
+};
+
+// Read-through cache for the rendered template list. The list is only rebuilt when the
+// repository's version stamp moves; the stamp itself is re-read at most once per
+// revalidate_interval, or on the next request after Invalidate(). Upserts call Invalidate()
+// locally and other instances learn about them over Redis, so the interval only bounds
+// staleness when a notification is missed.
+class TemplateListCache {
+ public:
+  using VersionReader = std::function<std::string()>;
+  using Renderer = std::function<std::string()>;
+
+  TemplateListCache(VersionReader read_version, Renderer render, std::chrono::milliseconds revalidate_interval);
+
+  TemplateListCache(const TemplateListCache &) = delete;
+  TemplateListCache &operator=(const TemplateListCache &) = delete;
+
+  // Throws whatever the reader or renderer throws when there is nothing usable cached.
+  std::shared_ptr<const TemplateListSnapshot> Get();
+  void Invalidate();
+
+  void RecordNotModified() { not_modified_.Add(); }
+  std::string RenderMetrics(std::string_view service) const;
+
+ private:
+  const VersionReader read_version_;
+  const Renderer render_;
+  const std::chrono::milliseconds revalidate_interval_;
+
+  // Held across a refresh so concurrent misses wait for one rebuild instead of each running it.
+  std::mutex refresh_mutex_;
+  mutable std::mutex mutex_;
+  std::shared_ptr<const TemplateListSnapshot> snapshot_;
+  std::chrono::steady_clock::time_point checked_at_{};
+  bool invalidated_ = true;
+
+  metrics::Counter hits_;
+  metrics::Counter revalidated_;
+  metrics::Counter rebuilt_;
+  metrics::Counter not_modified_;
+};
+
+}  // namespace jobs
+
+#endif  // CONVEYANCERS_MARKETPLACE_JOBS_TEMPLATE_CACHE_H
@@ -0,0 +1,427 @@
+#include "template_sync.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <exception>
+#include <iomanip>
+#include <regex>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#include <openssl/sha.h>
+
+#include "../../common/codec.h"
+#include "../../common/logger.h"
+#include "../../common/tracing.h"
+
+namespace jobs {
+namespace {
+
+using json = nlohmann::json;
+
+void Log(const std::string &event, const std::string &detail) {
+  logging::ServiceLogger::Instance("jobs").Warn(event, detail);
+}
+
+struct ParsedUrl {
+  std::string scheme;
+  std::string host;
+  int port = 0;
+  std::string path;
+  bool secure = false;
+
+  // httplib only takes http and https, so wss and friends map onto those.
+  std::string Origin() const { return (secure ? "https://" : "http://") + host + ":" + std::to_string(port); }
+};
+
+ParsedUrl ParseUrl(const std::string &url) {
+  static const std::regex kRegex(R"(^([a-zA-Z][a-zA-Z0-9+.-]*)://([^/ :]+)(:([0-9]+))?(.*)$)");
+  std::smatch matches;
+  if (!std::regex_match(url, matches, kRegex)) {
+    throw std::runtime_error("invalid_url");
+  }
+  ParsedUrl parsed;
+  parsed.scheme = matches[1];
+  parsed.host = matches[2];
+  parsed.path = matches[5].str().empty() ? std::string{"/"} : matches[5].str();
+  parsed.secure = parsed.scheme == "https" || parsed.scheme == "wss";
+  parsed.port = parsed.secure ? 443 : 80;
+  if (matches[4].matched) {
+    try {
+      parsed.port = std::stoi(matches[4]);
+    } catch (...) {
+    }
+  }
+  return parsed;
+}
+
+std::string UtcTimestamp(std::chrono::system_clock::time_point when) {
+  const std::time_t time = std::chrono::system_clock::to_time_t(when);
+  std::tm tm{};
+#ifdef _WIN32
+  gmtime_s(&tm, &time);
+#else
+  gmtime_r(&time, &tm);
+#endif
+  std::ostringstream out;
+  out << std::put_time(&tm, "%FT%TZ");
+  return out.str();
+}
+
+httplib::Headers PortalHeaders(const json &auth, const PortalValidators &validators) {
+  httplib::Headers headers;
+  if (auth.is_object()) {
+    if (const auto api_key = auth.find("apiKey"); api_key != auth.end() && api_key->is_string()) {
+      headers.emplace("Authorization", "Bearer " + api_key->get<std::string>());
+    }
+    if (const auto header_values = auth.find("headers"); header_values != auth.end() && header_values->is_object()) {
+      for (const auto &item : header_values->items()) {
+        if (item.value().is_string()) {
+          headers.emplace(item.key(), item.value().get<std::string>());
+        }
+      }
+    }
+  }
+  if (!validators.etag.empty()) {
+    headers.emplace("If-None-Match", validators.etag);
+  }
+  if (!validators.last_modified.empty()) {
+    headers.emplace("If-Modified-Since", validators.last_modified);
+  }
+  return headers;
+}
+
+PortalValidators ValidatorsFromMetadata(const json &metadata) {
+  PortalValidators validators;
+  if (metadata.is_object()) {
+    if (const auto etag = metadata.find("etag"); etag != metadata.end() && etag->is_string()) {
+      validators.etag = etag->get<std::string>();
+    }
+    if (const auto modified = metadata.find("lastModified"); modified != metadata.end() && modified->is_string()) {
+      validators.last_modified = modified->get<std::string>();
+    }
+  }
+  return validators;
+}
+
+double Seconds(std::chrono::milliseconds duration) { return static_cast<double>(duration.count()) / 1000.0; }
+
+}  // namespace
+
+TemplateSyncResult ParsePortalTemplate(const std::string &url, int status, const std::string &body) {
+  json payload = json::parse(body);
+  TemplateSyncResult result;
+  result.metadata = json::object();
+  result.metadata["syncedAt"] = UtcTimestamp(std::chrono::system_clock::now());
+  result.metadata["statusCode"] = status;
+  result.source = json{{"type", "portal"}, {"url", url}, {"statusCode", status}};
+  if (payload.is_object() && payload.contains("version")) {
+    result.metadata["portalVersion"] = payload["version"];
+    result.source["version"] = payload["version"];
+  }
+  const auto *tasks_ptr = &payload;
+  if (payload.is_object() && payload.contains("tasks")) {
+    tasks_ptr = &payload["tasks"];
+  } else if (payload.is_object() && payload.contains("workflow") && payload["workflow"].is_object() &&
+             payload["workflow"].contains("tasks")) {
+    tasks_ptr = &payload["workflow"]["tasks"];
+  }
+  if (!tasks_ptr->is_array()) {
+    throw std::runtime_error("portal_tasks_missing");
+  }
+  for (const auto &task : *tasks_ptr) {
+    persistence::TemplateTaskRecord task_record;
+    if (task.is_object()) {
+      task_record.name = task.value("name", task.value("title", ""));
+      task_record.due_days = task.value("dueDays", task.value("due_days", 0));
+      task_record.assigned_role = task.value("assignedRole", task.value("owner", ""));
+    }
+    result.tasks.push_back(std::move(task_record));
+  }
+  return result;
+}
+
+std::string TasksDigest(const std::vector<persistence::TemplateTaskRecord> &tasks) {
+  // Length-prefixed so no choice of names can make two different lists serialise alike.
+  std::string canonical;
+  const auto append = [&canonical](std::string_view field) {
+    canonical += std::to_string(field.size());
+    canonical += ':';
+    canonical += field;
+  };
+  for (const auto &task : tasks) {
+    append(task.name);
+    append(std::to_string(task.due_days));
+    append(task.assigned_role);
+  }
+  std::array<unsigned char, SHA256_DIGEST_LENGTH> digest{};
+  SHA256(reinterpret_cast<const unsigned char *>(canonical.data()), canonical.size(), digest.data());
+  return codec::HexEncode(digest.data(), digest.size());
+}
+
+PortalClient::PortalClient(PortalClientOptions options) : options_(options) {}
+
+PortalFetch PortalClient::Fetch(const std::string &url, const json &auth, const PortalValidators &validators) {
+  if (url.empty()) {
+    throw std::runtime_error("portal_url_missing");
+  }
+  const ParsedUrl parsed = ParseUrl(url);
+#ifndef CPPHTTPLIB_OPENSSL_SUPPORT
+  if (parsed.secure) {
+    throw std::runtime_error("ssl_not_supported");
+  }
+#endif
+  const std::string origin = parsed.Origin();
+  auto client = Checkout(origin);
+
+  tracing::Span span("GET portal", tracing::SpanKind::kClient);
+  span.SetAttribute("server.address", parsed.host).SetAttribute("url.path", parsed.path);
+  const auto response = client->Get(parsed.path, PortalHeaders(auth, validators));
+  if (!response) {
+    // The connection may have gone stale while idle; it is not returned to the pool.
+    span.SetError(httplib::to_string(response.error()));
+    throw std::runtime_error("portal_request_failed");
+  }
+  Checkin(origin, std::move(client));
+  span.SetAttribute("http.response.status_code", static_cast<std::int64_t>(response->status));
+
+  PortalFetch fetch;
+  fetch.validators.etag = response->get_header_value("ETag");
+  fetch.validators.last_modified = response->get_header_value("Last-Modified");
+  if (response->status == 304) {
+    fetch.not_modified = true;
+    // A 304 may leave out validators that have not changed.
+    if (fetch.validators.etag.empty()) {
+      fetch.validators.etag = validators.etag;
+    }
+    if (fetch.validators.last_modified.empty()) {
+      fetch.validators.last_modified = validators.last_modified;
+    }
+    return fetch;
+  }
+  if (response->status >= 400) {
+    span.SetError("HTTP " + std::to_string(response->status));
+    throw std::runtime_error("portal_request_failed");
+  }
+  span.End();
+  fetch.result = ParsePortalTemplate(url, response->status, response->body);
+  if (!fetch.validators.etag.empty()) {
+    fetch.result.metadata["etag"] = fetch.validators.etag;
+  }
+  if (!fetch.validators.last_modified.empty()) {
+    fetch.result.metadata["lastModified"] = fetch.validators.last_modified;
+  }
+  return fetch;
+}
+
+std::unique_ptr<httplib::Client> PortalClient::Checkout(const std::string &origin) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (auto it = idle_.find(origin); it != idle_.end() && !it->second.empty()) {
+      auto client = std::move(it->second.back());
+      it->second.pop_back();
+      return client;
+    }
+  }
+  auto client = std::make_unique<httplib::Client>(origin);
+  client->set_keep_alive(true);
+  client->set_connection_timeout(static_cast<time_t>(options_.connect_timeout.count()), 0);
+  client->set_read_timeout(static_cast<time_t>(options_.read_timeout.count()), 0);
+#ifdef CPPHTTPLIB_OPENSSL_SUPPORT
+  client->enable_server_certificate_verification(false);
+#endif
+  return client;
+}
+
+void PortalClient::Checkin(const std::string &origin, std::unique_ptr<httplib::Client> client) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto &idle = idle_[origin];
+  if (idle.size() < options_.idle_per_origin) {
+    idle.push_back(std::move(client));
+  }
+}
+
+TemplateSyncScheduler::TemplateSyncScheduler(Lister list, Fetcher fetch, Applier apply, TemplateSyncOptions options)
+    : list_(std::move(list)), fetch_(std::move(fetch)), apply_(std::move(apply)), options_(options) {
+  thread_ = std::thread([this]() { Run(); });
+}
+
+TemplateSyncScheduler::~TemplateSyncScheduler() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  thread_.join();
+}
+
+void TemplateSyncScheduler::Trigger() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    triggered_ = true;
+  }
+  wake_.notify_all();
+}
+
+void TemplateSyncScheduler::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    const auto woken = [this]() { return stopping_ || triggered_; };
+    if (options_.interval.count() > 0) {
+      wake_.wait_for(lock, options_.interval, woken);
+    } else {
+      wake_.wait(lock, woken);
+    }
+    if (stopping_) {
+      return;
+    }
+    triggered_ = false;
+    lock.unlock();
+    RunOnce();
+    lock.lock();
+  }
+}
+
+TemplateSyncReport TemplateSyncScheduler::RunOnce() {
+  std::lock_guard<std::mutex> run(run_mutex_);
+  const auto started = std::chrono::steady_clock::now();
+  TemplateSyncReport report;
+
+  std::vector<persistence::TemplateRecord> records;
+  try {
+    records = list_();
+  } catch (const std::exception &ex) {
+    Log("template_sync_list_failed", ex.what());
+    return report;
+  }
+  const auto manual = [](const persistence::TemplateRecord &record) { return record.integration_url.empty(); };
+  records.erase(std::remove_if(records.begin(), records.end(), manual), records.end());
+
+  std::vector<TemplateSyncStatus> results(records.size());
+  std::atomic<std::size_t> next{0};
+  const auto work = [&]() {
+    for (std::size_t i = next.fetch_add(1); i < records.size(); i = next.fetch_add(1)) {
+      results[i] = SyncOne(records[i]);
+    }
+  };
+  const std::size_t workers = std::min(std::max<std::size_t>(options_.concurrency, 1), records.size());
+  std::vector<std::thread> threads;
+  threads.reserve(workers > 0 ? workers - 1 : 0);
+  for (std::size_t i = 1; i < workers; ++i) {
+    threads.emplace_back(work);
+  }
+  work();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  for (const auto &status : results) {
+    if (status.outcome == "updated") {
+      ++report.updated;
+    } else if (status.outcome == "unchanged") {
+      ++report.unchanged;
+    } else {
+      ++report.failed;
+    }
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - started;
+  pass_latency_.Observe(elapsed);
+  report.duration = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed);
+  return report;
+}
+
+TemplateSyncStatus TemplateSyncScheduler::SyncOne(const persistence::TemplateRecord &record) {
+  const auto started = std::chrono::steady_clock::now();
+  TemplateSyncStatus status;
+  status.template_id = record.id;
+  status.name = record.name;
+  status.version = record.latest_version;
+
+  PortalValidators validators = ValidatorsFromMetadata(record.metadata);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (const auto it = entries_.find(record.id);
+        it != entries_.end() && it->second.validated_version == record.latest_version) {
+      validators = it->second.validators;
+    }
+  }
+
+  PortalValidators received;
+  bool validated = false;
+  try {
+    auto fetch = fetch_(record, validators);
+    received = std::move(fetch.validators);
+    validated = true;
+    if (fetch.not_modified || TasksDigest(fetch.result.tasks) == TasksDigest(record.tasks)) {
+      status.outcome = "unchanged";
+    } else {
+      status.version = apply_(record, fetch.result);
+      status.outcome = "updated";
+    }
+  } catch (const std::exception &ex) {
+    status.outcome = "failed";
+    status.error = ex.what();
+    Log("template_sync_failed", record.id + ": " + status.error);
+  }
+
+  const auto elapsed = std::chrono::steady_clock::now() - started;
+  latency_.Observe(elapsed);
+  (status.outcome == "updated" ? updated_ : status.outcome == "unchanged" ? unchanged_ : failed_).Add();
+  status.duration = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed);
+  status.finished_at = UtcTimestamp(std::chrono::system_clock::now());
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto &entry = entries_[record.id];
+  entry.status = status;
+  if (validated) {
+    entry.validators = std::move(received);
+    entry.validated_version = status.version;
+  }
+  return status;
+}
+
+std::vector<TemplateSyncStatus> TemplateSyncScheduler::Statuses() const {
+  std::vector<TemplateSyncStatus> statuses;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    statuses.reserve(entries_.size());
+    for (const auto &entry : entries_) {
+      statuses.push_back(entry.second.status);
+    }
+  }
+  std::sort(statuses.begin(), statuses.end(), [](const TemplateSyncStatus &a, const TemplateSyncStatus &b) {
+    return a.name != b.name ? a.name < b.name : a.template_id < b.template_id;
+  });
+  return statuses;
+}
+
+std::string TemplateSyncScheduler::RenderMetrics(std::string_view service) const {
+  std::ostringstream labels;
+  labels << "service=\"" << service << '"';
+  std::ostringstream oss;
+  oss << "# HELP template_syncs_total Template portal syncs, by outcome" << '\n';
+  oss << "# TYPE template_syncs_total counter" << '\n';
+  oss << "template_syncs_total{" << labels.str() << ",outcome=\"updated\"} " << updated_.Value() << '\n';
+  oss << "template_syncs_total{" << labels.str() << ",outcome=\"unchanged\"} " << unchanged_.Value() << '\n';
+  oss << "template_syncs_total{" << labels.str() << ",outcome=\"failed\"} " << failed_.Value() << '\n';
+  oss << "# HELP template_sync_seconds Time to fetch and store one template from its portal" << '\n';
+  oss << "# TYPE template_sync_seconds histogram" << '\n';
+  metrics::WriteHistogram(oss, "template_sync_seconds", labels.str(), latency_.Collect());
+  oss << "# HELP template_sync_pass_seconds Time for one sync pass over every portal template" << '\n';
+  oss << "# TYPE template_sync_pass_seconds histogram" << '\n';
+  metrics::WriteHistogram(oss, "template_sync_pass_seconds", labels.str(), pass_latency_.Collect());
+  oss << "# HELP template_sync_last_seconds Duration of the latest sync of each template" << '\n';
+  oss << "# TYPE template_sync_last_seconds gauge" << '\n';
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto &[id, entry] : entries_) {
+    oss << "template_sync_last_seconds{" << labels.str() << ",template_id=\"" << id << "\"} "
+        << Seconds(entry.status.duration) << '\n';
+  }
+  return oss.str();
+}
+
+}  // namespace jobs
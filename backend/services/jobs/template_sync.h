@@ -0,0 +1,173 @@
+#ifndef CONVEYANCERS_MARKETPLACE_JOBS_TEMPLATE_SYNC_H
+#define CONVEYANCERS_MARKETPLACE_JOBS_TEMPLATE_SYNC_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../../common/metrics.h"
+#include "../../common/persistence/jobs_repository.h"
+#include "../../third_party/httplib.h"
+#include "../../third_party/json.hpp"
+
+namespace jobs {
+
+struct TemplateSyncResult {
+  std::vector<persistence::TemplateTaskRecord> tasks;
+  nlohmann::json metadata;
+  nlohmann::json source;
+};
+
+// Turns a portal response into tasks plus the sync metadata and source stored with the
+// version. Tasks may be the body itself, body.tasks or body.workflow.tasks. Throws
+// std::runtime_error("portal_tasks_missing") and nlohmann parse errors.
+TemplateSyncResult ParsePortalTemplate(const std::string &url, int status, const std::string &body);
+
+// SHA-256 over the task fields, so two fetches of the same workflow compare equal no matter
+// what else the portal put in the body.
+std::string TasksDigest(const std::vector<persistence::TemplateTaskRecord> &tasks);
+
+// Validators from the last response, sent back as If-None-Match / If-Modified-Since.
+struct PortalValidators {
+  std::string etag;
+  std::string last_modified;
+};
+
+struct PortalFetch {
+  // 304: result is empty and the stored version is still current.
+  bool not_modified = false;
+  TemplateSyncResult result;
+  PortalValidators validators;
+};
+
+struct PortalClientOptions {
+  std::chrono::seconds connect_timeout{5};
+  std::chrono::seconds read_timeout{10};
+  // Idle keep-alive connections kept per origin; more can be open while requests are in flight.
+  std::size_t idle_per_origin = 4;
+};
+
+// Portal HTTP client that keeps connections alive per origin (scheme, host and port), so a
+// sync pass over many templates on one portal pays for one handshake per concurrent request
+// rather than one per template. Safe to call from several threads.
+class PortalClient {
+ public:
+  explicit PortalClient(PortalClientOptions options = {});
+
+  PortalClient(const PortalClient &) = delete;
+  PortalClient &operator=(const PortalClient &) = delete;
+
+  // auth may carry "apiKey" (sent as a bearer token) and a "headers" object. Throws
+  // std::runtime_error with portal_url_missing, invalid_url, ssl_not_supported or
+  // portal_request_failed, and whatever ParsePortalTemplate throws. The returned metadata
+  // records the response validators as "etag" and "lastModified".
+  PortalFetch Fetch(const std::string &url, const nlohmann::json &auth, const PortalValidators &validators = {});
+
+ private:
+  std::unique_ptr<httplib::Client> Checkout(const std::string &origin);
+  void Checkin(const std::string &origin, std::unique_ptr<httplib::Client> client);
+
+  const PortalClientOptions options_;
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::vector<std::unique_ptr<httplib::Client>>> idle_;
+};
+
+struct TemplateSyncOptions {
+  // Time between background passes; zero, the default, leaves only passes started by Trigger().
+  // Enable it on a single instance per deployment.
+  std::chrono::seconds interval{0};
+  // Portal requests in flight at once during a pass.
+  std::size_t concurrency = 4;
+};
+
+struct TemplateSyncStatus {
+  std::string template_id;
+  std::string name;
+  // "updated", "unchanged" or "failed".
+  std::string outcome;
+  std::string error;
+  int version = 0;
+  std::chrono::milliseconds duration{0};
+  // ISO 8601, UTC.
+  std::string finished_at;
+};
+
+struct TemplateSyncReport {
+  std::size_t updated = 0;
+  std::size_t unchanged = 0;
+  std::size_t failed = 0;
+  std::chrono::milliseconds duration{0};
+};
+
+// Refreshes every template that has an integration URL from its portal on a background
+// thread. A template only gets a new version when the portal reports a change: conditional
+// requests let the portal answer 304, and a 200 whose tasks hash to the stored ones is
+// dropped as well. Run one scheduler per deployment, since two instances syncing the same
+// change would each write a version.
+class TemplateSyncScheduler {
+ public:
+  using Lister = std::function<std::vector<persistence::TemplateRecord>()>;
+  using Fetcher =
+      std::function<PortalFetch(const persistence::TemplateRecord &record, const PortalValidators &validators)>;
+  // Stores a changed template and returns its new version.
+  using Applier = std::function<int(const persistence::TemplateRecord &record, const TemplateSyncResult &result)>;
+
+  TemplateSyncScheduler(Lister list, Fetcher fetch, Applier apply, TemplateSyncOptions options = {});
+  // Waits for a pass in progress to finish its in-flight requests.
+  ~TemplateSyncScheduler();
+
+  TemplateSyncScheduler(const TemplateSyncScheduler &) = delete;
+  TemplateSyncScheduler &operator=(const TemplateSyncScheduler &) = delete;
+
+  // One pass on the calling thread; concurrent calls run one after the other. Never throws.
+  TemplateSyncReport RunOnce();
+  // Starts a pass on the background thread without waiting for it.
+  void Trigger();
+  // Latest result per template, ordered by name.
+  std::vector<TemplateSyncStatus> Statuses() const;
+  std::string RenderMetrics(std::string_view service) const;
+
+ private:
+  struct Entry {
+    TemplateSyncStatus status;
+    // Validators are only trusted for the version they were received with; a version
+    // written by someone else falls back to the validators stored in its metadata.
+    PortalValidators validators;
+    int validated_version = -1;
+  };
+
+  void Run();
+  TemplateSyncStatus SyncOne(const persistence::TemplateRecord &record);
+
+  const Lister list_;
+  const Fetcher fetch_;
+  const Applier apply_;
+  const TemplateSyncOptions options_;
+
+  std::mutex run_mutex_;
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  bool triggered_ = false;
+  bool stopping_ = false;
+  std::map<std::string, Entry> entries_;
+  std::thread thread_;
+
+  metrics::Counter updated_;
+  metrics::Counter unchanged_;
+  metrics::Counter failed_;
+  metrics::Histogram latency_;
+  metrics::Histogram pass_latency_;
+};
+
+}  // namespace jobs
+
+#endif  // CONVEYANCERS_MARKETPLACE_JOBS_TEMPLATE_SYNC_H
@@ -0,0 +1,150 @@
+#include "upload_stream.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+#include <openssl/rand.h>
+
+#include "../../common/codec.h"
+
+namespace jobs {
+
+UploadInspector::UploadInspector() : sha_(EVP_MD_CTX_new(), &EVP_MD_CTX_free) {
+  if (!sha_ || EVP_DigestInit_ex(sha_.get(), EVP_sha256(), nullptr) != 1) {
+    throw std::runtime_error("digest_init_failed");
+  }
+  tail_.reserve(kEicar.size() * 2);
+}
+
+void UploadInspector::Update(const char *data, std::size_t length) {
+  if (length == 0) {
+    return;
+  }
+  EVP_DigestUpdate(sha_.get(), data, length);
+  bytes_seen_ += length;
+  if (eicar_detected_) {
+    return;
+  }
+
+  // Search the carried-over tail plus the head of this chunk for a signature straddling the
+  // boundary, then the chunk itself.
+  const std::size_t keep = kEicar.size() - 1;
+  tail_.append(data, std::min(length, keep));
+  if (tail_.find(kEicar) != std::string::npos) {
+    eicar_detected_ = true;
+    return;
+  }
+  const std::string_view chunk(data, length);
+  if (chunk.find(kEicar) != std::string_view::npos) {
+    eicar_detected_ = true;
+    return;
+  }
+
+  if (length >= keep) {
+    tail_.assign(data + length - keep, keep);
+  } else if (tail_.size() > keep) {
+    tail_.erase(0, tail_.size() - keep);
+  }
+}
+
+std::string UploadInspector::FinishChecksum() {
+  std::array<unsigned char, EVP_MAX_MD_SIZE> digest{};
+  unsigned int digest_length = 0;
+  EVP_DigestFinal_ex(sha_.get(), digest.data(), &digest_length);
+  return codec::HexEncode(digest.data(), digest_length);
+}
+
+ChunkPipe::ChunkPipe(std::size_t capacity) : buffer_(std::max<std::size_t>(capacity, 1)) {}
+
+bool ChunkPipe::Write(const char *data, std::size_t length) {
+  std::size_t written = 0;
+  while (written < length) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this]() { return aborted_ || size_ < buffer_.size(); });
+    if (aborted_) {
+      return false;
+    }
+    // Copy up to the wrap point; the outer loop handles the remainder.
+    const std::size_t tail = (head_ + size_) % buffer_.size();
+    const std::size_t count = std::min({length - written, buffer_.size() - size_, buffer_.size() - tail});
+    std::copy_n(data + written, count, buffer_.data() + tail);
+    size_ += count;
+    written += count;
+    lock.unlock();
+    changed_.notify_all();
+  }
+  return true;
+}
+
+std::size_t ChunkPipe::Read(char *buffer, std::size_t length) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  changed_.wait(lock, [this]() { return aborted_ || closed_ || size_ > 0; });
+  if (aborted_) {
+    return 0;
+  }
+  const std::size_t count = std::min({length, size_, buffer_.size() - head_});
+  std::copy_n(buffer_.data() + head_, count, buffer);
+  head_ = (head_ + count) % buffer_.size();
+  size_ -= count;
+  lock.unlock();
+  changed_.notify_all();
+  return count;
+}
+
+void ChunkPipe::Close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+  }
+  changed_.notify_all();
+}
+
+void ChunkPipe::Abort() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    aborted_ = true;
+  }
+  changed_.notify_all();
+}
+
+bool ChunkPipe::Aborted() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return aborted_;
+}
+
+std::string NewDocumentId() {
+  std::array<unsigned char, 16> bytes{};
+  if (RAND_bytes(bytes.data(), static_cast<int>(bytes.size())) != 1) {
+    throw std::runtime_error("random_unavailable");
+  }
+  bytes[6] = static_cast<unsigned char>((bytes[6] & 0x0f) | 0x40);
+  bytes[8] = static_cast<unsigned char>((bytes[8] & 0x3f) | 0x80);
+  const std::string hex = codec::HexEncode(bytes.data(), bytes.size());
+  return hex.substr(0, 8) + "-" + hex.substr(8, 4) + "-" + hex.substr(12, 4) + "-" + hex.substr(16, 4) + "-" +
+         hex.substr(20);
+}
+
+std::string DocumentObjectKey(std::string_view job_id, std::string_view document_id, std::string_view file_name) {
+  constexpr std::size_t kMaxFileName = 128;
+  if (const auto slash = file_name.find_last_of("/\\"); slash != std::string_view::npos) {
+    file_name.remove_prefix(slash + 1);
+  }
+  std::string name;
+  name.reserve(std::min(file_name.size(), kMaxFileName));
+  for (const char ch : file_name.substr(0, kMaxFileName)) {
+    const bool safe = (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') ||
+                      ch == '.' || ch == '_' || ch == '-';
+    name.push_back(safe ? ch : '_');
+  }
+  // Dot-only names ("." and "..") would turn into path segments of their own.
+  if (name.find_first_not_of('.') == std::string::npos) {
+    name = "document.bin";
+  }
+  std::string key;
+  key.reserve(job_id.size() + document_id.size() + name.size() + 2);
+  key.append(job_id).append("/").append(document_id).append("/").append(name);
+  return key;
+}
+
+}  // namespace jobs
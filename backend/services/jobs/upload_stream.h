@@ -0,0 +1,85 @@
+#ifndef CONVEYANCERS_MARKETPLACE_JOBS_UPLOAD_STREAM_H
+#define CONVEYANCERS_MARKETPLACE_JOBS_UPLOAD_STREAM_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <openssl/evp.h>
+
+namespace jobs {
+
+// Hashes an upload and looks for the EICAR test signature as chunks arrive, so neither needs
+// the whole document in memory. Only the last kEicar.size() - 1 bytes are retained, which is
+// enough to catch a signature split across chunk boundaries.
+class UploadInspector {
+ public:
+  static constexpr std::string_view kEicar =
+      "X5O!P%@AP[4\\PZX54(P^)7CC)7}$EICAR-STANDARD-ANTIVIRUS-TEST-FILE!$H+H*";
+
+  UploadInspector();
+
+  void Update(const char *data, std::size_t length);
+
+  // Lowercase hex SHA-256 of everything passed to Update. Call once, after the last chunk.
+  std::string FinishChecksum();
+
+  bool EicarDetected() const { return eicar_detected_; }
+  std::uint64_t BytesSeen() const { return bytes_seen_; }
+
+ private:
+  std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> sha_;
+  std::string tail_;
+  std::uint64_t bytes_seen_ = 0;
+  bool eicar_detected_ = false;
+};
+
+// Single-producer/single-consumer byte pipe with a fixed capacity. The request thread writes
+// received chunks and blocks while the storage upload on the other side catches up, which
+// caps memory per upload at `capacity` bytes.
+class ChunkPipe {
+ public:
+  explicit ChunkPipe(std::size_t capacity);
+
+  ChunkPipe(const ChunkPipe &) = delete;
+  ChunkPipe &operator=(const ChunkPipe &) = delete;
+
+  // Returns false once the pipe has been aborted.
+  bool Write(const char *data, std::size_t length);
+  // Blocks until data is available and may return fewer bytes than requested. Returns 0 at
+  // end of stream or after Abort().
+  std::size_t Read(char *buffer, std::size_t length);
+
+  // Writer is done; readers drain the remaining bytes and then see end of stream.
+  void Close();
+  // Either side gave up; wakes and fails the other.
+  void Abort();
+  bool Aborted() const;
+
+ private:
+  mutable std::mutex mutex_;
+  std::condition_variable changed_;
+  std::vector<char> buffer_;
+  std::size_t head_ = 0;
+  std::size_t size_ = 0;
+  bool closed_ = false;
+  bool aborted_ = false;
+};
+
+// Fresh random (version 4) uuid, generated before the document row exists so the upload can
+// be streamed to its final object key first.
+std::string NewDocumentId();
+
+// Object key for one stored document: "<job_id>/<document_id>/<file name>". The file name is
+// reduced to its last path segment with anything outside [A-Za-z0-9._-] replaced, so keys are
+// never shared between documents and a client-chosen name cannot address another object.
+std::string DocumentObjectKey(std::string_view job_id, std::string_view document_id, std::string_view file_name);
+
+}  // namespace jobs
+
+#endif  // CONVEYANCERS_MARKETPLACE_JOBS_UPLOAD_STREAM_H
@@ -3,13 +3,18 @@
 #include <cstdlib>
 #include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "../../common/codec.h"
 #include "../../common/env_loader.h"
+#include "../../common/http_server.h"
+#include "../../common/json_writer.h"
 #include "../../common/logger.h"
 #include "../../common/persistence/audit_repository.h"
 #include "../../common/persistence/escrow_repository.h"
 #include "../../common/persistence/postgres.h"
+#include "../../common/security.h"
 #include "../../third_party/httplib.h"
 #include "../../third_party/json.hpp"
 
@@ -41,16 +46,69 @@ void SendJson(httplib::Response &res, const json &payload, int status = 200) {
   res.body = payload.dump();
 }
 
-json EscrowToJson(const persistence::EscrowRecord &record) {
-  return {{"id", record.id},
-          {"jobId", record.job_id},
-          {"milestoneId", record.milestone_id},
-          {"amountAuthorisedCents", record.amount_authorised_cents},
-          {"amountHeldCents", record.amount_held_cents},
-          {"amountReleasedCents", record.amount_released_cents},
-          {"providerRef", record.provider_ref},
-          {"status", record.status},
-          {"createdAt", record.created_at}};
+// For bodies serialised with json_writer::Writer.
+void SendJsonBody(httplib::Response &res, std::string body, int status = 200) {
+  res.status = status;
+  res.set_header("Content-Type", "application/json");
+  res.body = std::move(body);
+}
+
+void WriteEscrow(json_writer::Writer &out, const persistence::EscrowRecord &record) {
+  out.BeginObject()
+      .Field("id", record.id)
+      .Field("jobId", record.job_id)
+      .Field("milestoneId", record.milestone_id)
+      .Field("amountAuthorisedCents", record.amount_authorised_cents)
+      .Field("amountHeldCents", record.amount_held_cents)
+      .Field("amountReleasedCents", record.amount_released_cents)
+      .Field("providerRef", record.provider_ref)
+      .Field("status", record.status)
+      .Field("createdAt", record.created_at)
+      .EndObject();
+}
+
+std::string RenderEscrow(const persistence::EscrowRecord &record) {
+  return json_writer::Render([&record](json_writer::Writer &out) { WriteEscrow(out, record); });
+}
+
+// Release routes require an Idempotency-Key so that a client retrying after a timeout gets the first
+// attempt's answer instead of a second release. Sends the 400 and returns an empty key when it is unusable.
+std::string RequireIdempotencyKey(const httplib::Request &req, httplib::Response &res) {
+  auto key = req.get_header_value("Idempotency-Key");
+  if (key.empty() || key.size() > 255) {
+    SendJson(res, json{{"error", "invalid_idempotency_key"}}, 400);
+    return {};
+  }
+  return key;
+}
+
+// The audit actor column is a uuid, so a malformed actorId is refused before any funds move.
+std::optional<std::string> ReadActorId(const json &body, httplib::Response &res) {
+  auto actor_id = body.value("actorId", std::string{});
+  if (!actor_id.empty() && !codec::IsUuid(actor_id)) {
+    SendJson(res, json{{"error", "invalid_actor_id"}}, 400);
+    return std::nullopt;
+  }
+  return actor_id;
+}
+
+// Answers the outcomes that moved no funds and were not replays. Returns false for those two.
+bool SendReleaseRefusal(httplib::Response &res, persistence::EscrowReleaseOutcome outcome) {
+  switch (outcome) {
+    case persistence::EscrowReleaseOutcome::kNotFound:
+      SendJson(res, json{{"error", "not_found"}}, 404);
+      return true;
+    case persistence::EscrowReleaseOutcome::kInsufficientFunds:
+      SendJson(res, json{{"error", "insufficient_funds"}}, 409);
+      return true;
+    case persistence::EscrowReleaseOutcome::kKeyReused:
+      SendJson(res, json{{"error", "idempotency_key_reused"}}, 422);
+      return true;
+    case persistence::EscrowReleaseOutcome::kReleased:
+    case persistence::EscrowReleaseOutcome::kReplayed:
+      break;
+  }
+  return false;
 }
 
 }  // namespace
@@ -64,9 +122,24 @@ int main() {
   auto config = persistence::MakePostgresConfigFromEnv("DATABASE_URL", database_url);
 
   persistence::EscrowRepository escrow(config);
-  persistence::AuditRepository audit(config);
+  persistence::AuditRepository audit_repository(config);
+  persistence::AsyncAuditWriter audit(
+      [&audit_repository](const std::vector<persistence::AuditEvent> &events) {
+        audit_repository.RecordEvents(events);
+      },
+      persistence::MakeAuditWriterOptionsFromEnv("payments"));
 
+  http_server::ServerOptions server_defaults;
+  server_defaults.max_payload_bytes = 1024 * 1024;
   httplib::Server server;
+  http_server::Bootstrap(server, "payments", http_server::MakeServerOptionsFromEnv("PAYMENTS", server_defaults));
+  security::ExposeMetrics(server, "payments");
+  security::MetricsRegistry::Instance().RegisterCollector("payments", [config]() {
+    return persistence::RenderPoolMetrics(config->Stats(), "payments") +
+           persistence::RenderRoutingMetrics(config->Routing(), "payments");
+  });
+  security::MetricsRegistry::Instance().RegisterCollector(
+      "payments", [&audit]() { return audit.RenderMetrics("payments"); });
 
   server.Get("/health", [](const httplib::Request &, httplib::Response &res) {
     SendJson(res, json{{"status", "ok"}});
@@ -75,6 +148,10 @@ int main() {
   server.Post("/escrow", [&](const httplib::Request &req, httplib::Response &res) {
     try {
       const auto body = json::parse(req.body);
+      const auto actor_id = ReadActorId(body, res);
+      if (!actor_id) {
+        return;
+      }
       persistence::EscrowCreateInput input;
       input.job_id = body.value("jobId", "");
       input.milestone_id = body.value("milestoneId", "");
@@ -85,10 +162,10 @@ int main() {
         return;
       }
       const auto record = escrow.CreateEscrow(input);
-      audit.RecordEvent(body.value("actorId", ""), "escrow_created", record.job_id,
+      audit.RecordEvent(*actor_id, "escrow_created", record.job_id,
                         json{{"escrowId", record.id}, {"amountCents", record.amount_authorised_cents}}, req.remote_addr);
       logger.Info("escrow_created", json{{"escrowId", record.id}, {"jobId", record.job_id}}.dump());
-      SendJson(res, EscrowToJson(record), 201);
+      SendJsonBody(res, RenderEscrow(record), 201);
     } catch (const std::exception &ex) {
       logger.Error("create_escrow_failed", ex.what());
       SendJson(res, json{{"error", "create_escrow_failed"}}, 500);
@@ -97,29 +174,87 @@ int main() {
 
   server.Post(R"(/escrow/(.+)/release)", [&](const httplib::Request &req, httplib::Response &res) {
     try {
+      const auto idempotency_key = RequireIdempotencyKey(req, res);
+      if (idempotency_key.empty()) {
+        return;
+      }
       const auto body = json::parse(req.body);
+      const auto actor_id = ReadActorId(body, res);
+      if (!actor_id) {
+        return;
+      }
       const std::string escrow_id = req.matches[1];
       const int amount = body.value("amountCents", 0);
       if (amount <= 0) {
         SendJson(res, json{{"error", "invalid_amount"}}, 400);
         return;
       }
-      escrow.ReleaseFunds(escrow_id, amount);
-      audit.RecordEvent(body.value("actorId", ""), "escrow_released", escrow_id,
-                        json{{"amountCents", amount}}, req.remote_addr);
-      const auto updated = escrow.GetById(escrow_id);
-      if (!updated) {
-        SendJson(res, json{{"error", "not_found"}}, 404);
+      const auto result = escrow.ReleaseFunds(escrow_id, amount, idempotency_key);
+      if (SendReleaseRefusal(res, result.outcome)) {
         return;
       }
-      logger.Info("escrow_released", json{{"escrowId", escrow_id}, {"amountCents", amount}}.dump());
-      SendJson(res, EscrowToJson(*updated));
+      if (result.outcome == persistence::EscrowReleaseOutcome::kReplayed) {
+        res.set_header("Idempotent-Replayed", "true");
+      } else {
+        audit.RecordEvent(*actor_id, "escrow_released", escrow_id,
+                          json{{"amountCents", amount}, {"idempotencyKey", idempotency_key}}, req.remote_addr);
+        logger.Info("escrow_released", json{{"escrowId", escrow_id}, {"amountCents", amount}}.dump());
+      }
+      SendJsonBody(res, RenderEscrow(*result.record));
     } catch (const std::exception &ex) {
       logger.Error("release_escrow_failed", ex.what());
       SendJson(res, json{{"error", "release_escrow_failed"}}, 500);
     }
   });
 
+  // Settles a job: releases whatever is still held on each of its milestones in one transaction.
+  server.Post(R"(/jobs/([^/]+)/escrow/release)", [&](const httplib::Request &req, httplib::Response &res) {
+    try {
+      const auto idempotency_key = RequireIdempotencyKey(req, res);
+      if (idempotency_key.empty()) {
+        return;
+      }
+      const auto body = req.body.empty() ? json::object() : json::parse(req.body);
+      const auto actor_id = ReadActorId(body, res);
+      if (!actor_id) {
+        return;
+      }
+      const std::string job_id = req.matches[1];
+      const auto result = escrow.ReleaseForJob(job_id, idempotency_key);
+      if (SendReleaseRefusal(res, result.outcome)) {
+        return;
+      }
+      if (result.outcome == persistence::EscrowReleaseOutcome::kReplayed) {
+        res.set_header("Idempotent-Replayed", "true");
+      } else {
+        json escrow_ids = json::array();
+        for (const auto &record : result.records) {
+          escrow_ids.push_back(record.id);
+        }
+        audit.RecordEvent(*actor_id, "job_escrow_released", job_id,
+                          json{{"escrowIds", std::move(escrow_ids)},
+                               {"amountCents", result.released_cents},
+                               {"idempotencyKey", idempotency_key}},
+                          req.remote_addr);
+        logger.Info("job_escrow_released", json{{"jobId", job_id},
+                                                {"escrowCount", result.records.size()},
+                                                {"amountCents", result.released_cents}}.dump());
+      }
+      std::string response;
+      json_writer::Writer out(response);
+      out.Reserve(64 + result.records.size() * 320);
+      out.BeginObject().Field("jobId", job_id).Field("releasedCents", result.released_cents).Key("escrow").BeginArray();
+      for (const auto &record : result.records) {
+        WriteEscrow(out, record);
+      }
+      out.EndArray().EndObject();
+      SendJsonBody(res, std::move(response));
+    } catch (const std::exception &ex) {
+      logger.Error("release_job_escrow_failed", ex.what());
+      SendJson(res, json{{"error", "release_job_escrow_failed"}}, 500);
+    }
+  });
+
   server.Get(R"(/escrow/(.+))", [&](const httplib::Request &req, httplib::Response &res) {
     try {
       const auto record = escrow.GetById(req.matches[1]);
@@ -127,7 +262,7 @@ int main() {
         SendJson(res, json{{"error", "not_found"}}, 404);
         return;
       }
-      SendJson(res, EscrowToJson(*record));
+      SendJsonBody(res, RenderEscrow(*record));
     } catch (const std::exception &ex) {
       logger.Error("get_escrow_failed", ex.what());
       SendJson(res, json{{"error", "get_escrow_failed"}}, 500);
@@ -137,11 +272,15 @@ int main() {
   server.Get(R"(/jobs/(.+)/escrow)", [&](const httplib::Request &req, httplib::Response &res) {
     try {
       const auto records = escrow.ListForJob(req.matches[1]);
-      json array = json::array();
+      std::string body;
+      json_writer::Writer out(body);
+      out.Reserve(16 + records.size() * 320);
+      out.BeginObject().Key("escrow").BeginArray();
       for (const auto &record : records) {
-        array.push_back(EscrowToJson(record));
+        WriteEscrow(out, record);
       }
-      SendJson(res, json{{"escrow", array}});
+      out.EndArray().EndObject();
+      SendJsonBody(res, std::move(body));
     } catch (const std::exception &ex) {
       logger.Error("list_escrow_failed", ex.what());
       SendJson(res, json{{"error", "list_escrow_failed"}}, 500);
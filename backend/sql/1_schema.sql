@@ -64,6 +64,15 @@ create table if not exists escrow_payments (
   provider_ref text, status text, created_at timestamptz default now()
 );
 
+-- One row per escrow release request, keyed by the client's Idempotency-Key. Single releases record the
+-- escrow and amount; job-wide settlements record only the job.
+create table if not exists escrow_release_requests (
+  idempotency_key text primary key,
+  escrow_id uuid references escrow_payments(id) on delete cascade,
+  job_id uuid references jobs(id) on delete cascade,
+  amount_cents int, created_at timestamptz default now()
+);
+
 create table if not exists messages (
   id uuid primary key default gen_random_uuid(),
   job_id uuid references jobs(id) on delete cascade,
@@ -76,7 +85,8 @@ create table if not exists documents (
   id uuid primary key default gen_random_uuid(),
   job_id uuid references jobs(id) on delete cascade,
   doc_type text, url text, checksum text, uploaded_by uuid references users(id),
-  version int default 1, created_at timestamptz default now()
+  version int default 1, created_at timestamptz default now(),
+  scan_status text not null default 'clean'
 );
 
 create table if not exists job_templates (
@@ -119,3 +129,18 @@ create table if not exists audit_logs (
   id bigserial primary key,
   actor uuid, action text, subject text, details jsonb, ip text, created_at timestamptz default now()
 );
+
+-- Keyset pagination on (created_at, id), newest first.
+create index if not exists jobs_customer_created_idx on jobs(customer_id, created_at desc, id desc);
+create index if not exists jobs_conveyancer_created_idx on jobs(conveyancer_id, created_at desc, id desc);
+create index if not exists messages_job_created_idx on messages(job_id, created_at desc, id desc);
+create index if not exists documents_job_created_idx on documents(job_id, created_at desc, id desc);
+-- Quarantined uploads still waiting for a virus scan. Databases created before scanning existed
+-- lack the column, which create table if not exists leaves alone.
+alter table documents add column if not exists scan_status text not null default 'clean';
+create index if not exists documents_pending_scan_idx on documents(created_at) where scan_status = 'pending';
+
+-- Escrow listing and job-wide settlement.
+create index if not exists escrow_payments_job_created_idx on escrow_payments(job_id, created_at desc);
+-- What a job-wide settlement released (amount_cents holds its total), so a replay answers with the same escrows.
+alter table escrow_release_requests add column if not exists released_escrow_ids uuid[];
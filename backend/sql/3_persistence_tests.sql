@@ -5,3 +5,7 @@ select 'auth_credentials_exists' as check_name,
        (select count(*) from information_schema.tables where table_name = 'auth_credentials') as table_count;
 select 'conveyancer_profiles_services_jsonb' as check_name,
        (select data_type from information_schema.columns where table_name = 'conveyancer_profiles' and column_name = 'services') as data_type;
+select 'escrow_release_requests_exists' as check_name,
+       (select count(*) from information_schema.tables where table_name = 'escrow_release_requests') as table_count;
+select 'escrow_release_requests_released_escrow_ids' as check_name,
+       (select count(*) from information_schema.columns where table_name = 'escrow_release_requests' and column_name = 'released_escrow_ids') as column_count;
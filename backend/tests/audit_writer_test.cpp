@@ -0,0 +1,204 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../common/persistence/audit_writer.h"
+
+#include "../common/persistence/audit_writer.cpp"
+
+namespace {
+
+class RecordingSink {
+ public:
+  void operator()(const std::vector<persistence::AuditEvent> &events) {
+    if (fail) {
+      throw std::runtime_error("database unavailable");
+    }
+    for (const auto &event : events) {
+      if (!reject_subject.empty() && event.subject == reject_subject) {
+        throw persistence::RejectedAuditEvent("invalid input syntax for type uuid");
+      }
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    batches_.push_back(events.size());
+    for (const auto &event : events) {
+      subjects_.push_back(event.subject);
+      events_.push_back(event);
+    }
+  }
+
+  std::vector<persistence::AuditEvent> Events() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return events_;
+  }
+
+  std::vector<std::string> Subjects() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return subjects_;
+  }
+
+  std::vector<std::size_t> Batches() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return batches_;
+  }
+
+  std::atomic<bool> fail{false};
+  std::string reject_subject;
+
+ private:
+  std::mutex mutex_;
+  std::vector<std::size_t> batches_;
+  std::vector<std::string> subjects_;
+  std::vector<persistence::AuditEvent> events_;
+};
+
+bool WaitUntil(const std::function<bool()> &condition) {
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (condition()) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return false;
+}
+
+std::filesystem::path TempSpillPath(const std::string &name) {
+  const auto path = std::filesystem::temp_directory_path() / (name + ".spill");
+  std::filesystem::remove(path);
+  return path;
+}
+
+}  // namespace
+
+TEST(AuditWriterTest, EventJsonRoundTripsWithNullOptionalFields) {
+  const persistence::AuditEvent event{"", "login", "acct-1", {{"email", "a@example.com"}}, "", ""};
+  const auto value = persistence::detail::AuditEventToJson(event);
+  EXPECT_TRUE(value["actor"].is_null());
+  EXPECT_TRUE(value["ip"].is_null());
+  EXPECT_TRUE(value["occurred_at"].is_null());
+  const auto parsed = persistence::detail::AuditEventFromJson(value);
+  EXPECT_EQ(parsed.action, "login");
+  EXPECT_EQ(parsed.subject, "acct-1");
+  EXPECT_EQ(parsed.details["email"], "a@example.com");
+  EXPECT_TRUE(parsed.actor_id.empty());
+}
+
+TEST(AuditWriterTest, WritesInOrderedBatchesAndFlushesOnShutdown) {
+  RecordingSink sink;
+  persistence::AuditWriterOptions options;
+  options.batch_size = 3;
+  options.max_latency = std::chrono::seconds(1);
+  {
+    persistence::AsyncAuditWriter writer(std::ref(sink), options);
+    for (int i = 0; i < 7; ++i) {
+      writer.RecordEvent("", "job_created", std::to_string(i), nlohmann::json::object());
+    }
+  }
+  const auto subjects = sink.Subjects();
+  ASSERT_EQ(subjects.size(), 7u);
+  for (int i = 0; i < 7; ++i) {
+    EXPECT_EQ(subjects[i], std::to_string(i));
+  }
+  for (const auto size : sink.Batches()) {
+    EXPECT_LE(size, 3u);
+  }
+}
+
+TEST(AuditWriterTest, FlushesPartialBatchAfterMaxLatency) {
+  RecordingSink sink;
+  persistence::AuditWriterOptions options;
+  options.batch_size = 100;
+  options.max_latency = std::chrono::milliseconds(20);
+  persistence::AsyncAuditWriter writer(std::ref(sink), options);
+  writer.RecordEvent("", "login", "acct-1", nlohmann::json::object());
+  EXPECT_TRUE(WaitUntil([&]() { return sink.Subjects().size() == 1; }));
+}
+
+TEST(AuditWriterTest, SpillsWhileSinkFailsAndReplaysOnRecovery) {
+  RecordingSink sink;
+  sink.fail = true;
+  persistence::AuditWriterOptions options;
+  options.max_latency = std::chrono::milliseconds(1);
+  options.retry_interval = std::chrono::milliseconds(20);
+  options.spill_path = TempSpillPath("audit_writer_test");
+  persistence::AsyncAuditWriter writer(std::ref(sink), options);
+  writer.RecordEvent("", "milestone_created", "a", nlohmann::json::object());
+  writer.RecordEvent("", "milestone_created", "b", nlohmann::json::object());
+  ASSERT_TRUE(WaitUntil([&]() {
+    return writer.RenderMetrics("jobs").find("outcome=\"spilled\"} 2") != std::string::npos;
+  }));
+  EXPECT_TRUE(std::filesystem::exists(options.spill_path));
+
+  sink.fail = false;
+  ASSERT_TRUE(WaitUntil([&]() { return sink.Subjects().size() == 2; }));
+  EXPECT_EQ(sink.Subjects(), (std::vector<std::string>{"a", "b"}));
+  EXPECT_TRUE(WaitUntil([&]() {
+    return writer.RenderMetrics("jobs").find("outcome=\"replayed\"} 2") != std::string::npos;
+  }));
+  EXPECT_FALSE(std::filesystem::exists(options.spill_path));
+}
+
+TEST(AuditWriterTest, ReplaysSpillLeftByPreviousRun) {
+  const auto path = TempSpillPath("audit_writer_restart_test");
+  {
+    std::ofstream out(path);
+    out << persistence::detail::AuditEventToJson({"", "escrow_released", "e-1", {}, "", ""}).dump() << '\n';
+  }
+  RecordingSink sink;
+  persistence::AuditWriterOptions options;
+  options.retry_interval = std::chrono::milliseconds(10);
+  options.spill_path = path;
+  persistence::AsyncAuditWriter writer(std::ref(sink), options);
+  EXPECT_TRUE(WaitUntil([&]() { return sink.Subjects() == std::vector<std::string>{"e-1"}; }));
+}
+
+TEST(AuditWriterTest, RejectedEventDoesNotHoldBackItsBatch) {
+  RecordingSink sink;
+  sink.reject_subject = "poison";
+  persistence::AuditWriterOptions options;
+  options.batch_size = 3;
+  options.max_latency = std::chrono::seconds(1);
+  options.spill_path = TempSpillPath("audit_writer_reject_test");
+  {
+    persistence::AsyncAuditWriter writer(std::ref(sink), options);
+    writer.RecordEvent("", "milestone_created", "a", nlohmann::json::object());
+    writer.RecordEvent("", "milestone_created", "poison", nlohmann::json::object());
+    writer.RecordEvent("", "milestone_created", "b", nlohmann::json::object());
+    ASSERT_TRUE(WaitUntil([&]() { return sink.Subjects().size() == 2; }));
+    const auto metrics = writer.RenderMetrics("jobs");
+    EXPECT_NE(metrics.find("outcome=\"rejected\"} 1"), std::string::npos);
+    EXPECT_NE(metrics.find("outcome=\"written\"} 2"), std::string::npos);
+  }
+  EXPECT_EQ(sink.Subjects(), (std::vector<std::string>{"a", "b"}));
+  EXPECT_FALSE(std::filesystem::exists(options.spill_path));
+}
+
+TEST(AuditWriterTest, StampsEventsWhenRecordedAndKeepsMalformedActorsOutOfTheUuidColumn) {
+  RecordingSink sink;
+  persistence::AuditWriterOptions options;
+  options.max_latency = std::chrono::milliseconds(1);
+  {
+    persistence::AsyncAuditWriter writer(std::ref(sink), options);
+    writer.RecordEvent("5f0c6a9e-8d1b-4e3a-9a55-2b7c1f0e9d01", "login", "a", nlohmann::json::object());
+    writer.RecordEvent("not-a-uuid", "login", "b", nlohmann::json::object());
+  }
+  const auto events = sink.Events();
+  ASSERT_EQ(events.size(), 2u);
+  EXPECT_EQ(events[0].actor_id, "5f0c6a9e-8d1b-4e3a-9a55-2b7c1f0e9d01");
+  EXPECT_FALSE(events[0].occurred_at.empty());
+  EXPECT_TRUE(events[1].actor_id.empty());
+  EXPECT_EQ(events[1].details["unverifiedActor"], "not-a-uuid");
+  const auto parsed =
+      persistence::detail::AuditEventFromJson(persistence::detail::AuditEventToJson(events[0]));
+  EXPECT_EQ(parsed.occurred_at, events[0].occurred_at);
+}
@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../common/codec.h"
+#include "../third_party/json.hpp"
+
+namespace {
+
+// Lengths straddle the 16 and 32 byte blocks so both the vector loops and the scalar tails run.
+const std::vector<std::size_t> kLengths = {0, 1, 2, 3, 4, 15, 16, 17, 31, 32, 33, 47, 48, 63, 64, 65, 100, 257, 1000};
+
+std::string RandomBytes(std::mt19937 &rng, std::size_t length) {
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::string out(length, '\0');
+  for (auto &ch : out) {
+    ch = static_cast<char>(byte(rng));
+  }
+  return out;
+}
+
+}  // namespace
+
+TEST(CodecTest, EscapesLikeNlohmannDumpAtEveryOffset) {
+  // Clean text with a single escapable byte moved through every position of a 70-byte string.
+  const std::string escapable = std::string("\"\\\b\f\n\r\t\x01\x1f", 9);
+  for (const char special : escapable) {
+    for (std::size_t at = 0; at < 70; ++at) {
+      std::string sample(70, 'x');
+      sample[at] = special;
+      EXPECT_EQ('"' + codec::EscapeJson(sample) + '"', nlohmann::json(sample).dump()) << at;
+    }
+  }
+  // 0x7f and 0x80+ pass through; the unsigned compare must not treat them as control bytes.
+  const std::string high = "caf\xc3\xa9 \x7f \xe2\x82\xac" + std::string(40, 'y') + "\xff";
+  EXPECT_EQ(codec::EscapeJson(high), high);
+}
+
+TEST(CodecTest, EscapeMatchesScalarOnRandomInput) {
+  std::mt19937 rng(7);
+  for (const auto length : kLengths) {
+    const std::string sample = RandomBytes(rng, length);
+    std::string expected;
+    codec::detail::AppendEscapedJsonScalar(expected, sample);
+    EXPECT_EQ(codec::EscapeJson(sample), expected) << length;
+  }
+}
+
+TEST(CodecTest, HexRoundTripsAndMatchesScalar) {
+  std::mt19937 rng(11);
+  for (const auto length : kLengths) {
+    const std::string bytes = RandomBytes(rng, length);
+    const std::string hex = codec::HexEncode(bytes);
+    std::string expected(length * 2, '\0');
+    codec::detail::HexEncodeScalar(expected.data(), reinterpret_cast<const unsigned char *>(bytes.data()), length);
+    EXPECT_EQ(hex, expected) << length;
+
+    std::string decoded;
+    ASSERT_TRUE(codec::HexDecode(hex, decoded)) << length;
+    EXPECT_EQ(decoded, bytes);
+    std::string upper = hex;
+    for (auto &ch : upper) {
+      ch = static_cast<char>(std::toupper(static_cast<unsigned char>(ch)));
+    }
+    ASSERT_TRUE(codec::HexDecode(upper, decoded)) << length;
+    EXPECT_EQ(decoded, bytes);
+  }
+  EXPECT_EQ(codec::HexEncode("\x00\x9f\xfa", 3), "009ffa");
+}
+
+TEST(CodecTest, HexRejectsOddLengthsAndForeignCharacters) {
+  std::vector<unsigned char> out;
+  EXPECT_FALSE(codec::HexDecode("abc", out));
+  // A bad digit anywhere inside a 32-character block or in the tail.
+  for (const char bad : {'g', 'G', '/', ':', '@', '`', ' ', '\0'}) {
+    for (std::size_t at = 0; at < 40; ++at) {
+      std::string hex(40, 'a');
+      hex[at] = bad;
+      EXPECT_FALSE(codec::HexDecode(hex, out)) << at << " " << static_cast<int>(bad);
+    }
+  }
+}
+
+TEST(CodecTest, IsUuidAcceptsOnlyTheCanonicalForm) {
+  EXPECT_TRUE(codec::IsUuid("5f0c6a9e-8d1b-4e3a-9a55-2b7c1f0e9d01"));
+  EXPECT_TRUE(codec::IsUuid("5F0C6A9E-8D1B-4E3A-9A55-2B7C1F0E9D01"));
+  EXPECT_FALSE(codec::IsUuid(""));
+  EXPECT_FALSE(codec::IsUuid("x"));
+  EXPECT_FALSE(codec::IsUuid("5f0c6a9e8d1b4e3a9a552b7c1f0e9d01"));
+  EXPECT_FALSE(codec::IsUuid("5f0c6a9e-8d1b-4e3a-9a55-2b7c1f0e9d0z"));
+  EXPECT_FALSE(codec::IsUuid("5f0c6a9e-8d1b-4e3a-9a55_2b7c1f0e9d01"));
+  EXPECT_FALSE(codec::IsUuid("5f0c6a9e-8d1b-4e3a-9a55-2b7c1f0e9d01 "));
+}
+
+TEST(CodecTest, Base64MatchesRfc4648Vectors) {
+  const std::vector<std::pair<std::string, std::string>> vectors = {
+      {"", ""}, {"f", "Zg=="}, {"fo", "Zm8="}, {"foo", "Zm9v"}, {"foob", "Zm9vYg=="}, {"fooba", "Zm9vYmE="},
+      {"foobar", "Zm9vYmFy"}};
+  for (const auto &[plain, encoded] : vectors) {
+    EXPECT_EQ(codec::Base64Encode(plain), encoded);
+    std::string decoded;
+    ASSERT_TRUE(codec::Base64Decode(encoded, decoded)) << encoded;
+    EXPECT_EQ(decoded, plain);
+  }
+  EXPECT_EQ(codec::Base64Encode("\xfb\xff", codec::Base64Alphabet::kUrl), "-_8");
+  EXPECT_EQ(codec::Base64Encode("\xfb\xff"), "+/8=");
+}
+
+TEST(CodecTest, Base64RoundTripsAcrossBlockBoundaries) {
+  std::mt19937 rng(13);
+  for (const auto alphabet : {codec::Base64Alphabet::kStandard, codec::Base64Alphabet::kUrl}) {
+    for (const auto length : kLengths) {
+      const std::string bytes = RandomBytes(rng, length);
+      const std::string encoded = codec::Base64Encode(bytes, alphabet);
+      std::vector<unsigned char> decoded;
+      ASSERT_TRUE(codec::Base64Decode(encoded, decoded, alphabet)) << length;
+      EXPECT_EQ(std::string(decoded.begin(), decoded.end()), bytes) << length;
+    }
+  }
+  // Long enough for several vector blocks, decoded without its padding as well.
+  const std::string bytes = RandomBytes(rng, 4097);
+  std::string encoded = codec::Base64Encode(bytes);
+  std::string decoded;
+  ASSERT_TRUE(codec::Base64Decode(encoded, decoded));
+  EXPECT_EQ(decoded, bytes);
+  encoded.erase(encoded.find('='));
+  ASSERT_TRUE(codec::Base64Decode(encoded, decoded));
+  EXPECT_EQ(decoded, bytes);
+}
+
+TEST(CodecTest, Base64RejectsMalformedInput) {
+  std::string out;
+  EXPECT_FALSE(codec::Base64Decode("Zm9vY", out));
+  EXPECT_FALSE(codec::Base64Decode("Zg=a", out));
+  EXPECT_FALSE(codec::Base64Decode("====", out));
+  EXPECT_FALSE(codec::Base64Decode("Zm9v\nYmFy", out));
+  EXPECT_FALSE(codec::Base64Decode("-_8", out));
+  EXPECT_FALSE(codec::Base64Decode("+/8", out, codec::Base64Alphabet::kUrl));
+  // A foreign character in each position of a string long enough for the vector loops.
+  const std::string valid = codec::Base64Encode(std::string(96, 'z'));
+  for (std::size_t at = 0; at < valid.size(); ++at) {
+    std::string sample = valid;
+    sample[at] = '*';
+    EXPECT_FALSE(codec::Base64Decode(sample, out)) << at;
+  }
+}
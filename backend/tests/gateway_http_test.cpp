@@ -17,8 +17,63 @@ TEST(HttpUtilsTest, ResolveIdentityPortParsesInteger) {
   EXPECT_EQ(ResolveIdentityPort(nullptr), 7001);
 }
 
+TEST(HttpUtilsTest, ResolvePositiveIntFallsBackOnInvalidValues) {
+  EXPECT_EQ(ResolvePositiveInt("16", 8), 16);
+  EXPECT_EQ(ResolvePositiveInt("0", 8), 8);
+  EXPECT_EQ(ResolvePositiveInt("-3", 8), 8);
+  EXPECT_EQ(ResolvePositiveInt("lots", 8), 8);
+  EXPECT_EQ(ResolvePositiveInt(nullptr, 8), 8);
+}
+
 TEST(HttpUtilsTest, ForwardQueryStringEncodesParameters) {
   httplib::Params params = {{"state", "New South Wales"}, {"page", "1"}, {"empty", ""}};
   const auto encoded = ForwardQueryString(params);
   EXPECT_EQ(encoded, "empty&page=1&state=New%20South%20Wales");
 }
+
+TEST(HttpUtilsTest, ResolveServiceAddressParsesServiceUrls) {
+  const auto jobs = ResolveServiceAddress("http://jobs:9002", "127.0.0.1", 8082);
+  EXPECT_EQ(jobs.host, "jobs");
+  EXPECT_EQ(jobs.port, 9002);
+  const auto no_port = ResolveServiceAddress("https://payments.internal/api", "127.0.0.1", 8083);
+  EXPECT_EQ(no_port.host, "payments.internal");
+  EXPECT_EQ(no_port.port, 8083);
+  const auto fallback = ResolveServiceAddress(nullptr, "127.0.0.1", 8083);
+  EXPECT_EQ(fallback.host, "127.0.0.1");
+  EXPECT_EQ(fallback.port, 8083);
+}
+
+TEST(HttpUtilsTest, StitchJobDetailAddsEscrowOrNull) {
+  const std::string detail = R"({"job":{"id":"j1"},"milestones":[],"documents":[],"messages":[]})";
+  const std::string escrow = R"({"escrow":[{"id":"e1"}]})";
+  const auto stitched = nlohmann::json::parse(StitchJobDetail(detail, &escrow));
+  EXPECT_EQ(stitched["job"]["id"], "j1");
+  EXPECT_EQ(stitched["escrow"][0]["id"], "e1");
+
+  const auto unavailable = nlohmann::json::parse(StitchJobDetail(detail, nullptr));
+  EXPECT_TRUE(unavailable["escrow"].is_null());
+  const std::string garbage = "<html>";
+  EXPECT_TRUE(nlohmann::json::parse(StitchJobDetail(detail, &garbage))["escrow"].is_null());
+}
+
+TEST(HttpUtilsTest, UpstreamCallsCarryConditionalsAndRelayReplays) {
+  httplib::Request req;
+  req.set_header("X-API-Key", "caller-key");
+  req.set_header("If-None-Match", "\"abc-gzip\"");
+  req.set_header("Idempotency-Key", "release-1");
+  const auto headers = UpstreamHeaders(req);
+  EXPECT_EQ(headers.find("If-None-Match")->second, "\"abc-gzip\"");
+  EXPECT_EQ(headers.find("Idempotency-Key")->second, "release-1");
+  EXPECT_EQ(headers.find("X-API-Key")->second, security::ExpectedApiKey());
+
+  httplib::Response upstream;
+  upstream.status = 200;
+  upstream.set_header("Idempotent-Replayed", "true");
+  upstream.set_header("X-Internal", "hidden");
+  upstream.set_content(R"({"released":[]})", "application/json");
+  httplib::Response res;
+  Relay(upstream, res);
+  EXPECT_EQ(res.get_header_value("Idempotent-Replayed"), "true");
+  EXPECT_FALSE(res.has_header("X-Internal"));
+  EXPECT_EQ(res.body, upstream.body);
+}
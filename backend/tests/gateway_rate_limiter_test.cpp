@@ -0,0 +1,298 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../gateway/src/rate_limiter.h"
+#include "../gateway/src/redis_rate_store.h"
+
+#include "../gateway/src/http_utils.cpp"
+#include "../gateway/src/rate_limiter.cpp"
+#include "../gateway/src/redis_rate_store.cpp"
+#include "../common/redis_client.cpp"
+
+namespace {
+
+using Clock = gateway::RateLimiter::Clock;
+using std::chrono::milliseconds;
+
+// Redis stand-in that runs the rate script's logic itself: SCRIPT LOAD answers a fixed sha and
+// EVALSHA applies Gcra() to a per-key TAT on its own clock. Counts EVALSHA calls.
+class FakeRedis {
+ public:
+  FakeRedis() {
+    fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ::bind(fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    ::listen(fd_, 16);
+    socklen_t length = sizeof(addr);
+    ::getsockname(fd_, reinterpret_cast<sockaddr *>(&addr), &length);
+    port_ = ntohs(addr.sin_port);
+    thread_ = std::thread([this]() { Serve(); });
+  }
+
+  ~FakeRedis() {
+    ::shutdown(fd_, SHUT_RDWR);
+    ::close(fd_);
+    thread_.join();
+  }
+
+  int Port() const { return port_; }
+  int Evaluations() const { return evaluations_.load(); }
+
+ private:
+  // One client at a time is enough: the store reuses an idle connection when it has one.
+  void Serve() {
+    while (true) {
+      const int client = ::accept(fd_, nullptr, nullptr);
+      if (client < 0) {
+        return;
+      }
+      redis::RespParser parser;
+      char buffer[4096];
+      ssize_t rc = 0;
+      while ((rc = ::recv(client, buffer, sizeof(buffer), 0)) > 0) {
+        parser.Feed(buffer, static_cast<std::size_t>(rc));
+        std::string replies;
+        while (auto command = parser.Next()) {
+          replies += Answer(command->elements);
+        }
+        ::send(client, replies.data(), replies.size(), MSG_NOSIGNAL);
+      }
+      ::close(client);
+    }
+  }
+
+  std::string Answer(const std::vector<redis::RespReply> &args) {
+    if (args.size() == 3 && args[0].text == "SCRIPT") {
+      return "$4\r\nsha1\r\n";
+    }
+    if (args.size() != 6 || args[0].text != "EVALSHA" || args[1].text != "sha1") {
+      return "-NOSCRIPT No matching script\r\n";
+    }
+    ++evaluations_;
+    const auto now = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count();
+    auto &tat = tats_[args[3].text];
+    const auto step = gateway::Gcra(tat, now, std::stoll(args[4].text), std::stoll(args[5].text));
+    if (step.allowed) {
+      tat = now + step.ahead_us;
+    }
+    return "*2\r\n:" + std::to_string(step.allowed ? 1 : 0) + "\r\n:" + std::to_string(step.ahead_us) + "\r\n";
+  }
+
+  int fd_ = -1;
+  int port_ = 0;
+  std::thread thread_;
+  std::atomic<int> evaluations_{0};
+  std::map<std::string, std::int64_t> tats_;
+};
+
+}  // namespace
+
+TEST(RateLimiterTest, ParsesLimitSpecs) {
+  const gateway::RateLimit fallback{5, 7, false};
+  auto limit = gateway::ParseRateLimit("0.2:10:shared", fallback);
+  EXPECT_DOUBLE_EQ(limit.per_second, 0.2);
+  EXPECT_EQ(limit.burst, 10u);
+  EXPECT_TRUE(limit.shared);
+
+  limit = gateway::ParseRateLimit("20:40", fallback);
+  EXPECT_DOUBLE_EQ(limit.per_second, 20);
+  EXPECT_EQ(limit.burst, 40u);
+  EXPECT_FALSE(limit.shared);
+
+  EXPECT_EQ(gateway::ParseRateLimit("0", fallback).per_second, 0);
+  for (const char *invalid : {"", "20", "20:", "20:0", "-1:5", "20:5:local", "abc:5"}) {
+    EXPECT_EQ(gateway::ParseRateLimit(invalid, fallback).burst, 7u) << invalid;
+  }
+  EXPECT_EQ(gateway::ParseRateLimit(nullptr, fallback).burst, 7u);
+}
+
+TEST(RateLimiterTest, AllowsBurstThenRefillsAtTheRate) {
+  gateway::RateLimiter limiter("ip", {10, 3}, 1024);
+  const auto now = Clock::now();
+
+  for (std::uint32_t expected : {2u, 1u, 0u}) {
+    const auto decision = limiter.Check("203.0.113.7", now);
+    EXPECT_TRUE(decision.allowed);
+    EXPECT_EQ(decision.limit, 3u);
+    EXPECT_EQ(decision.remaining, expected);
+  }
+  auto decision = limiter.Check("203.0.113.7", now);
+  EXPECT_FALSE(decision.allowed);
+  EXPECT_EQ(decision.retry_after, milliseconds(100));
+  EXPECT_EQ(decision.reset, milliseconds(300));
+
+  EXPECT_TRUE(limiter.Check("198.51.100.1", now).allowed);
+  EXPECT_FALSE(limiter.Check("203.0.113.7", now + milliseconds(99)).allowed);
+  EXPECT_TRUE(limiter.Check("203.0.113.7", now + milliseconds(100)).allowed);
+  decision = limiter.Check("203.0.113.7", now + milliseconds(1000));
+  EXPECT_TRUE(decision.allowed);
+  EXPECT_EQ(decision.remaining, 2u);
+
+  gateway::RateLimiter off("api_key", {}, 16);
+  EXPECT_FALSE(off.Enabled());
+  EXPECT_TRUE(off.Check("key", now).allowed);
+}
+
+TEST(RateLimiterTest, KeysInAFullTableNeverGetMoreThanTheirLimit) {
+  gateway::RateLimiter limiter("ip", {1, 2}, 64);
+  const auto now = Clock::now();
+  std::map<std::string, int> allowed;
+  for (int round = 0; round < 4; ++round) {
+    for (int key = 0; key < 1000; ++key) {
+      const auto name = "10.0." + std::to_string(key);
+      allowed[name] += limiter.Check(name, now).allowed ? 1 : 0;
+    }
+  }
+  for (const auto &[name, count] : allowed) {
+    EXPECT_LE(count, 2) << name;
+  }
+}
+
+TEST(RateLimiterTest, ConcurrentChecksTakeEachTokenOnce) {
+  gateway::RateLimiter limiter("ip", {1, 500}, 1024);
+  const auto now = Clock::now();
+  std::atomic<int> allowed{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < 200; ++i) {
+        if (limiter.Check("198.51.100.9", now).allowed) {
+          ++allowed;
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(allowed.load(), 500);
+}
+
+TEST(RateLimiterTest, SharedCheckOverridesOnlyWhatTheLocalBucketAllowed) {
+  int calls = 0;
+  std::optional<gateway::GcraStep> answer = gateway::GcraStep{false, 5000000};
+  const gateway::RateLimiter::SharedCheck shared = [&](std::string_view limiter, std::string_view key,
+                                                       std::int64_t interval_us, std::int64_t tolerance_us) {
+    ++calls;
+    EXPECT_EQ(limiter, "login_email");
+    EXPECT_EQ(key, "a@example.com");
+    EXPECT_EQ(interval_us, 1000000);
+    EXPECT_EQ(tolerance_us, 2000000);
+    return answer;
+  };
+  gateway::RateLimiter limiter("login_email", {1, 2, true}, 64, shared);
+  const auto now = Clock::now();
+
+  EXPECT_FALSE(limiter.Check("a@example.com", now).allowed);
+  answer.reset();
+  EXPECT_TRUE(limiter.Check("a@example.com", now).allowed);
+  EXPECT_FALSE(limiter.Check("a@example.com", now).allowed);
+  EXPECT_EQ(calls, 2);
+
+  gateway::RateLimiter local("ip", {1, 2}, 64, shared);
+  EXPECT_TRUE(local.Check("a@example.com", now).allowed);
+  EXPECT_EQ(calls, 2);
+
+  const auto metrics = gateway::RateLimiter::RenderMetrics({&limiter});
+  EXPECT_NE(metrics.find(R"(gateway_rate_limit_requests_total{limiter="login_email",outcome="allowed"} 1)"),
+            std::string::npos);
+  EXPECT_NE(metrics.find(R"(gateway_rate_limit_requests_total{limiter="login_email",outcome="limited"} 2)"),
+            std::string::npos);
+  EXPECT_NE(metrics.find(R"(gateway_rate_limit_shared_errors_total{limiter="login_email"} 1)"), std::string::npos);
+}
+
+TEST(RateLimiterTest, AdmitReportsTheTightestLimiterAndRejectsWith429) {
+  gateway::RateLimiter ip("ip", {10, 5}, 64);
+  gateway::RateLimiter login("login_ip", {0.5, 2}, 64);
+
+  httplib::Response res;
+  EXPECT_TRUE(gateway::Admit(res, {{&ip, "203.0.113.7"}, {&login, "203.0.113.7"}, {&login, ""}}));
+  EXPECT_EQ(res.get_header_value("X-RateLimit-Limit"), "2");
+  EXPECT_EQ(res.get_header_value("X-RateLimit-Remaining"), "1");
+  EXPECT_EQ(res.get_header_value("X-RateLimit-Reset"), "2");
+
+  EXPECT_TRUE(gateway::Admit(res, {{&ip, "203.0.113.7"}, {&login, "203.0.113.7"}}));
+  httplib::Response rejected;
+  EXPECT_FALSE(gateway::Admit(rejected, {{&ip, "203.0.113.7"}, {&login, "203.0.113.7"}}));
+  EXPECT_EQ(rejected.status, 429);
+  EXPECT_EQ(rejected.get_header_value("X-RateLimit-Remaining"), "0");
+  EXPECT_EQ(rejected.get_header_value("Retry-After"), "2");
+  EXPECT_NE(rejected.body.find("rate_limited"), std::string::npos);
+
+  httplib::Response untouched;
+  EXPECT_TRUE(gateway::Admit(untouched, {{&ip, ""}}));
+  EXPECT_FALSE(untouched.has_header("X-RateLimit-Limit"));
+}
+
+TEST(RateLimiterTest, ClientAddressTrustsOnlyTheConfiguredProxies) {
+  httplib::Request req;
+  req.remote_addr = "10.0.0.2";
+  req.set_header("X-Forwarded-For", "198.51.100.1, 203.0.113.7 ,10.0.0.1");
+
+  EXPECT_EQ(gateway::ClientAddress(req, 0), "10.0.0.2");
+  EXPECT_EQ(gateway::ClientAddress(req, 1), "10.0.0.1");
+  EXPECT_EQ(gateway::ClientAddress(req, 2), "203.0.113.7");
+  EXPECT_EQ(gateway::ClientAddress(req, 5), "198.51.100.1");
+
+  httplib::Request direct;
+  direct.remote_addr = "10.0.0.3";
+  EXPECT_EQ(gateway::ClientAddress(direct, 1), "10.0.0.3");
+}
+
+TEST(RedisRateStoreTest, ReplicasShareOneBucket) {
+  FakeRedis redis;
+  gateway::RedisRateStore store("127.0.0.1", redis.Port(), "");
+  const auto shared = [&store](std::string_view limiter, std::string_view key, std::int64_t interval_us,
+                               std::int64_t tolerance_us) {
+    return store.Check(limiter, key, interval_us, tolerance_us);
+  };
+  gateway::RateLimiter first("login_ip", {0.1, 3, true}, 64, shared);
+  gateway::RateLimiter second("login_ip", {0.1, 3, true}, 64, shared);
+
+  int allowed = 0;
+  for (int i = 0; i < 4; ++i) {
+    allowed += first.Check("203.0.113.7").allowed ? 1 : 0;
+    allowed += second.Check("203.0.113.7").allowed ? 1 : 0;
+  }
+  EXPECT_EQ(allowed, 3);
+  // Each replica only asks Redis while its own bucket still has tokens.
+  EXPECT_EQ(redis.Evaluations(), 6);
+}
+
+TEST(RedisRateStoreTest, UnreachableRedisLeavesTheLocalDecision) {
+  int port = 0;
+  {
+    FakeRedis closed;
+    port = closed.Port();
+  }
+  gateway::RedisRateStore store("127.0.0.1", port, "");
+  EXPECT_TRUE(store.Configured());
+  EXPECT_FALSE(store.Check("login_ip", "203.0.113.7", 1000000, 3000000));
+  EXPECT_FALSE(gateway::RedisRateStore("", 6379, "").Configured());
+
+  gateway::RateLimiter limiter("login_ip", {1, 1, true}, 64,
+                               [&store](std::string_view limiter_name, std::string_view key, std::int64_t interval_us,
+                                        std::int64_t tolerance_us) {
+                                 return store.Check(limiter_name, key, interval_us, tolerance_us);
+                               });
+  EXPECT_TRUE(limiter.Check("203.0.113.7").allowed);
+  EXPECT_FALSE(limiter.Check("203.0.113.7").allowed);
+  EXPECT_NE(gateway::RateLimiter::RenderMetrics({&limiter})
+                .find(R"(gateway_rate_limit_shared_errors_total{limiter="login_ip"} 1)"),
+            std::string::npos);
+}
@@ -0,0 +1,190 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../gateway/src/profile_search.h"
+#include "../gateway/src/response_cache.h"
+
+#include "../gateway/src/http_utils.cpp"
+#include "../gateway/src/profile_search.cpp"
+#include "../gateway/src/rate_limiter.cpp"
+#include "../gateway/src/response_cache.cpp"
+#include "../gateway/src/upstream_pool.cpp"
+
+namespace {
+
+gateway::ResponseCache MakeCache(std::size_t capacity, std::chrono::milliseconds ttl) {
+  gateway::ResponseCacheOptions options;
+  options.name = "profile_search";
+  options.capacity = capacity;
+  options.ttl = ttl;
+  return gateway::ResponseCache(options);
+}
+
+gateway::ResponseCache::Value Response(int status, std::string body) {
+  return std::make_shared<const gateway::CachedResponse>(
+      gateway::CachedResponse{status, "application/json", std::move(body)});
+}
+
+}  // namespace
+
+TEST(ResponseCacheTest, ServesRepeatsUntilTtlExpires) {
+  auto cache = MakeCache(8, std::chrono::milliseconds(1000));
+  int fetches = 0;
+  const auto fetch = [&]() { return Response(200, "r" + std::to_string(++fetches)); };
+  const auto now = gateway::ResponseCache::Clock::now();
+  EXPECT_EQ(cache.GetOrFetch("buyer /profiles/search?q=smith", fetch, now)->body, "r1");
+  EXPECT_EQ(cache.GetOrFetch("buyer /profiles/search?q=smith", fetch, now + std::chrono::milliseconds(999))->body,
+            "r1");
+  EXPECT_EQ(cache.GetOrFetch("seller /profiles/search?q=smith", fetch, now)->body, "r2");
+  EXPECT_EQ(cache.GetOrFetch("buyer /profiles/search?q=smith", fetch, now + std::chrono::milliseconds(1000))->body,
+            "r3");
+  EXPECT_EQ(fetches, 3);
+  const auto metrics = cache.RenderMetrics();
+  EXPECT_NE(metrics.find("gateway_response_cache_requests_total{cache=\"profile_search\",outcome=\"hit\"} 1"),
+            std::string::npos);
+  EXPECT_NE(metrics.find("gateway_response_cache_evictions_total{cache=\"profile_search\",reason=\"expired\"} 1"),
+            std::string::npos);
+}
+
+TEST(ResponseCacheTest, EvictsLeastRecentlyUsed) {
+  auto cache = MakeCache(2, std::chrono::milliseconds(60000));
+  int fetches = 0;
+  const auto fetch = [&]() { return Response(200, std::to_string(++fetches)); };
+  cache.GetOrFetch("a", fetch);
+  cache.GetOrFetch("b", fetch);
+  cache.GetOrFetch("a", fetch);
+  cache.GetOrFetch("c", fetch);
+  EXPECT_EQ(cache.Size(), 2u);
+  EXPECT_EQ(cache.GetOrFetch("a", fetch)->body, "1");
+  EXPECT_EQ(cache.GetOrFetch("b", fetch)->body, "4");
+  EXPECT_NE(cache.RenderMetrics().find("reason=\"capacity\"} 2"), std::string::npos);
+}
+
+TEST(ResponseCacheTest, DoesNotStoreFailures) {
+  auto cache = MakeCache(8, std::chrono::milliseconds(60000));
+  int fetches = 0;
+  EXPECT_EQ(cache.GetOrFetch("q", [&]() {
+    ++fetches;
+    return gateway::ResponseCache::Value();
+  }),
+            nullptr);
+  EXPECT_EQ(cache.GetOrFetch("q", [&]() { return Response(500 + fetches++, "{}"); })->status, 501);
+  EXPECT_THROW(cache.GetOrFetch("q", []() -> gateway::ResponseCache::Value { throw std::runtime_error("down"); }),
+               std::runtime_error);
+  EXPECT_EQ(cache.GetOrFetch("q", []() { return Response(200, "ok"); })->body, "ok");
+  EXPECT_EQ(cache.Size(), 1u);
+}
+
+TEST(ResponseCacheTest, CoalescesConcurrentMisses) {
+  auto cache = MakeCache(8, std::chrono::milliseconds(60000));
+  std::mutex mutex;
+  std::condition_variable released;
+  bool release = false;
+  std::atomic<int> fetches{0};
+  const auto fetch = [&]() {
+    ++fetches;
+    std::unique_lock<std::mutex> lock(mutex);
+    released.wait(lock, [&]() { return release; });
+    return Response(200, "shared");
+  };
+
+  std::vector<std::thread> callers;
+  std::atomic<int> served{0};
+  for (int i = 0; i < 8; ++i) {
+    callers.emplace_back([&]() {
+      if (cache.GetOrFetch("buyer /profiles/search?state=NSW", fetch)->body == "shared") {
+        ++served;
+      }
+    });
+  }
+  // Let the callers pile up behind the first fetch before it completes.
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    release = true;
+  }
+  released.notify_all();
+  for (auto &caller : callers) {
+    caller.join();
+  }
+  EXPECT_EQ(fetches.load(), 1);
+  EXPECT_EQ(served.load(), 8);
+}
+
+TEST(ResponseCacheTest, ProfileSearchPathKeepsOnlyIdentityParameters) {
+  EXPECT_EQ(gateway::ProfileSearchPath({}), "/profiles");
+  EXPECT_EQ(gateway::ProfileSearchPath({{"state", "NSW"}, {"q", "smith & co"}, {"page", "2"}, {"limit", ""}}),
+            "/profiles?q=smith%20%26%20co&state=NSW");
+  EXPECT_EQ(gateway::ProfileSearchPath({{"q", "a&limit=100"}}), "/profiles?q=a%26limit%3D100");
+}
+
+TEST(ResponseCacheTest, GatewaySearchIsServedByIdentityProfilesAndCached) {
+  std::atomic<int> searches{0};
+  std::mutex mutex;
+  std::string seen_query;
+  httplib::Server identity_server;
+  identity_server.Get("/profiles", [&](const httplib::Request &req, httplib::Response &res) {
+    ++searches;
+    std::lock_guard<std::mutex> lock(mutex);
+    seen_query = req.get_param_value("state") + "|" + req.get_param_value("q");
+    res.set_content(R"({"profiles":[{"id":"c1"}]})", "application/json");
+  });
+  identity_server.Get(R"(/profiles/(.+))", [](const httplib::Request &, httplib::Response &res) {
+    res.status = 404;
+    res.set_content(R"({"error":"not_found"})", "application/json");
+  });
+  const int identity_port = identity_server.bind_to_any_port("127.0.0.1");
+  std::thread identity_thread([&identity_server]() { identity_server.listen_after_bind(); });
+  identity_server.wait_until_ready();
+
+  gateway::UpstreamOptions upstream;
+  upstream.name = "identity";
+  upstream.host = "127.0.0.1";
+  upstream.port = identity_port;
+  gateway::UpstreamPool identity(upstream);
+  auto cache = MakeCache(8, std::chrono::milliseconds(60000));
+  gateway::RateLimiter ip("ip", {}, 64);
+  gateway::RateLimiter api_key("api_key", {}, 64);
+  gateway::RateLimiter login_ip("login_ip", {}, 64);
+  gateway::RateLimiter login_email("login_email", {}, 64);
+  const gateway::Admission admission({&ip, &api_key, &login_ip, &login_email}, 0);
+
+  httplib::Server gateway_server;
+  gateway_server.Get("/api/profiles/search", [&](const httplib::Request &req, httplib::Response &res) {
+    gateway::SearchProfiles(identity, cache, admission, req, res);
+  });
+  const int gateway_port = gateway_server.bind_to_any_port("127.0.0.1");
+  std::thread gateway_thread([&gateway_server]() { gateway_server.listen_after_bind(); });
+  gateway_server.wait_until_ready();
+
+  httplib::Client client("127.0.0.1", gateway_port);
+  client.set_default_headers({{"X-API-Key", security::ExpectedApiKey()}, {"X-Actor-Role", "buyer"}});
+  const auto first = client.Get("/api/profiles/search?state=NSW&q=smith");
+  ASSERT_TRUE(first);
+  EXPECT_EQ(first->status, 200);
+  EXPECT_NE(first->body.find("c1"), std::string::npos);
+  const auto repeat = client.Get("/api/profiles/search?q=smith&utm=x&state=NSW");
+  ASSERT_TRUE(repeat);
+  EXPECT_EQ(repeat->status, 200);
+  EXPECT_EQ(repeat->body, first->body);
+  EXPECT_EQ(searches.load(), 1);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT_EQ(seen_query, "NSW|smith");
+  }
+  EXPECT_EQ(cache.Size(), 1u);
+
+  gateway_server.stop();
+  gateway_thread.join();
+  identity_server.stop();
+  identity_thread.join();
+}
@@ -0,0 +1,320 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../gateway/src/route_table.h"
+
+#include "../gateway/src/http_utils.cpp"
+#include "../gateway/src/rate_limiter.cpp"
+#include "../gateway/src/route_table.cpp"
+#include "../gateway/src/upstream_pool.cpp"
+
+namespace {
+
+gateway::UpstreamOptions Upstream(const std::string &name, int port = 1) {
+  gateway::UpstreamOptions options;
+  options.name = name;
+  options.host = "127.0.0.1";
+  options.port = port;
+  return options;
+}
+
+// Upstream that answers every GET after a delay, echoing the path and recording traceparents.
+class SlowUpstream {
+ public:
+  explicit SlowUpstream(std::chrono::milliseconds delay) {
+    server_.Get(".*", [this, delay](const httplib::Request &req, httplib::Response &res) {
+      std::this_thread::sleep_for(delay);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        traceparents_.push_back(req.get_header_value("traceparent"));
+      }
+      res.set_content(nlohmann::json{{"path", req.path}}.dump(), "application/json");
+    });
+    port_ = server_.bind_to_any_port("127.0.0.1");
+    thread_ = std::thread([this]() { server_.listen_after_bind(); });
+    server_.wait_until_ready();
+  }
+
+  ~SlowUpstream() {
+    server_.stop();
+    thread_.join();
+  }
+
+  int Port() const { return port_; }
+  std::vector<std::string> Traceparents() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return traceparents_;
+  }
+
+ private:
+  httplib::Server server_;
+  int port_ = 0;
+  std::thread thread_;
+  std::mutex mutex_;
+  std::vector<std::string> traceparents_;
+};
+
+httplib::Result Answer(int status, const std::string &content_type, const std::string &body) {
+  auto response = std::make_unique<httplib::Response>();
+  response->status = status;
+  response->set_content(body, content_type);
+  return httplib::Result(std::move(response), httplib::Error::Success);
+}
+
+}  // namespace
+
+TEST(RouteTableTest, ParsesRouteSpecs) {
+  const auto routes = gateway::ParseRoutes(" /api/identity=identity, /api/jobs/=jobs:/jobs/ ,,/=payments");
+  ASSERT_EQ(routes.size(), 3u);
+  EXPECT_EQ(routes[0].prefix, "/api/identity");
+  EXPECT_EQ(routes[0].upstream, "identity");
+  EXPECT_EQ(routes[0].upstream_prefix, "");
+  EXPECT_EQ(routes[1].prefix, "/api/jobs");
+  EXPECT_EQ(routes[1].upstream_prefix, "/jobs");
+  EXPECT_EQ(routes[2].prefix, "/");
+
+  EXPECT_THROW(gateway::ParseRoutes("/api/jobs"), std::invalid_argument);
+  EXPECT_THROW(gateway::ParseRoutes("api/jobs=jobs"), std::invalid_argument);
+  EXPECT_THROW(gateway::ParseRoutes("/api/jobs="), std::invalid_argument);
+  EXPECT_THROW(gateway::ParseRoutes("/api/jobs=jobs:jobs"), std::invalid_argument);
+  EXPECT_TRUE(gateway::ParseRoutes("").empty());
+}
+
+TEST(RouteTableTest, ResolvesLongestPrefixOnSegmentBoundaries) {
+  gateway::UpstreamPool identity(Upstream("identity"));
+  gateway::UpstreamPool jobs(Upstream("jobs"));
+  gateway::UpstreamPool payments(Upstream("payments"));
+  const gateway::RouteTable routes(
+      gateway::ParseRoutes("/api/jobs=jobs:/jobs,/api/jobs/escrow=payments:/escrow,/api/identity=identity"),
+      {&identity, &jobs, &payments});
+
+  auto target = routes.Resolve("/api/jobs/7/documents?limit=5&cursor=a%2Bb");
+  ASSERT_TRUE(target);
+  EXPECT_EQ(target->upstream, &jobs);
+  EXPECT_EQ(target->path, "/jobs/7/documents?limit=5&cursor=a%2Bb");
+
+  target = routes.Resolve("/api/jobs/escrow/e-1/release");
+  ASSERT_TRUE(target);
+  EXPECT_EQ(target->upstream, &payments);
+  EXPECT_EQ(target->path, "/escrow/e-1/release");
+
+  target = routes.Resolve("/api/jobs?accountId=a");
+  ASSERT_TRUE(target);
+  EXPECT_EQ(target->path, "/jobs?accountId=a");
+
+  target = routes.Resolve("/api/identity");
+  ASSERT_TRUE(target);
+  EXPECT_EQ(target->upstream, &identity);
+  EXPECT_EQ(target->path, "/");
+
+  EXPECT_FALSE(routes.Resolve("/api/jobsearch"));
+  EXPECT_FALSE(routes.Resolve("/api/payments/escrow/e-1"));
+  EXPECT_FALSE(routes.Resolve("/api/identity/../jobs/7"));
+  EXPECT_TRUE(routes.Resolve("/api/identity/profiles/a..b"));
+
+  EXPECT_THROW(gateway::RouteTable(gateway::ParseRoutes("/api/billing=billing"), {&identity}),
+               std::invalid_argument);
+}
+
+TEST(RouteTableTest, ProxiedLoginsAreHeldToTheLoginLimits) {
+  std::atomic<int> password_checks{0};
+  httplib::Server identity_server;
+  identity_server.Post(R"(/(sessions/login|accounts/register))",
+                       [&password_checks](const httplib::Request &, httplib::Response &res) {
+                         ++password_checks;
+                         res.set_content(R"({"ok":true})", "application/json");
+                       });
+  const int identity_port = identity_server.bind_to_any_port("127.0.0.1");
+  std::thread identity_thread([&identity_server]() { identity_server.listen_after_bind(); });
+  identity_server.wait_until_ready();
+
+  gateway::UpstreamPool identity(Upstream("identity", identity_port));
+  gateway::UpstreamPool jobs(Upstream("jobs"));
+  const gateway::RouteTable routes(gateway::ParseRoutes("/api/identity=identity,/api/jobs=jobs:/jobs"),
+                                   {&identity, &jobs});
+  gateway::RateLimiter ip("ip", {}, 64);
+  gateway::RateLimiter api_key("api_key", {}, 64);
+  gateway::RateLimiter login_ip("login_ip", {0.01, 100}, 64);
+  gateway::RateLimiter login_email("login_email", {0.01, 2}, 64);
+  const gateway::Admission admission({&ip, &api_key, &login_ip, &login_email}, 0);
+
+  httplib::Server gateway_server;
+  gateway_server.Post(R"(/api/.*)", [&routes, &admission](const httplib::Request &req, httplib::Response &res) {
+    gateway::Proxy(routes, admission, req, res);
+  });
+  const int gateway_port = gateway_server.bind_to_any_port("127.0.0.1");
+  std::thread gateway_thread([&gateway_server]() { gateway_server.listen_after_bind(); });
+  gateway_server.wait_until_ready();
+
+  httplib::Client client("127.0.0.1", gateway_port);
+  client.set_default_headers({{"X-API-Key", security::ExpectedApiKey()}});
+  const auto post = [&client](const std::string &path, const std::string &email) {
+    const auto res = client.Post(path, nlohmann::json{{"email", email}, {"password", "guess"}}.dump(),
+                                 "application/json");
+    return res ? res->status : 0;
+  };
+  EXPECT_EQ(post("/api/identity/sessions/login", "owner@example.com"), 200);
+  EXPECT_EQ(post("/api/identity/sessions/login", "Owner@Example.com"), 200);
+  EXPECT_EQ(post("/api/identity/sessions/login", "owner@example.com"), 429);
+  // Escaping the path or signing up with the address draws on the same bucket.
+  EXPECT_EQ(post("/api/identity/sessions/log%69n", "owner@example.com"), 429);
+  EXPECT_EQ(post("/api/identity/accounts/register", "owner@example.com"), 429);
+  EXPECT_EQ(post("/api/identity/sessions/login", "other@example.com"), 200);
+  EXPECT_EQ(password_checks.load(), 3);
+
+  gateway::RouteTable::Target logout{&identity, "/sessions/logout"};
+  EXPECT_FALSE(gateway::ChecksPassword(logout));
+  gateway::RouteTable::Target elsewhere{&jobs, "/sessions/login"};
+  EXPECT_FALSE(gateway::ChecksPassword(elsewhere));
+
+  gateway_server.stop();
+  gateway_thread.join();
+  identity_server.stop();
+  identity_thread.join();
+}
+
+TEST(RouteTableTest, ProxyRefusesStreamsAndRawUploads) {
+  std::atomic<int> forwarded{0};
+  httplib::Server jobs_server;
+  const auto answer = [&forwarded](const httplib::Request &, httplib::Response &res) {
+    ++forwarded;
+    res.set_content(R"({"ok":true})", "application/json");
+  };
+  jobs_server.Get(".*", answer);
+  jobs_server.Post(".*", answer);
+  const int jobs_port = jobs_server.bind_to_any_port("127.0.0.1");
+  std::thread jobs_thread([&jobs_server]() { jobs_server.listen_after_bind(); });
+  jobs_server.wait_until_ready();
+
+  gateway::UpstreamPool jobs(Upstream("jobs", jobs_port));
+  const gateway::RouteTable routes(gateway::ParseRoutes("/api/jobs=jobs:/jobs"), {&jobs});
+  gateway::RateLimiter ip("ip", {}, 64);
+  gateway::RateLimiter api_key("api_key", {}, 64);
+  gateway::RateLimiter login_ip("login_ip", {}, 64);
+  gateway::RateLimiter login_email("login_email", {}, 64);
+  const gateway::Admission admission({&ip, &api_key, &login_ip, &login_email}, 0);
+
+  const auto proxy = [&routes, &admission](const std::string &method, const std::string &target,
+                                           const httplib::Headers &headers) {
+    httplib::Request req;
+    req.method = method;
+    req.target = target;
+    req.headers = headers;
+    req.set_header("X-API-Key", security::ExpectedApiKey());
+    httplib::Response res;
+    gateway::Proxy(routes, admission, req, res);
+    return res;
+  };
+  auto res = proxy("GET", "/api/jobs/7/events", {});
+  EXPECT_EQ(res.status, 406);
+  EXPECT_NE(res.body.find("event_stream_not_proxied"), std::string::npos);
+  EXPECT_EQ(proxy("GET", "/api/jobs/7/even%74s?since=abc", {}).status, 406);
+  EXPECT_EQ(proxy("GET", "/api/jobs/7/messages", {{"Accept", "text/event-stream"}}).status, 406);
+  res = proxy("POST", "/api/jobs/7/documents", {{"Content-Type", "application/pdf"}});
+  EXPECT_EQ(res.status, 415);
+  EXPECT_NE(res.body.find("upload_not_proxied"), std::string::npos);
+  EXPECT_EQ(forwarded.load(), 0);
+
+  EXPECT_EQ(proxy("POST", "/api/jobs/7/documents", {{"Content-Type", "application/json"}}).status, 200);
+  EXPECT_EQ(proxy("GET", "/api/jobs/7/documents", {}).status, 200);
+  EXPECT_EQ(proxy("GET", "/api/jobs/events", {}).status, 200);
+  EXPECT_EQ(forwarded.load(), 3);
+
+  jobs_server.stop();
+  jobs_thread.join();
+}
+
+TEST(RouteTableTest, FanoutWaitsForTheSlowestCallOnly) {
+  SlowUpstream jobs_server(std::chrono::milliseconds(200));
+  SlowUpstream payments_server(std::chrono::milliseconds(200));
+  gateway::UpstreamPool jobs(Upstream("jobs", jobs_server.Port()));
+  gateway::UpstreamPool payments(Upstream("payments", payments_server.Port()));
+
+  tracing::SpanContext caller;
+  caller.trace_id.fill(0xab);
+  caller.span_id.fill(0x01);
+  tracing::ContextScope scope(caller);
+
+  gateway::FanoutExecutor executor(2, 8);
+  const auto start = std::chrono::steady_clock::now();
+  const auto results = gateway::Fanout(
+      executor, {{&jobs, "/jobs/7/detail"}, {&payments, "/jobs/7/escrow"}, {&jobs, "/jobs/7/milestones"}}, {});
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+
+  ASSERT_EQ(results.size(), 3u);
+  for (const auto &result : results) {
+    ASSERT_TRUE(result);
+    EXPECT_EQ(result->status, 200);
+  }
+  EXPECT_EQ(nlohmann::json::parse(results[0]->body)["path"], "/jobs/7/detail");
+  EXPECT_EQ(nlohmann::json::parse(results[1]->body)["path"], "/jobs/7/escrow");
+  EXPECT_EQ(nlohmann::json::parse(results[2]->body)["path"], "/jobs/7/milestones");
+  EXPECT_LT(elapsed, std::chrono::milliseconds(550));
+
+  auto traceparents = jobs_server.Traceparents();
+  const auto escrow = payments_server.Traceparents();
+  traceparents.insert(traceparents.end(), escrow.begin(), escrow.end());
+  ASSERT_EQ(traceparents.size(), 3u);
+  for (const auto &traceparent : traceparents) {
+    EXPECT_NE(traceparent.find(tracing::TraceIdHex(caller)), std::string::npos) << traceparent;
+  }
+  EXPECT_TRUE(gateway::Fanout(executor, {}, {}).empty());
+}
+
+TEST(RouteTableTest, FanoutRunsOnTheCallerWhenTheExecutorIsBusy) {
+  std::mutex mutex;
+  std::condition_variable released;
+  bool release = false;
+  gateway::FanoutExecutor executor(1, 1);
+  const auto block = [&]() {
+    std::unique_lock<std::mutex> lock(mutex);
+    released.wait(lock, [&release]() { return release; });
+  };
+  // Its caller and the only worker each take one of these and stay there.
+  const std::vector<std::function<void()>> blockers = {block, block};
+  std::thread blocked([&executor, &blockers]() { executor.Run(blockers); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  std::vector<std::thread::id> ran_on(4);
+  std::vector<std::function<void()>> tasks;
+  for (std::size_t i = 0; i < ran_on.size(); ++i) {
+    tasks.emplace_back([&ran_on, i]() { ran_on[i] = std::this_thread::get_id(); });
+  }
+  executor.Run(tasks);
+  for (const auto &id : ran_on) {
+    EXPECT_EQ(id, std::this_thread::get_id());
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    release = true;
+  }
+  released.notify_all();
+  blocked.join();
+}
+
+TEST(RouteTableTest, MergeKeepsEachPartsStatusAndBody) {
+  std::vector<httplib::Result> results;
+  results.push_back(Answer(200, "application/json", R"({"id":"7"})"));
+  results.push_back(Answer(404, "text/plain", "missing"));
+  results.push_back(httplib::Result(nullptr, httplib::Error::Connection));
+  results.push_back(Answer(200, "application/json", "{not json"));
+
+  const auto merged = nlohmann::json::parse(gateway::MergeResponses({"job", "notes", "escrow", "broken"}, results));
+  EXPECT_EQ(merged["job"]["status"], 200);
+  EXPECT_EQ(merged["job"]["body"]["id"], "7");
+  EXPECT_EQ(merged["notes"]["status"], 404);
+  EXPECT_EQ(merged["notes"]["body"], "missing");
+  EXPECT_EQ(merged["escrow"]["status"], 503);
+  EXPECT_EQ(merged["escrow"]["body"]["error"], "upstream_unavailable");
+  EXPECT_EQ(merged["broken"]["body"], "{not json");
+}
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <future>
+#include <thread>
+
+#include "../gateway/src/upstream_pool.h"
+
+#include "../gateway/src/http_utils.cpp"
+#include "../gateway/src/upstream_pool.cpp"
+
+using gateway::CircuitBreaker;
+
+TEST(CircuitBreakerTest, OpensAfterConsecutiveFailures) {
+  CircuitBreaker breaker(3, std::chrono::milliseconds(1000));
+  const auto now = CircuitBreaker::Clock::now();
+  breaker.RecordFailure(now);
+  breaker.RecordFailure(now);
+  EXPECT_EQ(breaker.CurrentState(), CircuitBreaker::State::kClosed);
+  EXPECT_TRUE(breaker.Allow(now));
+  breaker.RecordFailure(now);
+  EXPECT_EQ(breaker.CurrentState(), CircuitBreaker::State::kOpen);
+  EXPECT_FALSE(breaker.Allow(now + std::chrono::milliseconds(500)));
+}
+
+TEST(CircuitBreakerTest, SuccessResetsFailureCount) {
+  CircuitBreaker breaker(2, std::chrono::milliseconds(1000));
+  const auto now = CircuitBreaker::Clock::now();
+  breaker.RecordFailure(now);
+  breaker.RecordSuccess();
+  breaker.RecordFailure(now);
+  EXPECT_EQ(breaker.CurrentState(), CircuitBreaker::State::kClosed);
+}
+
+TEST(CircuitBreakerTest, HalfOpenAllowsSingleProbe) {
+  CircuitBreaker breaker(1, std::chrono::milliseconds(100));
+  const auto now = CircuitBreaker::Clock::now();
+  breaker.RecordFailure(now);
+  const auto later = now + std::chrono::milliseconds(150);
+  EXPECT_TRUE(breaker.Allow(later));
+  EXPECT_EQ(breaker.CurrentState(), CircuitBreaker::State::kHalfOpen);
+  EXPECT_FALSE(breaker.Allow(later));
+  breaker.RecordSuccess();
+  EXPECT_EQ(breaker.CurrentState(), CircuitBreaker::State::kClosed);
+  EXPECT_TRUE(breaker.Allow(later));
+}
+
+TEST(CircuitBreakerTest, FailedProbeReopens) {
+  CircuitBreaker breaker(1, std::chrono::milliseconds(100));
+  const auto now = CircuitBreaker::Clock::now();
+  breaker.RecordFailure(now);
+  const auto later = now + std::chrono::milliseconds(150);
+  ASSERT_TRUE(breaker.Allow(later));
+  breaker.RecordFailure(later);
+  EXPECT_EQ(breaker.CurrentState(), CircuitBreaker::State::kOpen);
+  EXPECT_FALSE(breaker.Allow(later + std::chrono::milliseconds(50)));
+}
+
+TEST(UpstreamPoolTest, RejectsWithoutCallingUpstreamWhileOpen) {
+  gateway::UpstreamOptions options;
+  options.name = "identity";
+  options.host = "127.0.0.1";
+  options.port = 1;
+  options.pool_size = 1;
+  options.connect_timeout = std::chrono::milliseconds(50);
+  options.failure_threshold = 1;
+  options.open_interval = std::chrono::minutes(1);
+  gateway::UpstreamPool pool(options);
+
+  EXPECT_FALSE(pool.Get("/health", {}));
+  const auto rejected = pool.Get("/health", {});
+  EXPECT_FALSE(rejected);
+  EXPECT_EQ(rejected.error(), httplib::Error::Connection);
+  EXPECT_NE(pool.RenderMetrics().find("outcome=\"rejected\"} 1"), std::string::npos);
+}
+
+TEST(UpstreamPoolTest, GivesUpWaitingForABusyClient) {
+  httplib::Server server;
+  server.Get("/slow", [](const httplib::Request &, httplib::Response &res) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    res.set_content("ok", "text/plain");
+  });
+  const int port = server.bind_to_any_port("127.0.0.1");
+  std::thread listener([&server]() { server.listen_after_bind(); });
+  server.wait_until_ready();
+
+  gateway::UpstreamOptions options;
+  options.name = "jobs";
+  options.host = "127.0.0.1";
+  options.port = port;
+  options.pool_size = 1;
+  options.acquire_timeout = std::chrono::milliseconds(50);
+  gateway::UpstreamPool pool(options);
+
+  auto busy = std::async(std::launch::async, [&pool]() { return pool.Get("/slow", {}); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  const auto start = std::chrono::steady_clock::now();
+  const auto waited = pool.Get("/slow", {});
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(300));
+  EXPECT_FALSE(waited);
+  EXPECT_EQ(waited.error(), httplib::Error::Connection);
+  ASSERT_TRUE(busy.get());
+
+  // The lease came back, so the next call gets the client.
+  EXPECT_TRUE(pool.Get("/slow", {}));
+  EXPECT_NE(pool.RenderMetrics().find("outcome=\"rejected\"} 1"), std::string::npos);
+  server.stop();
+  listener.join();
+}
@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "../common/http_server.h"
+
+namespace {
+
+template <typename Predicate>
+bool WaitUntil(Predicate done) {
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (done()) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return false;
+}
+
+}  // namespace
+
+TEST(ServerOptionsTest, ReadsPrefixedOverrides) {
+  setenv("HTTP_SERVER_TEST_WORKER_THREADS", "3", 1);
+  setenv("HTTP_SERVER_TEST_MAX_QUEUED_CONNECTIONS", "0", 1);
+  setenv("HTTP_SERVER_TEST_KEEP_ALIVE_MAX_REQUESTS", "0", 1);
+  setenv("HTTP_SERVER_TEST_MAX_PAYLOAD_BYTES", "lots", 1);
+  http_server::ServerOptions defaults;
+  defaults.max_payload_bytes = 1024;
+  const auto options = http_server::MakeServerOptionsFromEnv("HTTP_SERVER_TEST", defaults);
+  EXPECT_EQ(options.worker_threads, 3u);
+  EXPECT_EQ(options.max_queued_connections, 0u);
+  EXPECT_EQ(options.keep_alive_max_requests, defaults.keep_alive_max_requests);
+  EXPECT_EQ(options.max_payload_bytes, 1024u);
+  EXPECT_EQ(options.read_timeout, defaults.read_timeout);
+}
+
+TEST(WorkerPoolTest, RejectsThenDropsOnceTheQueueIsFull) {
+  auto stats = std::make_shared<http_server::PoolStats>();
+  http_server::WorkerPool pool(1, 1, stats);
+  std::promise<void> release_worker;
+  std::shared_future<void> worker_released = release_worker.get_future().share();
+  std::promise<void> release_rejections;
+  std::shared_future<void> rejections_released = release_rejections.get_future().share();
+  std::promise<bool> shed_flag;
+
+  ASSERT_TRUE(pool.enqueue([worker_released]() { worker_released.wait(); }));
+  ASSERT_TRUE(WaitUntil([&stats]() { return stats->active.Value() == 1; }));
+  std::promise<bool> queued_flag;
+  ASSERT_TRUE(pool.enqueue([&queued_flag]() { queued_flag.set_value(security::SheddingLoad()); }));
+  EXPECT_EQ(stats->queued.Value(), 1);
+
+  ASSERT_TRUE(pool.enqueue([&shed_flag, rejections_released]() {
+    shed_flag.set_value(security::SheddingLoad());
+    rejections_released.wait();
+  }));
+  EXPECT_TRUE(shed_flag.get_future().get());
+  ASSERT_TRUE(pool.enqueue([]() {}));
+  EXPECT_FALSE(pool.enqueue([]() {}));
+  EXPECT_EQ(stats->rejected.Value(), 2u);
+  EXPECT_EQ(stats->dropped.Value(), 1u);
+
+  release_worker.set_value();
+  release_rejections.set_value();
+  EXPECT_FALSE(queued_flag.get_future().get());
+  pool.shutdown();
+  EXPECT_EQ(stats->queued.Value(), 0);
+  EXPECT_EQ(stats->active.Value(), 0);
+}
+
+TEST(BootstrapTest, AnswersOverflowWith503) {
+  http_server::ServerOptions options;
+  options.worker_threads = 1;
+  options.max_queued_connections = 1;
+  httplib::Server server;
+  http_server::Bootstrap(server, "http_server_test", options);
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  server.Get("/slow", [released](const httplib::Request &, httplib::Response &res) {
+    released.wait();
+    res.set_content("slow", "text/plain");
+  });
+  server.Get("/fast", [](const httplib::Request &, httplib::Response &res) { res.set_content("fast", "text/plain"); });
+  const int port = server.bind_to_any_port("127.0.0.1");
+  std::thread listener([&server]() { server.listen_after_bind(); });
+  server.wait_until_ready();
+
+  const auto metric = [](const std::string &series) {
+    return security::MetricsRegistry::Instance().Render("http_server_test").find(series) != std::string::npos;
+  };
+  auto slow = std::async(std::launch::async, [port]() { return httplib::Client("127.0.0.1", port).Get("/slow"); });
+  ASSERT_TRUE(WaitUntil([&]() { return metric("service_workers_active{service=\"http_server_test\"} 1"); }));
+  auto queued = std::async(std::launch::async, [port]() { return httplib::Client("127.0.0.1", port).Get("/fast"); });
+  ASSERT_TRUE(WaitUntil([&]() { return metric("service_connection_queue_depth{service=\"http_server_test\"} 1"); }));
+
+  const auto shed = httplib::Client("127.0.0.1", port).Get("/fast");
+  ASSERT_TRUE(shed);
+  EXPECT_EQ(shed->status, 503);
+  EXPECT_EQ(shed->get_header_value("Retry-After"), "1");
+  EXPECT_TRUE(metric("service_connections_shed_total{service=\"http_server_test\",outcome=\"rejected\"} 1"));
+
+  release.set_value();
+  const auto slow_result = slow.get();
+  const auto queued_result = queued.get();
+  ASSERT_TRUE(slow_result);
+  ASSERT_TRUE(queued_result);
+  EXPECT_EQ(slow_result->body, "slow");
+  EXPECT_EQ(queued_result->body, "fast");
+  server.stop();
+  listener.join();
+}
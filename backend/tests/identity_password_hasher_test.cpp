@@ -0,0 +1,56 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "../services/identity/password_hasher.h"
+
+#include "../services/identity/password_hasher.cpp"
+
+TEST(PasswordHasherTest, ReturnsDerivedHash) {
+  identity::PasswordHasher hasher([](const std::string &password, const std::string &salt) { return salt + password; },
+                                  2, 4);
+  EXPECT_EQ(hasher.Hash("secret", "salt:"), "salt:secret");
+  const auto metrics = hasher.RenderMetrics("identity");
+  EXPECT_NE(metrics.find("password_hash_duration_seconds_count{service=\"identity\"} 1"), std::string::npos);
+}
+
+TEST(PasswordHasherTest, RejectsWhenQueueIsFull) {
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  std::atomic<bool> started{false};
+  identity::PasswordHasher hasher(
+      [released, &started](const std::string &password, const std::string &) {
+        started = true;
+        released.wait();
+        return password;
+      },
+      1, 1);
+
+  // One job occupies the only worker and a second fills the queue.
+  auto running = std::async(std::launch::async, [&]() { return hasher.Hash("first", ""); });
+  while (!started) {
+    std::this_thread::yield();
+  }
+  auto queued = std::async(std::launch::async, [&]() { return hasher.Hash("second", ""); });
+  while (hasher.QueueDepth() != 1) {
+    std::this_thread::yield();
+  }
+
+  EXPECT_FALSE(hasher.Hash("third", "").has_value());
+  release.set_value();
+  EXPECT_EQ(running.get(), "first");
+  EXPECT_EQ(queued.get(), "second");
+  EXPECT_NE(hasher.RenderMetrics("identity").find("password_hash_rejected_total{service=\"identity\"} 1"),
+            std::string::npos);
+}
+
+TEST(PasswordHasherTest, PropagatesDeriveErrors) {
+  identity::PasswordHasher hasher(
+      [](const std::string &, const std::string &) -> std::string { throw std::runtime_error("password_hash_failed"); },
+      1, 1);
+  EXPECT_THROW(hasher.Hash("secret", "salt"), std::runtime_error);
+}
@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "../services/identity/search_index.h"
+
+#include "../services/identity/search_index.cpp"
+
+namespace {
+
+persistence::PublicProfileRecord MakeConveyancer(const std::string &id, const std::string &name,
+                                                 const std::string &state, const std::string &bio = "",
+                                                 std::vector<std::string> specialties = {}) {
+  persistence::PublicProfileRecord record;
+  record.id = id;
+  record.role = "conveyancer";
+  record.full_name = name;
+  record.state = state;
+  record.biography = bio;
+  record.specialties = std::move(specialties);
+  return record;
+}
+
+std::vector<std::string> Ids(const std::vector<persistence::PublicProfileRecord> &records) {
+  std::vector<std::string> ids;
+  for (const auto &record : records) {
+    ids.push_back(record.id);
+  }
+  return ids;
+}
+
+class SearchIndexTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    index_.Replace({MakeConveyancer("1", "Alice Nguyen", "NSW", "Residential settlements in Sydney"),
+                    MakeConveyancer("2", "Bob Carter", "VIC", "Commercial leases", {"commercial"}),
+                    MakeConveyancer("3", "Carla Alison", "nsw", "Off the plan purchases"),
+                    [] {
+                      auto customer = MakeConveyancer("4", "Alice Customer", "NSW");
+                      customer.role = "customer";
+                      return customer;
+                    }()});
+  }
+
+  identity::ConveyancerSearchIndex index_;
+};
+
+}  // namespace
+
+TEST(SearchIndexTokenizeTest, LowercasesAndSplitsOnPunctuation) {
+  EXPECT_EQ(identity::Tokenize("Off-the-plan, NSW!"), (std::vector<std::string>{"off", "the", "plan", "nsw"}));
+}
+
+TEST_F(SearchIndexTest, EmptyQueryListsStateInNameOrder) {
+  EXPECT_TRUE(index_.Loaded());
+  EXPECT_EQ(Ids(index_.Search("NSW", "", 10)), (std::vector<std::string>{"1", "3"}));
+  EXPECT_EQ(Ids(index_.Search("", "", 10)), (std::vector<std::string>{"1", "2", "3"}));
+  EXPECT_TRUE(index_.Search("QLD", "", 10).empty());
+}
+
+TEST_F(SearchIndexTest, RanksNameMatchesAboveSubstringMatches) {
+  index_.Upsert(MakeConveyancer("5", "Aaron Smith", "NSW", "Partnered with Alice for years"));
+  EXPECT_EQ(Ids(index_.Search("", "alice", 10)), (std::vector<std::string>{"1", "5"}));
+  // Both names have a token starting with "ali", so they tie and break on name; the biography
+  // prefix match ranks last.
+  EXPECT_EQ(Ids(index_.Search("", "ali", 10)), (std::vector<std::string>{"1", "3", "5"}));
+  // "lison" is only a substring of "alison".
+  EXPECT_EQ(Ids(index_.Search("", "lison", 10)), (std::vector<std::string>{"3"}));
+  EXPECT_EQ(Ids(index_.Search("", "commercial", 10)), (std::vector<std::string>{"2"}));
+}
+
+TEST_F(SearchIndexTest, RequiresEveryTerm) {
+  EXPECT_EQ(Ids(index_.Search("", "alice sydney", 10)), (std::vector<std::string>{"1"}));
+  EXPECT_TRUE(index_.Search("", "alice commercial", 10).empty());
+}
+
+TEST_F(SearchIndexTest, UpsertAndRemoveKeepIndexFresh) {
+  index_.Upsert(MakeConveyancer("2", "Bob Carter", "NSW", "Now in Sydney"));
+  EXPECT_EQ(Ids(index_.Search("NSW", "sydney", 10)), (std::vector<std::string>{"1", "2"}));
+  EXPECT_TRUE(index_.Search("VIC", "", 10).empty());
+  index_.Remove("1");
+  EXPECT_EQ(Ids(index_.Search("", "sydney", 10)), (std::vector<std::string>{"2"}));
+  EXPECT_EQ(index_.Snapshot().documents, 2u);
+}
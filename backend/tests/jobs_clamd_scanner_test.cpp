@@ -0,0 +1,276 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../services/jobs/clamd_scanner.h"
+
+#include "../services/jobs/clamd_scanner.cpp"
+
+namespace {
+
+// Minimal clamd stand-in speaking the NUL-terminated session protocol. Streams containing
+// "EVIL" are reported as infected. With close_after_scan set, every connection is closed once
+// it has answered one scan, like a daemon whose idle timeout expired.
+class FakeClamd {
+ public:
+  explicit FakeClamd(bool close_after_scan = false) : close_after_scan_(close_after_scan) {
+    fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ::bind(fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    ::listen(fd_, 4);
+    socklen_t length = sizeof(addr);
+    ::getsockname(fd_, reinterpret_cast<sockaddr *>(&addr), &length);
+    port_ = ntohs(addr.sin_port);
+    thread_ = std::thread([this]() { Serve(); });
+  }
+
+  ~FakeClamd() {
+    ::shutdown(fd_, SHUT_RDWR);
+    ::close(fd_);
+    thread_.join();
+  }
+
+  int Port() const { return port_; }
+  int Connections() const { return connections_; }
+
+  std::size_t LargestChunk() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return largest_chunk_;
+  }
+
+ private:
+  bool ReadExact(int client, char *out, std::size_t length) {
+    std::size_t read = 0;
+    while (read < length) {
+      const ssize_t rc = ::recv(client, out + read, length - read, 0);
+      if (rc <= 0) {
+        return false;
+      }
+      read += static_cast<std::size_t>(rc);
+    }
+    return true;
+  }
+
+  bool ReadCommand(int client, std::string *command) {
+    command->clear();
+    char ch = 0;
+    while (ReadExact(client, &ch, 1)) {
+      if (ch == '\0') {
+        return true;
+      }
+      command->push_back(ch);
+    }
+    return false;
+  }
+
+  void Serve() {
+    while (true) {
+      const int client = ::accept(fd_, nullptr, nullptr);
+      if (client < 0) {
+        return;
+      }
+      ++connections_;
+      std::string command;
+      unsigned id = 0;
+      while (ReadCommand(client, &command)) {
+        if (command == "zEND") {
+          break;
+        }
+        if (command != "zINSTREAM") {
+          continue;
+        }
+        std::string data;
+        while (true) {
+          std::uint32_t length = 0;
+          if (!ReadExact(client, reinterpret_cast<char *>(&length), sizeof(length))) {
+            break;
+          }
+          length = ntohl(length);
+          if (length == 0) {
+            break;
+          }
+          {
+            std::lock_guard<std::mutex> lock(mutex_);
+            largest_chunk_ = std::max<std::size_t>(largest_chunk_, length);
+          }
+          std::string chunk(length, '\0');
+          ReadExact(client, chunk.data(), length);
+          data += chunk;
+        }
+        const std::string verdict = data.find("EVIL") != std::string::npos ? "Test.Evil FOUND" : "OK";
+        const std::string reply = std::to_string(++id) + ": stream: " + verdict;
+        ::send(client, reply.c_str(), reply.size() + 1, MSG_NOSIGNAL);
+        if (close_after_scan_) {
+          break;
+        }
+      }
+      ::close(client);
+    }
+  }
+
+  const bool close_after_scan_;
+  int fd_ = -1;
+  int port_ = 0;
+  std::atomic<int> connections_{0};
+  std::mutex mutex_;
+  std::size_t largest_chunk_ = 0;
+  std::thread thread_;
+};
+
+jobs::ScanSource Bytes(std::string data) {
+  return [data = std::move(data)](const jobs::ChunkSink &sink) {
+    // Hand the data over in uneven pieces so chunk coalescing is exercised.
+    for (std::size_t offset = 0; offset < data.size(); offset += 700) {
+      if (!sink(data.data() + offset, std::min<std::size_t>(700, data.size() - offset))) {
+        return false;
+      }
+    }
+    return true;
+  };
+}
+
+jobs::ClamdOptions Options(int port) {
+  jobs::ClamdOptions options;
+  options.host = "127.0.0.1";
+  options.port = port;
+  options.sessions = 1;
+  options.chunk_bytes = 1024;
+  options.timeout = std::chrono::milliseconds(2000);
+  return options;
+}
+
+}  // namespace
+
+TEST(ClamdScannerTest, ParsesSessionReplies) {
+  unsigned id = 0;
+  auto verdict = jobs::ParseClamdReply("7: stream: OK", &id);
+  EXPECT_EQ(verdict.result, jobs::ScanVerdict::Result::kClean);
+  EXPECT_EQ(id, 7u);
+  verdict = jobs::ParseClamdReply("2: stream: Eicar-Signature FOUND", &id);
+  EXPECT_EQ(verdict.result, jobs::ScanVerdict::Result::kInfected);
+  EXPECT_EQ(verdict.detail, "Eicar-Signature");
+  verdict = jobs::ParseClamdReply("INSTREAM size limit exceeded. ERROR", &id);
+  EXPECT_EQ(verdict.result, jobs::ScanVerdict::Result::kError);
+  EXPECT_EQ(verdict.detail, "INSTREAM size limit exceeded.");
+  EXPECT_EQ(id, 0u);
+}
+
+TEST(ClamdScannerTest, ReusesOneSessionAcrossScans) {
+  FakeClamd clamd;
+  jobs::ClamdScanner scanner(Options(clamd.Port()));
+  EXPECT_EQ(scanner.Scan(Bytes(std::string(5000, 'a'))).result, jobs::ScanVerdict::Result::kClean);
+  const auto infected = scanner.Scan(Bytes(std::string(3000, 'b') + "EVIL"));
+  EXPECT_EQ(infected.result, jobs::ScanVerdict::Result::kInfected);
+  EXPECT_EQ(infected.detail, "Test.Evil");
+  EXPECT_EQ(scanner.Scan(Bytes("small")).result, jobs::ScanVerdict::Result::kClean);
+  EXPECT_EQ(clamd.Connections(), 1);
+  EXPECT_EQ(clamd.LargestChunk(), 1024u);
+  EXPECT_NE(scanner.RenderMetrics("jobs").find("clamav_scans_total{service=\"jobs\",result=\"clean\"} 2"),
+            std::string::npos);
+}
+
+TEST(ClamdScannerTest, ReconnectsWhenSessionWasClosed) {
+  FakeClamd clamd(true);
+  jobs::ClamdScanner scanner(Options(clamd.Port()));
+  EXPECT_EQ(scanner.Scan(Bytes("first")).result, jobs::ScanVerdict::Result::kClean);
+  EXPECT_EQ(scanner.Scan(Bytes("second EVIL")).result, jobs::ScanVerdict::Result::kInfected);
+  EXPECT_EQ(clamd.Connections(), 2);
+}
+
+TEST(ClamdScannerTest, ReportsUnreachableDaemonAsError) {
+  jobs::ClamdScanner scanner(Options(1));
+  const auto verdict = scanner.Scan(Bytes("data"));
+  EXPECT_EQ(verdict.result, jobs::ScanVerdict::Result::kError);
+  EXPECT_FALSE(verdict.detail.empty());
+}
+
+TEST(ScanQueueTest, RetriesErrorsThenReportsVerdicts) {
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::vector<std::pair<std::string, jobs::ScanVerdict::Result>> results;
+  std::atomic<int> scans{0};
+  jobs::ScanQueueOptions options;
+  options.workers = 1;
+  options.max_attempts = 3;
+  options.retry_backoff = std::chrono::milliseconds(1);
+  jobs::ScanQueue queue(
+      [&scans](const jobs::ScanSource &source) {
+        ++scans;
+        std::string data;
+        source([&data](const char *chunk, std::size_t length) {
+          data.append(chunk, length);
+          return true;
+        });
+        if (data == "flaky" && scans < 3) {
+          return jobs::ScanVerdict{jobs::ScanVerdict::Result::kError, "connect_failed"};
+        }
+        if (data == "down") {
+          return jobs::ScanVerdict{jobs::ScanVerdict::Result::kError, "connect_failed"};
+        }
+        return jobs::ScanVerdict{jobs::ScanVerdict::Result::kClean, ""};
+      },
+      [&](const std::string &document_id, const jobs::ScanVerdict &verdict) {
+        std::lock_guard<std::mutex> lock(mutex);
+        results.emplace_back(document_id, verdict.result);
+        changed.notify_all();
+      },
+      options);
+
+  ASSERT_TRUE(queue.Submit("doc-1", Bytes("flaky")));
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    ASSERT_TRUE(changed.wait_for(lock, std::chrono::seconds(5), [&]() { return results.size() == 1; }));
+  }
+  EXPECT_EQ(scans.load(), 3);
+  ASSERT_TRUE(queue.Submit("doc-2", Bytes("down")));
+  std::unique_lock<std::mutex> lock(mutex);
+  ASSERT_TRUE(changed.wait_for(lock, std::chrono::seconds(5), [&]() { return results.size() == 2; }));
+  EXPECT_EQ(results[0], std::make_pair(std::string("doc-1"), jobs::ScanVerdict::Result::kClean));
+  EXPECT_EQ(results[1], std::make_pair(std::string("doc-2"), jobs::ScanVerdict::Result::kError));
+  EXPECT_EQ(scans.load(), 6);
+}
+
+TEST(ScanQueueTest, RejectsSubmissionsPastTheLimit) {
+  std::mutex mutex;
+  std::condition_variable released;
+  bool release = false;
+  jobs::ScanQueueOptions options;
+  options.workers = 1;
+  options.queue_limit = 2;
+  jobs::ScanQueue queue(
+      [&](const jobs::ScanSource &) {
+        std::unique_lock<std::mutex> lock(mutex);
+        released.wait(lock, [&]() { return release; });
+        return jobs::ScanVerdict{jobs::ScanVerdict::Result::kClean, ""};
+      },
+      [](const std::string &, const jobs::ScanVerdict &) {}, options);
+
+  ASSERT_TRUE(queue.Submit("doc-1", Bytes("a")));
+  // Wait for the worker to take doc-1 so the next two fill the queue.
+  while (queue.Depth() != 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_TRUE(queue.Submit("doc-2", Bytes("b")));
+  EXPECT_TRUE(queue.Submit("doc-3", Bytes("c")));
+  EXPECT_TRUE(queue.Saturated());
+  EXPECT_FALSE(queue.Submit("doc-4", Bytes("d")));
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    release = true;
+  }
+  released.notify_all();
+}
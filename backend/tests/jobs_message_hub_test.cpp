@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../services/jobs/message_hub.h"
+
+#include "../services/jobs/message_hub.cpp"
+
+namespace {
+
+constexpr auto kNoWait = std::chrono::milliseconds(0);
+
+}  // namespace
+
+TEST(MessageHubTest, FansOutToEverySubscriberOnTheChannel) {
+  jobs::MessageHub hub(8, nullptr, nullptr);
+  auto first = hub.Subscribe("jobs:1");
+  auto second = hub.Subscribe("jobs:1");
+  auto other = hub.Subscribe("jobs:2");
+
+  hub.Deliver("jobs:1", "hello");
+  hub.Deliver("jobs:3", "nobody");
+
+  EXPECT_EQ(first->Next(kNoWait).value_or(""), "hello");
+  EXPECT_EQ(second->Next(kNoWait).value_or(""), "hello");
+  EXPECT_FALSE(other->Next(kNoWait).has_value());
+  EXPECT_EQ(hub.SubscriberCount(), 3u);
+}
+
+TEST(MessageHubTest, ReportsFirstAndLastSubscriberPerChannel) {
+  std::vector<std::string> calls;
+  jobs::MessageHub hub(
+      8, [&calls](const std::string &channel) { calls.push_back("+" + channel); },
+      [&calls](const std::string &channel) { calls.push_back("-" + channel); });
+  {
+    auto first = hub.Subscribe("jobs:1");
+    auto second = hub.Subscribe("jobs:1");
+    EXPECT_EQ(hub.Channels(), std::vector<std::string>{"jobs:1"});
+    first.reset();
+    EXPECT_EQ(calls, std::vector<std::string>{"+jobs:1"});
+  }
+  EXPECT_EQ(calls, (std::vector<std::string>{"+jobs:1", "-jobs:1"}));
+  EXPECT_TRUE(hub.Channels().empty());
+  EXPECT_EQ(hub.SubscriberCount(), 0u);
+}
+
+TEST(MessageHubTest, SlowSubscriberDropsOldestAndIsFlagged) {
+  jobs::MessageHub hub(2, nullptr, nullptr);
+  auto subscription = hub.Subscribe("jobs:1");
+  hub.Deliver("jobs:1", "a");
+  hub.Deliver("jobs:1", "b");
+  hub.Deliver("jobs:1", "c");
+
+  EXPECT_TRUE(subscription->TakeOverflow());
+  EXPECT_FALSE(subscription->TakeOverflow());
+  EXPECT_EQ(subscription->Next(kNoWait).value_or(""), "b");
+  EXPECT_EQ(subscription->Next(kNoWait).value_or(""), "c");
+  EXPECT_NE(hub.RenderMetrics("jobs").find("job_events_dropped_total{service=\"jobs\"} 1"), std::string::npos);
+}
+
+TEST(MessageHubTest, NextWakesOnDeliveryAndOnClose) {
+  jobs::MessageHub hub(8, nullptr, nullptr);
+  auto subscription = hub.Subscribe("jobs:1");
+  std::thread publisher([&hub]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    hub.Deliver("jobs:1", "late");
+  });
+  EXPECT_EQ(subscription->Next(std::chrono::seconds(5)).value_or(""), "late");
+  publisher.join();
+
+  std::thread closer([&hub]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    hub.CloseAll();
+  });
+  const auto started = std::chrono::steady_clock::now();
+  EXPECT_FALSE(subscription->Next(std::chrono::seconds(5)).has_value());
+  EXPECT_LT(std::chrono::steady_clock::now() - started, std::chrono::seconds(5));
+  EXPECT_TRUE(subscription->Closed());
+  closer.join();
+}
@@ -0,0 +1,252 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../services/jobs/redis_client.h"
+
+#include "../common/redis_client.cpp"
+#include "../services/jobs/redis_client.cpp"
+
+namespace {
+
+// Minimal Redis stand-in: answers every command with :1, records PUBLISH payloads and
+// SUBSCRIBE channels, and can push messages to the current client. The first
+// `drop_connections` connections are closed as soon as they send anything.
+class FakeRedis {
+ public:
+  explicit FakeRedis(int drop_connections = 0) : drop_connections_(drop_connections) {
+    fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ::bind(fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    ::listen(fd_, 4);
+    socklen_t length = sizeof(addr);
+    ::getsockname(fd_, reinterpret_cast<sockaddr *>(&addr), &length);
+    port_ = ntohs(addr.sin_port);
+    thread_ = std::thread([this]() { Serve(); });
+  }
+
+  ~FakeRedis() {
+    stopping_ = true;
+    ::shutdown(fd_, SHUT_RDWR);
+    ::close(fd_);
+    thread_.join();
+  }
+
+  int Port() const { return port_; }
+
+  std::vector<std::string> Payloads() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return payloads_;
+  }
+
+  std::vector<std::string> Subscribed() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return subscribed_;
+  }
+
+  void Push(const std::string &channel, const std::string &payload) {
+    std::string message;
+    redis::AppendRespCommand(message, {"message", channel, payload});
+    std::lock_guard<std::mutex> lock(mutex_);
+    ::send(client_, message.data(), message.size(), MSG_NOSIGNAL);
+  }
+
+ private:
+  void Serve() {
+    int accepted = 0;
+    while (!stopping_) {
+      const int client = ::accept(fd_, nullptr, nullptr);
+      if (client < 0) {
+        return;
+      }
+      const bool drop = accepted++ < drop_connections_;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        client_ = client;
+      }
+      redis::RespParser parser;
+      char buffer[4096];
+      ssize_t rc = 0;
+      while ((rc = ::recv(client, buffer, sizeof(buffer), 0)) > 0) {
+        if (drop) {
+          break;
+        }
+        parser.Feed(buffer, static_cast<std::size_t>(rc));
+        std::string replies;
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (auto command = parser.Next()) {
+          const auto &args = command->elements;
+          if (args.size() == 3 && args[0].text == "PUBLISH") {
+            payloads_.push_back(args[2].text);
+          } else if (args.size() == 2 && args[0].text == "SUBSCRIBE") {
+            subscribed_.push_back(args[1].text);
+          } else if (args.size() == 2 && args[0].text == "UNSUBSCRIBE") {
+            std::erase(subscribed_, args[1].text);
+          }
+          replies += ":1\r\n";
+        }
+        ::send(client, replies.data(), replies.size(), MSG_NOSIGNAL);
+      }
+      ::close(client);
+    }
+  }
+
+  const int drop_connections_;
+  int fd_ = -1;
+  int port_ = 0;
+  std::atomic<bool> stopping_{false};
+  std::mutex mutex_;
+  std::vector<std::string> payloads_;
+  std::vector<std::string> subscribed_;
+  int client_ = -1;
+  std::thread thread_;
+};
+
+template <typename Predicate>
+bool WaitUntil(Predicate done) {
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (done()) {
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return false;
+}
+
+bool WaitFor(FakeRedis &server, std::size_t count) {
+  return WaitUntil([&server, count]() { return server.Payloads().size() >= count; });
+}
+
+}  // namespace
+
+TEST(RespParserTest, EncodesCommandsAsBulkArrays) {
+  std::string out;
+  redis::AppendRespCommand(out, {"PUBLISH", "jobs:1", "{}"});
+  EXPECT_EQ(out, "*3\r\n$7\r\nPUBLISH\r\n$6\r\njobs:1\r\n$2\r\n{}\r\n");
+}
+
+TEST(RespParserTest, DecodesRepliesSplitAcrossReads) {
+  const std::string wire =
+      "+OK\r\n:42\r\n$5\r\nhello\r\n$-1\r\n"
+      "*3\r\n$7\r\nmessage\r\n$6\r\njobs:1\r\n$2\r\n{}\r\n-ERR bad\r\n";
+  redis::RespParser parser;
+  std::vector<redis::RespReply> replies;
+  for (char ch : wire) {
+    parser.Feed(&ch, 1);
+    while (auto reply = parser.Next()) {
+      replies.push_back(std::move(*reply));
+    }
+  }
+  ASSERT_EQ(replies.size(), 6u);
+  EXPECT_EQ(replies[0].type, redis::RespReply::Type::kSimple);
+  EXPECT_EQ(replies[1].integer, 42);
+  EXPECT_EQ(replies[2].text, "hello");
+  EXPECT_EQ(replies[3].type, redis::RespReply::Type::kNull);
+  ASSERT_EQ(replies[4].elements.size(), 3u);
+  EXPECT_EQ(replies[4].elements[1].text, "jobs:1");
+  EXPECT_EQ(replies[5].type, redis::RespReply::Type::kError);
+  EXPECT_EQ(parser.Buffered(), 0u);
+}
+
+TEST(RespParserTest, RejectsMalformedInput) {
+  redis::RespParser parser;
+  parser.Feed("?what\r\n", 7);
+  EXPECT_THROW(parser.Next(), std::runtime_error);
+}
+
+TEST(RedisPublisherTest, PublishesQueuedMessagesInOrder) {
+  FakeRedis server;
+  jobs::RedisPublisher publisher("127.0.0.1", server.Port(), "");
+  for (int i = 0; i < 200; ++i) {
+    ASSERT_TRUE(publisher.Publish("jobs:1", std::to_string(i)));
+  }
+  ASSERT_TRUE(WaitFor(server, 200));
+  const auto payloads = server.Payloads();
+  for (int i = 0; i < 200; ++i) {
+    EXPECT_EQ(payloads[i], std::to_string(i));
+  }
+  EXPECT_NE(publisher.RenderMetrics("jobs").find("outcome=\"published\"} 200"), std::string::npos);
+}
+
+TEST(RedisPublisherTest, ReconnectsAndRetriesAfterDisconnect) {
+  FakeRedis server(1);
+  jobs::RedisPublisherOptions options;
+  options.min_backoff = std::chrono::milliseconds(5);
+  jobs::RedisPublisher publisher("127.0.0.1", server.Port(), "", options);
+  ASSERT_TRUE(publisher.Publish("jobs:1", "first"));
+  ASSERT_TRUE(WaitFor(server, 1));
+  EXPECT_EQ(server.Payloads().front(), "first");
+  EXPECT_NE(publisher.RenderMetrics("jobs").find("redis_reconnects_total{service=\"jobs\"} 1"), std::string::npos);
+}
+
+TEST(RedisPublisherTest, RefusesWhenUnconfiguredOrFull) {
+  jobs::RedisPublisher unconfigured("", 0, "");
+  EXPECT_FALSE(unconfigured.Publish("jobs:1", "x"));
+
+  jobs::RedisPublisherOptions options;
+  options.queue_limit = 1;
+  options.min_backoff = std::chrono::milliseconds(1000);
+  // Nothing listens on port 1, so the worker holds the first message in backoff.
+  jobs::RedisPublisher publisher("127.0.0.1", 1, "", options);
+  std::size_t accepted = 0;
+  for (int i = 0; i < 5; ++i) {
+    accepted += publisher.Publish("jobs:1", "x") ? 1 : 0;
+  }
+  EXPECT_LT(accepted, 5u);
+  EXPECT_NE(publisher.RenderMetrics("jobs").find("outcome=\"dropped\"}"), std::string::npos);
+}
+
+TEST(RedisSubscriberTest, SubscribesLiveAndHandsMessagesToHandler) {
+  FakeRedis server;
+  std::mutex mutex;
+  std::vector<std::string> received;
+  jobs::RedisSubscriber subscriber(
+      "127.0.0.1", server.Port(), "",
+      [&](const std::string &channel, const std::string &payload) {
+        std::lock_guard<std::mutex> lock(mutex);
+        received.push_back(channel + "=" + payload);
+      },
+      []() { return std::vector<std::string>{"jobs:1"}; });
+  ASSERT_TRUE(WaitUntil([&server]() { return server.Subscribed().size() == 1; }));
+
+  subscriber.Subscribe("jobs:2");
+  ASSERT_TRUE(WaitUntil([&server]() { return server.Subscribed().size() == 2; }));
+  server.Push("jobs:2", "{\"content\":\"hi\"}");
+  ASSERT_TRUE(WaitUntil([&]() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return !received.empty();
+  }));
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT_EQ(received.front(), "jobs:2={\"content\":\"hi\"}");
+  }
+
+  subscriber.Unsubscribe("jobs:1");
+  ASSERT_TRUE(WaitUntil([&server]() { return server.Subscribed().size() == 1; }));
+  EXPECT_EQ(server.Subscribed().front(), "jobs:2");
+}
+
+TEST(RedisSubscriberTest, RestoresChannelsAfterReconnect) {
+  FakeRedis server(1);
+  jobs::RedisPublisherOptions options;
+  options.min_backoff = std::chrono::milliseconds(5);
+  jobs::RedisSubscriber subscriber(
+      "127.0.0.1", server.Port(), "", [](const std::string &, const std::string &) {},
+      []() { return std::vector<std::string>{"jobs:1"}; }, options);
+  ASSERT_TRUE(WaitUntil([&server]() { return server.Subscribed().size() == 1; }));
+  EXPECT_NE(subscriber.RenderMetrics("jobs").find("redis_subscriber_reconnects_total{service=\"jobs\"} 1"),
+            std::string::npos);
+}
@@ -0,0 +1,70 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+
+#include "../services/jobs/template_cache.h"
+
+#include "../services/jobs/template_cache.cpp"
+
+namespace {
+
+struct FakeTemplates {
+  std::string version = "1.1";
+  int version_reads = 0;
+  int renders = 0;
+
+  jobs::TemplateListCache MakeCache(std::chrono::milliseconds interval) {
+    return jobs::TemplateListCache(
+        [this]() {
+          ++version_reads;
+          return version;
+        },
+        [this]() {
+          ++renders;
+          return "{\"templates\":[" + std::to_string(renders) + "]}";
+        },
+        interval);
+  }
+};
+
+}  // namespace
+
+TEST(TemplateListCacheTest, ServesCachedBodyUntilInvalidated) {
+  FakeTemplates source;
+  auto cache = source.MakeCache(std::chrono::hours(1));
+  const auto first = cache.Get();
+  const auto second = cache.Get();
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(first->body, "{\"templates\":[1]}");
+  EXPECT_EQ(first->etag, "\"templates-1.1\"");
+  EXPECT_EQ(source.version_reads, 1);
+  EXPECT_EQ(source.renders, 1);
+}
+
+TEST(TemplateListCacheTest, RebuildsOnlyWhenVersionMoves) {
+  FakeTemplates source;
+  auto cache = source.MakeCache(std::chrono::hours(1));
+  cache.Get();
+
+  cache.Invalidate();
+  EXPECT_EQ(cache.Get()->body, "{\"templates\":[1]}");
+  EXPECT_EQ(source.version_reads, 2);
+  EXPECT_EQ(source.renders, 1);
+
+  source.version = "1.2";
+  cache.Invalidate();
+  const auto rebuilt = cache.Get();
+  EXPECT_EQ(rebuilt->body, "{\"templates\":[2]}");
+  EXPECT_EQ(rebuilt->etag, "\"templates-1.2\"");
+  EXPECT_NE(cache.RenderMetrics("jobs").find("outcome=\"rebuilt\"} 2"), std::string::npos);
+}
+
+TEST(TemplateListCacheTest, RevalidatesAfterInterval) {
+  FakeTemplates source;
+  auto cache = source.MakeCache(std::chrono::milliseconds(0));
+  cache.Get();
+  source.version = "2.2";
+  EXPECT_EQ(cache.Get()->etag, "\"templates-2.2\"");
+  EXPECT_EQ(source.renders, 2);
+}
@@ -0,0 +1,269 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../services/jobs/template_sync.h"
+
+#include "../services/jobs/template_sync.cpp"
+
+namespace {
+
+using json = nlohmann::json;
+
+persistence::TemplateRecord PortalTemplate(const std::string &id, std::vector<persistence::TemplateTaskRecord> tasks,
+                                           int version = 1) {
+  persistence::TemplateRecord record;
+  record.id = id;
+  record.name = "Template " + id;
+  record.integration_url = "http://portal.test/templates/" + id;
+  record.latest_version = version;
+  record.tasks = std::move(tasks);
+  return record;
+}
+
+std::vector<persistence::TemplateTaskRecord> Tasks(const std::string &first) {
+  return {{first, 3, "conveyancer"}, {"Settle", 10, "conveyancer"}};
+}
+
+jobs::PortalFetch Fetched(std::vector<persistence::TemplateTaskRecord> tasks, const std::string &etag = "") {
+  jobs::PortalFetch fetch;
+  fetch.result.tasks = std::move(tasks);
+  fetch.validators.etag = etag;
+  return fetch;
+}
+
+// Portal serving one workflow with an ETag, counting full responses and distinct connections.
+class FakePortal {
+ public:
+  FakePortal() {
+    server_.Get("/workflow", [this](const httplib::Request &req, httplib::Response &res) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ports_.insert(req.remote_port);
+        auth_ = req.get_header_value("Authorization");
+      }
+      res.set_header("ETag", "\"wf-7\"");
+      if (req.get_header_value("If-None-Match") == "\"wf-7\"") {
+        res.status = 304;
+        return;
+      }
+      ++full_responses_;
+      res.set_content(R"({"version":7,"workflow":{"tasks":[{"title":"Searches","due_days":5,"owner":"buyer"}]}})",
+                      "application/json");
+    });
+    port_ = server_.bind_to_any_port("127.0.0.1");
+    thread_ = std::thread([this]() { server_.listen_after_bind(); });
+    server_.wait_until_ready();
+  }
+
+  ~FakePortal() {
+    server_.stop();
+    thread_.join();
+  }
+
+  std::string Url() const { return "http://127.0.0.1:" + std::to_string(port_) + "/workflow"; }
+  int FullResponses() const { return full_responses_.load(); }
+  std::size_t Connections() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return ports_.size();
+  }
+  std::string Authorization() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return auth_;
+  }
+
+ private:
+  httplib::Server server_;
+  int port_ = 0;
+  std::thread thread_;
+  std::atomic<int> full_responses_{0};
+  std::mutex mutex_;
+  std::set<int> ports_;
+  std::string auth_;
+};
+
+}  // namespace
+
+TEST(TemplateSyncTest, ParsesEveryPortalShape) {
+  const auto nested = jobs::ParsePortalTemplate("http://p/x", 200, R"({"workflow":{"tasks":[{"title":"A"}]}})");
+  ASSERT_EQ(nested.tasks.size(), 1u);
+  EXPECT_EQ(nested.tasks[0].name, "A");
+  EXPECT_EQ(nested.source["type"], "portal");
+
+  const auto flat = jobs::ParsePortalTemplate(
+      "http://p/x", 200, R"({"version":"2024.1","tasks":[{"name":"B","dueDays":4,"assignedRole":"seller"}]})");
+  ASSERT_EQ(flat.tasks.size(), 1u);
+  EXPECT_EQ(flat.tasks[0].due_days, 4);
+  EXPECT_EQ(flat.tasks[0].assigned_role, "seller");
+  EXPECT_EQ(flat.metadata["portalVersion"], "2024.1");
+  EXPECT_EQ(flat.source["version"], "2024.1");
+
+  EXPECT_EQ(jobs::ParsePortalTemplate("http://p/x", 200, R"([{"name":"C"},{"name":"D"}])").tasks.size(), 2u);
+  EXPECT_THROW(jobs::ParsePortalTemplate("http://p/x", 200, R"({"tasks":{}})"), std::runtime_error);
+}
+
+TEST(TemplateSyncTest, DigestCoversEveryTaskField) {
+  EXPECT_EQ(jobs::TasksDigest(Tasks("Searches")), jobs::TasksDigest(Tasks("Searches")));
+  EXPECT_NE(jobs::TasksDigest(Tasks("Searches")), jobs::TasksDigest(Tasks("Search")));
+  auto moved_due = Tasks("Searches");
+  moved_due[1].due_days = 11;
+  EXPECT_NE(jobs::TasksDigest(moved_due), jobs::TasksDigest(Tasks("Searches")));
+  // Field boundaries are part of the digest.
+  EXPECT_NE(jobs::TasksDigest({{"ab", 1, "c"}}), jobs::TasksDigest({{"a", 1, "bc"}}));
+}
+
+TEST(TemplateSyncTest, ClientRevalidatesOverOneKeptAliveConnection) {
+  FakePortal portal;
+  jobs::PortalClient client;
+  const auto first = client.Fetch(portal.Url(), json{{"apiKey", "secret"}});
+  EXPECT_FALSE(first.not_modified);
+  ASSERT_EQ(first.result.tasks.size(), 1u);
+  EXPECT_EQ(first.result.tasks[0].name, "Searches");
+  EXPECT_EQ(first.result.metadata["etag"], "\"wf-7\"");
+  EXPECT_EQ(first.validators.etag, "\"wf-7\"");
+  EXPECT_EQ(portal.Authorization(), "Bearer secret");
+
+  const auto second = client.Fetch(portal.Url(), json::object(), first.validators);
+  EXPECT_TRUE(second.not_modified);
+  EXPECT_EQ(second.validators.etag, "\"wf-7\"");
+  EXPECT_EQ(portal.FullResponses(), 1);
+  EXPECT_EQ(portal.Connections(), 1u);
+
+  EXPECT_THROW(client.Fetch("https://portal.test/x", json::object()), std::runtime_error);
+  EXPECT_THROW(client.Fetch("not a url", json::object()), std::runtime_error);
+}
+
+TEST(TemplateSyncTest, OnlyChangedTemplatesGetANewVersion) {
+  const std::vector<persistence::TemplateRecord> records = {
+      PortalTemplate("a", Tasks("Searches")), PortalTemplate("b", Tasks("Searches")),
+      PortalTemplate("c", Tasks("Searches")), PortalTemplate("manual", Tasks("Searches"))};
+  std::vector<persistence::TemplateRecord> listed = records;
+  listed.back().integration_url.clear();
+
+  std::mutex mutex;
+  std::vector<std::string> applied;
+  jobs::TemplateSyncOptions options;
+  options.interval = std::chrono::seconds(0);
+  jobs::TemplateSyncScheduler scheduler(
+      [&listed]() { return listed; },
+      [](const persistence::TemplateRecord &record, const jobs::PortalValidators &) {
+        if (record.id == "a") {
+          return Fetched(Tasks("Searches"));
+        }
+        if (record.id == "b") {
+          return Fetched(Tasks("Title searches"));
+        }
+        throw std::runtime_error("portal_request_failed");
+      },
+      [&](const persistence::TemplateRecord &record, const jobs::TemplateSyncResult &) {
+        std::lock_guard<std::mutex> lock(mutex);
+        applied.push_back(record.id);
+        return record.latest_version + 1;
+      },
+      options);
+
+  const auto report = scheduler.RunOnce();
+  EXPECT_EQ(report.updated, 1u);
+  EXPECT_EQ(report.unchanged, 1u);
+  EXPECT_EQ(report.failed, 1u);
+  EXPECT_EQ(applied, std::vector<std::string>{"b"});
+
+  const auto statuses = scheduler.Statuses();
+  ASSERT_EQ(statuses.size(), 3u);
+  EXPECT_EQ(statuses[0].outcome, "unchanged");
+  EXPECT_EQ(statuses[1].outcome, "updated");
+  EXPECT_EQ(statuses[1].version, 2);
+  EXPECT_EQ(statuses[2].outcome, "failed");
+  EXPECT_EQ(statuses[2].error, "portal_request_failed");
+  EXPECT_FALSE(statuses[2].finished_at.empty());
+
+  const auto metrics = scheduler.RenderMetrics("jobs");
+  EXPECT_NE(metrics.find("template_syncs_total{service=\"jobs\",outcome=\"updated\"} 1"), std::string::npos);
+  EXPECT_NE(metrics.find("template_sync_seconds_count{service=\"jobs\"} 3"), std::string::npos);
+  EXPECT_NE(metrics.find("template_sync_last_seconds{service=\"jobs\",template_id=\"c\"}"), std::string::npos);
+}
+
+TEST(TemplateSyncTest, ValidatorsFollowTheVersionTheyWereReceivedWith) {
+  auto record = PortalTemplate("a", Tasks("Searches"), 3);
+  record.metadata = json{{"etag", "\"stored\""}};
+  std::vector<std::string> sent;
+  jobs::TemplateSyncOptions options;
+  options.interval = std::chrono::seconds(0);
+  jobs::TemplateSyncScheduler scheduler(
+      [&record]() { return std::vector<persistence::TemplateRecord>{record}; },
+      [&sent](const persistence::TemplateRecord &, const jobs::PortalValidators &validators) {
+        sent.push_back(validators.etag);
+        jobs::PortalFetch fetch;
+        fetch.not_modified = true;
+        fetch.validators.etag = "\"fresh\"";
+        return fetch;
+      },
+      [](const persistence::TemplateRecord &record, const jobs::TemplateSyncResult &) {
+        return record.latest_version + 1;
+      },
+      options);
+
+  scheduler.RunOnce();
+  scheduler.RunOnce();
+  // Someone else wrote version 4; its own metadata carries no validators.
+  record.latest_version = 4;
+  record.metadata = json::object();
+  scheduler.RunOnce();
+  EXPECT_EQ(sent, (std::vector<std::string>{"\"stored\"", "\"fresh\"", ""}));
+}
+
+TEST(TemplateSyncTest, PassesStayWithinTheConcurrencyLimit) {
+  std::vector<persistence::TemplateRecord> records;
+  for (int i = 0; i < 12; ++i) {
+    records.push_back(PortalTemplate(std::to_string(i), Tasks("Searches")));
+  }
+  std::atomic<int> in_flight{0};
+  std::atomic<int> peak{0};
+  jobs::TemplateSyncOptions options;
+  options.interval = std::chrono::seconds(0);
+  options.concurrency = 3;
+  jobs::TemplateSyncScheduler scheduler(
+      [&records]() { return records; },
+      [&](const persistence::TemplateRecord &, const jobs::PortalValidators &) {
+        const int now = ++in_flight;
+        int seen = peak.load();
+        while (now > seen && !peak.compare_exchange_weak(seen, now)) {
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        --in_flight;
+        return Fetched(Tasks("Searches"));
+      },
+      [](const persistence::TemplateRecord &record, const jobs::TemplateSyncResult &) {
+        return record.latest_version;
+      },
+      options);
+
+  const auto report = scheduler.RunOnce();
+  EXPECT_EQ(report.unchanged, 12u);
+  EXPECT_EQ(peak.load(), 3);
+}
+
+TEST(TemplateSyncTest, TriggerRunsAPassInTheBackground) {
+  std::atomic<int> listed{0};
+  jobs::TemplateSyncOptions options;
+  options.interval = std::chrono::seconds(0);
+  jobs::TemplateSyncScheduler scheduler(
+      [&listed]() {
+        ++listed;
+        return std::vector<persistence::TemplateRecord>{};
+      },
+      [](const persistence::TemplateRecord &, const jobs::PortalValidators &) { return jobs::PortalFetch{}; },
+      [](const persistence::TemplateRecord &, const jobs::TemplateSyncResult &) { return 0; }, options);
+  scheduler.Trigger();
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (listed.load() == 0 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  EXPECT_EQ(listed.load(), 1);
+}
@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+
+#include "../services/jobs/upload_stream.h"
+
+#include "../services/jobs/upload_stream.cpp"
+
+namespace {
+
+std::string Checksum(const std::string &data, std::size_t chunk) {
+  jobs::UploadInspector inspector;
+  for (std::size_t offset = 0; offset < data.size(); offset += chunk) {
+    inspector.Update(data.data() + offset, std::min(chunk, data.size() - offset));
+  }
+  return inspector.FinishChecksum();
+}
+
+}  // namespace
+
+TEST(UploadInspectorTest, ChecksumDoesNotDependOnChunking) {
+  EXPECT_EQ(Checksum("abc", 3), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+  std::string data(100000, '\0');
+  for (std::size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<char>(i * 31);
+  }
+  EXPECT_EQ(Checksum(data, 1), Checksum(data, data.size()));
+  EXPECT_EQ(Checksum(data, 4096), Checksum(data, 7));
+}
+
+TEST(UploadInspectorTest, DetectsEicarSplitAcrossChunks) {
+  const std::string payload = "header-" + std::string(jobs::UploadInspector::kEicar) + "-trailer";
+  for (std::size_t chunk : {1, 5, 20, 64, 200}) {
+    jobs::UploadInspector inspector;
+    for (std::size_t offset = 0; offset < payload.size(); offset += chunk) {
+      inspector.Update(payload.data() + offset, std::min(chunk, payload.size() - offset));
+    }
+    EXPECT_TRUE(inspector.EicarDetected()) << "chunk size " << chunk;
+    EXPECT_EQ(inspector.BytesSeen(), payload.size());
+  }
+
+  jobs::UploadInspector clean;
+  const std::string partial(jobs::UploadInspector::kEicar.substr(0, 40));
+  clean.Update(partial.data(), partial.size());
+  clean.Update("padding", 7);
+  clean.Update(partial.data(), partial.size());
+  EXPECT_FALSE(clean.EicarDetected());
+}
+
+TEST(ChunkPipeTest, TransfersMoreThanCapacityAcrossThreads) {
+  jobs::ChunkPipe pipe(16);
+  std::string input;
+  for (int i = 0; i < 1000; ++i) {
+    input += std::to_string(i) + ",";
+  }
+  std::string output;
+  std::thread reader([&]() {
+    char buffer[7];
+    while (const std::size_t read = pipe.Read(buffer, sizeof(buffer))) {
+      output.append(buffer, read);
+    }
+  });
+  for (std::size_t offset = 0; offset < input.size(); offset += 13) {
+    ASSERT_TRUE(pipe.Write(input.data() + offset, std::min<std::size_t>(13, input.size() - offset)));
+  }
+  pipe.Close();
+  reader.join();
+  EXPECT_EQ(output, input);
+}
+
+TEST(ChunkPipeTest, AbortUnblocksWriter) {
+  jobs::ChunkPipe pipe(4);
+  std::thread reader([&]() {
+    char buffer[2];
+    pipe.Read(buffer, sizeof(buffer));
+    pipe.Abort();
+  });
+  EXPECT_FALSE(pipe.Write("0123456789", 10));
+  reader.join();
+  EXPECT_TRUE(pipe.Aborted());
+  char buffer[4];
+  EXPECT_EQ(pipe.Read(buffer, sizeof(buffer)), 0u);
+}
+
+TEST(DocumentKeyTest, EachDocumentGetsItsOwnUuid) {
+  const std::string first = jobs::NewDocumentId();
+  const std::string second = jobs::NewDocumentId();
+  EXPECT_TRUE(codec::IsUuid(first));
+  EXPECT_NE(first, second);
+  EXPECT_EQ(first[14], '4');
+  EXPECT_NE(jobs::DocumentObjectKey("job", first, "deed.pdf"), jobs::DocumentObjectKey("job", second, "deed.pdf"));
+}
+
+TEST(DocumentKeyTest, FileNamesCannotLeaveTheDocumentPrefix) {
+  EXPECT_EQ(jobs::DocumentObjectKey("job", "doc", "deed.pdf"), "job/doc/deed.pdf");
+  EXPECT_EQ(jobs::DocumentObjectKey("job", "doc", "../other/doc/deed.pdf"), "job/doc/deed.pdf");
+  EXPECT_EQ(jobs::DocumentObjectKey("job", "doc", "..\\deed copy?.pdf"), "job/doc/deed_copy_.pdf");
+  EXPECT_EQ(jobs::DocumentObjectKey("job", "doc", ".."), "job/doc/document.bin");
+  EXPECT_EQ(jobs::DocumentObjectKey("job", "doc", "a/"), "job/doc/document.bin");
+  EXPECT_EQ(jobs::DocumentObjectKey("job", "doc", std::string(300, 'x')).size(), 8u + 128u);
+}
@@ -0,0 +1,51 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "../common/json_writer.h"
+
+TEST(JsonWriterTest, WritesNestedObjectsAndArrays) {
+  const std::string text = json_writer::Render([](json_writer::Writer &out) {
+    out.BeginObject()
+        .Field("id", std::string("job-1"))
+        .Field("count", 3)
+        .Field("verified", true)
+        .Field("missing", nullptr)
+        .Field("tags", std::vector<std::string>{"a", "b"})
+        .Key("items")
+        .BeginArray();
+    out.BeginObject().Field("n", 1).EndObject();
+    out.BeginObject().Field("n", 2).EndObject();
+    out.EndArray().Key("empty").BeginArray().EndArray().EndObject();
+  });
+  EXPECT_EQ(text,
+            "{\"id\":\"job-1\",\"count\":3,\"verified\":true,\"missing\":null,\"tags\":[\"a\",\"b\"],"
+            "\"items\":[{\"n\":1},{\"n\":2}],\"empty\":[]}");
+  EXPECT_NO_THROW(nlohmann::json::parse(text));
+}
+
+TEST(JsonWriterTest, EscapesStringsLikeNlohmannDump) {
+  const std::vector<std::string> samples = {
+      "plain", "quote\" and \\ slash", "line\nbreak\ttab\r", std::string("nul\0byte", 8), "\x01\x1f\b\f",
+      "caf\xc3\xa9 / \xe2\x82\xac"};
+  for (const auto &sample : samples) {
+    const std::string text = json_writer::Render([&](json_writer::Writer &out) { out.Value(sample); });
+    EXPECT_EQ(text, nlohmann::json(sample).dump());
+  }
+}
+
+TEST(JsonWriterTest, WritesIntegerLimitsAndEmbeddedJson) {
+  const nlohmann::json metadata = {{"synced", true}, {"tasks", {1, 2}}};
+  const std::string text = json_writer::Render([&](json_writer::Writer &out) {
+    out.BeginArray()
+        .Value(std::numeric_limits<std::int64_t>::min())
+        .Value(std::numeric_limits<std::uint64_t>::max())
+        .Value(metadata)
+        .Raw("{\"pre\":1}")
+        .EndArray();
+  });
+  EXPECT_EQ(text, "[-9223372036854775808,18446744073709551615," + metadata.dump() + ",{\"pre\":1}]");
+}
@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../common/logger.h"
+
+namespace {
+
+std::filesystem::path MakeTempDirectory(const std::string &name) {
+  const auto directory = std::filesystem::temp_directory_path() / ("logger_test_" + name);
+  std::filesystem::remove_all(directory);
+  std::filesystem::create_directories(directory);
+  return directory;
+}
+
+std::string ReadFile(const std::filesystem::path &path) {
+  std::ifstream stream(path);
+  return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+}
+
+logging::AsyncLogWriter::Record MakeRecord(const std::filesystem::path *file, std::string entry) {
+  logging::AsyncLogWriter::Record record;
+  record.file = file;
+  record.entry = std::move(entry);
+  return record;
+}
+
+}  // namespace
+
+TEST(MpscRingTest, PushesAndPopsInOrderUntilFull) {
+  logging::detail::MpscRing<int> ring(4);
+  EXPECT_EQ(ring.Capacity(), 4u);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(ring.TryPush(int(i)));
+  }
+  EXPECT_FALSE(ring.TryPush(99));
+  for (int i = 0; i < 4; ++i) {
+    const auto value = ring.TryPop();
+    ASSERT_TRUE(value.has_value());
+    EXPECT_EQ(*value, i);
+  }
+  EXPECT_FALSE(ring.TryPop().has_value());
+  EXPECT_TRUE(ring.TryPush(5));
+}
+
+TEST(MpscRingTest, AcceptsConcurrentProducers) {
+  logging::detail::MpscRing<int> ring(4096);
+  std::vector<std::thread> producers;
+  for (int t = 0; t < 4; ++t) {
+    producers.emplace_back([&ring]() {
+      for (int i = 0; i < 1000; ++i) {
+        ASSERT_TRUE(ring.TryPush(int(i)));
+      }
+    });
+  }
+  for (auto &producer : producers) {
+    producer.join();
+  }
+  int popped = 0;
+  while (ring.TryPop()) {
+    ++popped;
+  }
+  EXPECT_EQ(popped, 4000);
+}
+
+TEST(LoggerFormatTest, BuildsEscapedJsonEntry) {
+  const auto entry =
+      logging::detail::BuildLogEntry("2024-01-31T12:34:56.789Z", "jobs", "info", "said \"hi\"\n", "req-1");
+  EXPECT_EQ(entry,
+            R"({"timestamp":"2024-01-31T12:34:56.789Z","service":"jobs","category":"info","message":"said \"hi\"\n",)"
+            R"("context":"req-1"})");
+  EXPECT_EQ(logging::detail::BuildLogEntry("t", "s", "c", "m", ""),
+            R"({"timestamp":"t","service":"s","category":"c","message":"m"})");
+}
+
+TEST(LoggerFormatTest, TimestampIsIso8601WithMilliseconds) {
+  const auto timestamp = logging::detail::TimestampNow();
+  ASSERT_EQ(timestamp.size(), 24u);
+  EXPECT_EQ(timestamp[10], 'T');
+  EXPECT_EQ(timestamp[19], '.');
+  EXPECT_EQ(timestamp.back(), 'Z');
+}
+
+TEST(AsyncLogWriterTest, WritesQueuedEntriesAndErrorCopies) {
+  const auto directory = MakeTempDirectory("writes");
+  const auto service_file = directory / "jobs.log";
+  logging::AsyncLogOptions options;
+  options.console = false;
+  {
+    logging::AsyncLogWriter writer(options, directory / "errors.log");
+    EXPECT_TRUE(writer.Submit(MakeRecord(&service_file, "first")));
+    auto error = MakeRecord(&service_file, "second");
+    error.error = true;
+    EXPECT_TRUE(writer.Submit(std::move(error)));
+    writer.Stop();
+    EXPECT_FALSE(writer.Submit(MakeRecord(&service_file, "late")));
+    const auto stats = writer.Stats();
+    EXPECT_EQ(stats.enqueued, 2u);
+    EXPECT_EQ(stats.written, 2u);
+    EXPECT_EQ(stats.dropped, 0u);
+  }
+  EXPECT_EQ(ReadFile(service_file), "first\nsecond\n");
+  EXPECT_EQ(ReadFile(directory / "errors.log"), "second\n");
+  std::filesystem::remove_all(directory);
+}
+
+TEST(AsyncLogWriterTest, RotatesBySizeWithoutLogSuffix) {
+  const auto directory = MakeTempDirectory("rotation");
+  const auto service_file = directory / "identity.log";
+  logging::AsyncLogOptions options;
+  options.console = false;
+  options.batch_size = 1;
+  options.max_file_bytes = 8;
+  options.max_rotated_files = 2;
+  {
+    logging::AsyncLogWriter writer(options, directory / "errors.log");
+    for (const char *entry : {"aaaaaa", "bbbbbb", "cccccc", "dddddd"}) {
+      ASSERT_TRUE(writer.Submit(MakeRecord(&service_file, entry)));
+      // Let each entry land in its own batch so every write sees the previous size.
+      for (int i = 0; i < 200 && writer.Stats().written < writer.Stats().enqueued; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      }
+    }
+    writer.Stop();
+    EXPECT_EQ(writer.Stats().rotations, 3u);
+  }
+  EXPECT_EQ(ReadFile(service_file), "dddddd\n");
+  EXPECT_EQ(ReadFile(directory / "identity.log.1"), "cccccc\n");
+  EXPECT_EQ(ReadFile(directory / "identity.log.2"), "bbbbbb\n");
+  EXPECT_FALSE(std::filesystem::exists(directory / "identity.log.3"));
+  std::filesystem::remove_all(directory);
+}
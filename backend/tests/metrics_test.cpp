@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../common/metrics.h"
+#include "../common/security.h"
+
+TEST(MetricsTest, CounterSumsAcrossThreads) {
+  metrics::Counter counter;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&counter]() {
+      for (int i = 0; i < 1000; ++i) {
+        counter.Add();
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(counter.Value(), 8000u);
+}
+
+TEST(MetricsTest, HistogramBucketsAreCumulative) {
+  metrics::Histogram histogram;
+  histogram.Observe(std::chrono::milliseconds(1));
+  histogram.Observe(std::chrono::milliseconds(5));
+  histogram.Observe(std::chrono::milliseconds(200));
+  histogram.Observe(std::chrono::seconds(30));
+  const auto snapshot = histogram.Collect();
+  EXPECT_EQ(snapshot.count, 4u);
+  EXPECT_EQ(snapshot.cumulative[0], 2u);  // le=0.005 is inclusive
+  EXPECT_EQ(snapshot.cumulative[5], 3u);  // le=0.25
+  EXPECT_EQ(snapshot.cumulative.back(), 3u);
+  EXPECT_NEAR(snapshot.sum_seconds, 30.206, 1e-9);
+}
+
+TEST(MetricsTest, RouteLabelFoldsIdentifiers) {
+  std::string route;
+  metrics::AppendRouteLabel(route, "/jobs/3f2c9a1e-77b2/milestones");
+  EXPECT_EQ(route, "/jobs/:id/milestones");
+  route.clear();
+  metrics::AppendRouteLabel(route, "/profiles/search");
+  EXPECT_EQ(route, "/profiles/search");
+}
+
+TEST(MetricsTest, FamilyFoldsLabelSetsPastTheCap) {
+  metrics::Family<metrics::Counter> family(2);
+  family.Get("a").Add();
+  family.Get("b", "overflow").Add();
+  family.Get("c", "overflow").Add();
+  family.Get("d", "overflow").Add();
+  family.Get("e").Add();
+  family.Get("a").Add();
+
+  const auto series = family.Collect();
+  ASSERT_EQ(series.size(), 3u);
+  EXPECT_EQ(series[0].first, "a");
+  EXPECT_EQ(series[0].second->Value(), 2u);
+  EXPECT_EQ(series[2].first, "overflow");
+  EXPECT_EQ(series[2].second->Value(), 2u);
+}
+
+TEST(MetricsTest, ClientErrorsShareOneRouteLabel) {
+  auto &registry = security::MetricsRegistry::Instance();
+  registry.RecordRequest("route_label_test", "/wp-admin/setup", "GET", 404, std::chrono::milliseconds(1));
+  registry.RecordRequest("route_label_test", "/phpmyadmin/index", "GET", 404, std::chrono::milliseconds(1));
+  registry.RecordRequest("route_label_test", "/jobs/7", "GET", 500, std::chrono::milliseconds(1));
+
+  const auto text = registry.Render("route_label_test");
+  EXPECT_NE(text.find("service_request_duration_seconds_count{service=\"route_label_test\",route=\"unmatched\","
+                      "method=\"GET\",status=\"404\"} 2"),
+            std::string::npos);
+  EXPECT_NE(text.find("route=\"/jobs/:id\",method=\"GET\",status=\"500\""), std::string::npos);
+  EXPECT_EQ(text.find("wp-admin"), std::string::npos);
+}
+
+TEST(MetricsTest, LabelsRoundTrip) {
+  std::string key;
+  metrics::JoinLabels(key, {"jobs", "/jobs/:id", "GET", "200"});
+  const auto labels = metrics::SplitLabels(key);
+  ASSERT_EQ(labels.size(), 4u);
+  EXPECT_EQ(labels[1], "/jobs/:id");
+  EXPECT_EQ(labels[3], "200");
+}
+
+TEST(MetricsTest, RegistryRendersCountsHistogramsAndInFlight) {
+  auto &registry = security::MetricsRegistry::Instance();
+  registry.RecordRequest("metrics_test", "/jobs/42", "GET", 200, std::chrono::milliseconds(3));
+  registry.RecordRequest("metrics_test", "/jobs/43", "GET", 200, std::chrono::milliseconds(30));
+  registry.RecordRequest("other_service", "/jobs/43", "GET", 200, std::chrono::milliseconds(30));
+  registry.RecordAuthFailure("metrics_test", "api_key");
+  registry.InFlight("metrics_test").Add(1);
+
+  const auto text = registry.Render("metrics_test");
+  EXPECT_NE(text.find("service_request_total{service=\"metrics_test\",method=\"GET\",status=\"200\"} 2"),
+            std::string::npos);
+  EXPECT_NE(text.find("service_request_duration_seconds_bucket{service=\"metrics_test\",route=\"/jobs/:id\","
+                      "method=\"GET\",status=\"200\",le=\"0.005\"} 1"),
+            std::string::npos);
+  EXPECT_NE(text.find("service_request_duration_seconds_count{service=\"metrics_test\",route=\"/jobs/:id\","
+                      "method=\"GET\",status=\"200\"} 2"),
+            std::string::npos);
+  EXPECT_NE(text.find("service_requests_in_flight{service=\"metrics_test\"} 1"), std::string::npos);
+  EXPECT_NE(text.find("service_auth_failures_total{service=\"metrics_test\",category=\"api_key\"} 1"),
+            std::string::npos);
+  EXPECT_EQ(text.find("other_service"), std::string::npos);
+  registry.InFlight("metrics_test").Add(-1);
+}
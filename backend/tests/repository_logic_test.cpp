@@ -23,6 +23,22 @@ TEST(AccountsRepositoryUtilsTest, ParseStringArrayHandlesInvalidJson) {
   EXPECT_TRUE(parsed.empty());
 }
 
+TEST(AccountsRepositoryUtilsTest, ParseStringArrayReadsPostgresJsonbText) {
+  using Strings = std::vector<std::string>;
+  EXPECT_EQ(ParseStringArray(std::string_view(R"(["residential", "off-the-plan"])")),
+            (Strings{"residential", "off-the-plan"}));
+  EXPECT_EQ(ParseStringArray(std::string_view(" [ ] ")), Strings{});
+  EXPECT_EQ(ParseStringArray(std::string_view(R"([""])")), Strings{""});
+  // Escapes and mixed element types take the full parser.
+  EXPECT_EQ(ParseStringArray(std::string_view(R"(["say \"hi\"", "caf\u00e9"])")),
+            (Strings{"say \"hi\"", "caf\xc3\xa9"}));
+  EXPECT_EQ(ParseStringArray(std::string_view(R"(["a", 1, null, "b"])")), (Strings{"a", "b"}));
+  EXPECT_TRUE(ParseStringArray(std::string_view(R"(["a", "b")")).empty());
+  EXPECT_TRUE(ParseStringArray(std::string_view(R"(["a"] x)")).empty());
+  EXPECT_TRUE(ParseStringArray(std::string_view(R"(["a",])")).empty());
+  EXPECT_TRUE(ParseStringArray(std::nullopt).empty());
+}
+
 TEST(AccountsRepositoryUtilsTest, BuildAccountRecordPopulatesOptionalFields) {
   AccountRowData data;
   data.id = "user-123";
@@ -38,8 +54,8 @@ TEST(AccountsRepositoryUtilsTest, BuildAccountRecordPopulatesOptionalFields) {
   data.biography = "Bio";
   data.licence_number = "LIC123";
   data.licence_state = "NSW";
-  data.specialties_json = std::string("[\"commercial\"]");
-  data.services_json = std::string("[\"online\"]");
+  data.specialties_json = "[\"commercial\"]";
+  data.services_json = "[\"online\"]";
   data.verified = true;
 
   const auto record = BuildAccountRecord(data);
@@ -52,21 +68,40 @@ TEST(AccountsRepositoryUtilsTest, BuildAccountRecordPopulatesOptionalFields) {
   EXPECT_EQ(record.services[0], "online");
 }
 
+TEST(AccountsRepositoryUtilsTest, BuildPublicProfileOmitsCredentials) {
+  AccountRowData data;
+  data.id = "user-456";
+  data.role = "conveyancer";
+  data.full_name = "Sam Settle";
+  data.password_hash = "hash";
+  data.two_factor_secret = "secret";
+  data.specialties_json = "[\"residential\"]";
+
+  const auto profile = BuildPublicProfile(data);
+  EXPECT_EQ(profile.full_name, "Sam Settle");
+  ASSERT_EQ(profile.specialties.size(), 1);
+
+  const auto account = BuildAccountRecord(data);
+  EXPECT_EQ(account.full_name, profile.full_name);
+  EXPECT_EQ(account.password_hash, "hash");
+  EXPECT_EQ(account.two_factor_secret, "secret");
+}
+
 TEST(JobsRepositoryUtilsTest, BuildTemplateRecordExtractsTasksAndMetadata) {
   TemplateRowData data;
   data.id = "template-1";
   data.name = "Sale";
   data.jurisdiction = "QLD";
   data.integration_url = "https://example.com";
-  data.integration_auth_json = std::string("{\"token\":\"abc\"}");
+  data.integration_auth_json = "{\"token\":\"abc\"}";
   data.latest_version = 3;
-  data.payload_json = std::string(R"({
+  data.payload_json = R"({
     "tasks": [
       {"name": "Review", "dueDays": 2, "assignedRole": "conveyancer"},
       {"name": "Approve", "dueDays": 5}
     ],
     "syncMetadata": {"region": "brisbane"}
-  })");
+  })";
 
   const auto record = BuildTemplateRecord(data);
   EXPECT_EQ(record.id, data.id);
@@ -84,9 +119,58 @@ TEST(JobsRepositoryUtilsTest, BuildTemplateRecordHandlesInvalidPayload) {
   TemplateRowData data;
   data.id = "template-2";
   data.name = "Lease";
-  data.payload_json = std::string("not json");
+  data.payload_json = "not json";
 
   const auto record = BuildTemplateRecord(data);
   EXPECT_TRUE(record.tasks.empty());
   EXPECT_TRUE(record.metadata.is_object());
 }
+
+TEST(JobsRepositoryUtilsTest, ParsesAggregatedJobDetailColumns) {
+  const auto milestones = ParseMilestones(
+      R"([{"id":"m1","job_id":"j1","name":"Deposit","amount_cents":5000,"due_date":"2024-05-01","status":null}])");
+  ASSERT_EQ(milestones.size(), 1u);
+  EXPECT_EQ(milestones[0].name, "Deposit");
+  EXPECT_EQ(milestones[0].amount_cents, 5000);
+  EXPECT_EQ(milestones[0].due_date, "2024-05-01");
+  EXPECT_TRUE(milestones[0].status.empty());
+
+  const auto documents = ParseDocuments(R"([{"id":"d1","job_id":"j1","doc_type":"contract","url":"u",)"
+                                        R"("checksum":null,"uploaded_by":null,"version":null,"created_at":"t"}])");
+  ASSERT_EQ(documents.size(), 1u);
+  EXPECT_EQ(documents[0].doc_type, "contract");
+  EXPECT_EQ(documents[0].version, 1);
+  EXPECT_TRUE(documents[0].checksum.empty());
+  EXPECT_EQ(documents[0].scan_status, "clean");
+
+  const auto messages = ParseMessages(R"([{"id":"x","from":null,"content":"hi","attachments":[{"name":"a"}]}])");
+  ASSERT_EQ(messages.size(), 1u);
+  EXPECT_EQ(messages[0]["attachments"][0]["name"], "a");
+  EXPECT_TRUE(ParseMilestones("[]").empty());
+}
+
+TEST(JobsRepositoryUtilsTest, CursorTokensRoundTripAndRejectGarbage) {
+  const persistence::PageCursor cursor{"2024-05-01 10:15:30.123456+00", "5f0c6a9e-8d1b-4e3a-9a55-2b7c1f0e9d01"};
+  const auto token = EncodeCursor(cursor);
+  EXPECT_EQ(token.find_first_not_of("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"),
+            std::string::npos);
+  const auto decoded = DecodeCursor(token);
+  ASSERT_TRUE(decoded.has_value());
+  EXPECT_EQ(decoded->created_at, cursor.created_at);
+  EXPECT_EQ(decoded->id, cursor.id);
+
+  EXPECT_FALSE(DecodeCursor("not a token!").has_value());
+  EXPECT_FALSE(DecodeCursor(EncodeCursor({"", "id"})).has_value());
+  EXPECT_FALSE(DecodeCursor("").has_value());
+
+  const auto id = cursor.id;
+  EXPECT_TRUE(DecodeCursor(EncodeCursor({"2024-02-29 23:59:59+05:30", id})).has_value());
+  EXPECT_TRUE(DecodeCursor(EncodeCursor({"2024-05-01 10:15:30.5-07", id})).has_value());
+  EXPECT_FALSE(DecodeCursor(EncodeCursor({"yesterday", id})).has_value());
+  EXPECT_FALSE(DecodeCursor(EncodeCursor({"2023-02-29 10:15:30+00", id})).has_value());
+  EXPECT_FALSE(DecodeCursor(EncodeCursor({"2024-05-01 24:00:00+00", id})).has_value());
+  EXPECT_FALSE(DecodeCursor(EncodeCursor({"2024-05-01 10:15:30", id})).has_value());
+  EXPECT_FALSE(DecodeCursor(EncodeCursor({"2024-05-01 10:15:30.+00", id})).has_value());
+  EXPECT_FALSE(DecodeCursor(EncodeCursor({cursor.created_at, "x"})).has_value());
+  EXPECT_FALSE(DecodeCursor(EncodeCursor({cursor.created_at, "5f0c6a9e-8d1b-4e3a-9a55-2b7c1f0e9d0g"})).has_value());
+}
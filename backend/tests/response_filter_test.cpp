@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <zlib.h>
+
+#include "../common/response_filter.h"
+
+namespace {
+
+std::string Gunzip(const std::string &compressed) {
+  z_stream stream{};
+  EXPECT_EQ(inflateInit2(&stream, 15 + 16), Z_OK);
+  std::string out(64 * 1024, '\0');
+  stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(compressed.data()));
+  stream.avail_in = static_cast<uInt>(compressed.size());
+  stream.next_out = reinterpret_cast<Bytef *>(out.data());
+  stream.avail_out = static_cast<uInt>(out.size());
+  EXPECT_EQ(inflate(&stream, Z_FINISH), Z_STREAM_END);
+  out.resize(stream.total_out);
+  inflateEnd(&stream);
+  return out;
+}
+
+std::string TemplateList() {
+  std::string body = R"({"templates":[)";
+  for (int i = 0; i < 64; ++i) {
+    body += R"({"id":"t-)" + std::to_string(i) + R"(","name":"Residential purchase","jurisdiction":"NSW"},)";
+  }
+  body.back() = ']';
+  return body + "}";
+}
+
+}  // namespace
+
+TEST(ResponseFilterTest, NegotiatesByQuality) {
+  using response_filter::Encoding;
+  EXPECT_EQ(response_filter::Negotiate(""), Encoding::kIdentity);
+  EXPECT_EQ(response_filter::Negotiate("gzip, deflate, br"), Encoding::kBrotli);
+  EXPECT_EQ(response_filter::Negotiate("gzip, br;q=0.5"), Encoding::kGzip);
+  EXPECT_EQ(response_filter::Negotiate("GZIP;q=0.8, br;q=0"), Encoding::kGzip);
+  EXPECT_EQ(response_filter::Negotiate("*;q=0.1, br;q=0"), Encoding::kGzip);
+  EXPECT_EQ(response_filter::Negotiate("identity, gzip;q=0"), Encoding::kIdentity);
+  EXPECT_EQ(response_filter::Negotiate("gzip;q=bogus"), Encoding::kIdentity);
+}
+
+TEST(ResponseFilterTest, MatchesIfNoneMatchLists) {
+  EXPECT_TRUE(response_filter::EtagMatches("\"templates-1.1\"", "\"templates-1.1\""));
+  EXPECT_TRUE(response_filter::EtagMatches("\"a\", W/\"templates-1.1\"", "\"templates-1.1\""));
+  EXPECT_TRUE(response_filter::EtagMatches("*", "\"templates-1.1\""));
+  EXPECT_TRUE(response_filter::EtagMatches("\"templates-1.1-br\"", "\"templates-1.1\""));
+  EXPECT_FALSE(response_filter::EtagMatches("", "\"templates-1.1\""));
+  EXPECT_FALSE(response_filter::EtagMatches("\"templates-1.2\"", "\"templates-1.1\""));
+  EXPECT_FALSE(response_filter::EtagMatches("\"templates-1.1-zstd\"", "\"templates-1.1\""));
+}
+
+TEST(ResponseFilterTest, TagsBodiesByContent) {
+  const auto etag = response_filter::StrongEtag("{\"profiles\":[]}");
+  EXPECT_EQ(etag, response_filter::StrongEtag("{\"profiles\":[]}"));
+  EXPECT_NE(etag, response_filter::StrongEtag("{\"profiles\":[{}]}"));
+  EXPECT_EQ(etag.rfind("\"f-", 0), 0u);
+  EXPECT_EQ(response_filter::RepresentationEtag(etag, response_filter::Encoding::kGzip),
+            etag.substr(0, etag.size() - 1) + "-gzip\"");
+  EXPECT_EQ(response_filter::RepresentationEtag("W/\"v1\"", response_filter::Encoding::kBrotli), "W/\"v1\"");
+}
+
+TEST(ResponseFilterTest, CompressesAndRevalidates) {
+  response_filter::FilterOptions options;
+  response_filter::FilterStats stats;
+  const auto body = TemplateList();
+
+  httplib::Request req;
+  req.method = "GET";
+  req.set_header("Accept-Encoding", "gzip");
+  httplib::Response res;
+  res.status = 200;
+  res.set_content(body, "application/json");
+  res.set_header("Content-Length", std::to_string(body.size()));
+  response_filter::Apply(req, res, options, stats);
+  EXPECT_EQ(res.get_header_value("Content-Encoding"), "gzip");
+  EXPECT_EQ(res.get_header_value("Vary"), "Accept-Encoding");
+  EXPECT_EQ(res.get_header_value("Content-Length"), std::to_string(res.body.size()));
+  EXPECT_EQ(res.get_header_value_count("Content-Length"), 1u);
+  EXPECT_LT(res.body.size(), body.size() / 4);
+  EXPECT_EQ(Gunzip(res.body), body);
+  const auto etag = res.get_header_value("ETag");
+  EXPECT_EQ(etag, response_filter::RepresentationEtag(response_filter::StrongEtag(body),
+                                                      response_filter::Encoding::kGzip));
+
+  // Run twice on one thread so the second response reuses the gzip context and scratch buffer.
+  httplib::Response again;
+  again.status = 200;
+  again.set_content(body, "application/json");
+  response_filter::Apply(req, again, options, stats);
+  EXPECT_EQ(Gunzip(again.body), body);
+  EXPECT_EQ(stats.gzip.Value(), 2u);
+  EXPECT_EQ(stats.bytes_in.Value(), 2 * body.size());
+
+  httplib::Request revalidate;
+  revalidate.method = "GET";
+  revalidate.set_header("If-None-Match", etag);
+  httplib::Response not_modified;
+  not_modified.status = 200;
+  not_modified.set_content(body, "application/json");
+  response_filter::Apply(revalidate, not_modified, options, stats);
+  EXPECT_EQ(not_modified.status, 304);
+  EXPECT_TRUE(not_modified.body.empty());
+  EXPECT_FALSE(not_modified.has_header("Content-Type"));
+  EXPECT_EQ(stats.not_modified.Value(), 1u);
+}
+
+TEST(ResponseFilterTest, CompressesOnlyLargeTextSuccesses) {
+  response_filter::FilterOptions options;
+  response_filter::FilterStats stats;
+  httplib::Request req;
+  req.method = "GET";
+  req.set_header("Accept-Encoding", "br");
+
+  httplib::Response small;
+  small.status = 200;
+  small.set_content(R"({"status":"ok"})", "application/json");
+  response_filter::Apply(req, small, options, stats);
+  EXPECT_FALSE(small.has_header("Content-Encoding"));
+  EXPECT_TRUE(small.has_header("ETag"));
+
+  httplib::Response error;
+  error.status = 500;
+  error.set_content(TemplateList(), "application/json");
+  response_filter::Apply(req, error, options, stats);
+  EXPECT_FALSE(error.has_header("Content-Encoding"));
+  EXPECT_FALSE(error.has_header("ETag"));
+
+  httplib::Response image;
+  image.status = 200;
+  image.set_content(TemplateList(), "image/png");
+  response_filter::Apply(req, image, options, stats);
+  EXPECT_FALSE(image.has_header("Content-Encoding"));
+
+  httplib::Response brotli;
+  brotli.status = 200;
+  brotli.set_content(TemplateList(), "application/json");
+  std::thread([&]() { response_filter::Apply(req, brotli, options, stats); }).join();
+  EXPECT_EQ(brotli.get_header_value("Content-Encoding"), "br");
+  EXPECT_EQ(stats.brotli.Value(), 1u);
+}
@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../common/tracing.h"
+
+namespace {
+
+struct CapturedExports {
+  std::mutex mutex;
+  std::vector<std::string> bodies;
+};
+
+CapturedExports &InstallFakeTracer() {
+  static CapturedExports captured;
+  tracing::TracerOptions options;
+  options.service_name = "tracing_test";
+  options.endpoint = "http://collector.invalid";
+  options.batch_size = 1;
+  options.flush_interval = std::chrono::milliseconds(5);
+  tracing::Tracer::Install(options, [](const std::string &body) {
+    std::lock_guard<std::mutex> lock(captured.mutex);
+    captured.bodies.push_back(body);
+    return true;
+  });
+  return captured;
+}
+
+std::vector<nlohmann::json> WaitForSpans(CapturedExports &captured, std::size_t count) {
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (std::chrono::steady_clock::now() < deadline) {
+    {
+      std::lock_guard<std::mutex> lock(captured.mutex);
+      std::vector<nlohmann::json> spans;
+      for (const auto &body : captured.bodies) {
+        const auto batch = nlohmann::json::parse(body);
+        for (const auto &span : batch["resourceSpans"][0]["scopeSpans"][0]["spans"]) {
+          spans.push_back(span);
+        }
+      }
+      if (spans.size() >= count) {
+        captured.bodies.clear();
+        return spans;
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return {};
+}
+
+}  // namespace
+
+TEST(TraceparentTest, ParsesAndFormatsVersion00) {
+  const std::string header = "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01";
+  const auto context = tracing::ParseTraceparent(header);
+  ASSERT_TRUE(context);
+  EXPECT_TRUE(context->sampled);
+  EXPECT_EQ(tracing::TraceIdHex(*context), "4bf92f3577b34da6a3ce929d0e0e4736");
+  EXPECT_EQ(tracing::SpanIdHex(*context), "00f067aa0ba902b7");
+  EXPECT_EQ(tracing::FormatTraceparent(*context), header);
+
+  EXPECT_FALSE(tracing::ParseTraceparent(""));
+  EXPECT_FALSE(tracing::ParseTraceparent("00-00000000000000000000000000000000-00f067aa0ba902b7-01"));
+  EXPECT_FALSE(tracing::ParseTraceparent("00-4bf92f3577b34da6a3ce929d0e0e4736-0000000000000000-01"));
+  EXPECT_FALSE(tracing::ParseTraceparent("00-4BF92F3577B34DA6A3CE929D0E0E4736-00f067aa0ba902b7-01"));
+  EXPECT_FALSE(tracing::ParseTraceparent("ff-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01"));
+  EXPECT_FALSE(tracing::ParseTraceparent("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01-extra"));
+  const auto future = tracing::ParseTraceparent("01-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-00-extra");
+  ASSERT_TRUE(future);
+  EXPECT_FALSE(future->sampled);
+}
+
+TEST(SpanTest, NestsAndRestoresTheCurrentContext) {
+  const auto remote = *tracing::ParseTraceparent("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-00");
+  {
+    tracing::Span server("GET /jobs/:id", tracing::SpanKind::kServer, remote);
+    EXPECT_EQ(tracing::TraceIdHex(server.Context()), "4bf92f3577b34da6a3ce929d0e0e4736");
+    EXPECT_FALSE(server.Context().sampled);
+    {
+      tracing::Span query("get_job_by_id", tracing::SpanKind::kClient);
+      EXPECT_EQ(query.Context().trace_id, server.Context().trace_id);
+      EXPECT_NE(query.Context().span_id, server.Context().span_id);
+      EXPECT_EQ(tracing::CurrentContext().span_id, query.Context().span_id);
+      tracing::Span detached("clamav INSTREAM", tracing::SpanKind::kClient, tracing::CurrentContext(), false);
+      EXPECT_EQ(tracing::CurrentContext().span_id, query.Context().span_id);
+    }
+    EXPECT_EQ(tracing::CurrentContext().span_id, server.Context().span_id);
+
+    const auto parent = tracing::CurrentContext();
+    std::thread([parent]() {
+      tracing::ContextScope scope(parent);
+      tracing::Span upload("minio PutObject", tracing::SpanKind::kClient);
+      EXPECT_EQ(upload.Context().trace_id, parent.trace_id);
+    }).join();
+  }
+  EXPECT_FALSE(tracing::CurrentContext().Valid());
+}
+
+TEST(TracerTest, ExportsSampledSpansAsOtlpJson) {
+  auto &captured = InstallFakeTracer();
+  {
+    tracing::Span server("GET /jobs/:id", tracing::SpanKind::kServer);
+    server.SetAttribute("http.response.status_code", static_cast<std::int64_t>(200));
+    tracing::Span query("get_job_by_id", tracing::SpanKind::kClient);
+    query.SetAttribute("db.system", "postgresql").SetError("timeout");
+  }
+  const auto spans = WaitForSpans(captured, 2);
+  ASSERT_EQ(spans.size(), 2u);
+  const auto &query = spans[0];
+  const auto &server = spans[1];
+  EXPECT_EQ(query["name"], "get_job_by_id");
+  EXPECT_EQ(query["kind"], 3);
+  EXPECT_EQ(query["traceId"], server["traceId"]);
+  EXPECT_EQ(query["parentSpanId"], server["spanId"]);
+  EXPECT_EQ(query["status"]["code"], 2);
+  EXPECT_EQ(query["attributes"][0]["value"]["stringValue"], "postgresql");
+  EXPECT_FALSE(server.contains("parentSpanId"));
+  EXPECT_EQ(server["attributes"][0]["value"]["intValue"], "200");
+  EXPECT_LE(std::stoull(server["startTimeUnixNano"].get<std::string>()),
+            std::stoull(query["startTimeUnixNano"].get<std::string>()));
+}
+
+TEST(TracerTest, MarksSpansEndedByAnExceptionAsErrors) {
+  auto &captured = InstallFakeTracer();
+  try {
+    tracing::Span span("store_document", tracing::SpanKind::kClient);
+    throw std::runtime_error("unique violation");
+  } catch (const std::exception &) {
+  }
+  const auto spans = WaitForSpans(captured, 1);
+  ASSERT_EQ(spans.size(), 1u);
+  EXPECT_EQ(spans[0]["status"]["message"], "exception");
+}